@@ -54,11 +54,17 @@ struct rx_meas_stat {
 	int16_t s, rl_fail;
 };
 
+/* size of the L1CTL socket receive buffer, holds several frames */
+#define L2_RX_BUF_SIZE	4096
+
 /* One Mobilestation for osmocom */
 struct osmocom_ms {
 	struct llist_head entity;
 	char name[32];
 	struct osmo_wqueue l2_wq, sap_wq;
+	/* bytes read from the L1CTL socket, not yet split into frames */
+	uint8_t l2_rx_buf[L2_RX_BUF_SIZE];
+	uint16_t l2_rx_len;
 	uint16_t test_arfcn;
 	struct osmol1_entity l1_entity;
 
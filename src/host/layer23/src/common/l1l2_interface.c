@@ -42,64 +42,66 @@
 #define GSM_L2_LENGTH 256
 #define GSM_L2_HEADROOM 32
 
+/* read as many bytes as available with one read() and dispatch all
+ * complete length-prefixed frames, keep a partial one for the next call */
 static int layer2_read(struct osmo_fd *fd)
 {
+	struct osmocom_ms *ms = fd->data;
 	struct msgb *msg;
-	uint16_t len;
+	uint16_t len, offs = 0;
 	int rc;
 
-	msg = msgb_alloc_headroom(GSM_L2_LENGTH+GSM_L2_HEADROOM, GSM_L2_HEADROOM, "Layer2");
-	if (!msg) {
-		LOGP(DL1C, LOGL_ERROR, "Failed to allocate msg.\n");
-		return -ENOMEM;
-	}
-
-	rc = read(fd->fd, &len, sizeof(len));
-	if (rc < sizeof(len)) {
+	rc = read(fd->fd, ms->l2_rx_buf + ms->l2_rx_len,
+		  sizeof(ms->l2_rx_buf) - ms->l2_rx_len);
+	if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (rc <= 0) {
 		fprintf(stderr, "Layer2 socket failed\n");
-		msgb_free(msg);
-		if (rc >= 0)
+		if (rc == 0)
 			rc = -EIO;
-		layer2_close((struct osmocom_ms *) fd->data);
+		layer2_close(ms);
 		return rc;
 	}
-
-	len = ntohs(len);
-	if (len > GSM_L2_LENGTH) {
-		LOGP(DL1C, LOGL_ERROR, "Length is too big: %u\n", len);
-		msgb_free(msg);
-		return -EINVAL;
+	ms->l2_rx_len += rc;
+
+	while (ms->l2_rx_len - offs >= sizeof(len)) {
+		len = (ms->l2_rx_buf[offs] << 8) | ms->l2_rx_buf[offs + 1];
+		if (len > GSM_L2_LENGTH) {
+			LOGP(DL1C, LOGL_ERROR, "Length is too big: %u\n", len);
+			/* framing is lost, start over with the next read */
+			ms->l2_rx_len = 0;
+			return -EINVAL;
+		}
+		/* wait for the rest of the frame */
+		if (ms->l2_rx_len - offs - sizeof(len) < len)
+			break;
+
+		/* keep the whole frame for the next read if out of memory */
+		msg = msgb_alloc_headroom(GSM_L2_LENGTH+GSM_L2_HEADROOM,
+					  GSM_L2_HEADROOM, "Layer2");
+		if (!msg) {
+			LOGP(DL1C, LOGL_ERROR, "Failed to allocate msg.\n");
+			rc = -ENOMEM;
+			break;
+		}
+		msg->l1h = msgb_put(msg, len);
+		memcpy(msg->l1h, ms->l2_rx_buf + offs + sizeof(len), len);
+		offs += sizeof(len) + len;
+
+		l1ctl_recv(ms, msg);
+
+		/* the connection may have been closed meanwhile */
+		if (fd->fd < 0) {
+			ms->l2_rx_len = 0;
+			return 0;
+		}
 	}
 
+	/* move the partial frame to the start of the buffer */
+	ms->l2_rx_len -= offs;
+	memmove(ms->l2_rx_buf, ms->l2_rx_buf + offs, ms->l2_rx_len);
 
-	msg->l1h = msgb_put(msg, len);
-	rc = read(fd->fd, msg->l1h, msgb_l1len(msg));
-	if (rc != msgb_l1len(msg)) {
-		LOGP(DL1C, LOGL_ERROR, "Can not read data: len=%d rc=%d "
-		     "errno=%d\n", len, rc, errno);
-		msgb_free(msg);
-		return rc;
-	}
-
-	l1ctl_recv((struct osmocom_ms *) fd->data, msg);
-
-	return 0;
-}
-
-static int layer2_write(struct osmo_fd *fd, struct msgb *msg)
-{
-	int rc;
-
-	if (fd->fd <= 0)
-		return -EINVAL;
-
-	rc = write(fd->fd, msg->data, msg->len);
-	if (rc != msg->len) {
-		LOGP(DL1C, LOGL_ERROR, "Failed to write data: rc: %d\n", rc);
-		return rc;
-	}
-
-	return 0;
+	return rc < 0 ? rc : 0;
 }
 
 int layer2_open(struct osmocom_ms *ms, const char *socket_path)
@@ -127,10 +129,12 @@ int layer2_open(struct osmocom_ms *ms, const char *socket_path)
 	}
 
 	osmo_wqueue_init(&ms->l2_wq, 100);
+	ms->l2_rx_len = 0;
 	ms->l2_wq.bfd.data = ms;
 	ms->l2_wq.bfd.when = BSC_FD_READ;
 	ms->l2_wq.read_cb = layer2_read;
-	ms->l2_wq.write_cb = layer2_write;
+	/* write all pending L1CTL messages at once */
+	ms->l2_wq.mode = OSMO_WQUEUE_M_STREAM;
 
 	rc = osmo_fd_register(&ms->l2_wq.bfd);
 	if (rc != 0) {
@@ -144,9 +148,17 @@ int layer2_open(struct osmocom_ms *ms, const char *socket_path)
 
 int layer2_close(struct osmocom_ms *ms)
 {
+	const struct osmo_wqueue_stats *st = &ms->l2_wq.stats;
+
 	if (ms->l2_wq.bfd.fd <= 0)
 		return -EINVAL;
 
+	LOGP(DL1C, LOGL_INFO, "L1CTL Tx: %lu msgs, %llu bytes in %lu writes "
+	     "(%llu bytes per write), %lu write errors, max queue length %u\n",
+	     st->msgs, st->bytes, st->syscalls,
+	     st->syscalls ? st->bytes / st->syscalls : 0, st->errors,
+	     st->max_length);
+
 	close(ms->l2_wq.bfd.fd);
 	ms->l2_wq.bfd.fd = -1;
 	osmo_fd_unregister(&ms->l2_wq.bfd);
@@ -157,6 +157,7 @@ static int osmosap_send(struct osmocom_ms *ms, struct msgb *msg)
 	if (ms->sap_wq.bfd.fd <= 0)
 		return -EINVAL;
 
+	LOGP(DSAP, LOGL_INFO, "< %s\n", osmo_hexdump(msg->data, msg->len));
 	if (osmo_wqueue_enqueue(&ms->sap_wq, msg) != 0) {
 		LOGP(DSAP, LOGL_ERROR, "Failed to enqueue msg.\n");
 		msgb_free(msg);
@@ -410,23 +411,6 @@ static int sap_read(struct osmo_fd *fd)
 	return 0;
 }
 
-static int sap_write(struct osmo_fd *fd, struct msgb *msg)
-{
-	ssize_t rc;
-
-	if (fd->fd <= 0)
-		return -EINVAL;
-
-	LOGP(DSAP, LOGL_INFO, "< %s\n", osmo_hexdump(msg->data, msg->len));
-	rc = write(fd->fd, msg->data, msg->len);
-	if (rc != msg->len) {
-		LOGP(DSAP, LOGL_ERROR, "Failed to write data: rc: %zd\n", rc);
-		return rc;
-	}
-
-	return 0;
-}
-
 static void sap_connect(struct osmocom_ms *ms)
 {
 	uint8_t buffer[3];
@@ -523,7 +507,7 @@ int sap_open(struct osmocom_ms *ms, const char *socket_path)
 	ms->sap_wq.bfd.data = ms;
 	ms->sap_wq.bfd.when = BSC_FD_READ;
 	ms->sap_wq.read_cb = sap_read;
-	ms->sap_wq.write_cb = sap_write;
+	ms->sap_wq.mode = OSMO_WQUEUE_M_STREAM;
 
 	rc = osmo_fd_register(&ms->sap_wq.bfd);
 	if (rc != 0) {
@@ -25,9 +25,13 @@
 #include <osmocom/gsm/rsl.h>
 #include <osmocom/gsm/protocol/gsm_08_58.h>
 #include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
 #include <l1ctl_proto.h>
 
 #include "virtual_um.h"
@@ -35,10 +39,10 @@
 #include "virt_l1_model.h"
 #include "l1ctl_sap.h"
 #include "gsmtapl1_if.h"
+#include "virt_l1_sched.h"
+#include "virt_um_burst.h"
 #include "logging.h"
 
-static struct l1_model_ms *l1_model_ms = NULL;
-
 // for debugging
 static const struct value_string gsmtap_channels [22] = {
 	{ GSMTAP_CHANNEL_UNKNOWN,	"UNKNOWN" },
@@ -83,38 +87,43 @@ static const struct value_string gsmtap_types [10] = {
 	{ 0,				NULL },
 };
 
-void gsmtapl1_init(struct l1_model_ms *model)
-{
-	l1_model_ms = model;
-}
-
 /**
  * Append a gsmtap header to msg and send it over the virt um.
+ *
+ * msg is an uplink L1CTL primitive with l1h pointing to the l1ctl_hdr and
+ * l2h pointing to the payload to be sent, fn is the frame it goes out on.
  */
-void gsmtapl1_tx_to_virt_um_inst(struct virt_um_inst *vui, struct msgb *msg)
+void gsmtapl1_tx_to_virt_um_inst(struct virt_um_inst *vui, uint32_t fn,
+                                 uint16_t arfcn, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1hdr = (struct l1ctl_hdr *)msg->l1h;
-	struct l1ctl_info_dl *l1dl = (struct l1ctl_info_dl *)msg->data;
-	uint8_t ss = 0;
+	struct l1ctl_info_ul *ul = (struct l1ctl_info_ul *)l1hdr->data;
+	uint8_t chan_type = 0, ss = 0, tn = 0;
 	uint8_t gsmtap_chan;
 	struct msgb *outmsg;
 
+	rsl_dec_chan_nr(ul->chan_nr, &chan_type, &ss, &tn);
+
 	switch (l1hdr->msg_type) {
+	case L1CTL_RACH_REQ:
+		gsmtap_chan = GSMTAP_CHANNEL_RACH;
+		break;
 	case L1CTL_DATA_REQ:
-		// TODO: check what data request and set gsmtap_chan depending on that
-		gsmtap_chan = 0;
+	default:
+		gsmtap_chan = chantype_rsl2gsmtap(chan_type, ul->link_id);
 		break;
 	}
-	outmsg = gsmtap_makemsg(l1dl->band_arfcn, l1dl->chan_nr, gsmtap_chan,
-	                ss, l1dl->frame_nr, 0, 0, msgb_l2(msg),
-	                msgb_l2len(msg));
+	outmsg = gsmtap_makemsg(arfcn | GSMTAP_ARFCN_F_UPLINK, tn, gsmtap_chan,
+	                ss, fn, 0, 0, msgb_l2(msg), msgb_l2len(msg));
 	if (outmsg) {
-		struct gsmtap_hdr *gh = (struct gsmtap_hdr *)outmsg->l1h;
-		virt_um_write_msg(vui, outmsg);
+		// gsmtap_makemsg() does not set l1h
+		struct gsmtap_hdr *gh = (struct gsmtap_hdr *)msgb_data(outmsg);
+		// logged first, virt_um_write_msg() may free outmsg
 		DEBUGP(DVIRPHY,
-		                "Sending gsmtap msg to virt um - (arfcn=%u, type=%u, subtype=%u, timeslot=%u, subslot=%u)\n",
-		                gh->arfcn, gh->type, gh->sub_type, gh->timeslot,
+		                "Sending gsmtap msg to virt um - (arfcn=%u, fn=%u, type=%u, subtype=%u, timeslot=%u, subslot=%u)\n",
+		                arfcn, fn, gh->type, gh->sub_type, gh->timeslot,
 		                gh->sub_slot);
+		virt_um_write_msg(vui, outmsg);
 	} else {
 		LOGP(DVIRPHY, LOGL_ERROR, "Gsmtap msg could not be created!\n");
 	}
@@ -124,11 +133,51 @@ void gsmtapl1_tx_to_virt_um_inst(struct virt_um_inst *vui, struct msgb *msg)
 }
 
 /**
- * @see void gsmtapl1_tx_to_virt_um(struct virt_um_inst *vui, struct msgb *msg).
+ * Queue an uplink primitive for coding into bursts, they are sent once
+ * the coding workers are done with it, see virt_um_burst.h.
+ *
+ * A MAC block goes out on fn and the following frames of its channel.
+ */
+static void gsmtapl1_tx_bursts(struct l1_model_ms *ms, uint32_t fn,
+                               struct msgb *msg)
+{
+	struct l1ctl_hdr *l1hdr = (struct l1ctl_hdr *)msg->l1h;
+	struct l1ctl_info_ul *ul = (struct l1ctl_info_ul *)l1hdr->data;
+	struct l1_cell_info *cell = &ms->state->serving_cell;
+	uint16_t arfcn = cell->arfcn | GSMTAP_ARFCN_F_UPLINK;
+	uint8_t chan_type = 0, ss = 0, tn = 0;
+	int rc;
+
+	rsl_dec_chan_nr(ul->chan_nr, &chan_type, &ss, &tn);
+
+	if (l1hdr->msg_type == L1CTL_RACH_REQ)
+		rc = virt_um_burst_tx_rach(ms->model->burst, arfcn, tn, fn,
+		                *(uint8_t *)msgb_l2(msg), cell->bsic);
+	else
+		rc = virt_um_burst_tx_block(ms->model->burst, arfcn, tn,
+		                chantype_rsl2gsmtap(chan_type, ul->link_id), ss,
+		                fn, 0, msgb_l2(msg), msgb_l2len(msg));
+	if (rc < 0)
+		LOGP(DVIRPHY, LOGL_ERROR, "Uplink block could not be queued "
+		     "for coding!\n");
+
+	msgb_free(msg);
+}
+
+/**
+ * @see void gsmtapl1_tx_to_virt_um_inst(struct virt_um_inst *vui, uint32_t fn, uint16_t arfcn, struct msgb *msg).
+ *
+ * In burst mode the primitive is sent as bursts instead.
  */
-void gsmtapl1_tx_to_virt_um(struct msgb *msg)
+void gsmtapl1_tx_to_virt_um(struct l1_model_ms *ms, uint32_t fn,
+                            struct msgb *msg)
 {
-	gsmtapl1_tx_to_virt_um_inst(l1_model_ms->vui, msg);
+	if (ms->model->burst) {
+		gsmtapl1_tx_bursts(ms, fn, msg);
+		return;
+	}
+	gsmtapl1_tx_to_virt_um_inst(ms->vui, fn, ms->state->serving_cell.arfcn,
+	                            msg);
 }
 
 /* This is the header as it is used by gsmtap peer virtual layer 1.
@@ -148,95 +197,479 @@ struct gsmtap_hdr {
 }
  */
 
+/**
+ * Does a downlink frame on a channel go to all MS listening on the ARFCN?
+ * Frames of all other channels only go to the MS that has that
+ * dedicated channel established, see gsmtap_chan_is_ded().
+ */
+static int gsmtap_chan_is_common(uint8_t gsmtap_chan)
+{
+	switch (gsmtap_chan) {
+	case GSMTAP_CHANNEL_BCCH:
+	case GSMTAP_CHANNEL_CCCH:
+	case GSMTAP_CHANNEL_AGCH:
+	case GSMTAP_CHANNEL_PCH:
+	case GSMTAP_CHANNEL_CBCH51:
+	case GSMTAP_CHANNEL_CBCH52:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Is a downlink frame on the dedicated channel of the MS? The channel
+ * must match by timeslot and subslot, and by type if the GSMTAP channel
+ * type tells it.
+ */
+static int gsmtap_chan_is_ded(const struct l1_model_ms *ms,
+                              const struct gsmtap_hdr *gh)
+{
+	uint8_t chan_type, ss, tn, gh_type;
+
+	if (!ms->state->dedicated.active
+	    || rsl_dec_chan_nr(ms->state->dedicated.chan_nr, &chan_type, &ss,
+	                       &tn) < 0)
+		return 0;
+	if (tn != gh->timeslot)
+		return 0;
+	// the subslot is meaningful on SDCCH/4, SDCCH/8 and TCH/H only
+	if (rsl_enc_chan_nr(chan_type, gh->sub_slot, tn)
+	                != ms->state->dedicated.chan_nr)
+		return 0;
+	gh_type = chantype_gsmtap2rsl(gh->sub_type & ~GSMTAP_CHANNEL_ACCH);
+	return !gh_type || gh_type == chan_type;
+}
+
+/**
+ * Forward a l1ctl message to all MS concerned by the downlink frame
+ * described by gh, and free it afterwards.
+ *
+ * The message is composed once and written to every l2 connection as is.
+ *
+ * @return number of MS the message was forwarded to.
+ */
+static int gsmtapl1_fanout(struct l1_model *model, const struct gsmtap_hdr *gh,
+                           struct msgb *l1ctl_msg)
+{
+	uint16_t arfcn = ntohs(gh->arfcn);
+	int common = gsmtap_chan_is_common(gh->sub_type);
+	struct l1_model_ms *ms;
+	uint16_t *len;
+	int num = 0;
+
+	/* prepend 16bit length before sending */
+	len = (uint16_t *) msgb_push(l1ctl_msg, sizeof(*len));
+	*len = htons(l1ctl_msg->len - sizeof(*len));
+
+	llist_for_each_entry(ms, l1_model_arfcn_list(model, arfcn), list) {
+		if (!l1_model_ms_on_arfcn(ms, arfcn))
+			continue;
+		if (!common && !gsmtap_chan_is_ded(ms, gh))
+			continue;
+		// never blocks, a slow MS gets the frame queued or dropped
+		if (l1ctl_sock_write(ms->lsc, msgb_data(l1ctl_msg),
+		                     msgb_length(l1ctl_msg)) < 0)
+			continue;
+		num++;
+	}
+
+	msgb_free(l1ctl_msg);
+
+	return num;
+}
+
+/**
+ * Turn a received frame into a L1CTL message in place.
+ *
+ * The GSMTAP header has been pulled already, the L1CTL headers are
+ * pushed into its space and the headroom reserved by the virt um, so
+ * the payload is never copied. With with_data unset the payload is
+ * dropped and only the L1CTL header is kept.
+ */
+static void gsmtapl1_to_l1ctl(struct msgb *msg, const struct gsmtap_hdr *gh,
+                              uint8_t msg_type, int with_data)
+{
+	struct l1ctl_hdr *l1h;
+	struct l1ctl_info_dl *l1dl;
+	struct l1ctl_data_ind *l1di;
+	unsigned int len = msgb_length(msg);
+
+	if (with_data) {
+		// DATA_IND carries exactly one MAC block
+		l1di = (struct l1ctl_data_ind *) msgb_data(msg);
+		if (len > sizeof(l1di->data))
+			msgb_trim(msg, sizeof(l1di->data));
+		else if (len < sizeof(l1di->data))
+			memset(msgb_put(msg, sizeof(l1di->data) - len), 0,
+			       sizeof(l1di->data) - len);
+		msg->l2h = msgb_data(msg);
+
+		l1dl = (struct l1ctl_info_dl *) msgb_push(msg, sizeof(*l1dl));
+		l1dl->band_arfcn = htons(ntohs(gh->arfcn));
+		l1dl->link_id = gh->timeslot;
+		// see GSM 8.58 -> 9.3.1 for channel number encoding
+		l1dl->chan_nr = rsl_enc_chan_nr(chantype_gsmtap2rsl(gh->sub_type & ~GSMTAP_CHANNEL_ACCH), gh->sub_slot, gh->timeslot);
+		l1dl->frame_nr = htonl(ntohl(gh->frame_number));
+		l1dl->snr = gh->snr_db;
+		l1dl->rx_level = gh->signal_dbm;
+		l1dl->num_biterr = 0;
+		l1dl->fire_crc = 0;
+	} else {
+		msgb_trim(msg, 0);
+		msg->l2h = NULL;
+	}
+
+	l1h = (struct l1ctl_hdr *) msgb_push(msg, sizeof(*l1h));
+	l1h->msg_type = msg_type;
+	l1h->flags = 0;
+	l1h->padding[0] = l1h->padding[1] = 0;
+	msg->l1h = (uint8_t *) l1h;
+}
+
+/**
+ * Handle a frame received from the virt um, or a block decoded from
+ * received bursts.
+ *
+ * The frame is converted to a L1CTL message in its own buffer, then
+ * forwarded to all MS tuned to its ARFCN and timeslot. Blocks decoded
+ * from bursts are older than the last burst, they must not clock the
+ * uplink scheduler, see sync.
+ */
+static void gsmtapl1_rx_frame(struct l1_model *model, struct msgb *msg,
+                              int sync)
+{
+	// the header is overwritten by the L1CTL headers
+	struct gsmtap_hdr gh;
+	int forward = 1;
+
+	rate_ctr_inc(&model->rx_ctrg->ctr[L1_MODEL_CTR_RX_FRAMES]);
+	if (msgb_length(msg) < sizeof(gh)) {
+		rate_ctr_inc(&model->rx_ctrg->ctr[
+		                L1_MODEL_CTR_RX_DROP_CHAN]);
+		msgb_free(msg);
+		return;
+	}
+	memcpy(&gh, msgb_data(msg), sizeof(gh));
+	msgb_pull(msg, sizeof(gh));
+
+	// the downlink clocks our uplink scheduler
+	if (sync && !(ntohs(gh.arfcn) & GSMTAP_ARFCN_F_UPLINK))
+		virt_l1_sched_sync(model->sched,
+		                   ntohl(gh.frame_number));
+
+	DEBUGP(DVIRPHY,
+	                "Receiving gsmtap msg from virt um - (arfcn=%u, framenumber=%u, type=%s, subtype=%s, timeslot=%u, subslot=%u)\n",
+	                ntohs(gh.arfcn), ntohl(gh.frame_number), get_value_string(gsmtap_types, gh.type), get_value_string(gsmtap_channels, gh.sub_type), gh.timeslot,
+	                gh.sub_slot);
+
+	// compose the l1ctl message for layer 2, the SACCH is handled
+	// like the channel it is associated to
+	switch (gh.sub_type & ~GSMTAP_CHANNEL_ACCH) {
+	case GSMTAP_CHANNEL_RACH:
+		LOGP(DL1C, LOGL_NOTICE,
+		                "Ignoring gsmtap msg from virt um - channel type is uplink only!\n");
+		forward = 0;
+		break;
+	case GSMTAP_CHANNEL_SDCCH:
+	case GSMTAP_CHANNEL_SDCCH4:
+	case GSMTAP_CHANNEL_SDCCH8:
+		gsmtapl1_to_l1ctl(msg, &gh, L1CTL_DATA_IND, 0);
+		// TODO: implement channel handling
+		break;
+	case GSMTAP_CHANNEL_TCH_F:
+		gsmtapl1_to_l1ctl(msg, &gh, L1CTL_TRAFFIC_IND, 0);
+		// TODO: implement channel handling
+		break;
+	case GSMTAP_CHANNEL_AGCH:
+	case GSMTAP_CHANNEL_PCH:
+	case GSMTAP_CHANNEL_BCCH:
+		gsmtapl1_to_l1ctl(msg, &gh, L1CTL_DATA_IND, 1);
+		break;
+	case GSMTAP_CHANNEL_CCCH:
+	case GSMTAP_CHANNEL_TCH_H:
+	case GSMTAP_CHANNEL_PACCH:
+	case GSMTAP_CHANNEL_PDCH:
+	case GSMTAP_CHANNEL_PTCCH:
+	case GSMTAP_CHANNEL_CBCH51:
+	case GSMTAP_CHANNEL_CBCH52:
+		LOGP(DL1C, LOGL_NOTICE,
+		                "Ignoring gsmtap msg from virt um - channel type not supported!\n");
+		forward = 0;
+		break;
+	default:
+		LOGP(DL1C, LOGL_NOTICE,
+		                "Ignoring gsmtap msg from virt um - channel type unknown.\n");
+		forward = 0;
+		break;
+	}
+
+	if (!forward) {
+		rate_ctr_inc(&model->rx_ctrg->ctr[
+		                L1_MODEL_CTR_RX_DROP_CHAN]);
+		// hand the buffer back to the msgb pool for the next
+		// received frame
+		msgb_free(msg);
+		return;
+	}
+
+	/* forward l1ctl message to l2, this frees it */
+	if (!gsmtapl1_fanout(model, &gh, msg))
+		rate_ctr_inc(&model->rx_ctrg->ctr[
+		                L1_MODEL_CTR_RX_DROP_NO_MS]);
+}
+
+/**
+ * Receive a burst from the virt um.
+ *
+ * The first burst of a block clocks the uplink scheduler like any
+ * downlink frame would, with the frame number of the block. The block is
+ * handed to gsmtapl1_rx_block_cb() once all of its bursts are decoded.
+ */
+static void gsmtapl1_rx_burst(struct l1_model *model, struct msgb *msg)
+{
+	const struct gsmtap_hdr *gh = (const struct gsmtap_hdr *) msgb_data(msg);
+
+	if (!model->burst) {
+		// not in burst mode, nothing to decode them with
+		rate_ctr_inc(&model->rx_ctrg->ctr[L1_MODEL_CTR_RX_FRAMES]);
+		rate_ctr_inc(&model->rx_ctrg->ctr[L1_MODEL_CTR_RX_DROP_CHAN]);
+		msgb_free(msg);
+		return;
+	}
+
+	if (!(ntohs(gh->arfcn) & GSMTAP_ARFCN_F_UPLINK)
+	    && VIRT_UM_BURST_SS_BID(gh->sub_slot) == 0)
+		virt_l1_sched_sync(model->sched, ntohl(gh->frame_number));
+	virt_um_burst_rx(model->burst, msg);
+}
+
+/* a block decoded from bursts, it goes on like a received frame */
+static void gsmtapl1_rx_block_cb(struct virt_um_inst *vui, struct msgb *msg)
+{
+	gsmtapl1_rx_frame(vui->priv, msg, 0);
+}
+
 /**
  * Receive a gsmtap message from the virt um.
+ *
+ * Whole L2 frames are forwarded to the MS right away, bursts are
+ * collected until their block is decoded.
  */
 void gsmtapl1_rx_from_virt_um_inst_cb(struct virt_um_inst *vui,
                                       struct msgb *msg)
 {
-	if (msg) {
-		struct gsmtap_hdr *gh;
-		struct l1ctl_info_dl *l1dl;
-		struct msgb *l1ctl_msg = NULL;
-		struct l1ctl_data_ind * l1di;
+	struct l1_model *model = vui->priv;
 
-		msg->l1h = msgb_data(msg);
-		msg->l2h = msgb_pull(msg, sizeof(*gh));
-		gh = msgb_l1(msg);
+	if (!msg)
+		return;
 
-		DEBUGP(DVIRPHY,
-		                "Receiving gsmtap msg from virt um - (arfcn=%u, framenumber=%u, type=%s, subtype=%s, timeslot=%u, subslot=%u)\n",
-		                ntohs(gh->arfcn), ntohl(gh->frame_number), get_value_string(gsmtap_types, gh->type), get_value_string(gsmtap_channels, gh->sub_type), gh->timeslot,
-		                gh->sub_slot);
+	if (msgb_length(msg) >= sizeof(struct gsmtap_hdr)
+	    && ((struct gsmtap_hdr *) msgb_data(msg))->type
+	                    == GSMTAP_TYPE_UM_BURST)
+		gsmtapl1_rx_burst(model, msg);
+	else
+		gsmtapl1_rx_frame(model, msg, 1);
+}
 
-		// compose the l1ctl message for layer 2
-		switch (gh->sub_type) {
-		case GSMTAP_CHANNEL_RACH:
-			LOGP(DL1C, LOGL_NOTICE,
-			                "Ignoring gsmtap msg from virt um - channel type is uplink only!\n");
-			break;
-		case GSMTAP_CHANNEL_SDCCH:
-		case GSMTAP_CHANNEL_SDCCH4:
-		case GSMTAP_CHANNEL_SDCCH8:
-			l1ctl_msg = l1ctl_msgb_alloc(L1CTL_DATA_IND);
-			// TODO: implement channel handling
-			break;
-		case GSMTAP_CHANNEL_TCH_F:
-			l1ctl_msg = l1ctl_msgb_alloc(L1CTL_TRAFFIC_IND);
-			// TODO: implement channel handling
-			break;
-		case GSMTAP_CHANNEL_AGCH:
-		case GSMTAP_CHANNEL_PCH:
-		case GSMTAP_CHANNEL_BCCH:
-			l1ctl_msg = l1ctl_msgb_alloc(L1CTL_DATA_IND);
-			l1dl = (struct l1ctl_info_dl *) msgb_put(l1ctl_msg, sizeof(struct l1ctl_info_dl));
-			l1di = (struct l1ctl_data_ind *) msgb_put(l1ctl_msg, sizeof(struct l1ctl_data_ind));
-
-			l1dl->band_arfcn = htons(ntohs(gh->arfcn));
-			l1dl->link_id = gh->timeslot;
-			// see GSM 8.58 -> 9.3.1 for channel number encoding
-			l1dl->chan_nr = rsl_enc_chan_nr(chantype_gsmtap2rsl(gh->sub_type), gh->sub_slot, gh->timeslot);
-			l1dl->frame_nr = htonl(ntohl(gh->frame_number));
-			l1dl->snr = gh->snr_db;
-			l1dl->rx_level = gh->signal_dbm;
-			l1dl->num_biterr = 0;
-			l1dl->fire_crc = 0;
-
-			memcpy(l1di->data, msgb_data(msg), msgb_length(msg));
-
-			break;
-		case GSMTAP_CHANNEL_CCCH:
-		case GSMTAP_CHANNEL_TCH_H:
-		case GSMTAP_CHANNEL_PACCH:
-		case GSMTAP_CHANNEL_PDCH:
-		case GSMTAP_CHANNEL_PTCCH:
-		case GSMTAP_CHANNEL_CBCH51:
-		case GSMTAP_CHANNEL_CBCH52:
-			LOGP(DL1C, LOGL_NOTICE,
-			                "Ignoring gsmtap msg from virt um - channel type not supported!\n");
-			break;
-		default:
-			LOGP(DL1C, LOGL_NOTICE,
-			                "Ignoring gsmtap msg from virt um - channel type unknown.\n");
-			break;
+/**
+ * Exchange bursts instead of whole L2 frames on the virt um, coded by
+ * num_workers threads.
+ *
+ * Must be called before the first gsmtapl1_update_rx_filter(), the
+ * kernel rx filter does not know about bursts.
+ */
+int gsmtapl1_burst_init(struct l1_model *model, unsigned int num_workers)
+{
+	model->burst = virt_um_burst_init(model, model->vui, num_workers,
+	                                  gsmtapl1_rx_block_cb);
+	if (!model->burst)
+		return -EINVAL;
+
+	LOGP(DVIRPHY, LOGL_INFO, "Burst-level virtual Um, %u coding "
+	     "workers\n", num_workers);
+	return 0;
+}
+
+/* offset of a GSMTAP header field as seen by a socket filter, which
+ * starts at the UDP header */
+#define RX_FILTER_OFFS(field) \
+	(sizeof(struct udphdr) + offsetof(struct gsmtap_hdr, field))
+#define RX_FILTER_ACCEPT	0xffffffff
+
+/* channel types gsmtapl1_rx_from_virt_um_inst_cb() forwards to every MS
+ * on the ARFCN, and to the MS having a dedicated channel on the
+ * timeslot only */
+static const uint8_t rx_filter_common_chans[] = {
+	GSMTAP_CHANNEL_BCCH, GSMTAP_CHANNEL_AGCH, GSMTAP_CHANNEL_PCH,
+};
+static const uint8_t rx_filter_ded_chans[] = {
+	GSMTAP_CHANNEL_SDCCH, GSMTAP_CHANNEL_SDCCH4, GSMTAP_CHANNEL_SDCCH8,
+	GSMTAP_CHANNEL_TCH_F,
+};
+
+struct rx_filter_arfcn {
+	uint16_t arfcn;
+	uint8_t tn_mask;	// timeslots of dedicated channels
+};
+
+/* emit the part of the filter handling frames of one ARFCN, the
+ * sub_type is loaded already and its ACCH flag masked off, returns the
+ * number of instructions */
+static unsigned int rx_filter_emit_arfcn(struct sock_filter *f,
+                                         const struct rx_filter_arfcn *a)
+{
+	unsigned int n = 0, i, num_tn = 0, acc, ded;
+
+	for (i = 0; i < 8; i++)
+		num_tn += (a->tn_mask >> i) & 1;
+
+	// index of the dedicated channel and accept parts
+	ded = ARRAY_SIZE(rx_filter_common_chans) + 1;
+	if (num_tn)
+		ded += ARRAY_SIZE(rx_filter_ded_chans);
+	acc = num_tn ? ded + 1 + num_tn + 1 : ded;
+
+	for (i = 0; i < ARRAY_SIZE(rx_filter_common_chans); i++, n++)
+		f[n] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+		                rx_filter_common_chans[i], acc - n - 1, 0);
+	if (num_tn) {
+		for (i = 0; i < ARRAY_SIZE(rx_filter_ded_chans); i++, n++)
+			f[n] = (struct sock_filter) BPF_JUMP(
+			                BPF_JMP | BPF_JEQ | BPF_K,
+			                rx_filter_ded_chans[i], ded - n - 1, 0);
+	}
+	f[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0);
+	if (num_tn) {
+		f[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_B | BPF_ABS,
+		                RX_FILTER_OFFS(timeslot));
+		for (i = 0; i < 8; i++) {
+			if (!(a->tn_mask & (1 << i)))
+				continue;
+			f[n] = (struct sock_filter) BPF_JUMP(
+			                BPF_JMP | BPF_JEQ | BPF_K, i, acc - n - 1, 0);
+			n++;
 		}
+		f[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0);
+	}
+	f[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K,
+	                RX_FILTER_ACCEPT);
+
+	return n;
+}
 
-		/* forward l1ctl message to l2 */
-		if(l1ctl_msg) {
-			l1ctl_sap_tx_to_l23(l1ctl_msg);
+/**
+ * Have the kernel drop downlink frames no MS would receive.
+ *
+ * The filter passes the channel types handled by
+ * gsmtapl1_rx_from_virt_um_inst_cb() on ARFCNs some MS is tuned to,
+ * channels of dedicated mode only on the timeslots in use. Must be
+ * called whenever an MS is (re-)tuned, enters or leaves dedicated mode
+ * or goes away.
+ *
+ * Bursts carry the burst type in sub_type, not the channel type, so
+ * there is no filter in burst mode.
+ */
+void gsmtapl1_update_rx_filter(struct l1_model *model)
+{
+	struct rx_filter_arfcn *arfcns;
+	struct sock_filter *f;
+	struct l1_model_ms *ms;
+	unsigned int num = 0, len, i, j;
+	int rc;
+
+	if (model->burst)
+		return;
+
+	arfcns = talloc_zero_array(model, struct rx_filter_arfcn,
+	                model->num_ms + 1);
+	for (i = 0; i < L1_MODEL_ARFCN_HASH; i++) {
+		llist_for_each_entry(ms, &model->ms_by_arfcn[i], list) {
+			uint16_t arfcn = ms->state->serving_cell.arfcn & 0x3ff;
+
+			for (j = 0; j < num; j++) {
+				if (arfcns[j].arfcn == arfcn)
+					break;
+			}
+			if (j == num)
+				arfcns[num++].arfcn = arfcn;
+			if (ms->state->dedicated.active)
+				arfcns[j].tn_mask |= 1 << ms->state->dedicated.tn;
 		}
+	}
 
-		// handle memory deallocation
-		talloc_free(msg);
+	// load the ARFCN to X, then compare against each tuned one,
+	// skipping its part of the program if it does not match. Stop
+	// once the kernel limit is exceeded, the headroom leaves space
+	// for the part of one more ARFCN and the final return.
+	f = talloc_array(model, struct sock_filter, BPF_MAXINSNS + 32);
+	f[0] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_H | BPF_ABS,
+	                RX_FILTER_OFFS(arfcn));
+	f[1] = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x3ff);
+	f[2] = (struct sock_filter) BPF_STMT(BPF_MISC | BPF_TAX, 0);
+	len = 3;
+	for (i = 0; i < num && len < BPF_MAXINSNS; i++) {
+		unsigned int n;
+
+		f[len++] = (struct sock_filter) BPF_STMT(BPF_MISC | BPF_TXA, 0);
+		f[len] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+		                arfcns[i].arfcn, 0, 0);
+		f[len + 1] = (struct sock_filter) BPF_STMT(
+		                BPF_LD | BPF_B | BPF_ABS,
+		                RX_FILTER_OFFS(sub_type));
+		// the SACCH goes with the channel it is associated to
+		f[len + 2] = (struct sock_filter) BPF_STMT(
+		                BPF_ALU | BPF_AND | BPF_K,
+		                (uint8_t) ~GSMTAP_CHANNEL_ACCH);
+		n = rx_filter_emit_arfcn(&f[len + 3], &arfcns[i]) + 2;
+		f[len].jf = n;
+		len += 1 + n;
+	}
+	f[len++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0);
+	talloc_free(arfcns);
+
+	// unchanged, spare the syscall
+	if (model->rx_filter && len == model->rx_filter_len
+	    && !memcmp(f, model->rx_filter, len * sizeof(*f))) {
+		talloc_free(f);
+		return;
+	}
+
+	if (len > BPF_MAXINSNS) {
+		LOGP(DVIRPHY, LOGL_NOTICE, "Too many ARFCNs in use (%u) for "
+		     "the rx filter, removing it\n", num);
+		rate_ctr_inc(&model->rx_ctrg->ctr[L1_MODEL_CTR_FILTER_OFF]);
+		talloc_free(f);
+		f = NULL;
+		len = 0;
+	}
+
+	rc = virt_um_set_filter(model->vui, f, len);
+	if (rc == -ENOTSUP) {
+		// nothing to filter on, all frames are checked in userspace
+		talloc_free(f);
+		return;
+	} else if (rc < 0) {
+		LOGP(DVIRPHY, LOGL_ERROR, "Could not set the rx filter: %s\n",
+		     strerror(-rc));
+		talloc_free(f);
+		return;
 	}
+	rate_ctr_inc(&model->rx_ctrg->ctr[L1_MODEL_CTR_FILTER_UPDATE]);
+
+	talloc_free(model->rx_filter);
+	model->rx_filter = f;
+	model->rx_filter_len = len;
+	DEBUGP(DVIRPHY, "Rx filter updated, %u ARFCNs, %u instructions\n",
+	       num, len);
 }
 
 /**
- * @see void gsmtapl1_rx_from_virt_um_cb(struct virt_um_inst *vui, struct msgb msg).
+ * @see void gsmtapl1_rx_from_virt_um_inst_cb(struct virt_um_inst *vui, struct msgb msg).
  */
-void gsmtapl1_rx_from_virt_um(struct msgb *msg)
+void gsmtapl1_rx_from_virt_um(struct l1_model *model, struct msgb *msg)
 {
-	gsmtapl1_rx_from_virt_um_inst_cb(l1_model_ms->vui, msg);
+	gsmtapl1_rx_from_virt_um_inst_cb(model->vui, msg);
 }
 
 /*! \brief convert GSMTAP channel type to RSL channel number
@@ -7,12 +7,16 @@
 #include "virtual_um.h"
 #include "virt_l1_model.h"
 
-void gsmtapl1_init(struct l1_model_ms *model);
-
 void gsmtapl1_rx_from_virt_um_inst_cb(struct virt_um_inst *vui, struct msgb *msg);
-void gsmtapl1_rx_from_virt_um(struct msgb *msg);
+void gsmtapl1_rx_from_virt_um(struct l1_model *model, struct msgb *msg);
+
+void gsmtapl1_update_rx_filter(struct l1_model *model);
+
+int gsmtapl1_burst_init(struct l1_model *model, unsigned int num_workers);
 
-void gsmtapl1_tx_to_virt_um_inst(struct virt_um_inst *vui, struct msgb *msg);
-void gsmtapl1_tx_to_virt_um(struct msgb *msg);
+void gsmtapl1_tx_to_virt_um_inst(struct virt_um_inst *vui, uint32_t fn,
+                                 uint16_t arfcn, struct msgb *msg);
+void gsmtapl1_tx_to_virt_um(struct l1_model_ms *ms, uint32_t fn,
+                            struct msgb *msg);
 
 uint8_t chantype_gsmtap2rsl(uint8_t gsmtap_chantype);
@@ -4,6 +4,7 @@
 #include <osmocom/core/msgb.h>
 #include <osmocom/core/utils.h>
 #include <stdio.h>
+#include <string.h>
 #include <l1ctl_proto.h>
 #include <netinet/in.h>
 
@@ -11,37 +12,31 @@
 #include "l1ctl_sock.h"
 #include "virt_l1_model.h"
 #include "l1ctl_sap.h"
+#include "virt_l1_sched.h"
+#include "gsmtapl1_if.h"
 #include "logging.h"
 
-static struct l1_model_ms *l1_model_ms = NULL;
-
-/**
- * @brief Init the SAP.
- */
-void l1ctl_sap_init(struct l1_model_ms *model)
-{
-	l1_model_ms = model;
-}
-
 /**
  * @brief L1CTL handler called for received messages from L23.
  *
  * Enqueues the message into the rx queue.
  */
-void l1ctl_sap_rx_from_l23_inst_cb(struct l1ctl_sock_inst *lsi, struct msgb *msg)
+void l1ctl_sap_rx_from_l23_inst_cb(struct l1ctl_sock_client *lsc, struct msgb *msg)
 {
+	struct l1_model_ms *ms = lsc->priv;
+
 	if (msg) {
 		DEBUGP(DL1C, "Message incoming from layer 2: %s\n",
 		                osmo_hexdump(msg->data, msg->len));
-		l1ctl_sap_handler(msg);
+		l1ctl_sap_handler(ms, msg);
 	}
 }
 /**
- * @see l1ctl_sap_rx_from_l23_cb(struct l1ctl_sock_inst *lsi, struct msgb *msg).
+ * @see l1ctl_sap_rx_from_l23_cb(struct l1ctl_sock_client *lsc, struct msgb *msg).
  */
-void l1ctl_sap_rx_from_l23(struct msgb *msg)
+void l1ctl_sap_rx_from_l23(struct l1_model_ms *ms, struct msgb *msg)
 {
-	l1ctl_sap_rx_from_l23_inst_cb(l1_model_ms->lsi, msg);
+	l1ctl_sap_rx_from_l23_inst_cb(ms->lsc, msg);
 }
 
 /**
@@ -49,24 +44,24 @@ void l1ctl_sap_rx_from_l23(struct msgb *msg)
  *
  * This will forward the message as it is to the upper layer.
  */
-void l1ctl_sap_tx_to_l23_inst(struct l1ctl_sock_inst *lsi, struct msgb *msg)
+void l1ctl_sap_tx_to_l23_inst(struct l1ctl_sock_client *lsc, struct msgb *msg)
 {
 	uint16_t *len;
 	/* prepend 16bit length before sending */
 	len = (uint16_t *) msgb_push(msg, sizeof(*len));
 	*len = htons(msg->len - sizeof(*len));
 
-	if(l1ctl_sock_write_msg(lsi, msg) == -1 ) {
+	if(l1ctl_sock_write_msg(lsc, msg) == -1 ) {
 		//DEBUGP(DL1C, "Error writing to layer2 socket");
 	}
 }
 
 /**
- * @see void l1ctl_sap_tx_to_l23(struct l1ctl_sock_inst *lsi, struct msgb *msg).
+ * @see void l1ctl_sap_tx_to_l23_inst(struct l1ctl_sock_client *lsc, struct msgb *msg).
  */
-void l1ctl_sap_tx_to_l23(struct msgb *msg)
+void l1ctl_sap_tx_to_l23(struct l1_model_ms *ms, struct msgb *msg)
 {
-	l1ctl_sap_tx_to_l23_inst(l1_model_ms->lsi, msg);
+	l1ctl_sap_tx_to_l23_inst(ms->lsc, msg);
 }
 
 /**
@@ -140,7 +135,7 @@ struct msgb *l1ctl_create_l2_msg(int msg_type, uint32_t fn, uint16_t snr,
  * This handler will dequeue the rx queue (if !empty) and call the specific routine for the dequeued l1ctl message.
  *
  */
-void l1ctl_sap_handler(struct msgb *msg)
+void l1ctl_sap_handler(struct l1_model_ms *ms, struct msgb *msg)
 {
 //	struct msgb *msg;
 	struct l1ctl_hdr *l1h;
@@ -158,51 +153,52 @@ void l1ctl_sap_handler(struct msgb *msg)
 
 	switch (l1h->msg_type) {
 	case L1CTL_FBSB_REQ:
-		l1ctl_rx_fbsb_req(msg);
+		l1ctl_rx_fbsb_req(ms, msg);
 		break;
 	case L1CTL_DM_EST_REQ:
-		l1ctl_rx_dm_est_req(msg);
+		l1ctl_rx_dm_est_req(ms, msg);
 		break;
 	case L1CTL_DM_REL_REQ:
-		l1ctl_rx_dm_rel_req(msg);
+		l1ctl_rx_dm_rel_req(ms, msg);
 		break;
 	case L1CTL_PARAM_REQ:
-		l1ctl_rx_param_req(msg);
+		l1ctl_rx_param_req(ms, msg);
 		break;
 	case L1CTL_DM_FREQ_REQ:
-		l1ctl_rx_dm_freq_req(msg);
+		l1ctl_rx_dm_freq_req(ms, msg);
 		break;
 	case L1CTL_CRYPTO_REQ:
-		l1ctl_rx_crypto_req(msg);
+		l1ctl_rx_crypto_req(ms, msg);
 		break;
 	case L1CTL_RACH_REQ:
-		l1ctl_rx_rach_req(msg);
-		break;
+		l1ctl_rx_rach_req(ms, msg);
+		/* the scheduler keeps the msgb */
+		goto exit_nofree;
 	case L1CTL_DATA_REQ:
-		l1ctl_rx_data_req(msg);
+		l1ctl_rx_data_req(ms, msg);
 		/* we have to keep the msgb, not free it! */
 		goto exit_nofree;
 	case L1CTL_PM_REQ:
-		l1ctl_rx_pm_req(msg);
+		l1ctl_rx_pm_req(ms, msg);
 		break;
 	case L1CTL_RESET_REQ:
-		l1ctl_rx_reset_req(msg);
+		l1ctl_rx_reset_req(ms, msg);
 		break;
 	case L1CTL_CCCH_MODE_REQ:
-		l1ctl_rx_ccch_mode_req(msg);
+		l1ctl_rx_ccch_mode_req(ms, msg);
 		break;
 	case L1CTL_TCH_MODE_REQ:
-		l1ctl_rx_tch_mode_req(msg);
+		l1ctl_rx_tch_mode_req(ms, msg);
 		break;
 	case L1CTL_NEIGH_PM_REQ:
-		l1ctl_rx_neigh_pm_req(msg);
+		l1ctl_rx_neigh_pm_req(ms, msg);
 		break;
 	case L1CTL_TRAFFIC_REQ:
-		l1ctl_rx_traffic_req(msg);
+		l1ctl_rx_traffic_req(ms, msg);
 		/* we have to keep the msgb, not free it! */
 		goto exit_nofree;
 	case L1CTL_SIM_REQ:
-		l1ctl_rx_sim_req(msg);
+		l1ctl_rx_sim_req(ms, msg);
 		break;
 	}
 
@@ -227,7 +223,7 @@ void l1ctl_sap_handler(struct msgb *msg)
  * Note: Not needed for virtual physical layer.
  * TODO: Could be used to bind/connect to different virtual_bts sockets with a arfcn-socket mapping.
  */
-void l1ctl_rx_fbsb_req(struct msgb *msg)
+void l1ctl_rx_fbsb_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 	struct l1ctl_fbsb_req *sync_req = (struct l1ctl_fbsb_req *)l1h->data;
@@ -236,7 +232,13 @@ void l1ctl_rx_fbsb_req(struct msgb *msg)
 	                "Received and handled from l23 - L1CTL_FBSB_REQ (arfcn=%u, flags=0x%x)\n",
 	                ntohs(sync_req->band_arfcn), sync_req->flags);
 
-	l1ctl_tx_fbsb_conf(0, ntohs(sync_req->band_arfcn));
+	// receive downlink frames of that arfcn from now on, access bursts
+	// are encoded for the BSIC the virtual cells have
+	l1_model_ms_tune(ms, ntohs(sync_req->band_arfcn));
+	ms->state->serving_cell.bsic = VIRT_UM_BSIC;
+	gsmtapl1_update_rx_filter(ms->model);
+
+	l1ctl_tx_fbsb_conf(ms, 0, ntohs(sync_req->band_arfcn));
 }
 
 /**
@@ -250,7 +252,7 @@ void l1ctl_rx_fbsb_req(struct msgb *msg)
  *
  * TODO: Implement this handler routine!
  */
-void l1ctl_rx_dm_est_req(struct msgb *msg)
+void l1ctl_rx_dm_est_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 	struct l1ctl_info_ul *ul = (struct l1ctl_info_ul *)l1h->data;
@@ -262,6 +264,15 @@ void l1ctl_rx_dm_est_req(struct msgb *msg)
 	                ntohs(est_req->h0.band_arfcn), ul->chan_nr,
 	                est_req->tsc);
 
+	// downlink frames of the dedicated channel are only forwarded to
+	// the MS that has it established
+	ms->state->dedicated.active = 1;
+	ms->state->dedicated.chan_nr = ul->chan_nr;
+	ms->state->dedicated.tn = ul->chan_nr & 0x7;
+	if (!est_req->h)
+		l1_model_ms_tune(ms, ntohs(est_req->h0.band_arfcn));
+	gsmtapl1_update_rx_filter(ms->model);
+
 //	/* disable neighbour cell measurement of C0 TS 0 */
 //	mframe_disable(MF_TASK_NEIGH_PM51_C0T0);
 //
@@ -310,7 +321,7 @@ void l1ctl_rx_dm_est_req(struct msgb *msg)
  *
  * Note: Not needed for virtual physical layer.
  */
-void l1ctl_rx_dm_freq_req(struct msgb *msg)
+void l1ctl_rx_dm_freq_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 	struct l1ctl_info_ul *ul = (struct l1ctl_info_ul *)l1h->data;
@@ -336,7 +347,7 @@ void l1ctl_rx_dm_freq_req(struct msgb *msg)
  * TODO: Implement cryptographic operations for virtual um!
  * TODO: Implement this handler routine!
  */
-void l1ctl_rx_crypto_req(struct msgb *msg)
+void l1ctl_rx_crypto_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 	struct l1ctl_info_ul *ul = (struct l1ctl_info_ul *)l1h->data;
@@ -347,6 +358,12 @@ void l1ctl_rx_crypto_req(struct msgb *msg)
 	                "Received and handled from l23 - L1CTL_CRYPTO_REQ (algo=A5/%u, len=%u)\n",
 	                cr->algo, key_len);
 
+	ms->state->crypto.algo = cr->algo;
+	memset(ms->state->crypto.key, 0, sizeof(ms->state->crypto.key));
+	if (key_len > sizeof(ms->state->crypto.key))
+		key_len = sizeof(ms->state->crypto.key);
+	memcpy(ms->state->crypto.key, cr->key, key_len);
+
 //	if (cr->algo && key_len != 8) {
 //		DEBUGP(DL1C, "L1CTL_CRYPTO_REQ -> Invalid key\n");
 //		return;
@@ -366,11 +383,15 @@ void l1ctl_rx_crypto_req(struct msgb *msg)
  *
  * TODO: Implement this handler routine!
  */
-void l1ctl_rx_dm_rel_req(struct msgb *msg)
+void l1ctl_rx_dm_rel_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 //	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 
-	DEBUGP(DL1C, "Received and ignored from l23 - L1CTL_DM_REL_REQ\n");
+	DEBUGP(DL1C, "Received and handled from l23 - L1CTL_DM_REL_REQ\n");
+
+	ms->state->dedicated.active = 0;
+	memset(&ms->state->crypto, 0, sizeof(ms->state->crypto));
+	gsmtapl1_update_rx_filter(ms->model);
 //	l1a_mftask_set(0);
 //	l1s.dedicated.type = GSM_DCHAN_NONE;
 //	l1a_txq_msgb_flush(&l1s.tx_queue[L1S_CHAN_MAIN]);
@@ -394,7 +415,7 @@ void l1ctl_rx_dm_rel_req(struct msgb *msg)
  *
  * Note: Not needed for virtual physical layer.
  */
-void l1ctl_rx_param_req(struct msgb *msg)
+void l1ctl_rx_param_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 	struct l1ctl_info_ul *ul = (struct l1ctl_info_ul *)l1h->data;
@@ -414,9 +435,9 @@ void l1ctl_rx_param_req(struct msgb *msg)
  *
  * Transmit RACH request on RACH.
  *
- * TODO: Implement this handler routine!
+ * The access burst is queued in the uplink scheduler for its frame.
  */
-void l1ctl_rx_rach_req(struct msgb *msg)
+void l1ctl_rx_rach_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 	struct l1ctl_info_ul *ul = (struct l1ctl_info_ul *)l1h->data;
@@ -427,8 +448,14 @@ void l1ctl_rx_rach_req(struct msgb *msg)
 	                rach_req->ra, ntohs(rach_req->offset),
 	                rach_req->combined);
 
-//	l1a_rach_req(ntohs(rach_req->offset), rach_req->combined,
-//		rach_req->ra);
+	// the access burst carries only the ra byte, it goes out offset
+	// frames after the next one
+	msg->l1h = (uint8_t *)l1h;
+	msg->l2h = &rach_req->ra;
+	msgb_trim(msg, msg->l2h + 1 - msg->data);
+	virt_l1_sched_schedule(ms->model->sched, ms,
+	                       ms->model->sched->fn + 1 + ntohs(rach_req->offset),
+	                       0, msg);
 }
 
 /**
@@ -440,9 +467,10 @@ void l1ctl_rx_rach_req(struct msgb *msg)
  *
  * Transmit message on a signalling channel. FACCH/SDCCH or SACCH depending on the headers set link id (TS 8.58 - 9.3.2).
  *
- * TODO: Implement this handler routine!
+ * The MAC block is queued in the uplink scheduler for the next frame a
+ * block of its channel may start on, see virt_l1_sched_ul_fn().
  */
-void l1ctl_rx_data_req(struct msgb *msg)
+void l1ctl_rx_data_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 	struct l1ctl_info_ul *ul = (struct l1ctl_info_ul *)l1h->data;
@@ -453,6 +481,16 @@ void l1ctl_rx_data_req(struct msgb *msg)
 	                "Received and handled from l23 - L1CTL_DATA_REQ (link_id=0x%02x)\n",
 	                ul->link_id);
 
+	// send the MAC block with the next block of the channel
+	msg->l1h = (uint8_t *)l1h;
+	msg->l2h = data_ind->data;
+	if (msgb_l2len(msg) > sizeof(*data_ind))
+		msgb_trim(msg, msg->l2h + sizeof(*data_ind) - msg->data);
+	virt_l1_sched_schedule(ms->model->sched, ms,
+	                       virt_l1_sched_ul_fn(ms->model->sched, ms,
+	                                           ul->chan_nr, ul->link_id),
+	                       ul->chan_nr & 0x7, msg);
+
 //	msg->l3h = data_ind->data;
 //	if (ul->link_id & 0x40) {
 //		struct gsm48_hdr *gh = (struct gsm48_hdr *)(data_ind->data + 5);
@@ -483,7 +521,7 @@ void l1ctl_rx_data_req(struct msgb *msg)
  *
  * Note: We do not need to calculate that for the virtual physical layer, but l23 apps can expect a response. So this response is mocked here.
  */
-void l1ctl_rx_pm_req(struct msgb *msg)
+void l1ctl_rx_pm_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 	struct l1ctl_pm_req *pm_req = (struct l1ctl_pm_req *)l1h->data;
@@ -508,12 +546,12 @@ void l1ctl_rx_pm_req(struct msgb *msg)
 		}
 		// no more space in msgb, flush to l2
 		if(msgb_tailroom(resp_msg) < sizeof(*pm_conf)) {
-			l1ctl_sap_tx_to_l23(resp_msg);
+			l1ctl_sap_tx_to_l23(ms, resp_msg);
 			resp_msg = l1ctl_msgb_alloc(L1CTL_PM_CONF);
 		}
 	}
 	if(resp_msg) {
-		l1ctl_sap_tx_to_l23(resp_msg);
+		l1ctl_sap_tx_to_l23(ms, resp_msg);
 	}
 }
 
@@ -527,7 +565,7 @@ void l1ctl_rx_pm_req(struct msgb *msg)
  * Reset layer 1 (state machine, scheduler, transceiver) depending on the reset type.
  *
  */
-void l1ctl_rx_reset_req(struct msgb *msg)
+void l1ctl_rx_reset_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 	struct l1ctl_reset *reset_req = (struct l1ctl_reset *)l1h->data;
@@ -539,13 +577,13 @@ void l1ctl_rx_reset_req(struct msgb *msg)
 //		l1s_reset();
 //		l1s_reset_hw();
 //		audio_set_enabled(GSM48_CMODE_SIGN, 0);
-		l1ctl_tx_reset(L1CTL_RESET_CONF, reset_req->type);
+		l1ctl_tx_reset(ms, L1CTL_RESET_CONF, reset_req->type);
 		break;
 	case L1CTL_RES_T_SCHED:
 		DEBUGP(DL1C,
 		                "Received and handled from l23 - L1CTL_RESET_REQ (type=SCHED)\n");
 //		sched_gsmtime_reset();
-		l1ctl_tx_reset(L1CTL_RESET_CONF, reset_req->type);
+		l1ctl_tx_reset(ms, L1CTL_RESET_CONF, reset_req->type);
 		break;
 	default:
 		LOGP(DL1C, LOGL_ERROR,
@@ -565,7 +603,7 @@ void l1ctl_rx_reset_req(struct msgb *msg)
  *
  * TODO: Implement this handler routine!
  */
-void l1ctl_rx_ccch_mode_req(struct msgb *msg)
+void l1ctl_rx_ccch_mode_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 	struct l1ctl_ccch_mode_req *ccch_mode_req =
@@ -574,11 +612,11 @@ void l1ctl_rx_ccch_mode_req(struct msgb *msg)
 
 	DEBUGP(DL1C, "Received and handled from l23 - L1CTL_CCCH_MODE_REQ\n");
 
-	l1_model_ms->state->serving_cell.ccch_mode = ccch_mode;
+	ms->state->serving_cell.ccch_mode = ccch_mode;
 
 	// check if more has to be done here
 
-	l1ctl_tx_ccch_mode_conf(ccch_mode);
+	l1ctl_tx_ccch_mode_conf(ms, ccch_mode);
 
 //	/* pre-set the CCCH mode */
 //	l1s.serving_cell.ccch_mode = ccch_mode;
@@ -592,7 +630,7 @@ void l1ctl_rx_ccch_mode_req(struct msgb *msg)
 //	else if (ccch_mode == CCCH_MODE_NON_COMBINED)
 //		mframe_enable(MF_TASK_CCCH);
 //
-//	l1ctl_tx_ccch_mode_conf(ccch_mode);
+//	l1ctl_tx_ccch_mode_conf(ms, ccch_mode);
 }
 
 /**
@@ -606,7 +644,7 @@ void l1ctl_rx_ccch_mode_req(struct msgb *msg)
  *
  * TODO: Implement this handler routine!
  */
-void l1ctl_rx_tch_mode_req(struct msgb *msg)
+void l1ctl_rx_tch_mode_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 	struct l1ctl_tch_mode_req *tch_mode_req =
@@ -624,7 +662,7 @@ void l1ctl_rx_tch_mode_req(struct msgb *msg)
 //
 //	l1s.tch_sync = 1; /* Needed for audio to work */
 //
-//	l1ctl_tx_tch_mode_conf(tch_mode, audio_mode);
+//	l1ctl_tx_tch_mode_conf(ms, tch_mode, audio_mode);
 }
 
 /**
@@ -640,7 +678,7 @@ void l1ctl_rx_tch_mode_req(struct msgb *msg)
  *
  * Note: Not needed for virtual physical layer.
  */
-void l1ctl_rx_neigh_pm_req(struct msgb *msg)
+void l1ctl_rx_neigh_pm_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 	struct l1ctl_neigh_pm_req *pm_req =
@@ -663,7 +701,7 @@ void l1ctl_rx_neigh_pm_req(struct msgb *msg)
  *
  * TODO: Implement this handler routine!
  */
-void l1ctl_rx_traffic_req(struct msgb *msg)
+void l1ctl_rx_traffic_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)msg->data;
 	struct l1ctl_info_ul *ul = (struct l1ctl_info_ul *)l1h->data;
@@ -702,7 +740,7 @@ void l1ctl_rx_traffic_req(struct msgb *msg)
  *  ki comp128 <xx xx xx xx xx xx xx xx xx xx xx xx xx xx xx xx>
  * --------
  */
-void l1ctl_rx_sim_req(struct msgb *msg)
+void l1ctl_rx_sim_req(struct l1_model_ms *ms, struct msgb *msg)
 {
 	uint16_t len = msg->len - sizeof(struct l1ctl_hdr);
 	uint8_t *data = msg->data + sizeof(struct l1ctl_hdr);
@@ -725,7 +763,7 @@ void l1ctl_rx_sim_req(struct msgb *msg)
  * @param [in] msg_type L1CTL primitive message type.
  * @param [in] reset_type reset type (full, boot or just scheduler reset).
  */
-void l1ctl_tx_reset(uint8_t msg_type, uint8_t reset_type)
+void l1ctl_tx_reset(struct l1_model_ms *ms, uint8_t msg_type, uint8_t reset_type)
 {
 	struct msgb *msg = l1ctl_msgb_alloc(msg_type);
 	struct l1ctl_reset *reset_resp;
@@ -734,7 +772,7 @@ void l1ctl_tx_reset(uint8_t msg_type, uint8_t reset_type)
 
 	DEBUGP(DL1C, "Sending to l23 - %s (reset_type: %u)\n",
 	       	       getL1ctlPrimName(msg_type), reset_type);
-	l1ctl_sap_tx_to_l23(msg);
+	l1ctl_sap_tx_to_l23(ms, msg);
 }
 
 /**
@@ -742,11 +780,11 @@ void l1ctl_tx_reset(uint8_t msg_type, uint8_t reset_type)
  *
  * @param [in] msg_type L1CTL primitive message type.
  */
-void l1ctl_tx_msg(uint8_t msg_type)
+void l1ctl_tx_msg(struct l1_model_ms *ms, uint8_t msg_type)
 {
 	struct msgb *msg = l1ctl_msgb_alloc(msg_type);
 	DEBUGP(DL1C, "Sending to l23 - %s\n", getL1ctlPrimName(msg_type));
-	l1ctl_sap_tx_to_l23(msg);
+	l1ctl_sap_tx_to_l23(ms, msg);
 }
 
 /**
@@ -759,14 +797,14 @@ void l1ctl_tx_msg(uint8_t msg_type)
  *
  * No calculation needed for virtual pyh -> uses default values for a good link quality.
  */
-void l1ctl_tx_fbsb_conf(uint8_t res, uint16_t arfcn)
+void l1ctl_tx_fbsb_conf(struct l1_model_ms *ms, uint8_t res, uint16_t arfcn)
 {
 	struct msgb *msg;
 	struct l1ctl_fbsb_conf *resp;
 	uint32_t fn = 0; // 0 should be okay here
 	uint16_t snr = 40; // signal noise ratio > 40db is best signal.
 	int16_t initial_freq_err = 0; // 0 means no error.
-	uint8_t bsic = 0;
+	uint8_t bsic = ms->state->serving_cell.bsic;
 
 	msg = l1ctl_create_l2_msg(L1CTL_FBSB_CONF, fn,
 			snr,
@@ -780,7 +818,7 @@ void l1ctl_tx_fbsb_conf(uint8_t res, uint16_t arfcn)
 	DEBUGP(DL1C, "Sending to l23 - %s (res: %u)\n",
 	                getL1ctlPrimName(L1CTL_FBSB_CONF), res);
 
-	l1ctl_sap_tx_to_l23(msg);
+	l1ctl_sap_tx_to_l23(ms, msg);
 }
 
 /**
@@ -792,7 +830,7 @@ void l1ctl_tx_fbsb_conf(uint8_t res, uint16_t arfcn)
  *
  * Called by layer 1 to inform layer 2 that the ccch mode was successfully changed.
  */
-void l1ctl_tx_ccch_mode_conf(uint8_t ccch_mode)
+void l1ctl_tx_ccch_mode_conf(struct l1_model_ms *ms, uint8_t ccch_mode)
 {
 	struct msgb *msg = l1ctl_msgb_alloc(L1CTL_CCCH_MODE_CONF);
 	struct l1ctl_ccch_mode_conf *mode_conf;
@@ -802,7 +840,7 @@ void l1ctl_tx_ccch_mode_conf(uint8_t ccch_mode)
 
 	DEBUGP(DL1C, "Sending to l23 - L1CTL_CCCH_MODE_CONF (mode: %u)\n",
 	                ccch_mode);
-	l1ctl_sap_tx_to_l23(msg);
+	l1ctl_sap_tx_to_l23(ms, msg);
 }
 
 /**
@@ -815,7 +853,7 @@ void l1ctl_tx_ccch_mode_conf(uint8_t ccch_mode)
  *
  * Called by layer 1 to inform layer 23 that the traffic channel mode was successfully changed.
  */
-void l1ctl_tx_tch_mode_conf(uint8_t tch_mode, uint8_t audio_mode)
+void l1ctl_tx_tch_mode_conf(struct l1_model_ms *ms, uint8_t tch_mode, uint8_t audio_mode)
 {
 	struct msgb *msg = l1ctl_msgb_alloc(L1CTL_TCH_MODE_CONF);
 	struct l1ctl_tch_mode_conf *mode_conf;
@@ -827,7 +865,7 @@ void l1ctl_tx_tch_mode_conf(uint8_t tch_mode, uint8_t audio_mode)
 	DEBUGP(DL1C,
 	                "Sending to l23 - L1CTL_TCH_MODE_CONF (tch_mode: %u, audio_mode: %u)\n", tch_mode,
 	                audio_mode);
-	l1ctl_sap_tx_to_l23(msg);
+	l1ctl_sap_tx_to_l23(ms, msg);
 }
 
 
@@ -15,12 +15,11 @@
 #define L3_MSG_DATA 200
 #define L3_MSG_SIZE (sizeof(struct l1ctl_hdr) + L3_MSG_HEAD + L3_MSG_DATA)
 
-void l1ctl_sap_init(struct l1_model_ms *model);
-void l1ctl_sap_tx_to_l23_inst(struct l1ctl_sock_inst *lsi, struct msgb *msg);
-void l1ctl_sap_tx_to_l23(struct msgb *msg);
-void l1ctl_sap_rx_from_l23_inst_cb(struct l1ctl_sock_inst *lsi, struct msgb *msg);
-void l1ctl_sap_rx_from_l23(struct msgb *msg);
-void l1ctl_sap_handler(struct msgb *msg);
+void l1ctl_sap_tx_to_l23_inst(struct l1ctl_sock_client *lsc, struct msgb *msg);
+void l1ctl_sap_tx_to_l23(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_sap_rx_from_l23_inst_cb(struct l1ctl_sock_client *lsc, struct msgb *msg);
+void l1ctl_sap_rx_from_l23(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_sap_handler(struct l1_model_ms *ms, struct msgb *msg);
 
 /* utility methods */
 struct msgb *l1ctl_msgb_alloc(uint8_t msg_type);
@@ -28,26 +27,26 @@ struct msgb *l1ctl_create_l2_msg(int msg_type, uint32_t fn, uint16_t snr,
                                  uint16_t arfcn);
 
 /* receive routines */
-void l1ctl_rx_fbsb_req(struct msgb *msg);
-void l1ctl_rx_dm_est_req(struct msgb *msg);
-void l1ctl_rx_dm_rel_req(struct msgb *msg);
-void l1ctl_rx_param_req(struct msgb *msg);
-void l1ctl_rx_dm_freq_req(struct msgb *msg);
-void l1ctl_rx_crypto_req(struct msgb *msg);
-void l1ctl_rx_rach_req(struct msgb *msg);
-void l1ctl_rx_data_req(struct msgb *msg);
-void l1ctl_rx_pm_req(struct msgb *msg);
-void l1ctl_rx_reset_req(struct msgb *msg);
-void l1ctl_rx_ccch_mode_req(struct msgb *msg);
-void l1ctl_rx_tch_mode_req(struct msgb *msg);
-void l1ctl_rx_neigh_pm_req(struct msgb *msg);
-void l1ctl_rx_traffic_req(struct msgb *msg);
-void l1ctl_rx_sim_req(struct msgb *msg);
+void l1ctl_rx_fbsb_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_dm_est_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_dm_rel_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_param_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_dm_freq_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_crypto_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_rach_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_data_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_pm_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_reset_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_ccch_mode_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_tch_mode_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_neigh_pm_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_traffic_req(struct l1_model_ms *ms, struct msgb *msg);
+void l1ctl_rx_sim_req(struct l1_model_ms *ms, struct msgb *msg);
 
 /* transmit routines */
-void l1ctl_tx_reset(uint8_t msg_type, uint8_t reset_type);
-void l1ctl_tx_pm_conf(struct l1ctl_pm_req *pm_req);
-void l1ctl_tx_fbsb_conf(uint8_t res, uint16_t arfcn);
-void l1ctl_tx_ccch_mode_conf(uint8_t ccch_mode);
-void l1ctl_tx_tch_mode_conf(uint8_t tch_mode, uint8_t audio_mode);
-void l1ctl_tx_msg(uint8_t msg_type);
+void l1ctl_tx_reset(struct l1_model_ms *ms, uint8_t msg_type, uint8_t reset_type);
+void l1ctl_tx_pm_conf(struct l1_model_ms *ms, struct l1ctl_pm_req *pm_req);
+void l1ctl_tx_fbsb_conf(struct l1_model_ms *ms, uint8_t res, uint16_t arfcn);
+void l1ctl_tx_ccch_mode_conf(struct l1_model_ms *ms, uint8_t ccch_mode);
+void l1ctl_tx_tch_mode_conf(struct l1_model_ms *ms, uint8_t tch_mode, uint8_t audio_mode);
+void l1ctl_tx_msg(struct l1_model_ms *ms, uint8_t msg_type);
@@ -46,59 +46,90 @@
 #include "virtual_um.h"
 #include "logging.h"
 
-#define L1CTL_SOCK_MSGB_SIZE	256
-
 /**
- * @brief L1CTL socket file descriptor callback function.
- *
- * @param ofd The osmocom file descriptor.
- * @param what Indicates if the fd has a read, write or exception request. See select.h.
+ * Read as many bytes as are available with one read() and pass every
+ * complete length-prefixed frame to the receive callback. A trailing
+ * partial frame stays in the receive buffer until the next call.
  *
- * Will be called by osmo_select_main() if data on fd is pending.
+ * @return -1 if the connection has been closed and lsc is gone.
  */
-static int l1ctl_sock_data_cb(struct osmo_fd *ofd, unsigned int what)
+static int l1ctl_sock_read(struct l1ctl_sock_client *lsc)
 {
-	struct l1ctl_sock_inst *lsi = ofd->data;
-	int cnt = 0;
-	// Check if request is really read request
-	if (what & BSC_FD_READ) {
-		struct msgb *msg = msgb_alloc(L1CTL_SOCK_MSGB_SIZE,
-		                "L1CTL sock rx");
-		int rc;
+	struct l1ctl_sock_inst *lsi = lsc->lsi;
+	unsigned int offs = 0;
+	int rc;
+
+	rc = read(lsc->wq.bfd.fd, lsc->rx_buf + lsc->rx_buf_len,
+	          sizeof(lsc->rx_buf) - lsc->rx_buf_len);
+	if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (rc <= 0)
+		goto ERR;
+	lsc->rx_buf_len += rc;
+
+	while (lsc->rx_buf_len - offs >= sizeof(uint16_t)) {
+		struct msgb *msg;
 		uint16_t len;
 
-		// read length of the message first and convert to host byte order
-		rc = read(ofd->fd, &len, sizeof(len));
-		if (rc < sizeof(len)) {
-			goto ERR;
-		}
-		// convert to host byte order
-		len = ntohs(len);
+		// length of the message in network byte order
+		len = (lsc->rx_buf[offs] << 8) | lsc->rx_buf[offs + 1];
 		if (len <= 0 || len > L1CTL_SOCK_MSGB_SIZE) {
 			goto ERR;
 		}
-		rc = read(ofd->fd, msgb_data(msg), len);
+		// wait for the rest of the frame
+		if (lsc->rx_buf_len - offs - sizeof(len) < len)
+			break;
 
-		if (rc == len) {
-			msgb_put(msg, rc);
-			msg->l1h = msgb_data(msg);
-			lsi->recv_cb(lsi, msg);
-			return 0;
-		}
-ERR:
-		perror("Failed to receive msg from l2. Connection will be closed.\n");
-		l1ctl_sock_disconnect(lsi);
+		// out of memory, keep the whole frame for the next read
+		msg = msgb_alloc_nozero(L1CTL_SOCK_MSGB_SIZE,
+		                "L1CTL sock rx");
+		if (!msg)
+			break;
+		memcpy(msgb_put(msg, len), lsc->rx_buf + offs + sizeof(len),
+		       len);
+		msg->l1h = msgb_data(msg);
+		offs += sizeof(len) + len;
+		lsi->recv_cb(lsc, msg);
 	}
+
+	// move the partial frame to the start of the buffer
+	lsc->rx_buf_len -= offs;
+	memmove(lsc->rx_buf, lsc->rx_buf + offs, lsc->rx_buf_len);
 	return 0;
+ERR:
+	perror("Failed to receive msg from l2. Connection will be closed.\n");
+	l1ctl_sock_disconnect(lsc);
+	return -1;
+}
+
+/**
+ * @brief L1CTL socket file descriptor callback function.
+ *
+ * @param ofd The osmocom file descriptor.
+ * @param what Indicates if the fd has a read, write or exception request. See select.h.
+ *
+ * Will be called by osmo_select_main() if data on fd is pending or
+ * queued frames can be written.
+ */
+static int l1ctl_sock_data_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct l1ctl_sock_client *lsc = ofd->data;
 
+	if ((what & BSC_FD_READ) && l1ctl_sock_read(lsc) < 0)
+		return 0;
+	// the write queue takes care of short writes
+	if (what & BSC_FD_WRITE)
+		osmo_wqueue_bfd_cb(ofd, BSC_FD_WRITE);
+	return 0;
 }
 
 static int l1ctl_sock_accept_cb(struct osmo_fd *ofd, unsigned int what)
 {
 
 	struct l1ctl_sock_inst *lsi = ofd->data;
+	struct l1ctl_sock_client *lsc;
 	struct sockaddr_un local_addr;
-	socklen_t addr_len = sizeof(struct sockaddr_in);
+	socklen_t addr_len = sizeof(local_addr);
 	int fd;
 
 	fd = accept(ofd->fd, (struct sockaddr *)&local_addr, &addr_len);
@@ -107,21 +138,46 @@ static int l1ctl_sock_accept_cb(struct osmo_fd *ofd, unsigned int what)
 		return -1;
 	}
 
-	lsi->connection.fd = fd;
-	lsi->connection.when = BSC_FD_READ;
-	lsi->connection.cb = l1ctl_sock_data_cb;
-	lsi->connection.data = lsi;
+	lsc = talloc_zero(lsi, struct l1ctl_sock_client);
+	if (!lsc) {
+		close(fd);
+		return -ENOMEM;
+	}
+	// a slow l2 app must not stall the others
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	lsc->lsi = lsi;
+	osmo_wqueue_init(&lsc->wq, L1CTL_SOCK_TX_QUEUE_LEN);
+	lsc->wq.mode = OSMO_WQUEUE_M_STREAM;
+	lsc->wq.bfd.fd = fd;
+	lsc->wq.bfd.when = BSC_FD_READ;
+	lsc->wq.bfd.cb = l1ctl_sock_data_cb;
+	lsc->wq.bfd.data = lsc;
+
+	if (lsi->accept_cb && lsi->accept_cb(lsc) != 0) {
+		fprintf(stderr, "Refused connection to l2.\n");
+		close(fd);
+		talloc_free(lsc);
+		return -1;
+	}
 
-	if (osmo_fd_register(&lsi->connection) != 0) {
+	if (osmo_fd_register(&lsc->wq.bfd) != 0) {
 		fprintf(stderr, "Failed to register the l2 connection fd.\n");
+		if (lsi->close_cb)
+			lsi->close_cb(lsc);
+		close(fd);
+		talloc_free(lsc);
 		return -1;
 	}
+	llist_add_tail(&lsc->list, &lsi->clients);
 	return 0;
 }
 
 struct l1ctl_sock_inst *l1ctl_sock_init(
                 void *ctx,
-                void (*recv_cb)(struct l1ctl_sock_inst *lsi, struct msgb *msg),
+                void (*recv_cb)(struct l1ctl_sock_client *lsc, struct msgb *msg),
+                int (*accept_cb)(struct l1ctl_sock_client *lsc),
+                void (*close_cb)(struct l1ctl_sock_client *lsc),
                 char *path)
 {
 	struct l1ctl_sock_inst *lsi;
@@ -147,7 +203,8 @@ struct l1ctl_sock_inst *l1ctl_sock_init(
 		return NULL;
 	}
 
-	if (listen(fd, 0) != 0) {
+	// many l2 apps may connect at once
+	if (listen(fd, SOMAXCONN) != 0) {
 		fprintf(stderr, "Failed to listen.\n");
 		return NULL;
 	}
@@ -155,12 +212,13 @@ struct l1ctl_sock_inst *l1ctl_sock_init(
 	lsi = talloc_zero(ctx, struct l1ctl_sock_inst);
 	lsi->priv = NULL;
 	lsi->recv_cb = recv_cb;
+	lsi->accept_cb = accept_cb;
+	lsi->close_cb = close_cb;
+	INIT_LLIST_HEAD(&lsi->clients);
 	lsi->ofd.data = lsi;
 	lsi->ofd.fd = fd;
 	lsi->ofd.when = BSC_FD_READ;
 	lsi->ofd.cb = l1ctl_sock_accept_cb;
-	// no connection -> invalid filedescriptor and not 0 (==std_in)
-	lsi->connection.fd = -1;
 
 	osmo_fd_register(&lsi->ofd);
 
@@ -170,6 +228,10 @@ struct l1ctl_sock_inst *l1ctl_sock_init(
 void l1ctl_sock_destroy(struct l1ctl_sock_inst *lsi)
 {
 	struct osmo_fd *ofd = &lsi->ofd;
+	struct l1ctl_sock_client *lsc, *tmp;
+
+	llist_for_each_entry_safe(lsc, tmp, &lsi->clients, list)
+		l1ctl_sock_disconnect(lsc);
 
 	osmo_fd_unregister(ofd);
 	close(ofd->fd);
@@ -179,19 +241,94 @@ void l1ctl_sock_destroy(struct l1ctl_sock_inst *lsi)
 	talloc_free(lsi);
 }
 
-void l1ctl_sock_disconnect(struct l1ctl_sock_inst *lsi)
+void l1ctl_sock_disconnect(struct l1ctl_sock_client *lsc)
 {
-	struct osmo_fd *ofd = &lsi->connection;
+	struct osmo_fd *ofd = &lsc->wq.bfd;
+	struct l1ctl_sock_inst *lsi = lsc->lsi;
+
+	if (lsi->close_cb)
+		lsi->close_cb(lsc);
+
+	if (lsc->tx_dropped)
+		LOGP(DL1C, LOGL_NOTICE, "%u frames to l2 dropped, the l2 app "
+		     "was too slow\n", lsc->tx_dropped);
+
 	osmo_fd_unregister(ofd);
 	close(ofd->fd);
 	ofd->fd = -1;
 	ofd->when = 0;
+	osmo_wqueue_clear(&lsc->wq);
+	llist_del(&lsc->list);
+	talloc_free(lsc);
 }
 
-int l1ctl_sock_write_msg(struct l1ctl_sock_inst *lsi, struct msgb *msg)
+/* write as much of a frame as the socket takes right now, 0 if it has
+ * to wait behind queued ones or the socket is full */
+static int l1ctl_sock_try_write(struct l1ctl_sock_client *lsc,
+                                const uint8_t *data, unsigned int len)
 {
 	int rc;
-	rc = write(lsi->connection.fd, msgb_data(msg), msgb_length(msg));
-	msgb_free(msg);
-	return rc;
+
+	if (!llist_empty(&lsc->wq.msg_queue))
+		return 0;
+	rc = write(lsc->wq.bfd.fd, data, len);
+	if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	return rc < 0 ? -errno : rc;
+}
+
+/* queue the rest of a frame of which written bytes went out already */
+static int l1ctl_sock_queue(struct l1ctl_sock_client *lsc, struct msgb *msg,
+                            int written)
+{
+	// drop whole frames only, the l2 app could not resync otherwise
+	if (!written && lsc->wq.current_length >= lsc->wq.max_length) {
+		if (!lsc->tx_dropped++)
+			LOGP(DL1C, LOGL_NOTICE, "l2 app too slow, dropping "
+			     "frames to it\n");
+		msgb_free(msg);
+		return -ENOBUFS;
+	}
+	osmo_wqueue_enqueue(&lsc->wq, msg);
+	return written;
+}
+
+int l1ctl_sock_write(struct l1ctl_sock_client *lsc, const uint8_t *data,
+                     unsigned int len)
+{
+	struct msgb *msg;
+	int rc;
+
+	if (lsc->wq.bfd.fd < 0)
+		return -EBADF;
+	rc = l1ctl_sock_try_write(lsc, data, len);
+	if (rc < 0 || rc == len)
+		return rc;
+
+	msg = msgb_alloc(len - rc, "L1CTL sock tx");
+	if (!msg) {
+		// a frame is cut, have the read side close the connection
+		if (rc > 0)
+			shutdown(lsc->wq.bfd.fd, SHUT_RDWR);
+		return -ENOMEM;
+	}
+	memcpy(msgb_put(msg, len - rc), data + rc, len - rc);
+	return l1ctl_sock_queue(lsc, msg, rc);
+}
+
+int l1ctl_sock_write_msg(struct l1ctl_sock_client *lsc, struct msgb *msg)
+{
+	int rc;
+
+	if (lsc->wq.bfd.fd < 0) {
+		msgb_free(msg);
+		return -EBADF;
+	}
+	rc = l1ctl_sock_try_write(lsc, msgb_data(msg), msgb_length(msg));
+	if (rc < 0 || rc == msgb_length(msg)) {
+		msgb_free(msg);
+		return rc;
+	}
+	msgb_pull(msg, rc);
+	return l1ctl_sock_queue(lsc, msg, rc);
 }
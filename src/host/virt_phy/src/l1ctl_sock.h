@@ -1,16 +1,40 @@
 #pragma once
 
+#include <stdint.h>
 #include <osmocom/core/msgb.h>
 #include <osmocom/core/select.h>
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/write_queue.h>
 
 #define L1CTL_SOCK_PATH	"/tmp/osmocom_l2"
+/* Max. payload length of one length-prefixed L1CTL frame. */
+#define L1CTL_SOCK_MSGB_SIZE	256
+/* Size of the stream receive buffer, holds several frames. */
+#define L1CTL_SOCK_RX_BUF_SIZE	4096
+/* Max. number of frames waiting for a slow l2 app, newer ones are dropped. */
+#define L1CTL_SOCK_TX_QUEUE_LEN	1024
+
+struct l1ctl_sock_inst;
+
+/* One connected l2 app. */
+struct l1ctl_sock_client {
+	struct llist_head list; /* Entry in l1ctl_sock_inst.clients. */
+	struct l1ctl_sock_inst *lsi; /* The socket this client connected to. */
+	void *priv; /* Per-client data of the user, e.g. the l1 model of the MS. */
+	struct osmo_wqueue wq; /* L1CTL connection to the l2 app, non-blocking, wq.bfd is its fd. */
+	uint8_t rx_buf[L1CTL_SOCK_RX_BUF_SIZE]; /* Received bytes not yet split into frames. */
+	unsigned int rx_buf_len; /* Number of bytes in rx_buf. */
+	unsigned int tx_dropped; /* Frames dropped as wq was full. */
+};
 
 /* L1CTL socket instance contains socket data. */
 struct l1ctl_sock_inst {
 	void *priv; /* Will be appended after osmo-fd's data pointer. */
-	struct osmo_fd connection; /* L1CTL connection to l2 app */
 	struct osmo_fd ofd; /* Osmocom file descriptor to accept L1CTL connections. */
-	void (*recv_cb)(struct l1ctl_sock_inst *vui, struct msgb *msg); /* Callback function called for incoming data from l2 app. */
+	struct llist_head clients; /* Connected l2 apps, see l1ctl_sock_client. */
+	void (*recv_cb)(struct l1ctl_sock_client *lsc, struct msgb *msg); /* Callback function called for incoming data from l2 app, must not disconnect it. */
+	int (*accept_cb)(struct l1ctl_sock_client *lsc); /* Optional, called for a new l2 app. Refuses the connection if != 0. */
+	void (*close_cb)(struct l1ctl_sock_client *lsc); /* Optional, called before an l2 app connection is freed. */
 };
 
 /**
@@ -18,20 +42,33 @@ struct l1ctl_sock_inst {
  */
 struct l1ctl_sock_inst *l1ctl_sock_init(
                 void *ctx,
-                void (*recv_cb)(struct l1ctl_sock_inst *lsi, struct msgb *msg),
+                void (*recv_cb)(struct l1ctl_sock_client *lsc, struct msgb *msg),
+                int (*accept_cb)(struct l1ctl_sock_client *lsc),
+                void (*close_cb)(struct l1ctl_sock_client *lsc),
                 char *path);
 
 /**
  * @brief Transmit message to l2.
+ *
+ * Written right away if nothing is pending, what the socket does not
+ * take is queued until it is writable again. Never blocks.
+ */
+int l1ctl_sock_write_msg(struct l1ctl_sock_client *lsc, struct msgb *msg);
+
+/**
+ * @brief Transmit raw data to l2, the caller keeps ownership of it.
+ *
+ * Like l1ctl_sock_write_msg(), data is copied only if it has to be queued.
  */
-int l1ctl_sock_write_msg(struct l1ctl_sock_inst *lsi, struct msgb *msg);
+int l1ctl_sock_write(struct l1ctl_sock_client *lsc, const uint8_t *data,
+                     unsigned int len);
 
 /**
- * @brief Destroy instance.
+ * @brief Destroy instance, disconnects all l2 apps.
  */
-void l1ctl_sock_destroy();
+void l1ctl_sock_destroy(struct l1ctl_sock_inst *lsi);
 
 /**
- * @brief Disconnect current connection.
+ * @brief Disconnect and free an l2 app connection.
  */
-void l1ctl_sock_disconnect(struct l1ctl_sock_inst *lsi);
+void l1ctl_sock_disconnect(struct l1ctl_sock_client *lsc);
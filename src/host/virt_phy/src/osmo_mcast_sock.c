@@ -1,3 +1,5 @@
+#define _GNU_SOURCE	// recvmmsg(), sendmmsg()
+#include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -6,8 +8,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <talloc.h>
 #include <unistd.h>
+#include <linux/filter.h>
 
 #include "osmo_mcast_sock.h"
 
@@ -162,6 +166,163 @@ int mcast_bidir_sock_rx(struct mcast_bidir_sock *bidir_sock, void* buf,
 	return mcast_client_sock_rx(bidir_sock->rx_sock, buf, buf_len);
 }
 
+static void mcast_sock_batch_stats_add(struct mcast_sock_batch_stats *stats,
+                                       unsigned int num)
+{
+	unsigned int bucket = 0;
+
+	stats->batches++;
+	stats->msgs += num;
+	if (num > stats->max)
+		stats->max = num;
+	while ((num >>= 1) && bucket < MCAST_SOCK_BATCH_HIST - 1)
+		bucket++;
+	stats->hist[bucket]++;
+}
+
+/**
+ * Receive up to num datagrams with a single syscall, without blocking.
+ *
+ * Datagram i is written to the buffer described by iov[i] and its length
+ * is stored in rx_len[i].
+ *
+ * @return number of received datagrams, or -1 with errno set (EAGAIN if
+ * nothing was pending).
+ */
+int mcast_client_sock_rx_batch(struct mcast_client_sock *client_sock,
+                               struct iovec *iov, int *rx_len,
+                               unsigned int num)
+{
+	struct mmsghdr msgs[MCAST_SOCK_BATCH_MAX];
+	int i, rc;
+
+	if (num > MCAST_SOCK_BATCH_MAX)
+		num = MCAST_SOCK_BATCH_MAX;
+
+	memset(msgs, 0, num * sizeof(*msgs));
+	for (i = 0; i < num; i++) {
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	rc = recvmmsg(client_sock->osmo_fd->fd, msgs, num, MSG_DONTWAIT, NULL);
+	if (rc < 0 && errno == ENOSYS) {
+		// kernel without recvmmsg(), fall back to one datagram
+		rc = recv(client_sock->osmo_fd->fd, iov[0].iov_base,
+		          iov[0].iov_len, MSG_DONTWAIT);
+		if (rc < 0)
+			return rc;
+		rx_len[0] = rc;
+		rc = 1;
+	} else if (rc < 0) {
+		return rc;
+	} else {
+		for (i = 0; i < rc; i++)
+			rx_len[i] = msgs[i].msg_len;
+	}
+
+	mcast_sock_batch_stats_add(&client_sock->rx_stats, rc);
+
+	return rc;
+}
+
+/**
+ * Send num datagrams, datagram i described by iov[i], with as few
+ * syscalls as possible.
+ *
+ * @return number of datagrams sent, or -1 with errno set if not even
+ * the first one could be sent.
+ */
+int mcast_server_sock_tx_batch(struct mcast_server_sock *serv_sock,
+                               struct iovec *iov, unsigned int num)
+{
+	struct mmsghdr msgs[MCAST_SOCK_BATCH_MAX];
+	unsigned int sent = 0;
+	int i, n, rc;
+
+	while (sent < num) {
+		n = num - sent;
+		if (n > MCAST_SOCK_BATCH_MAX)
+			n = MCAST_SOCK_BATCH_MAX;
+
+		memset(msgs, 0, n * sizeof(*msgs));
+		for (i = 0; i < n; i++) {
+			msgs[i].msg_hdr.msg_name = serv_sock->sock_conf;
+			msgs[i].msg_hdr.msg_namelen =
+			                sizeof(*serv_sock->sock_conf);
+			msgs[i].msg_hdr.msg_iov = &iov[sent + i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		rc = sendmmsg(serv_sock->osmo_fd->fd, msgs, n, 0);
+		if (rc < 0 && errno == ENOSYS) {
+			// kernel without sendmmsg(), fall back to one datagram
+			rc = mcast_server_sock_tx(serv_sock,
+			                iov[sent].iov_base, iov[sent].iov_len);
+			if (rc >= 0)
+				rc = 1;
+		}
+		if (rc <= 0)
+			break;
+
+		mcast_sock_batch_stats_add(&serv_sock->tx_stats, rc);
+		sent += rc;
+	}
+
+	if (sent == 0 && num > 0)
+		return -1;
+
+	return sent;
+}
+
+int mcast_bidir_sock_rx_batch(struct mcast_bidir_sock *bidir_sock,
+                              struct iovec *iov, int *rx_len,
+                              unsigned int num)
+{
+	return mcast_client_sock_rx_batch(bidir_sock->rx_sock, iov, rx_len,
+	                                  num);
+}
+
+int mcast_bidir_sock_tx_batch(struct mcast_bidir_sock *bidir_sock,
+                              struct iovec *iov, unsigned int num)
+{
+	return mcast_server_sock_tx_batch(bidir_sock->tx_sock, iov, num);
+}
+
+/**
+ * Attach a classic BPF program to the socket, datagrams it returns 0 for
+ * are dropped by the kernel before they are queued to the socket.
+ *
+ * The program sees the UDP header at offset 0, the payload starts at
+ * offset 8. Passing len 0 removes the filter.
+ *
+ * @return 0 on success, negative errno on error.
+ */
+int mcast_client_sock_set_filter(struct mcast_client_sock *client_sock,
+                                 struct sock_filter *code, unsigned int len)
+{
+	struct sock_fprog prog = { .len = len, .filter = code };
+	int rc;
+
+	if (!len) {
+		rc = setsockopt(client_sock->osmo_fd->fd, SOL_SOCKET,
+		                SO_DETACH_FILTER, NULL, 0);
+		// not having a filter to remove is fine
+		if (rc < 0 && errno == ENOENT)
+			rc = 0;
+	} else
+		rc = setsockopt(client_sock->osmo_fd->fd, SOL_SOCKET,
+		                SO_ATTACH_FILTER, &prog, sizeof(prog));
+
+	return rc < 0 ? -errno : 0;
+}
+
+int mcast_bidir_sock_set_filter(struct mcast_bidir_sock *bidir_sock,
+                                struct sock_filter *code, unsigned int len)
+{
+	return mcast_client_sock_set_filter(bidir_sock->rx_sock, code, len);
+}
+
 void mcast_client_sock_close(struct mcast_client_sock *client_sock)
 {
 	setsockopt(client_sock->osmo_fd->fd,
@@ -1,16 +1,37 @@
 #pragma once
 
+#include <stdint.h>
 #include <netinet/in.h>
+#include <sys/uio.h>
 #include <osmocom/core/select.h>
 
+struct sock_filter;
+
+// maximum number of datagrams handled by one recvmmsg()/sendmmsg() call
+#define MCAST_SOCK_BATCH_MAX	32
+// number of power-of-two buckets in the batch size histogram
+#define MCAST_SOCK_BATCH_HIST	6
+
+// batch size statistics, one batch is one syscall
+struct mcast_sock_batch_stats {
+	uint32_t batches;	// number of syscalls (rx: wakeups)
+	uint32_t msgs;		// number of datagrams in all batches
+	uint32_t max;		// largest batch seen
+	// hist[i] counts batches of size 2^i .. 2^(i+1)-1, the last
+	// bucket also counts all larger batches
+	uint32_t hist[MCAST_SOCK_BATCH_HIST];
+};
+
 struct mcast_server_sock {
 	struct osmo_fd *osmo_fd;
 	struct sockaddr_in *sock_conf;
+	struct mcast_sock_batch_stats tx_stats;
 };
 
 struct mcast_client_sock {
 	struct osmo_fd *osmo_fd;
 	struct ip_mreq *mcast_group;
+	struct mcast_sock_batch_stats rx_stats;
 };
 
 struct mcast_bidir_sock {
@@ -40,6 +61,20 @@ int mcast_bidir_sock_tx(struct mcast_bidir_sock *bidir_sock, void* data,
                         int data_len);
 int mcast_bidir_sock_rx(struct mcast_bidir_sock *bidir_sock, void* buf,
                         int buf_len);
+int mcast_client_sock_rx_batch(struct mcast_client_sock *client_sock,
+                               struct iovec *iov, int *rx_len,
+                               unsigned int num);
+int mcast_server_sock_tx_batch(struct mcast_server_sock *serv_sock,
+                               struct iovec *iov, unsigned int num);
+int mcast_bidir_sock_rx_batch(struct mcast_bidir_sock *bidir_sock,
+                              struct iovec *iov, int *rx_len,
+                              unsigned int num);
+int mcast_bidir_sock_tx_batch(struct mcast_bidir_sock *bidir_sock,
+                              struct iovec *iov, unsigned int num);
+int mcast_client_sock_set_filter(struct mcast_client_sock *client_sock,
+                                 struct sock_filter *code, unsigned int len);
+int mcast_bidir_sock_set_filter(struct mcast_bidir_sock *bidir_sock,
+                                struct sock_filter *code, unsigned int len);
 void mcast_client_sock_close(struct mcast_client_sock* client_sock);
 void mcast_server_sock_close(struct mcast_server_sock* server_sock);
 void mcast_bidir_sock_close(struct mcast_bidir_sock* bidir_sock);
@@ -0,0 +1,551 @@
+/* Single-writer/multi-reader broadcast ring in shared memory. */
+
+/* (C) 2016 by the osmocom-bb contributors
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * The writer owns a memfd holding the ring and listens on a unix socket.
+ * A reader connects, passes its eventfd to the writer and gets the memfd
+ * in return (SCM_RIGHTS), which it maps read-only.
+ *
+ * The writer never waits for readers. Each slot carries a sequence
+ * number which the writer makes odd while it updates the slot, readers
+ * check it before and after copying the payload and drop slots that
+ * were overwritten meanwhile. After a batch of writes the writer
+ * signals the eventfd of every reader.
+ */
+
+#define _GNU_SOURCE	// memfd_create()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+#include <osmocom/core/talloc.h>
+
+#include "shm_ring.h"
+
+// time between attempts to connect to a writer that is not up (yet)
+#define SHM_RING_RECONNECT_S	1
+
+static inline struct shm_ring_slot *ring_slot(const struct shm_ring_hdr *hdr,
+                                              uint64_t seq)
+{
+	size_t slot_len = sizeof(struct shm_ring_slot) + hdr->slot_size;
+
+	return (struct shm_ring_slot *)((uint8_t *)(hdr + 1)
+	                + (seq & (hdr->num_slots - 1)) * slot_len);
+}
+
+static size_t ring_map_len(uint32_t num_slots, uint32_t slot_size)
+{
+	return sizeof(struct shm_ring_hdr)
+	                + num_slots * (sizeof(struct shm_ring_slot) + slot_size);
+}
+
+// send one byte, along with a file descriptor
+static int send_fd(int sock, int fd)
+{
+	char buf[CMSG_SPACE(sizeof(int))];
+	uint8_t dummy = 0;
+	struct iovec iov = { .iov_base = &dummy, .iov_len = 1 };
+	struct msghdr mh = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = buf,
+		.msg_controllen = sizeof(buf),
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mh);
+
+	memset(buf, 0, sizeof(buf));
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	return sendmsg(sock, &mh, 0) == 1 ? 0 : -1;
+}
+
+// receive one byte, along with a file descriptor
+// returns the fd, -1 on error and -2 on end of file
+static int recv_fd(int sock)
+{
+	char buf[CMSG_SPACE(sizeof(int))];
+	uint8_t dummy;
+	struct iovec iov = { .iov_base = &dummy, .iov_len = 1 };
+	struct msghdr mh = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = buf,
+		.msg_controllen = sizeof(buf),
+	};
+	struct cmsghdr *cmsg;
+	int fd, rc;
+
+	rc = recvmsg(sock, &mh, 0);
+	if (rc == 0)
+		return -2;
+	if (rc < 0)
+		return -1;
+
+	cmsg = CMSG_FIRSTHDR(&mh);
+	if (!cmsg || cmsg->cmsg_level != SOL_SOCKET
+	    || cmsg->cmsg_type != SCM_RIGHTS)
+		return -1;
+	memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+	return fd;
+}
+
+/***************************************************************
+ * WRITER ******************************************************
+ ***************************************************************/
+
+static void peer_free(struct shm_ring_peer *peer)
+{
+	osmo_fd_unregister(&peer->conn);
+	close(peer->conn.fd);
+	if (peer->efd >= 0)
+		close(peer->efd);
+	llist_del(&peer->list);
+	talloc_free(peer);
+}
+
+static int peer_conn_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct shm_ring_peer *peer = ofd->data;
+	int fd;
+
+	fd = recv_fd(ofd->fd);
+	if (fd == -1 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+
+	// the only message a reader sends is its eventfd, anything else
+	// including the end of the connection detaches it
+	if (fd < 0 || peer->efd >= 0) {
+		if (fd >= 0)
+			close(fd);
+		peer_free(peer);
+		return 0;
+	}
+
+	peer->efd = fd;
+	if (send_fd(ofd->fd, peer->w->memfd) != 0) {
+		perror("Failed to pass shm ring to reader");
+		peer_free(peer);
+	}
+
+	return 0;
+}
+
+static int writer_accept_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct shm_ring_writer *w = ofd->data;
+	struct shm_ring_peer *peer;
+	int fd;
+
+	fd = accept(ofd->fd, NULL, NULL);
+	if (fd < 0)
+		return 0;
+
+	peer = talloc_zero(w, struct shm_ring_peer);
+	peer->w = w;
+	peer->efd = -1;
+	peer->conn.fd = fd;
+	peer->conn.when = BSC_FD_READ;
+	peer->conn.cb = peer_conn_cb;
+	peer->conn.data = peer;
+	if (osmo_fd_register(&peer->conn) != 0) {
+		close(fd);
+		talloc_free(peer);
+		return 0;
+	}
+	llist_add_tail(&peer->list, &w->peers);
+
+	return 0;
+}
+
+/* may the control socket at addr be replaced? Only if nobody listens
+ * on it anymore, i.e. a writer went away without removing it. */
+static int control_sock_stale(const struct sockaddr_un *addr)
+{
+	int fd, rc;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return 1;
+	rc = connect(fd, (const struct sockaddr *)addr, sizeof(*addr));
+	close(fd);
+	return rc != 0;
+}
+
+/**
+ * Create the ring and listen for readers on the unix socket at path.
+ *
+ * A socket left behind at path is replaced, fails with errno set to
+ * EADDRINUSE if another writer is still listening on it.
+ */
+struct shm_ring_writer *shm_ring_writer_create(void *ctx, const char *path)
+{
+	struct shm_ring_writer *w = talloc_zero(ctx, struct shm_ring_writer);
+	struct sockaddr_un addr;
+	int fd, err;
+
+	INIT_LLIST_HEAD(&w->peers);
+	w->path = talloc_strdup(w, path);
+	w->memfd = -1;
+	w->listen_ofd.fd = -1;
+
+	w->map_len = ring_map_len(SHM_RING_NUM_SLOTS, SHM_RING_SLOT_SIZE);
+	w->memfd = memfd_create("virt_um_ring", MFD_CLOEXEC);
+	if (w->memfd < 0 || ftruncate(w->memfd, w->map_len) != 0) {
+		perror("Failed to create shm ring");
+		goto err;
+	}
+	w->hdr = mmap(NULL, w->map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+	              w->memfd, 0);
+	if (w->hdr == MAP_FAILED) {
+		w->hdr = NULL;
+		perror("Failed to map shm ring");
+		goto err;
+	}
+	w->hdr->num_slots = SHM_RING_NUM_SLOTS;
+	w->hdr->slot_size = SHM_RING_SLOT_SIZE;
+	w->hdr->head = 0;
+	__atomic_store_n(&w->hdr->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("Failed to create shm ring control socket");
+		goto err;
+	}
+	w->listen_ofd.fd = fd;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if (!control_sock_stale(&addr)) {
+		fprintf(stderr, "shm ring control socket '%s' is in use by "
+		        "another writer\n", path);
+		errno = EADDRINUSE;
+		goto err;
+	}
+	unlink(addr.sun_path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+	    || listen(fd, SOMAXCONN) != 0) {
+		fprintf(stderr, "Failed to bind shm ring control socket '%s'\n",
+		        path);
+		goto err;
+	}
+	w->listen_ofd.when = BSC_FD_READ;
+	w->listen_ofd.cb = writer_accept_cb;
+	w->listen_ofd.data = w;
+	if (osmo_fd_register(&w->listen_ofd) != 0)
+		goto err;
+
+	return w;
+
+err:
+	err = errno;
+	if (w->listen_ofd.fd >= 0)
+		close(w->listen_ofd.fd);
+	if (w->hdr)
+		munmap(w->hdr, w->map_len);
+	if (w->memfd >= 0)
+		close(w->memfd);
+	talloc_free(w);
+	errno = err;
+	return NULL;
+}
+
+void shm_ring_writer_destroy(struct shm_ring_writer *w)
+{
+	struct shm_ring_peer *peer, *tmp;
+
+	// readers see the end of the connection and detach
+	llist_for_each_entry_safe(peer, tmp, &w->peers, list)
+		peer_free(peer);
+
+	osmo_fd_unregister(&w->listen_ofd);
+	close(w->listen_ofd.fd);
+	unlink(w->path);
+	munmap(w->hdr, w->map_len);
+	close(w->memfd);
+	talloc_free(w);
+}
+
+/**
+ * Put one frame into the ring, readers are not woken up before
+ * shm_ring_notify() is called.
+ *
+ * @return len, or -EMSGSIZE if the frame does not fit into a slot.
+ */
+int shm_ring_write(struct shm_ring_writer *w, const void *data,
+                   unsigned int len)
+{
+	struct shm_ring_hdr *hdr = w->hdr;
+	uint64_t seq = hdr->head;
+	struct shm_ring_slot *slot = ring_slot(hdr, seq);
+
+	if (len > hdr->slot_size)
+		return -EMSGSIZE;
+
+	__atomic_store_n(&slot->seq, 2 * seq + 1, __ATOMIC_RELAXED);
+	// the odd sequence number must be visible before the new payload
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(slot->data, data, len);
+	slot->len = len;
+	__atomic_store_n(&slot->seq, 2 * seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&hdr->head, seq + 1, __ATOMIC_RELEASE);
+
+	return len;
+}
+
+/**
+ * Wake up all readers attached to the ring.
+ */
+void shm_ring_notify(struct shm_ring_writer *w)
+{
+	struct shm_ring_peer *peer;
+	uint64_t one = 1;
+
+	llist_for_each_entry(peer, &w->peers, list) {
+		if (peer->efd >= 0)
+			(void)write(peer->efd, &one, sizeof(one));
+	}
+}
+
+/***************************************************************
+ * READER ******************************************************
+ ***************************************************************/
+
+static int reader_connect(struct shm_ring_reader *r);
+
+static void reader_detach(struct shm_ring_reader *r)
+{
+	if (r->hdr) {
+		munmap((void *)r->hdr, r->map_len);
+		r->hdr = NULL;
+	}
+	if (r->conn.fd >= 0) {
+		osmo_fd_unregister(&r->conn);
+		close(r->conn.fd);
+		r->conn.fd = -1;
+	}
+}
+
+static void reader_reconnect_cb(void *data)
+{
+	struct shm_ring_reader *r = data;
+
+	if (reader_connect(r) != 0)
+		osmo_timer_schedule(&r->reconnect_timer, SHM_RING_RECONNECT_S, 0);
+}
+
+static int reader_efd_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct shm_ring_reader *r = ofd->data;
+	uint64_t cnt;
+
+	// reset the counter, all pending slots are handled below
+	if (read(ofd->fd, &cnt, sizeof(cnt)) < 0 && errno == EAGAIN)
+		return 0;
+
+	if (r->hdr)
+		r->data_cb(r);
+
+	return 0;
+}
+
+static int reader_conn_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct shm_ring_reader *r = ofd->data;
+	const struct shm_ring_hdr *hdr;
+	struct stat st;
+	int memfd;
+
+	memfd = recv_fd(ofd->fd);
+	if (memfd == -1 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (memfd < 0 || r->hdr) {
+		// writer is gone, or did not follow the protocol
+		if (memfd >= 0)
+			close(memfd);
+		goto detach;
+	}
+
+	if (fstat(memfd, &st) != 0 || st.st_size < sizeof(*hdr)) {
+		close(memfd);
+		goto detach;
+	}
+	hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, memfd, 0);
+	close(memfd);
+	if (hdr == MAP_FAILED)
+		goto detach;
+	if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC
+	    || st.st_size < ring_map_len(hdr->num_slots, hdr->slot_size)) {
+		munmap((void *)hdr, st.st_size);
+		goto detach;
+	}
+
+	r->hdr = hdr;
+	r->map_len = st.st_size;
+	// only frames written from now on are of interest
+	r->tail = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+
+	return 0;
+
+detach:
+	reader_detach(r);
+	osmo_timer_schedule(&r->reconnect_timer, SHM_RING_RECONNECT_S, 0);
+	return 0;
+}
+
+static int reader_connect(struct shm_ring_reader *r)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, r->path, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+	    || send_fd(fd, r->efd.fd) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	r->conn.fd = fd;
+	r->conn.when = BSC_FD_READ;
+	r->conn.cb = reader_conn_cb;
+	r->conn.data = r;
+	if (osmo_fd_register(&r->conn) != 0) {
+		close(fd);
+		r->conn.fd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Attach to the ring of the writer listening at path.
+ *
+ * If the writer is not up yet, or goes away later on, the reader keeps
+ * trying to (re-)attach in the background.
+ */
+struct shm_ring_reader *shm_ring_reader_create(
+                void *ctx, const char *path,
+                void (*data_cb)(struct shm_ring_reader *r), void *data)
+{
+	struct shm_ring_reader *r = talloc_zero(ctx, struct shm_ring_reader);
+
+	r->path = talloc_strdup(r, path);
+	r->data_cb = data_cb;
+	r->data = data;
+	r->conn.fd = -1;
+	r->reconnect_timer.cb = reader_reconnect_cb;
+	r->reconnect_timer.data = r;
+
+	r->efd.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (r->efd.fd < 0) {
+		perror("Failed to create shm ring eventfd");
+		talloc_free(r);
+		return NULL;
+	}
+	r->efd.when = BSC_FD_READ;
+	r->efd.cb = reader_efd_cb;
+	r->efd.data = r;
+	osmo_fd_register(&r->efd);
+
+	reader_reconnect_cb(r);
+
+	return r;
+}
+
+void shm_ring_reader_destroy(struct shm_ring_reader *r)
+{
+	osmo_timer_del(&r->reconnect_timer);
+	reader_detach(r);
+	osmo_fd_unregister(&r->efd);
+	close(r->efd.fd);
+	talloc_free(r);
+}
+
+/**
+ * Copy the next frame out of the ring.
+ *
+ * Frames the writer has overwritten before they could be read are
+ * skipped and counted in r->dropped.
+ *
+ * @return length of the frame, 0 if the ring is empty.
+ */
+int shm_ring_read(struct shm_ring_reader *r, void *buf, unsigned int buf_len)
+{
+	const struct shm_ring_hdr *hdr = r->hdr;
+	uint64_t head;
+
+	if (!hdr)
+		return 0;
+
+	head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+	while (r->tail != head) {
+		const struct shm_ring_slot *slot;
+		uint64_t seq, seq2;
+		unsigned int len;
+
+		// lapped by the writer, skip what is gone
+		if (head - r->tail > hdr->num_slots) {
+			r->dropped += head - r->tail - hdr->num_slots;
+			r->tail = head - hdr->num_slots;
+		}
+
+		slot = ring_slot(hdr, r->tail);
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		len = slot->len;
+		if (len > buf_len)
+			len = buf_len;
+		if (len > hdr->slot_size)
+			len = hdr->slot_size;
+		memcpy(buf, slot->data, len);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+		r->tail++;
+		if (seq != 2 * (r->tail - 1) + 2 || seq2 != seq) {
+			// overwritten while we were copying
+			r->dropped++;
+			head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+			continue;
+		}
+
+		return len;
+	}
+
+	return 0;
+}
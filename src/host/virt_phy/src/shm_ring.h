@@ -0,0 +1,73 @@
+#pragma once
+
+/* Single-writer/multi-reader broadcast ring in shared memory. */
+
+#include <stdint.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/linuxlist.h>
+
+#define SHM_RING_MAGIC		0x56554d52	// "VUMR"
+#define SHM_RING_NUM_SLOTS	1024
+#define SHM_RING_SLOT_SIZE	256
+
+// header at the start of the shared memory segment
+struct shm_ring_hdr {
+	uint32_t magic;
+	uint32_t num_slots;	// power of two
+	uint32_t slot_size;	// max. payload length of a slot
+	uint32_t pad;
+	uint64_t head;		// sequence number of the next slot to be written
+};
+
+// one slot, slot_size bytes of data follow
+struct shm_ring_slot {
+	// 2 * seq + 1 while being written, 2 * seq + 2 once valid
+	uint64_t seq;
+	uint32_t len;
+	uint32_t pad;
+	uint8_t data[0];
+};
+
+// a reader connected to the writer
+struct shm_ring_peer {
+	struct llist_head list;
+	struct shm_ring_writer *w;
+	struct osmo_fd conn;	// control connection
+	int efd;		// eventfd of the reader, -1 until received
+};
+
+struct shm_ring_writer {
+	struct osmo_fd listen_ofd;	// control socket readers connect to
+	char *path;
+	int memfd;
+	size_t map_len;
+	struct shm_ring_hdr *hdr;
+	struct llist_head peers;
+};
+
+struct shm_ring_reader {
+	char *path;
+	struct osmo_fd conn;		// control connection to the writer
+	struct osmo_fd efd;		// eventfd the writer signals
+	struct osmo_timer_list reconnect_timer;
+	size_t map_len;
+	const struct shm_ring_hdr *hdr;	// NULL while not attached
+	uint64_t tail;			// sequence number of the next slot to read
+	uint32_t dropped;		// slots overwritten before they were read
+	// called after a wakeup, should drain the ring with shm_ring_read()
+	void (*data_cb)(struct shm_ring_reader *r);
+	void *data;
+};
+
+struct shm_ring_writer *shm_ring_writer_create(void *ctx, const char *path);
+void shm_ring_writer_destroy(struct shm_ring_writer *w);
+int shm_ring_write(struct shm_ring_writer *w, const void *data,
+                   unsigned int len);
+void shm_ring_notify(struct shm_ring_writer *w);
+
+struct shm_ring_reader *shm_ring_reader_create(
+                void *ctx, const char *path,
+                void (*data_cb)(struct shm_ring_reader *r), void *data);
+void shm_ring_reader_destroy(struct shm_ring_reader *r);
+int shm_ring_read(struct shm_ring_reader *r, void *buf, unsigned int buf_len);
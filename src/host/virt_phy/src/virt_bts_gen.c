@@ -0,0 +1,680 @@
+/* Synthetic downlink of a number of cells on the virtual Um. */
+
+/* (C) 2016 by the osmocom-bb contributors
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Stands in for a BTS when testing virt_phy. Every cell has a BCCH and
+ * one non-combined CCCH on timeslot 0 of its own ARFCN and follows the
+ * 51-multiframe: SI1 to SI4 on BCCH, one AGCH block and eight PCH
+ * blocks per multiframe. Paging requests and immediate assignments are
+ * generated at a configurable rate, RACH bursts received on the uplink
+ * are answered by an immediate assignment on the AGCH as well.
+ *
+ * FCCH and SCH are not sent, virt_phy does not need them to sync and
+ * takes every cell to have BSIC VIRT_UM_BSIC. With -B the blocks go
+ * out as bursts, see virt_um_burst.h, access bursts are decoded for the
+ * BSIC of the cell they are sent to.
+ *
+ * usage: virt_bts_gen [-n cells] [-A arfcn] [-p pagings/s] [-a imm.ass/s]
+ *                     [-b frames] [-s] [-B workers]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/timerfd.h>
+
+#include <osmocom/core/select.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/gsmtap.h>
+#include <osmocom/core/gsmtap_util.h>
+#include <osmocom/gsm/gsm_utils.h>
+#include <osmocom/gsm/gsm48.h>
+#include <osmocom/gsm/rsl.h>
+#include <osmocom/gsm/protocol/gsm_04_08.h>
+
+#include "virtual_um.h"
+#include "virt_um_burst.h"
+#include "logging.h"
+
+#define GEN_MAC_BLOCK_LEN	23
+// a TDMA frame lasts 120/26 ms
+#define GEN_FRAME_NS		4615385
+// bitmap 0 cell channel descriptions cover ARFCN 1..124 only
+#define GEN_MAX_ARFCN		124
+// number of CCCH blocks per 51-multiframe reserved for the AGCH
+#define GEN_BS_AG_BLKS_RES	1
+// RACH bursts waiting for an immediate assignment, per cell
+#define GEN_RACH_QUEUE		16
+// queued pagings beyond which new ones are dropped, per cell
+#define GEN_MAX_PAGING_BACKLOG	64
+#define GEN_MCC			1
+#define GEN_MNC			1
+#define GEN_SIGNAL_DBM		-60
+
+// first frame of each CCCH block in the 51-multiframe
+static const uint8_t ccch_block_fn[] = { 6, 12, 16, 22, 26, 32, 36, 42, 46 };
+
+struct gen_rach {
+	uint8_t ra;
+	uint32_t fn;
+};
+
+struct gen_cell {
+	uint16_t arfcn;
+	uint16_t cell_id;
+	uint8_t bsic;
+	uint8_t si[4][GEN_MAC_BLOCK_LEN];
+
+	// fractional number of pagings and assignments due
+	double paging_credit;
+	double imm_ass_credit;
+	uint32_t next_tmsi;
+	// SDCCH/8 subchannel of the next immediate assignment
+	uint8_t next_ss;
+
+	struct gen_rach rach[GEN_RACH_QUEUE];
+	unsigned int rach_len;
+};
+
+struct gen_stats {
+	unsigned int frames;	// GSMTAP frames sent
+	unsigned int pagings;
+	unsigned int imm_ass;
+	unsigned int rach;
+	unsigned int dropped;	// pagings beyond the PCH capacity
+	unsigned int late;	// frame clock ticks that were missed
+};
+
+struct gen {
+	struct virt_um_inst *vui;
+	// burst-level coding, NULL to send whole L2 frames
+	struct virt_um_burst *burst;
+	struct gen_cell *cells;
+	unsigned int num_cells;
+	uint16_t lac;
+	double pagings_per_frame;
+	double imm_ass_per_frame;
+
+	uint32_t fn;
+	struct osmo_fd clock;
+	struct osmo_timer_list report_timer;
+	unsigned int report_s;
+	uint64_t report_start_ns;
+	struct gen_stats stats;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* L2 pseudo length octet for a message of len octets after it */
+static inline uint8_t l2_plen(unsigned int len)
+{
+	return (len << 2) | 0x01;
+}
+
+/* set the bit of arfcn in a bit map 0 channel list */
+static void chan_list_add(uint8_t *list, uint16_t arfcn)
+{
+	list[15 - (arfcn - 1) / 8] |= 1 << ((arfcn - 1) % 8);
+}
+
+static void gen_rach_control(struct gsm48_rach_control *rc)
+{
+	rc->re = 1;
+	rc->cell_bar = 0;
+	rc->tx_integer = 9;
+	rc->max_trans = 1;
+	// all access classes may access
+	rc->t2 = 0;
+	rc->t3 = 0;
+}
+
+static void gen_cell_sel_par(struct gsm48_cell_sel_par *csp)
+{
+	csp->ms_txpwr_max_ccch = 5;
+	csp->cell_resel_hyst = 2;
+	csp->rxlev_acc_min = 0;
+	csp->neci = 1;
+	csp->acs = 0;
+}
+
+static void gen_si_header(uint8_t *buf, unsigned int len, uint8_t type)
+{
+	struct gsm48_system_information_type_header *sih = (void *) buf;
+
+	sih->l2_plen = l2_plen(len);
+	sih->rr_protocol_discriminator = GSM48_PDISC_RR;
+	sih->skip_indicator = 0;
+	sih->system_information = type;
+}
+
+static void gen_cell_init(struct gen *gen, struct gen_cell *cell,
+                          uint16_t arfcn, uint16_t cell_id)
+{
+	struct gsm48_system_information_type_1 *si1 = (void *) cell->si[0];
+	struct gsm48_system_information_type_2 *si2 = (void *) cell->si[1];
+	struct gsm48_system_information_type_3 *si3 = (void *) cell->si[2];
+	struct gsm48_system_information_type_4 *si4 = (void *) cell->si[3];
+	unsigned int i;
+
+	cell->arfcn = arfcn;
+	cell->cell_id = cell_id;
+	cell->bsic = VIRT_UM_BSIC;
+	cell->next_tmsi = cell_id << 24;
+	// spare octets and rest octets without optional content
+	memset(cell->si, GSM_MACBLOCK_PADDING, sizeof(cell->si));
+
+	gen_si_header(cell->si[0], sizeof(*si1) - 1, GSM48_MT_RR_SYSINFO_1);
+	memset(si1->cell_channel_description, 0, 16);
+	chan_list_add(si1->cell_channel_description, arfcn);
+	gen_rach_control(&si1->rach_control);
+
+	// all other cells are neighbours
+	gen_si_header(cell->si[1], sizeof(*si2) - 1, GSM48_MT_RR_SYSINFO_2);
+	memset(si2->bcch_frequency_list, 0, 16);
+	for (i = 0; i < gen->num_cells; i++) {
+		if (gen->cells[i].arfcn != arfcn)
+			chan_list_add(si2->bcch_frequency_list,
+			              gen->cells[i].arfcn);
+	}
+	si2->ncc_permitted = 0xff;
+	gen_rach_control(&si2->rach_control);
+
+	gen_si_header(cell->si[2], sizeof(*si3) - 1, GSM48_MT_RR_SYSINFO_3);
+	si3->cell_identity = htons(cell_id);
+	gsm48_generate_lai(&si3->lai, GEN_MCC, GEN_MNC, gen->lac);
+	memset(&si3->control_channel_desc, 0,
+	       sizeof(si3->control_channel_desc));
+	si3->control_channel_desc.ccch_conf = RSL_BCCH_CCCH_CONF_1_NC;
+	si3->control_channel_desc.bs_ag_blks_res = GEN_BS_AG_BLKS_RES;
+	// paging groups repeat every second multiframe
+	si3->control_channel_desc.bs_pa_mfrms = 0;
+	si3->cell_options.radio_link_timeout = 7;
+	si3->cell_options.dtx = 2;
+	si3->cell_options.pwrc = 0;
+	si3->cell_options.spare = 0;
+	gen_cell_sel_par(&si3->cell_sel_par);
+	gen_rach_control(&si3->rach_control);
+
+	gen_si_header(cell->si[3], sizeof(*si4) - 1, GSM48_MT_RR_SYSINFO_4);
+	gsm48_generate_lai(&si4->lai, GEN_MCC, GEN_MNC, gen->lac);
+	gen_cell_sel_par(&si4->cell_sel_par);
+	gen_rach_control(&si4->rach_control);
+}
+
+static void gen_send(struct gen *gen, struct gen_cell *cell,
+                     uint8_t chan_type, uint32_t fn, const uint8_t *data)
+{
+	struct msgb *msg;
+
+	if (gen->burst) {
+		if (virt_um_burst_tx_block(gen->burst, cell->arfcn, 0, chan_type,
+		                0, fn, GEN_SIGNAL_DBM, data,
+		                GEN_MAC_BLOCK_LEN) == 0)
+			gen->stats.frames++;
+		return;
+	}
+
+	msg = gsmtap_makemsg(cell->arfcn, 0, chan_type, 0, fn, GEN_SIGNAL_DBM,
+	                0, data, GEN_MAC_BLOCK_LEN);
+	if (!msg)
+		return;
+	virt_um_write_msg(gen->vui, msg);
+	gen->stats.frames++;
+}
+
+/* Paging Request Type 1 with up to two TMSIs, none makes it empty */
+static void gen_paging(struct gen *gen, struct gen_cell *cell, uint32_t fn,
+                       unsigned int num)
+{
+	uint8_t buf[GEN_MAC_BLOCK_LEN];
+	struct gsm48_paging1 *pr = (void *) buf;
+	uint8_t mi[GSM48_TMSI_LEN + 2];
+	uint8_t *cur = pr->data;
+
+	memset(buf, GSM_MACBLOCK_PADDING, sizeof(buf));
+	pr->proto_discr = GSM48_PDISC_RR;
+	pr->msg_type = GSM48_MT_RR_PAG_REQ_1;
+	pr->pag_mode = GSM48_PM_NORMAL;
+	pr->spare = 0;
+	pr->cneed1 = pr->cneed2 = 0;
+
+	if (num == 0) {
+		// mobile identity 1, type 'no identity'
+		*cur++ = 1;
+		*cur++ = 0xf0;
+	} else {
+		// mobile identity 1 is LV, 2 is TLV
+		gsm48_generate_mid_from_tmsi(mi, cell->next_tmsi++);
+		memcpy(cur, mi + 1, GSM48_TMSI_LEN + 1);
+		cur += GSM48_TMSI_LEN + 1;
+		if (num > 1) {
+			gsm48_generate_mid_from_tmsi(mi, cell->next_tmsi++);
+			memcpy(cur, mi, GSM48_TMSI_LEN + 2);
+			cur += GSM48_TMSI_LEN + 2;
+		}
+		gen->stats.pagings += num;
+	}
+	pr->l2_plen = l2_plen(cur - buf - 1);
+
+	gen_send(gen, cell, GSMTAP_CHANNEL_PCH, fn, buf);
+}
+
+/* Immediate Assignment of an SDCCH/8 on timeslot 1 */
+static void gen_imm_ass(struct gen *gen, struct gen_cell *cell, uint32_t fn,
+                        uint8_t ra, uint32_t rach_fn)
+{
+	uint8_t buf[GEN_MAC_BLOCK_LEN];
+	struct gsm48_imm_ass *ia = (void *) buf;
+	uint8_t t3 = rach_fn % 51;
+
+	memset(buf, GSM_MACBLOCK_PADDING, sizeof(buf));
+	ia->l2_plen = l2_plen(sizeof(*ia) - 1);
+	ia->proto_discr = GSM48_PDISC_RR;
+	ia->msg_type = GSM48_MT_RR_IMM_ASS;
+	ia->page_mode = GSM48_PM_NORMAL;
+	ia->chan_desc.chan_nr = rsl_enc_chan_nr(RSL_CHAN_SDCCH8_ACCH,
+	                cell->next_ss++ % 8, 1);
+	ia->chan_desc.h0.tsc = 7;
+	ia->chan_desc.h0.h = 0;
+	ia->chan_desc.h0.spare = 0;
+	ia->chan_desc.h0.arfcn_high = cell->arfcn >> 8;
+	ia->chan_desc.h0.arfcn_low = cell->arfcn & 0xff;
+	ia->req_ref.ra = ra;
+	ia->req_ref.t1 = (rach_fn / 1326) % 32;
+	ia->req_ref.t2 = rach_fn % 26;
+	ia->req_ref.t3_high = t3 >> 3;
+	ia->req_ref.t3_low = t3 & 7;
+	ia->timing_advance = 0;
+	ia->mob_alloc_len = 0;
+
+	gen_send(gen, cell, GSMTAP_CHANNEL_AGCH, fn, buf);
+	gen->stats.imm_ass++;
+}
+
+static void gen_agch_block(struct gen *gen, struct gen_cell *cell,
+                           uint32_t fn)
+{
+	// answer RACH bursts first, oldest first
+	if (cell->rach_len) {
+		gen_imm_ass(gen, cell, fn, cell->rach[0].ra, cell->rach[0].fn);
+		memmove(&cell->rach[0], &cell->rach[1],
+		        --cell->rach_len * sizeof(cell->rach[0]));
+	} else if (cell->imm_ass_credit >= 1) {
+		cell->imm_ass_credit -= 1;
+		// a random access reference nobody sent
+		gen_imm_ass(gen, cell, fn, 0x80 | (fn & 0x1f),
+		            (fn + GSM_MAX_FN - 3) % GSM_MAX_FN);
+	} else {
+		gen_paging(gen, cell, fn, 0);
+	}
+}
+
+static void gen_pch_block(struct gen *gen, struct gen_cell *cell,
+                          uint32_t fn)
+{
+	unsigned int num = 0;
+
+	if (cell->paging_credit >= 2)
+		num = 2;
+	else if (cell->paging_credit >= 1)
+		num = 1;
+	cell->paging_credit -= num;
+	gen_paging(gen, cell, fn, num);
+}
+
+/* everything a cell sends on timeslot 0 in frame fn */
+static void gen_cell_frame(struct gen *gen, struct gen_cell *cell,
+                           uint32_t fn)
+{
+	unsigned int mf = fn % 51, i;
+
+	cell->paging_credit += gen->pagings_per_frame;
+	if (cell->paging_credit > GEN_MAX_PAGING_BACKLOG) {
+		gen->stats.dropped += cell->paging_credit -
+		                GEN_MAX_PAGING_BACKLOG;
+		cell->paging_credit = GEN_MAX_PAGING_BACKLOG;
+	}
+	cell->imm_ass_credit += gen->imm_ass_per_frame;
+	if (cell->imm_ass_credit > GEN_MAX_PAGING_BACKLOG)
+		cell->imm_ass_credit = GEN_MAX_PAGING_BACKLOG;
+
+	// BCCH Norm, TC = (FN div 51) mod 8 selects the SI, the
+	// optional SIs of TC 4 and 5 are replaced by SI3 and SI4
+	if (mf == 2) {
+		static const uint8_t tc_si[8] = { 0, 1, 2, 3, 2, 3, 2, 3 };
+
+		gen_send(gen, cell, GSMTAP_CHANNEL_BCCH, fn,
+		         cell->si[tc_si[(fn / 51) % 8]]);
+		return;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(ccch_block_fn); i++) {
+		if (ccch_block_fn[i] != mf)
+			continue;
+		if (i < GEN_BS_AG_BLKS_RES)
+			gen_agch_block(gen, cell, fn);
+		else
+			gen_pch_block(gen, cell, fn);
+		return;
+	}
+}
+
+static void gen_frame(struct gen *gen)
+{
+	unsigned int i;
+
+	for (i = 0; i < gen->num_cells; i++)
+		gen_cell_frame(gen, &gen->cells[i], gen->fn);
+	gen->fn = (gen->fn + 1) % GSM_MAX_FN;
+}
+
+static int gen_clock_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct gen *gen = ofd->data;
+	uint64_t expired;
+	int rc;
+
+	rc = read(ofd->fd, &expired, sizeof(expired));
+	if (rc != sizeof(expired))
+		return 0;
+
+	// frames we were too late for are still sent, late
+	gen->stats.late += expired - 1;
+	while (expired--)
+		gen_frame(gen);
+	virt_um_flush(gen->vui);
+
+	return 0;
+}
+
+static int gen_clock_start(struct gen *gen)
+{
+	struct itimerspec its = {
+		.it_interval = { 0, GEN_FRAME_NS },
+		.it_value = { 0, GEN_FRAME_NS },
+	};
+
+	gen->clock.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (gen->clock.fd < 0)
+		return -errno;
+	gen->clock.when = BSC_FD_READ;
+	gen->clock.cb = gen_clock_cb;
+	gen->clock.data = gen;
+	if (osmo_fd_register(&gen->clock) < 0)
+		return -EIO;
+
+	return timerfd_settime(gen->clock.fd, 0, &its, NULL);
+}
+
+static struct gen_cell *gen_find_cell(struct gen *gen, uint16_t arfcn)
+{
+	unsigned int i;
+
+	for (i = 0; i < gen->num_cells; i++) {
+		if (gen->cells[i].arfcn == arfcn)
+			return &gen->cells[i];
+	}
+	return NULL;
+}
+
+/* access bursts are decoded for the BSIC of their cell */
+static uint8_t gen_rach_bsic_cb(struct virt_um_inst *vui, uint16_t arfcn)
+{
+	struct gen_cell *cell = gen_find_cell(vui->priv, arfcn);
+
+	return cell ? cell->bsic : VIRT_UM_BSIC;
+}
+
+/* uplink frames, RACH bursts are queued for an immediate assignment.
+ * Bursts come back here as frames once decoded. */
+static void gen_rx_cb(struct virt_um_inst *vui, struct msgb *msg)
+{
+	struct gen *gen = vui->priv;
+	struct gsmtap_hdr *gh;
+	struct gen_cell *cell;
+
+	if (!msg)
+		return;
+	gh = (struct gsmtap_hdr *) msgb_data(msg);
+	if (gen->burst && msgb_length(msg) >= sizeof(*gh)
+	    && gh->type == GSMTAP_TYPE_UM_BURST) {
+		virt_um_burst_rx(gen->burst, msg);
+		return;
+	}
+	// the ra byte follows the header, whose length the sender sets
+	if (msgb_length(msg) < sizeof(*gh) ||
+	    gh->hdr_len * 4 < sizeof(*gh) ||
+	    msgb_length(msg) <= gh->hdr_len * 4 ||
+	    gh->version != GSMTAP_VERSION || gh->type != GSMTAP_TYPE_UM ||
+	    gh->sub_type != GSMTAP_CHANNEL_RACH)
+		goto out;
+
+	cell = gen_find_cell(gen, ntohs(gh->arfcn) & GSMTAP_ARFCN_MASK);
+	if (!cell || cell->rach_len == GEN_RACH_QUEUE)
+		goto out;
+	cell->rach[cell->rach_len].ra = msgb_data(msg)[gh->hdr_len * 4];
+	cell->rach[cell->rach_len].fn = ntohl(gh->frame_number);
+	cell->rach_len++;
+	gen->stats.rach++;
+
+out:
+	msgb_free(msg);
+}
+
+static void gen_report_cb(void *data)
+{
+	struct gen *gen = data;
+	uint64_t now = now_ns();
+	double s = (now - gen->report_start_ns) / 1e9;
+
+	printf("%u cells: %.0f frames/s, %.1f pagings/s, %.1f imm.ass/s "
+	       "(%u RACH), %u pagings dropped, %u ticks late\n",
+	       gen->num_cells, gen->stats.frames / s, gen->stats.pagings / s,
+	       gen->stats.imm_ass / s, gen->stats.rach, gen->stats.dropped,
+	       gen->stats.late);
+	fflush(stdout);
+
+	memset(&gen->stats, 0, sizeof(gen->stats));
+	gen->report_start_ns = now;
+	osmo_timer_schedule(&gen->report_timer, gen->report_s, 0);
+}
+
+/* generate num_frames TDMA frames as fast as possible */
+static void gen_bench(struct gen *gen, unsigned int num_frames)
+{
+	uint64_t start;
+	unsigned int i;
+
+	start = now_ns();
+	for (i = 0; i < num_frames; i++) {
+		gen_frame(gen);
+		// the bursts of the frame are sent once coded
+		if (gen->burst)
+			virt_um_burst_flush(gen->burst);
+		virt_um_flush(gen->vui);
+	}
+	start = now_ns() - start;
+
+	printf("%u cells, %u TDMA frames in %.3f s: %.0f TDMA frames/s "
+	       "(%.0fx real time), %.0f GSMTAP frames/s\n", gen->num_cells,
+	       num_frames, start / 1e9, num_frames * 1e9 / start,
+	       num_frames * (double)GEN_FRAME_NS / start,
+	       gen->stats.frames * 1e9 / start);
+}
+
+static void print_help(void)
+{
+	printf(" -h --help		This text.\n");
+	printf(" -n --cells N		Number of cells (default 1).\n");
+	printf(" -A --arfcn ARFCN	ARFCN of the first cell, the others "
+	       "follow (default 1).\n");
+	printf(" -L --lac LAC		Location area code (default 1).\n");
+	printf(" -p --paging N		Paging requests per second and cell.\n");
+	printf(" -a --imm-ass N		Immediate assignments per second and "
+	       "cell, on top of those for RACH bursts.\n");
+	printf(" -r --report S		Report statistics every S seconds "
+	       "(default 10).\n");
+	printf(" -b --bench N		Generate N TDMA frames as fast as "
+	       "possible, then exit.\n");
+	printf(" -s --shm		Use shared memory rings instead of multicast "
+	       "for the virtual Um.\n");
+	printf(" -B --burst N		Send bursts instead of L2 frames, coded by "
+	       "N worker threads.\n");
+}
+
+int main(int argc, char **argv)
+{
+	enum virt_um_transport transport = VIRT_UM_T_MCAST;
+	unsigned int num_cells = 1, first_arfcn = 1, bench = 0, i;
+	unsigned int burst_workers = 0;
+	double pagings = 0, imm_ass = 0;
+	struct gen *gen;
+
+	gen = talloc_zero(NULL, struct gen);
+	gen->lac = 1;
+	gen->report_s = 10;
+
+	while (1) {
+		int option_index = 0, c;
+		static struct option long_options[] = {
+			{"help", 0, 0, 'h'},
+			{"cells", 1, 0, 'n'},
+			{"arfcn", 1, 0, 'A'},
+			{"lac", 1, 0, 'L'},
+			{"paging", 1, 0, 'p'},
+			{"imm-ass", 1, 0, 'a'},
+			{"report", 1, 0, 'r'},
+			{"bench", 1, 0, 'b'},
+			{"shm", 0, 0, 's'},
+			{"burst", 1, 0, 'B'},
+			{0, 0, 0, 0},
+		};
+
+		c = getopt_long(argc, argv, "hn:A:L:p:a:r:b:sB:", long_options,
+		                &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'n':
+			num_cells = atoi(optarg);
+			break;
+		case 'A':
+			first_arfcn = atoi(optarg);
+			break;
+		case 'L':
+			gen->lac = atoi(optarg);
+			break;
+		case 'p':
+			pagings = atof(optarg);
+			break;
+		case 'a':
+			imm_ass = atof(optarg);
+			break;
+		case 'r':
+			gen->report_s = atoi(optarg);
+			break;
+		case 'b':
+			bench = atoi(optarg);
+			break;
+		case 's':
+			transport = VIRT_UM_T_SHM;
+			break;
+		case 'B':
+			burst_workers = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_help();
+			exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+	if (num_cells < 1 || first_arfcn < 1 ||
+	    first_arfcn + num_cells - 1 > GEN_MAX_ARFCN) {
+		fprintf(stderr, "cells must be on ARFCN 1..%u\n",
+		        GEN_MAX_ARFCN);
+		return EXIT_FAILURE;
+	}
+
+	ms_log_init("DL1C,1:DVIRPHY,1");
+
+	gen->num_cells = num_cells;
+	gen->cells = talloc_zero_array(gen, struct gen_cell, num_cells);
+	// the neighbour lists need all ARFCNs first
+	for (i = 0; i < num_cells; i++)
+		gen->cells[i].arfcn = first_arfcn + i;
+	for (i = 0; i < num_cells; i++)
+		gen_cell_init(gen, &gen->cells[i], first_arfcn + i, i + 1);
+	gen->pagings_per_frame = pagings * GEN_FRAME_NS / 1e9;
+	gen->imm_ass_per_frame = imm_ass * GEN_FRAME_NS / 1e9;
+
+	// the downlink goes where the MS listen, the uplink comes from
+	// where they send to
+	gen->vui = virt_um_init(gen, DEFAULT_MS_MCAST_GROUP,
+	                DEFAULT_MS_MCAST_PORT, DEFAULT_BTS_MCAST_GROUP,
+	                DEFAULT_BTS_MCAST_PORT, gen_rx_cb, transport);
+	if (!gen->vui)
+		return EXIT_FAILURE;
+	gen->vui->priv = gen;
+	if (burst_workers) {
+		gen->burst = virt_um_burst_init(gen, gen->vui, burst_workers,
+		                gen_rx_cb);
+		if (!gen->burst)
+			return EXIT_FAILURE;
+		gen->burst->rach_bsic_cb = gen_rach_bsic_cb;
+	}
+
+	if (bench) {
+		gen_bench(gen, bench);
+		virt_um_burst_destroy(gen->burst);
+		virt_um_destroy(gen->vui);
+		talloc_free(gen);
+		return EXIT_SUCCESS;
+	}
+
+	if (gen_clock_start(gen) < 0) {
+		perror("Failed to start the frame clock");
+		return EXIT_FAILURE;
+	}
+	gen->report_timer.cb = gen_report_cb;
+	gen->report_timer.data = gen;
+	gen->report_start_ns = now_ns();
+	osmo_timer_schedule(&gen->report_timer, gen->report_s, 0);
+
+	while (1)
+		osmo_select_main(0);
+
+	// not reached
+	return EXIT_FAILURE;
+}
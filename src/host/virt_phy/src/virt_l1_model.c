@@ -1,16 +1,85 @@
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+
 #include "virt_l1_model.h"
+#include "virt_l1_sched.h"
+#include "virt_um_burst.h"
+
+static const struct rate_ctr_desc l1_model_rx_ctr_description[] = {
+	[L1_MODEL_CTR_RX_FRAMES]	= { "rx.frames",	"Frames received from the virtual Um" },
+	[L1_MODEL_CTR_RX_DROP_CHAN]	= { "rx.drop.chan",	"Frames of unhandled channel types    " },
+	[L1_MODEL_CTR_RX_DROP_NO_MS]	= { "rx.drop.no_ms",	"Frames no MS was tuned to            " },
+	[L1_MODEL_CTR_FILTER_UPDATE]	= { "filter.update",	"Kernel rx filter reprogrammed        " },
+	[L1_MODEL_CTR_FILTER_OFF]	= { "filter.off",	"Kernel rx filter too large, removed  " },
+};
 
-struct l1_model_ms* l1_model_ms_init(void *ctx) {
+static const struct rate_ctr_group_desc l1_model_rx_ctrg_desc = {
+	.group_name_prefix = "virtphy.rx",
+	.group_description = "Virtual physical layer receive statistics",
+	.num_ctr = ARRAY_SIZE(l1_model_rx_ctr_description),
+	.ctr_desc = l1_model_rx_ctr_description,
+};
 
-	struct l1_model_ms *model = talloc_zero(ctx, struct l1_model_ms);
-	model->state = talloc_zero(ctx, struct l1_state_ms);
+struct l1_model *l1_model_init(void *ctx)
+{
+	struct l1_model *model = talloc_zero(ctx, struct l1_model);
+	int i;
+
+	for (i = 0; i < L1_MODEL_ARFCN_HASH; i++)
+		INIT_LLIST_HEAD(&model->ms_by_arfcn[i]);
+	INIT_LLIST_HEAD(&model->ms_idle);
+	model->rx_ctrg = rate_ctr_group_alloc(model, &l1_model_rx_ctrg_desc, 0);
 
 	return model;
 }
 
-void l1_model_ms_destroy(struct l1_model_ms *model) {
-	virt_um_destroy(model->vui);
+void l1_model_destroy(struct l1_model *model)
+{
+	// disconnecting the l23 apps destroys their MS models
 	l1ctl_sock_destroy(model->lsi);
-	talloc_free(model->state);
+	virt_l1_sched_destroy(model->sched);
+	virt_um_burst_destroy(model->burst);
+	virt_um_destroy(model->vui);
+	rate_ctr_group_free(model->rx_ctrg);
 	talloc_free(model);
 }
+
+struct l1_model_ms *l1_model_ms_init(struct l1_model *model,
+                                     struct l1ctl_sock_client *lsc)
+{
+	struct l1_model_ms *ms = talloc_zero(model, struct l1_model_ms);
+
+	ms->model = model;
+	ms->lsc = lsc;
+	ms->vui = model->vui;
+	ms->state = talloc_zero(ms, struct l1_state_ms);
+	lsc->priv = ms;
+
+	llist_add_tail(&ms->list, &model->ms_idle);
+	model->num_ms++;
+
+	return ms;
+}
+
+void l1_model_ms_destroy(struct l1_model_ms *ms)
+{
+	virt_l1_sched_flush_ms(ms->model->sched, ms);
+	llist_del(&ms->list);
+	ms->model->num_ms--;
+	ms->lsc->priv = NULL;
+	talloc_free(ms);
+}
+
+/* (re-)tune the MS to an ARFCN, it receives downlink frames of that
+ * ARFCN from now on */
+void l1_model_ms_tune(struct l1_model_ms *ms, uint16_t arfcn)
+{
+	struct l1_model *model = ms->model;
+
+	ms->state->serving_cell.arfcn = arfcn;
+	ms->state->tuned = 1;
+
+	llist_del(&ms->list);
+	llist_add_tail(&ms->list, l1_model_arfcn_list(model, arfcn));
+}
@@ -1,12 +1,54 @@
 #pragma once
 
 #include <layer1/sync.h>
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/rate_ctr.h>
 #include "l1ctl_sock.h"
 #include "virtual_um.h"
 
-struct l1_model_ms {
+/* number of hash buckets for the MS lookup by ARFCN */
+#define L1_MODEL_ARFCN_HASH	64
+
+struct virt_l1_sched;
+struct virt_um_burst;
+struct sock_filter;
+
+/* counters of the "virtphy.rx" rate_ctr group of a model */
+enum l1_model_rx_ctr {
+	L1_MODEL_CTR_RX_FRAMES,		/* frames received from the virt um */
+	L1_MODEL_CTR_RX_DROP_CHAN,	/* dropped, channel type not handled */
+	L1_MODEL_CTR_RX_DROP_NO_MS,	/* dropped, no MS tuned to it */
+	L1_MODEL_CTR_FILTER_UPDATE,	/* kernel rx filter reprogrammed */
+	L1_MODEL_CTR_FILTER_OFF,	/* kernel rx filter had to be removed */
+};
+
+/* State shared by all MS served by this virtual physical layer. */
+struct l1_model {
 	struct l1ctl_sock_inst *lsi;
 	struct virt_um_inst *vui;
+	/* TDMA frame clock and uplink scheduler */
+	struct virt_l1_sched *sched;
+	/* burst-level coding of the virt um frames, NULL to exchange
+	 * whole L2 frames */
+	struct virt_um_burst *burst;
+	/* MS tuned to an ARFCN, hashed by that ARFCN, see l1_model_ms.list */
+	struct llist_head ms_by_arfcn[L1_MODEL_ARFCN_HASH];
+	/* MS not tuned to any ARFCN yet */
+	struct llist_head ms_idle;
+	unsigned int num_ms;
+	/* frames received and dropped in userspace, see l1_model_rx_ctr */
+	struct rate_ctr_group *rx_ctrg;
+	/* socket filter currently attached to the virt um, if any */
+	struct sock_filter *rx_filter;
+	unsigned int rx_filter_len;
+};
+
+/* One MS, i.e. one connected l23 app. */
+struct l1_model_ms {
+	struct llist_head list;
+	struct l1_model *model;
+	struct l1ctl_sock_client *lsc;
+	struct virt_um_inst *vui;
 	struct l1_state_ms *state;
 };
 
@@ -15,17 +57,52 @@ struct l1_state_ms {
 
 	/* the cell on which we are camping right now */
 	struct l1_cell_info serving_cell;
+	/* serving_cell.arfcn is valid */
+	uint8_t tuned;
 
 	/* neighbor cell sync info */
 	struct l1_cell_info neigh_cell[L1S_NUM_NEIGH_CELL];
 
+	/* dedicated channel, if any */
+	struct {
+		uint8_t active;
+		uint8_t chan_nr;
+		uint8_t tn;
+	} dedicated;
+
+	/* ciphering */
+	struct {
+		uint8_t algo;
+		uint8_t key[8];
+	} crypto;
+
 	/* TCH */
 	uint8_t tch_mode;
 	uint8_t tch_sync;
 	uint8_t audio_mode;
 };
 
-struct l1_model_ms *l1_model_ms_init(void *ctx);
+struct l1_model *l1_model_init(void *ctx);
+
+void l1_model_destroy(struct l1_model *model);
+
+struct l1_model_ms *l1_model_ms_init(struct l1_model *model,
+                                     struct l1ctl_sock_client *lsc);
+
+void l1_model_ms_destroy(struct l1_model_ms *ms);
+
+void l1_model_ms_tune(struct l1_model_ms *ms, uint16_t arfcn);
 
-void l1_model_ms_destroy(struct l1_model_ms *model);
+/* list of the MS possibly tuned to an ARFCN, see l1_model_ms_on_arfcn() */
+static inline struct llist_head *l1_model_arfcn_list(struct l1_model *model,
+                                                     uint16_t arfcn)
+{
+	return &model->ms_by_arfcn[(arfcn & 0x3ff) % L1_MODEL_ARFCN_HASH];
+}
 
+/* is the MS tuned to an ARFCN (band flags are ignored) */
+static inline int l1_model_ms_on_arfcn(struct l1_model_ms *ms, uint16_t arfcn)
+{
+	return ms->state->tuned &&
+	       (ms->state->serving_cell.arfcn & 0x3ff) == (arfcn & 0x3ff);
+}
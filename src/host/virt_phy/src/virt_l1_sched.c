@@ -0,0 +1,311 @@
+/* TDMA frame clock and uplink scheduler of the virtual physical layer. */
+
+/* (C) 2016 by the osmocom-bb contributors
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/timerfd.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/select.h>
+#include <osmocom/gsm/gsm_utils.h>
+#include <osmocom/gsm/rsl.h>
+#include <osmocom/gsm/protocol/gsm_08_58.h>
+#include <l1ctl_proto.h>
+
+#include "virt_l1_model.h"
+#include "virt_l1_sched.h"
+#include "gsmtapl1_if.h"
+#include "logging.h"
+
+/* signed distance a - b of two frame numbers, modulo the hyperframe */
+static int32_t fn_delta(uint32_t a, uint32_t b)
+{
+	int32_t d = (int32_t)((a + GSM_MAX_FN - b) % GSM_MAX_FN);
+
+	if (d >= GSM_MAX_FN / 2)
+		d -= GSM_MAX_FN;
+	return d;
+}
+
+/* (re-)start the frame clock, next tick one frame from now */
+static int sched_arm(struct virt_l1_sched *sched)
+{
+	struct itimerspec its = {
+		.it_interval = { 0, VIRT_L1_SCHED_FN_US * 1000 },
+		.it_value = { 0, VIRT_L1_SCHED_FN_US * 1000 },
+	};
+
+	return timerfd_settime(sched->ofd.fd, 0, &its, NULL);
+}
+
+/* send all primitives due on the current frame as one batch */
+static void sched_emit(struct virt_l1_sched *sched)
+{
+	struct virt_l1_sched_item *item, *tmp;
+	int num = 0;
+
+	llist_for_each_entry_safe(item, tmp, &sched->queue, list) {
+		if (fn_delta(item->fn, sched->fn) > 0)
+			break;
+		llist_del(&item->list);
+		sched->queue_len--;
+		gsmtapl1_tx_to_virt_um(item->ms, sched->fn, item->msg);
+		talloc_free(item);
+		num++;
+	}
+
+	if (num)
+		virt_um_flush(sched->model->vui);
+}
+
+static int sched_timer_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct virt_l1_sched *sched = ofd->data;
+	uint64_t expired;
+	int rc;
+
+	rc = read(ofd->fd, &expired, sizeof(expired));
+	if (rc != sizeof(expired))
+		return 0;
+
+	// we might have missed ticks, catch up
+	sched->fn = (sched->fn + expired) % GSM_MAX_FN;
+	sched_emit(sched);
+
+	return 0;
+}
+
+struct virt_l1_sched *virt_l1_sched_init(struct l1_model *model)
+{
+	struct virt_l1_sched *sched = talloc_zero(model, struct virt_l1_sched);
+
+	sched->model = model;
+	INIT_LLIST_HEAD(&sched->queue);
+
+	sched->ofd.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (sched->ofd.fd < 0) {
+		perror("Failed to create frame clock timerfd");
+		talloc_free(sched);
+		return NULL;
+	}
+	sched->ofd.when = BSC_FD_READ;
+	sched->ofd.cb = sched_timer_cb;
+	sched->ofd.data = sched;
+
+	if (sched_arm(sched) != 0 || osmo_fd_register(&sched->ofd) != 0) {
+		perror("Failed to start frame clock");
+		close(sched->ofd.fd);
+		talloc_free(sched);
+		return NULL;
+	}
+
+	return sched;
+}
+
+void virt_l1_sched_destroy(struct virt_l1_sched *sched)
+{
+	struct virt_l1_sched_item *item, *tmp;
+
+	llist_for_each_entry_safe(item, tmp, &sched->queue, list) {
+		msgb_free(item->msg);
+		talloc_free(item);
+	}
+
+	osmo_fd_unregister(&sched->ofd);
+	close(sched->ofd.fd);
+	talloc_free(sched);
+}
+
+/**
+ * Re-synchronise the frame clock to the frame number of a received
+ * downlink frame.
+ *
+ * Downlink frames of one TDMA frame arrive spread over the frame, so a
+ * clock that is one frame ahead is considered in sync.
+ */
+void virt_l1_sched_sync(struct virt_l1_sched *sched, uint32_t fn)
+{
+	int32_t d = fn_delta(fn, sched->fn);
+
+	if (sched->synced && (d == 0 || d == -1))
+		return;
+
+	if (sched->synced)
+		DEBUGP(DVIRPHY, "Frame clock off by %d frames, re-sync to fn=%u\n",
+		       d, fn);
+
+	sched->fn = fn;
+	sched->synced = 1;
+	// align the ticks to the frame boundary we just saw
+	sched_arm(sched);
+	// the clock might have jumped past primitives that are due
+	sched_emit(sched);
+}
+
+/**
+ * Queue an uplink primitive of an MS for the given frame and timeslot,
+ * the scheduler takes ownership of msg.
+ *
+ * Primitives for a frame that has already passed go out with the next
+ * tick.
+ */
+void virt_l1_sched_schedule(struct virt_l1_sched *sched, struct l1_model_ms *ms,
+                            uint32_t fn, uint8_t tn, struct msgb *msg)
+{
+	struct virt_l1_sched_item *item, *pos;
+
+	item = talloc_zero(sched, struct virt_l1_sched_item);
+	if (!item) {
+		msgb_free(msg);
+		return;
+	}
+	item->fn = fn % GSM_MAX_FN;
+	item->tn = tn;
+	item->ms = ms;
+	item->msg = msg;
+
+	// mostly appended in order, so look for the place from the tail
+	llist_for_each_entry_reverse(pos, &sched->queue, list) {
+		int32_t d = fn_delta(item->fn, pos->fn);
+
+		if (d > 0 || (d == 0 && item->tn >= pos->tn))
+			break;
+	}
+	// pos is the entry to insert after, or the list head itself
+	llist_add(&item->list, &pos->list);
+	sched->queue_len++;
+}
+
+/* first uplink frame of SACCH/TF blocks in the 104-multiframe, by
+ * timeslot pair, GSM 05.02 clause 7 table 1 */
+static const uint8_t ul_sacch_tf_fn[4] = { 12, 38, 64, 90 };
+/* first uplink frame of SDCCH/4 and SDCCH/8 blocks in the
+ * 51-multiframe, and of their SACCH in the 102-multiframe, by subslot.
+ * The uplink is the downlink delayed by 15 frames. */
+static const uint8_t ul_sdcch4_fn[4] = { 37, 41, 47, 0 };
+static const uint8_t ul_sacch4_fn[4] = { 57, 61, 6, 10 };
+static const uint8_t ul_sdcch8_fn[8] = { 15, 19, 23, 27, 31, 35, 39, 43 };
+static const uint8_t ul_sacch8_fn[8] = { 47, 51, 55, 59, 98, 0, 4, 8 };
+
+/* does an uplink block of the channel start on frame fn? */
+static int ul_block_start(uint8_t chan_nr, uint8_t link_id, uint32_t fn)
+{
+	int sacch = link_id & 0x40;
+	uint8_t type, ss, tn;
+
+	if (rsl_dec_chan_nr(chan_nr, &type, &ss, &tn) < 0)
+		return 1;
+
+	switch (type) {
+	case RSL_CHAN_Bm_ACCHs:
+		if (sacch)
+			return fn % 104 == ul_sacch_tf_fn[tn / 2];
+		// FACCH/F, blocks of 4 frames around the SACCH and idle one
+		switch (fn % 26) {
+		case 0: case 4: case 8: case 13: case 17: case 21:
+			return 1;
+		}
+		return 0;
+	case RSL_CHAN_Lm_ACCHs:
+		// the SACCH of subslot 1 follows the one of subslot 0
+		if (sacch)
+			return fn % 104 == ul_sacch_tf_fn[tn / 2] + 13 * ss;
+		// FACCH/H, every other frame
+		switch ((fn + 26 - ss) % 26) {
+		case 0: case 8: case 17:
+			return 1;
+		}
+		return 0;
+	case RSL_CHAN_SDCCH4_ACCH:
+		if (sacch)
+			return fn % 102 == ul_sacch4_fn[ss];
+		return fn % 51 == ul_sdcch4_fn[ss];
+	case RSL_CHAN_SDCCH8_ACCH:
+		if (sacch)
+			return fn % 102 == ul_sacch8_fn[ss];
+		return fn % 51 == ul_sdcch8_fn[ss];
+	default:
+		return 1;
+	}
+}
+
+/* is a block of the MS on the channel queued for frame fn already? */
+static int ul_block_taken(struct virt_l1_sched *sched, struct l1_model_ms *ms,
+                          uint8_t chan_nr, uint8_t link_id, uint32_t fn)
+{
+	struct virt_l1_sched_item *item;
+
+	llist_for_each_entry(item, &sched->queue, list) {
+		struct l1ctl_hdr *l1h = (struct l1ctl_hdr *)item->msg->l1h;
+		struct l1ctl_info_ul *ul = (struct l1ctl_info_ul *)l1h->data;
+
+		if (item->ms == ms && item->fn == fn
+		    && l1h->msg_type == L1CTL_DATA_REQ
+		    && ul->chan_nr == chan_nr
+		    && (ul->link_id & 0x40) == (link_id & 0x40))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Find the frame an uplink MAC block of an MS on a dedicated channel
+ * goes out on: the next frame a block of the channel starts on,
+ * according to the multiframe mapping of GSM 05.02, that has no other
+ * block of the MS on the channel queued for it yet.
+ */
+uint32_t virt_l1_sched_ul_fn(struct virt_l1_sched *sched,
+                             struct l1_model_ms *ms, uint8_t chan_nr,
+                             uint8_t link_id)
+{
+	uint32_t fn = sched->fn, i;
+
+	// one 104- or 102-multiframe has a block of every channel, look
+	// a few multiframes ahead for a free one
+	for (i = 1; i <= 4 * 104; i++) {
+		uint32_t f = (fn + i) % GSM_MAX_FN;
+
+		if (ul_block_start(chan_nr, link_id, f)
+		    && !ul_block_taken(sched, ms, chan_nr, link_id, f))
+			return f;
+	}
+	return (fn + 1) % GSM_MAX_FN;
+}
+
+/**
+ * Drop all queued primitives of an MS, e.g. when it disconnects.
+ */
+void virt_l1_sched_flush_ms(struct virt_l1_sched *sched,
+                            struct l1_model_ms *ms)
+{
+	struct virt_l1_sched_item *item, *tmp;
+
+	llist_for_each_entry_safe(item, tmp, &sched->queue, list) {
+		if (item->ms != ms)
+			continue;
+		llist_del(&item->list);
+		sched->queue_len--;
+		msgb_free(item->msg);
+		talloc_free(item);
+	}
+}
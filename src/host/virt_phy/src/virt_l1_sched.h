@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/msgb.h>
+
+/* duration of one TDMA frame */
+#define VIRT_L1_SCHED_FN_US	4615
+
+struct l1_model;
+struct l1_model_ms;
+
+/* One uplink primitive waiting for its frame. */
+struct virt_l1_sched_item {
+	struct llist_head list;
+	uint32_t fn;
+	uint8_t tn;
+	struct l1_model_ms *ms;
+	struct msgb *msg;
+};
+
+/* TDMA frame clock and uplink scheduler shared by all MS. */
+struct virt_l1_sched {
+	struct l1_model *model;
+	/* timerfd ticking once per TDMA frame */
+	struct osmo_fd ofd;
+	/* current frame number, re-synchronised to the downlink */
+	uint32_t fn;
+	uint8_t synced;
+	/* uplink primitives, sorted by fn and tn */
+	struct llist_head queue;
+	unsigned int queue_len;
+};
+
+struct virt_l1_sched *virt_l1_sched_init(struct l1_model *model);
+
+void virt_l1_sched_destroy(struct virt_l1_sched *sched);
+
+void virt_l1_sched_sync(struct virt_l1_sched *sched, uint32_t fn);
+
+void virt_l1_sched_schedule(struct virt_l1_sched *sched, struct l1_model_ms *ms,
+                            uint32_t fn, uint8_t tn, struct msgb *msg);
+
+uint32_t virt_l1_sched_ul_fn(struct virt_l1_sched *sched,
+                             struct l1_model_ms *ms, uint8_t chan_nr,
+                             uint8_t link_id);
+
+void virt_l1_sched_flush_ms(struct virt_l1_sched *sched,
+                            struct l1_model_ms *ms);
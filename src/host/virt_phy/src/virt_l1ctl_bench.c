@@ -0,0 +1,743 @@
+/* End-to-end latency of a running virtphy, from L1CTL to the virtual Um
+ * and back. */
+
+/* (C) 2016 by the osmocom-bb contributors
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Connects to the L1CTL socket of a virtphy like a layer 2 application
+ * and plays both ends of it:
+ *
+ * downlink	BCCH frames injected into the MS multicast group, timed
+ *		until the DATA_IND arrives on the L1CTL socket.
+ * rach		RACH_REQ written to the L1CTL socket, timed until the
+ *		access burst shows up in the BTS multicast group.
+ * data		DATA_REQ on an SDCCH/8, timed the same way.
+ *
+ * Every probe carries the time it was sent at, only the access burst is
+ * too short for it and is matched by its RA instead. Uplink latencies
+ * include the wait for the next TDMA frame in the virtphy scheduler,
+ * up to 4.6 ms.
+ *
+ * Each direction is measured at a fixed rate first, then the rate is
+ * doubled until the probes cannot be sent that fast any more, less than
+ * 99.9% of them are delivered or the 99th percentile exceeds the latency
+ * bound. The last rate that passed is
+ * reported as the maximum sustained rate. The exit status tells whether
+ * the fixed rate measurements stayed within the bound without a loss.
+ *
+ * usage: virt_l1ctl_bench [-S socket] [-A arfcn] [-c probes] [-r rate]
+ *                         [-M max rate] [-L ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+#include <osmocom/core/select.h>
+#include <osmocom/core/gsmtap.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/gsm_utils.h>
+#include <osmocom/gsm/rsl.h>
+#include <osmocom/gsm/protocol/gsm_04_08.h>
+
+#include <l1ctl_proto.h>
+
+#include "virtual_um.h"
+#include "osmo_mcast_sock.h"
+#include "l1ctl_sock.h"
+#include "logging.h"
+
+#define BENCH_MAGIC		0x4c31424eU
+#define BENCH_MAC_BLOCK_LEN	23
+// a TDMA frame lasts 120/26 ms
+#define BENCH_FRAME_NS		4615385ULL
+// shortest and longest interval of the send clock
+#define BENCH_TICK_MIN_NS	100000ULL
+#define BENCH_TICK_MAX_NS	5000000ULL
+// share of the probes that must arrive for a rate to be sustained
+#define BENCH_MIN_DELIVERY	0.999
+// share of the offered rate the probes must go out at, the sender is
+// slowed down when virtphy does not read the L1CTL socket fast enough
+#define BENCH_MIN_SEND_RATE	0.95
+// L1CTL messages written to the socket with one syscall
+#define BENCH_TX_BUF		(64 * 1024)
+#define BENCH_RX_BUF		(64 * 1024)
+
+/* payload of the downlink frames and the uplink MAC blocks */
+struct bench_probe {
+	uint32_t magic;
+	uint32_t run;
+	uint32_t seq;
+	uint64_t ts_ns;
+} __attribute__((packed));
+
+enum bench_dir {
+	BENCH_DL,
+	BENCH_UL_RACH,
+	BENCH_UL_DATA,
+};
+
+static const char *bench_dir_names[] = {
+	[BENCH_DL] = "downlink",
+	[BENCH_UL_RACH] = "rach",
+	[BENCH_UL_DATA] = "data",
+};
+
+/* one measurement at one rate */
+struct bench_run {
+	enum bench_dir dir;
+	uint32_t id;
+	double rate;
+	unsigned int count;
+	uint64_t start_ns;
+	// when the last probe was sent
+	uint64_t end_ns;
+	uint64_t drain_until_ns;
+	int done;
+
+	unsigned int sent;
+	unsigned int rcvd;
+	// latency of each received probe, in ns
+	uint32_t *lat;
+	// send time of the access burst of each RA
+	uint64_t rach_ts[256];
+};
+
+struct bench_result {
+	unsigned int sent;
+	unsigned int rcvd;
+	// the rate the probes actually went out at
+	double rate;
+	uint32_t p50, p99, p999, max;
+};
+
+struct bench {
+	struct osmo_fd l1ctl;
+	uint8_t rx_buf[BENCH_RX_BUF];
+	unsigned int rx_len;
+	uint8_t tx_buf[BENCH_TX_BUF];
+	unsigned int tx_len;
+	int fbsb_conf;
+
+	struct mcast_server_sock *dl_sock;
+	struct mcast_client_sock *ul_sock;
+	uint16_t arfcn;
+	// the downlink frame numbers follow the clock from here on
+	uint64_t fn_base_ns;
+
+	struct osmo_fd clock;
+	struct bench_run *run;
+	uint32_t next_run_id;
+	uint64_t max_p99_ns;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * L1CTL
+ */
+
+static int l1ctl_fd_cb(struct osmo_fd *ofd, unsigned int what);
+
+static void *l1ctl_put(struct bench *b, uint8_t msg_type, unsigned int len)
+{
+	struct l1ctl_hdr *l1h;
+	uint8_t *p;
+
+	if (b->tx_len + 2 + sizeof(*l1h) + len > sizeof(b->tx_buf))
+		return NULL;
+	p = b->tx_buf + b->tx_len;
+	p[0] = (sizeof(*l1h) + len) >> 8;
+	p[1] = (sizeof(*l1h) + len) & 0xff;
+	l1h = (struct l1ctl_hdr *)(p + 2);
+	memset(l1h, 0, sizeof(*l1h) + len);
+	l1h->msg_type = msg_type;
+	b->tx_len += 2 + sizeof(*l1h) + len;
+
+	return l1h->data;
+}
+
+static int l1ctl_flush(struct bench *b)
+{
+	unsigned int offs = 0;
+	int rc;
+
+	while (offs < b->tx_len) {
+		rc = write(b->l1ctl.fd, b->tx_buf + offs, b->tx_len - offs);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0 && errno == EAGAIN) {
+			// virtphy is behind, keep reading while we wait so
+			// it never blocks on us in turn
+			struct pollfd pfd = {
+				.fd = b->l1ctl.fd,
+				.events = POLLIN | POLLOUT,
+			};
+
+			if (poll(&pfd, 1, -1) > 0 && (pfd.revents & POLLIN))
+				l1ctl_fd_cb(&b->l1ctl, BSC_FD_READ);
+			continue;
+		}
+		if (rc <= 0) {
+			perror("L1CTL write");
+			exit(EXIT_FAILURE);
+		}
+		offs += rc;
+	}
+	b->tx_len = 0;
+
+	return 0;
+}
+
+static void bench_rx_probe(struct bench *b, enum bench_dir dir,
+                           const uint8_t *data, unsigned int len)
+{
+	struct bench_run *run = b->run;
+	struct bench_probe probe;
+
+	if (!run || run->dir != dir || len < sizeof(probe))
+		return;
+	memcpy(&probe, data, sizeof(probe));
+	// late probes of an earlier run do not count
+	if (probe.magic != BENCH_MAGIC || probe.run != run->id ||
+	    probe.seq >= run->sent || run->rcvd == run->count)
+		return;
+	run->lat[run->rcvd++] = now_ns() - probe.ts_ns;
+}
+
+static void l1ctl_rx_msg(struct bench *b, const uint8_t *data,
+                         unsigned int len)
+{
+	const struct l1ctl_hdr *l1h = (const struct l1ctl_hdr *)data;
+	unsigned int offs = sizeof(*l1h) + sizeof(struct l1ctl_info_dl);
+
+	if (len < sizeof(*l1h))
+		return;
+	switch (l1h->msg_type) {
+	case L1CTL_FBSB_CONF:
+		b->fbsb_conf = 1;
+		break;
+	case L1CTL_DATA_IND:
+		if (len >= offs)
+			bench_rx_probe(b, BENCH_DL, data + offs, len - offs);
+		break;
+	}
+}
+
+static int l1ctl_fd_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct bench *b = ofd->data;
+	unsigned int offs = 0, len;
+	int rc;
+
+	if (!(what & BSC_FD_READ))
+		return 0;
+	rc = read(ofd->fd, b->rx_buf + b->rx_len,
+	          sizeof(b->rx_buf) - b->rx_len);
+	if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (rc <= 0) {
+		fprintf(stderr, "virtphy closed the L1CTL socket\n");
+		exit(EXIT_FAILURE);
+	}
+	b->rx_len += rc;
+
+	// length of the message in network byte order
+	while (b->rx_len - offs >= 2) {
+		len = (b->rx_buf[offs] << 8) | b->rx_buf[offs + 1];
+		if (b->rx_len - offs - 2 < len)
+			break;
+		l1ctl_rx_msg(b, b->rx_buf + offs + 2, len);
+		offs += 2 + len;
+	}
+	memmove(b->rx_buf, b->rx_buf + offs, b->rx_len - offs);
+	b->rx_len -= offs;
+
+	return 0;
+}
+
+static int l1ctl_connect(struct bench *b, const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	b->l1ctl.fd = fd;
+	b->l1ctl.when = BSC_FD_READ;
+	b->l1ctl.cb = l1ctl_fd_cb;
+	b->l1ctl.data = b;
+
+	return osmo_fd_register(&b->l1ctl);
+}
+
+/* tune to the ARFCN and establish the SDCCH the DATA_REQs go to */
+static int l1ctl_setup(struct bench *b)
+{
+	struct l1ctl_fbsb_req *fbsb;
+	struct l1ctl_info_ul *ul;
+	struct l1ctl_dm_est_req *est;
+	uint64_t deadline;
+
+	fbsb = l1ctl_put(b, L1CTL_FBSB_REQ, sizeof(*fbsb));
+	fbsb->band_arfcn = htons(b->arfcn);
+	fbsb->flags = L1CTL_FBSB_F_FB01SB;
+	fbsb->ccch_mode = CCCH_MODE_NON_COMBINED;
+	l1ctl_flush(b);
+
+	deadline = now_ns() + 1000000000ULL;
+	while (!b->fbsb_conf && now_ns() < deadline)
+		osmo_select_main(1);
+	if (!b->fbsb_conf)
+		return -1;
+
+	ul = l1ctl_put(b, L1CTL_DM_EST_REQ, sizeof(*ul) + sizeof(*est));
+	ul->chan_nr = rsl_enc_chan_nr(RSL_CHAN_SDCCH8_ACCH, 0, 1);
+	est = (struct l1ctl_dm_est_req *)ul->payload;
+	est->tsc = 7;
+	est->h0.band_arfcn = htons(b->arfcn);
+	return l1ctl_flush(b);
+}
+
+/*
+ * Virtual Um
+ */
+
+static int ul_fd_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct bench *b = ofd->data;
+	uint8_t bufs[MCAST_SOCK_BATCH_MAX][VIRT_UM_MSGB_SIZE];
+	struct iovec iov[MCAST_SOCK_BATCH_MAX];
+	int rx_len[MCAST_SOCK_BATCH_MAX];
+	int i, rc;
+
+	if (!(what & BSC_FD_READ))
+		return 0;
+	for (i = 0; i < MCAST_SOCK_BATCH_MAX; i++) {
+		iov[i].iov_base = bufs[i];
+		iov[i].iov_len = sizeof(bufs[i]);
+	}
+	rc = mcast_client_sock_rx_batch(b->ul_sock, iov, rx_len,
+	                MCAST_SOCK_BATCH_MAX);
+
+	for (i = 0; i < rc; i++) {
+		struct gsmtap_hdr *gh = (struct gsmtap_hdr *)bufs[i];
+		struct bench_run *run = b->run;
+		unsigned int offs = gh->hdr_len * 4;
+
+		if (rx_len[i] < sizeof(*gh) || rx_len[i] <= offs ||
+		    gh->version != GSMTAP_VERSION ||
+		    ntohs(gh->arfcn) != (b->arfcn | GSMTAP_ARFCN_F_UPLINK))
+			continue;
+		if (gh->sub_type == GSMTAP_CHANNEL_RACH) {
+			uint8_t ra = bufs[i][offs];
+
+			if (!run || run->dir != BENCH_UL_RACH ||
+			    !run->rach_ts[ra] || run->rcvd == run->count)
+				continue;
+			run->lat[run->rcvd++] = now_ns() - run->rach_ts[ra];
+			run->rach_ts[ra] = 0;
+		} else {
+			bench_rx_probe(b, BENCH_UL_DATA, bufs[i] + offs,
+			               rx_len[i] - offs);
+		}
+	}
+
+	return 0;
+}
+
+static void dl_send(struct bench *b, unsigned int num)
+{
+	uint8_t bufs[MCAST_SOCK_BATCH_MAX][sizeof(struct gsmtap_hdr) +
+	                                   BENCH_MAC_BLOCK_LEN];
+	struct iovec iov[MCAST_SOCK_BATCH_MAX];
+	struct bench_run *run = b->run;
+	uint32_t fn;
+	unsigned int i, n;
+
+	fn = ((now_ns() - b->fn_base_ns) / BENCH_FRAME_NS) % GSM_MAX_FN;
+	while (num) {
+		n = OSMO_MIN(num, MCAST_SOCK_BATCH_MAX);
+		for (i = 0; i < n; i++) {
+			struct gsmtap_hdr *gh = (struct gsmtap_hdr *)bufs[i];
+			struct bench_probe probe = {
+				.magic = BENCH_MAGIC,
+				.run = run->id,
+				.seq = run->sent + i,
+				.ts_ns = now_ns(),
+			};
+
+			memset(bufs[i], GSM_MACBLOCK_PADDING, sizeof(bufs[i]));
+			memset(gh, 0, sizeof(*gh));
+			gh->version = GSMTAP_VERSION;
+			gh->hdr_len = sizeof(*gh) / 4;
+			gh->type = GSMTAP_TYPE_UM;
+			gh->arfcn = htons(b->arfcn);
+			gh->signal_dbm = -60;
+			gh->frame_number = htonl(fn);
+			gh->sub_type = GSMTAP_CHANNEL_BCCH;
+			memcpy(bufs[i] + sizeof(*gh), &probe, sizeof(probe));
+			iov[i].iov_base = bufs[i];
+			iov[i].iov_len = sizeof(bufs[i]);
+		}
+		// the sequence numbers are only valid once they are sent
+		run->sent += n;
+		if (mcast_server_sock_tx_batch(b->dl_sock, iov, n) < 0)
+			perror("send");
+		num -= n;
+	}
+}
+
+static void ul_send(struct bench *b, unsigned int num)
+{
+	struct bench_run *run = b->run;
+	struct l1ctl_info_ul *ul;
+
+	for (; num; num--) {
+		if (run->dir == BENCH_UL_RACH) {
+			struct l1ctl_rach_req *rach;
+
+			ul = l1ctl_put(b, L1CTL_RACH_REQ,
+			               sizeof(*ul) + sizeof(*rach));
+			if (!ul)
+				break;
+			ul->chan_nr = RSL_CHAN_RACH;
+			rach = (struct l1ctl_rach_req *)ul->payload;
+			rach->ra = run->sent & 0xff;
+			run->rach_ts[rach->ra] = now_ns();
+		} else {
+			struct bench_probe probe = {
+				.magic = BENCH_MAGIC,
+				.run = run->id,
+				.seq = run->sent,
+				.ts_ns = now_ns(),
+			};
+
+			ul = l1ctl_put(b, L1CTL_DATA_REQ,
+			               sizeof(*ul) + BENCH_MAC_BLOCK_LEN);
+			if (!ul)
+				break;
+			ul->chan_nr = rsl_enc_chan_nr(RSL_CHAN_SDCCH8_ACCH, 0,
+			                              1);
+			memset(ul->payload, GSM_MACBLOCK_PADDING,
+			       BENCH_MAC_BLOCK_LEN);
+			memcpy(ul->payload, &probe, sizeof(probe));
+		}
+		run->sent++;
+	}
+	l1ctl_flush(b);
+}
+
+/*
+ * Measurement
+ */
+
+static int clock_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct bench *b = ofd->data;
+	struct bench_run *run = b->run;
+	uint64_t expired, now = now_ns();
+	unsigned int due;
+
+	if (read(ofd->fd, &expired, sizeof(expired)) != sizeof(expired) ||
+	    !run)
+		return 0;
+
+	if (run->sent < run->count) {
+		// as many as should have been sent by now
+		due = (now - run->start_ns) * run->rate / 1e9;
+		if (due > run->count)
+			due = run->count;
+		if (due > run->sent) {
+			if (run->dir == BENCH_DL)
+				dl_send(b, due - run->sent);
+			else
+				ul_send(b, due - run->sent);
+		}
+		if (run->sent == run->count) {
+			run->end_ns = now_ns();
+			run->drain_until_ns = run->end_ns +
+			                2 * b->max_p99_ns + 2 * BENCH_FRAME_NS;
+		}
+	} else if (run->rcvd == run->sent || now >= run->drain_until_ns) {
+		run->done = 1;
+	}
+
+	return 0;
+}
+
+static int clock_start(struct bench *b, double rate)
+{
+	uint64_t tick = 1e9 / rate;
+	struct itimerspec its;
+
+	tick = OSMO_MAX(tick, BENCH_TICK_MIN_NS);
+	tick = OSMO_MIN(tick, BENCH_TICK_MAX_NS);
+	its.it_interval.tv_sec = its.it_value.tv_sec = 0;
+	its.it_interval.tv_nsec = its.it_value.tv_nsec = tick;
+
+	return timerfd_settime(b->clock.fd, 0, &its, NULL);
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* the smallest latency that p of the probes do not exceed */
+static uint32_t percentile(const uint32_t *sorted, unsigned int n, double p)
+{
+	unsigned int i = p * n;
+
+	if (!n)
+		return 0;
+	if (i >= n)
+		i = n - 1;
+	return sorted[i];
+}
+
+static void bench_run(struct bench *b, enum bench_dir dir, double rate,
+                      unsigned int count, struct bench_result *res)
+{
+	struct bench_run *run;
+
+	run = talloc_zero(b, struct bench_run);
+	run->dir = dir;
+	run->id = b->next_run_id++;
+	run->rate = rate;
+	run->count = count;
+	run->lat = talloc_array(run, uint32_t, count);
+	b->run = run;
+
+	clock_start(b, rate);
+	run->start_ns = now_ns();
+	while (!run->done)
+		osmo_select_main(0);
+	b->run = NULL;
+
+	qsort(run->lat, run->rcvd, sizeof(run->lat[0]), cmp_u32);
+	res->sent = run->sent;
+	res->rcvd = run->rcvd;
+	res->rate = run->sent * 1e9 / OSMO_MAX(run->end_ns - run->start_ns, 1);
+	res->p50 = percentile(run->lat, run->rcvd, 0.5);
+	res->p99 = percentile(run->lat, run->rcvd, 0.99);
+	res->p999 = percentile(run->lat, run->rcvd, 0.999);
+	res->max = run->rcvd ? run->lat[run->rcvd - 1] : 0;
+	talloc_free(run);
+}
+
+static int sustained(const struct bench *b, const struct bench_result *res,
+                     double rate)
+{
+	return res->rate >= rate * BENCH_MIN_SEND_RATE &&
+	       res->rcvd >= res->sent * BENCH_MIN_DELIVERY &&
+	       res->p99 <= b->max_p99_ns;
+}
+
+/* latency at a fixed rate, returns whether it stayed within the bound */
+static int bench_latency(struct bench *b, enum bench_dir dir, double rate,
+                         unsigned int count)
+{
+	struct bench_result res;
+
+	bench_run(b, dir, rate, count, &res);
+	printf("%-8s %6u/%-6u delivered at %6.0f/s, latency p50 %7.3f "
+	       "p99 %7.3f p99.9 %7.3f max %7.3f ms\n", bench_dir_names[dir],
+	       res.rcvd, res.sent, rate, res.p50 / 1e6, res.p99 / 1e6,
+	       res.p999 / 1e6, res.max / 1e6);
+	fflush(stdout);
+
+	return res.rcvd == res.sent && res.p99 <= b->max_p99_ns;
+}
+
+/* double the rate until it is no longer sustained */
+static void bench_max_rate(struct bench *b, enum bench_dir dir, double rate,
+                           double max_rate, double step_s)
+{
+	struct bench_result res;
+	double best = 0;
+
+	for (; rate <= max_rate; rate *= 2) {
+		bench_run(b, dir, rate, rate * step_s, &res);
+		printf("%-8s %8.0f/s offered, %8.0f/s sent, %6.2f%% delivered, "
+		       "p99 %7.3f ms\n", bench_dir_names[dir], rate, res.rate,
+		       res.sent ? 100.0 * res.rcvd / res.sent : 0,
+		       res.p99 / 1e6);
+		fflush(stdout);
+		if (!sustained(b, &res, rate))
+			break;
+		best = rate;
+	}
+	printf("%-8s max sustained rate %.0f/s%s\n", bench_dir_names[dir],
+	       best, rate > max_rate ? " (limit reached)" : "");
+	fflush(stdout);
+}
+
+static void print_help(void)
+{
+	printf(" -h --help		This text.\n");
+	printf(" -S --socket PATH	L1CTL socket of the virtphy (default "
+	       L1CTL_SOCK_PATH ").\n");
+	printf(" -A --arfcn ARFCN	ARFCN to tune to (default 1).\n");
+	printf(" -c --count N		Probes per latency measurement "
+	       "(default 1000).\n");
+	printf(" -r --rate N		Probes per second of the latency "
+	       "measurements (default 500).\n");
+	printf(" -M --max-rate N	Highest rate tried for the maximum "
+	       "sustained rate, 0 to skip it (default 100000).\n");
+	printf(" -t --step S		Seconds per rate tried (default 1).\n");
+	printf(" -L --latency MS	Bound of the 99th percentile "
+	       "(default 20).\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = L1CTL_SOCK_PATH;
+	unsigned int count = 1000;
+	double rate = 500, max_rate = 100000, step_s = 1;
+	int ok = 1, dir;
+	struct bench *b;
+
+	b = talloc_zero(NULL, struct bench);
+	b->arfcn = 1;
+	b->max_p99_ns = 20000000;
+
+	while (1) {
+		int option_index = 0, c;
+		static struct option long_options[] = {
+			{"help", 0, 0, 'h'},
+			{"socket", 1, 0, 'S'},
+			{"arfcn", 1, 0, 'A'},
+			{"count", 1, 0, 'c'},
+			{"rate", 1, 0, 'r'},
+			{"max-rate", 1, 0, 'M'},
+			{"step", 1, 0, 't'},
+			{"latency", 1, 0, 'L'},
+			{0, 0, 0, 0},
+		};
+
+		c = getopt_long(argc, argv, "hS:A:c:r:M:t:L:", long_options,
+		                &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'S':
+			path = optarg;
+			break;
+		case 'A':
+			b->arfcn = atoi(optarg);
+			break;
+		case 'c':
+			count = atoi(optarg);
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 'M':
+			max_rate = atof(optarg);
+			break;
+		case 't':
+			step_s = atof(optarg);
+			break;
+		case 'L':
+			b->max_p99_ns = atof(optarg) * 1e6;
+			break;
+		case 'h':
+		default:
+			print_help();
+			exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+	if (count < 1 || rate <= 0 || step_s <= 0 ||
+	    b->arfcn > GSMTAP_ARFCN_MASK) {
+		print_help();
+		return EXIT_FAILURE;
+	}
+
+	ms_log_init("DL1C,1:DVIRPHY,1");
+
+	b->fn_base_ns = now_ns();
+	b->dl_sock = mcast_server_sock_setup(b, DEFAULT_MS_MCAST_GROUP,
+	                DEFAULT_MS_MCAST_PORT, 1);
+	b->ul_sock = mcast_client_sock_setup(b, DEFAULT_BTS_MCAST_GROUP,
+	                DEFAULT_BTS_MCAST_PORT, ul_fd_cb, b);
+	if (!b->dl_sock || !b->ul_sock) {
+		fprintf(stderr, "cannot join the virtual Um groups\n");
+		return EXIT_FAILURE;
+	}
+
+	b->clock.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	b->clock.when = BSC_FD_READ;
+	b->clock.cb = clock_cb;
+	b->clock.data = b;
+	if (b->clock.fd < 0 || osmo_fd_register(&b->clock) < 0) {
+		perror("Failed to create the send clock");
+		return EXIT_FAILURE;
+	}
+
+	if (l1ctl_connect(b, path) < 0) {
+		fprintf(stderr, "%s: %s, is virtphy running?\n", path,
+		        strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if (l1ctl_setup(b) < 0) {
+		fprintf(stderr, "no L1CTL_FBSB_CONF from virtphy\n");
+		return EXIT_FAILURE;
+	}
+
+	for (dir = BENCH_DL; dir <= BENCH_UL_DATA; dir++)
+		ok &= bench_latency(b, dir, rate, count);
+	// the access bursts are told apart by their RA only, they do not
+	// get a rate of their own
+	if (max_rate > 0) {
+		bench_max_rate(b, BENCH_DL, rate, max_rate, step_s);
+		bench_max_rate(b, BENCH_UL_DATA, rate, max_rate, step_s);
+	}
+
+	close(b->l1ctl.fd);
+	talloc_free(b);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,182 @@
+/* Throughput and latency of the virtual Um transports. */
+
+/* (C) 2016 by the osmocom-bb contributors
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * One writer broadcasts GSMTAP sized frames to a number of readers, all
+ * of them virt_um instances in this process. Each frame carries the
+ * time it was queued at, readers compute the latency from it.
+ *
+ * usage: virt_um_bench [num_readers] [num_frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <osmocom/core/select.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
+
+#include "virtual_um.h"
+#include "logging.h"
+
+#define BENCH_GROUP		"239.193.23.1"
+#define BENCH_PORT		7000
+// each instance needs a group to transmit to, readers never do
+#define BENCH_DUMMY_GROUP	"239.193.23.2"
+#define BENCH_DUMMY_PORT	7001
+// size of a GSMTAP header plus a 23 byte MAC block
+#define BENCH_FRAME_LEN		(16 + 23)
+#define BENCH_MAX_READERS	64
+
+struct bench_reader {
+	struct virt_um_inst *vui;
+	unsigned int rx;
+	uint64_t lat_sum_ns;
+	uint64_t lat_max_ns;
+};
+
+static struct bench_reader readers[BENCH_MAX_READERS];
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_rx_cb(struct virt_um_inst *vui, struct msgb *msg)
+{
+	struct bench_reader *rd = vui->priv;
+	uint64_t sent, lat;
+
+	if (!msg)
+		return;
+	if (msgb_length(msg) == BENCH_FRAME_LEN) {
+		memcpy(&sent, msgb_data(msg), sizeof(sent));
+		lat = now_ns() - sent;
+		rd->rx++;
+		rd->lat_sum_ns += lat;
+		if (lat > rd->lat_max_ns)
+			rd->lat_max_ns = lat;
+	}
+	msgb_free(msg);
+}
+
+static void writer_rx_cb(struct virt_um_inst *vui, struct msgb *msg)
+{
+	msgb_free(msg);
+}
+
+static void run(const char *name, enum virt_um_transport transport,
+                unsigned int num_readers, unsigned int num_frames)
+{
+	struct virt_um_inst *writer;
+	uint64_t start, elapsed, lat_sum = 0, lat_max = 0;
+	unsigned int i, sent = 0, rx = 0, idle = 0;
+
+	writer = virt_um_init(NULL, BENCH_GROUP, BENCH_PORT, BENCH_DUMMY_GROUP,
+	                BENCH_DUMMY_PORT, writer_rx_cb, transport);
+	if (!writer) {
+		fprintf(stderr, "%s: cannot create the writer\n", name);
+		return;
+	}
+	for (i = 0; i < num_readers; i++) {
+		memset(&readers[i], 0, sizeof(readers[i]));
+		// the shm transport creates a ring per tx group, give each
+		// reader its own one
+		readers[i].vui = virt_um_init(NULL, BENCH_DUMMY_GROUP,
+		                BENCH_DUMMY_PORT + 1 + i, BENCH_GROUP, BENCH_PORT,
+		                bench_rx_cb, transport);
+		if (!readers[i].vui) {
+			fprintf(stderr, "%s: cannot create reader %u\n", name, i);
+			exit(EXIT_FAILURE);
+		}
+		readers[i].vui->priv = &readers[i];
+	}
+
+	// let the readers attach
+	for (i = 0; i < 100; i++)
+		osmo_select_main(1);
+
+	start = now_ns();
+	while (sent < num_frames || idle < 1000) {
+		if (sent < num_frames) {
+			// one batch per round, like the uplink of a busy frame
+			for (i = 0; i < VIRT_UM_TX_BATCH && sent < num_frames;
+			     i++, sent++) {
+				struct msgb *msg = msgb_alloc(VIRT_UM_MSGB_SIZE,
+				                "bench tx");
+				uint64_t t = now_ns();
+
+				memset(msgb_put(msg, BENCH_FRAME_LEN), 0,
+				       BENCH_FRAME_LEN);
+				memcpy(msgb_data(msg), &t, sizeof(t));
+				virt_um_write_msg(writer, msg);
+			}
+			virt_um_flush(writer);
+		}
+		if (osmo_select_main(1))
+			idle = 0;
+		else if (sent == num_frames)
+			idle++;
+	}
+	// the trailing idle rounds are not part of the transfer
+	elapsed = now_ns() - start;
+
+	for (i = 0; i < num_readers; i++) {
+		rx += readers[i].rx;
+		lat_sum += readers[i].lat_sum_ns;
+		if (readers[i].lat_max_ns > lat_max)
+			lat_max = readers[i].lat_max_ns;
+		virt_um_destroy(readers[i].vui);
+	}
+	virt_um_destroy(writer);
+
+	printf("%-6s %3u readers: %8u/%u frames delivered, %9.0f frames/s, "
+	       "latency avg %7.1f us max %8.1f us\n", name, num_readers, rx,
+	       num_frames * num_readers, rx * 1e9 / elapsed,
+	       rx ? lat_sum / 1e3 / rx : 0.0, lat_max / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int num_readers = 4, num_frames = 100000;
+
+	if (argc > 1)
+		num_readers = atoi(argv[1]);
+	if (argc > 2)
+		num_frames = atoi(argv[2]);
+	if (num_readers < 1 || num_readers > BENCH_MAX_READERS) {
+		fprintf(stderr, "1 to %u readers\n", BENCH_MAX_READERS);
+		return EXIT_FAILURE;
+	}
+
+	ms_log_init("DL1C,1:DVIRPHY,1");
+	osmo_select_set_backend(OSMO_SELECT_BACKEND_EPOLL);
+
+	run("mcast", VIRT_UM_T_MCAST, num_readers, num_frames);
+	run("shm", VIRT_UM_T_SHM, num_readers, num_frames);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,671 @@
+/* Burst-level virtual Um, channel coding on a pool of worker threads. */
+
+/* (C) 2016 by the osmocom-bb contributors
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Instead of whole L2 frames, the peers exchange the bursts a block is
+ * coded into, see virt_um_burst.h for their format. Received bursts are
+ * collected per logical channel until a block is complete or the frame
+ * number moves past it, blocks to send are split into bursts on the
+ * frames of their channel.
+ *
+ * The coding itself is done by worker threads, the select loop only
+ * queues jobs and picks up the completed ones when the workers signal
+ * an eventfd. Jobs, messages and the logical channels are only ever
+ * touched by the select loop, the workers only fill in the job data.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/gsmtap_util.h>
+#include <osmocom/core/bits.h>
+#include <osmocom/gsm/gsm_utils.h>
+#include <osmocom/gsm/gsm0503.h>
+
+#include "virt_um_burst.h"
+#include "logging.h"
+
+// fill octets of L2 blocks shorter than a MAC block
+#define VIRT_UM_BURST_PADDING	0x2b
+
+static const struct rate_ctr_desc virt_um_burst_ctr_description[] = {
+	[VIRT_UM_BURST_CTR_RX_BURSTS]	  = { "rx.bursts",	"Bursts received                      " },
+	[VIRT_UM_BURST_CTR_RX_BLOCKS]	  = { "rx.blocks",	"Blocks decoded                       " },
+	[VIRT_UM_BURST_CTR_RX_BAD_CRC]	  = { "rx.bad_crc",	"Blocks failing the CRC               " },
+	[VIRT_UM_BURST_CTR_RX_INCOMPLETE] = { "rx.incomplete",	"Blocks missing bursts                " },
+	[VIRT_UM_BURST_CTR_RX_DROP]	  = { "rx.drop",	"Bursts of unknown type or length     " },
+	[VIRT_UM_BURST_CTR_TX_BLOCKS]	  = { "tx.blocks",	"Blocks encoded and sent              " },
+	[VIRT_UM_BURST_CTR_QUEUE_FULL]	  = { "queue.full",	"Blocks dropped, coding queue full    " },
+};
+
+static const struct rate_ctr_group_desc virt_um_burst_ctrg_desc = {
+	.group_name_prefix = "virt_um.burst",
+	.group_description = "Burst-level virtual Um statistics",
+	.num_ctr = ARRAY_SIZE(virt_um_burst_ctr_description),
+	.ctr_desc = virt_um_burst_ctr_description,
+};
+
+/* frames between the bursts of a block of channel chan */
+static unsigned int burst_fn_step(uint8_t chan)
+{
+	switch (chan) {
+	case GSMTAP_CHANNEL_TCH_F | GSMTAP_CHANNEL_ACCH:
+	case GSMTAP_CHANNEL_TCH_H | GSMTAP_CHANNEL_ACCH:
+		return VIRT_UM_BURST_TCH_SACCH_STEP;
+	default:
+		return 1;
+	}
+}
+
+/* whether frame a comes after frame b, across the wrap of the frame
+ * number */
+static int burst_fn_after(uint32_t a, uint32_t b)
+{
+	uint32_t d = (a + GSM_MAX_FN - b) % GSM_MAX_FN;
+
+	return d && d < GSM_MAX_FN / 2;
+}
+
+/* do the coding of a job, runs on a worker */
+static void burst_job_run(struct gsm0503_batch *batch,
+                          struct virt_um_burst_job *job)
+{
+	ubit_t u[VIRT_UM_BURST_PER_BLOCK * GSM0503_BURST_BITS];
+
+	switch (job->type) {
+	case VIRT_UM_BURST_JOB_TX_XCCH:
+		gsm0503_xcch_encode_batch(batch, u, job->data, 1);
+		osmo_ubit2sbit(job->bits, u, sizeof(u));
+		break;
+	case VIRT_UM_BURST_JOB_TX_RACH:
+		gsm0503_rach_encode(u, job->data[0], job->bsic);
+		osmo_ubit2sbit(job->bits, u, GSM0503_RACH_BITS);
+		break;
+	case VIRT_UM_BURST_JOB_RX_XCCH:
+		job->rc = gsm0503_xcch_decode_batch(batch, job->data, job->bits,
+		                1, NULL) == 1 ? 0 : -1;
+		break;
+	case VIRT_UM_BURST_JOB_RX_RACH:
+		job->rc = gsm0503_rach_decode(job->data, job->bits, job->bsic);
+		break;
+	}
+}
+
+static void *burst_worker(void *data)
+{
+	struct virt_um_burst *vb = data;
+	struct virt_um_burst_job *job;
+	struct gsm0503_batch batch;
+	LLIST_HEAD(jobs);
+	uint64_t one = 1;
+	int i, wake;
+
+	gsm0503_batch_init(&batch);
+
+	pthread_mutex_lock(&vb->lock);
+	while (!vb->stop) {
+		if (llist_empty(&vb->pending)) {
+			pthread_cond_wait(&vb->work, &vb->lock);
+			continue;
+		}
+		// take a few at once, the lock is contended by the select
+		// loop queueing more
+		for (i = 0; i < VIRT_UM_BURST_WORKER_BATCH
+		            && !llist_empty(&vb->pending); i++)
+			llist_move_tail(vb->pending.next, &jobs);
+		vb->busy += i;
+		pthread_mutex_unlock(&vb->lock);
+
+		llist_for_each_entry(job, &jobs, list)
+			burst_job_run(&batch, job);
+
+		pthread_mutex_lock(&vb->lock);
+		// the select loop empties the list each time it is woken up
+		wake = llist_empty(&vb->done);
+		llist_splice_init(&jobs, vb->done.prev);
+		vb->busy -= i;
+		if (!vb->busy && llist_empty(&vb->pending))
+			pthread_cond_broadcast(&vb->idle);
+		if (wake)
+			write(vb->done_ofd.fd, &one, sizeof(one));
+	}
+	pthread_mutex_unlock(&vb->lock);
+
+	gsm0503_batch_deinit(&batch);
+
+	return NULL;
+}
+
+static struct virt_um_burst_job *burst_job_get(struct virt_um_burst *vb,
+                                               enum virt_um_burst_job_type type)
+{
+	struct virt_um_burst_job *job;
+
+	if (vb->num_queued >= VIRT_UM_BURST_QUEUE_MAX) {
+		rate_ctr_inc(&vb->ctrg->ctr[VIRT_UM_BURST_CTR_QUEUE_FULL]);
+		return NULL;
+	}
+
+	if (llist_empty(&vb->free_jobs)) {
+		job = talloc_zero(vb, struct virt_um_burst_job);
+		if (!job)
+			return NULL;
+	} else {
+		job = llist_entry(vb->free_jobs.next, struct virt_um_burst_job,
+		                  list);
+		llist_del(&job->list);
+	}
+	job->type = type;
+	vb->num_queued++;
+
+	return job;
+}
+
+static void burst_job_put(struct virt_um_burst *vb,
+                          struct virt_um_burst_job *job)
+{
+	vb->num_queued--;
+	llist_add(&job->list, &vb->free_jobs);
+}
+
+static void burst_job_queue(struct virt_um_burst *vb,
+                            struct virt_um_burst_job *job)
+{
+	pthread_mutex_lock(&vb->lock);
+	llist_add_tail(&job->list, &vb->pending);
+	pthread_cond_signal(&vb->work);
+	pthread_mutex_unlock(&vb->lock);
+}
+
+/* hand a decoded block to the receiver, as if it came from the virt um */
+static void burst_rx_complete(struct virt_um_burst *vb,
+                              struct virt_um_burst_job *job)
+{
+	unsigned int len = GSM0503_XCCH_L2_LEN;
+	struct msgb *msg;
+
+	if (job->rc < 0) {
+		rate_ctr_inc(&vb->ctrg->ctr[VIRT_UM_BURST_CTR_RX_BAD_CRC]);
+		return;
+	}
+	rate_ctr_inc(&vb->ctrg->ctr[VIRT_UM_BURST_CTR_RX_BLOCKS]);
+
+	if (job->type == VIRT_UM_BURST_JOB_RX_RACH)
+		len = 1;
+	msg = msgb_alloc_headroom_nozero(VIRT_UM_MSGB_SIZE,
+	                VIRT_UM_MSGB_HEADROOM, "Virtual UM Rx");
+	if (!msg)
+		return;
+	memcpy(msgb_put(msg, sizeof(job->gh)), &job->gh, sizeof(job->gh));
+	memcpy(msgb_put(msg, len), job->data, len);
+	vb->block_cb(vb->vui, msg);
+}
+
+/* send the bursts of an encoded block, on the frames of its channel */
+static void burst_tx_complete(struct virt_um_burst *vb,
+                              struct virt_um_burst_job *job)
+{
+	const struct gsmtap_hdr *bh = &job->gh;
+	uint32_t fn = ntohl(bh->frame_number);
+	unsigned int step = burst_fn_step(bh->sub_type);
+	uint8_t burst_type = GSMTAP_BURST_NORMAL;
+	unsigned int num = VIRT_UM_BURST_PER_BLOCK;
+	unsigned int len = GSM0503_BURST_BITS;
+	struct gsmtap_hdr *gh;
+	struct msgb *msg;
+	unsigned int i;
+
+	if (job->type == VIRT_UM_BURST_JOB_TX_RACH) {
+		burst_type = GSMTAP_BURST_ACCESS;
+		num = 1;
+		len = GSM0503_RACH_BITS;
+	}
+
+	for (i = 0; i < num; i++) {
+		msg = gsmtap_makemsg_ex(GSMTAP_TYPE_UM_BURST, ntohs(bh->arfcn),
+		                bh->timeslot, burst_type,
+		                VIRT_UM_BURST_SS(bh->sub_slot, i),
+		                (fn + i * step) % GSM_MAX_FN, bh->signal_dbm, 0,
+		                (const uint8_t *) &job->bits[i * len], len);
+		if (!msg) {
+			LOGP(DVIRPHY, LOGL_ERROR, "Gsmtap burst could not be "
+			     "created!\n");
+			return;
+		}
+		gh = (struct gsmtap_hdr *) msgb_data(msg);
+		gh->res = bh->sub_type;
+		virt_um_write_msg(vb->vui, msg);
+	}
+	rate_ctr_inc(&vb->ctrg->ctr[VIRT_UM_BURST_CTR_TX_BLOCKS]);
+}
+
+/* pick up the jobs the workers completed */
+static void burst_complete(struct virt_um_burst *vb)
+{
+	struct virt_um_burst_job *job, *tmp;
+	LLIST_HEAD(done);
+	int tx = 0;
+
+	pthread_mutex_lock(&vb->lock);
+	llist_splice_init(&vb->done, &done);
+	pthread_mutex_unlock(&vb->lock);
+
+	llist_for_each_entry_safe(job, tmp, &done, list) {
+		llist_del(&job->list);
+		switch (job->type) {
+		case VIRT_UM_BURST_JOB_TX_XCCH:
+		case VIRT_UM_BURST_JOB_TX_RACH:
+			burst_tx_complete(vb, job);
+			tx = 1;
+			break;
+		case VIRT_UM_BURST_JOB_RX_XCCH:
+		case VIRT_UM_BURST_JOB_RX_RACH:
+			burst_rx_complete(vb, job);
+			break;
+		}
+		burst_job_put(vb, job);
+	}
+
+	if (tx)
+		virt_um_flush(vb->vui);
+}
+
+static int burst_done_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct virt_um_burst *vb = ofd->data;
+	uint64_t num;
+
+	// reset the eventfd before looking at the list, the workers
+	// signal again for anything added after that
+	if (read(ofd->fd, &num, sizeof(num)) != sizeof(num))
+		return 0;
+	burst_complete(vb);
+
+	return 0;
+}
+
+/**
+ * Set up burst-level coding of the frames of a virt um.
+ *
+ * Blocks decoded from received bursts are handed to block_cb as
+ * GSMTAP_TYPE_UM frames, the same way the virt um hands over frames it
+ * received.
+ */
+struct virt_um_burst *virt_um_burst_init(void *ctx, struct virt_um_inst *vui,
+                unsigned int num_workers,
+                void (*block_cb)(struct virt_um_inst *vui, struct msgb *msg))
+{
+	struct virt_um_burst *vb;
+	unsigned int i;
+
+	if (num_workers < 1 || num_workers > VIRT_UM_BURST_WORKERS_MAX) {
+		LOGP(DVIRPHY, LOGL_ERROR, "Need 1 to %u coding workers\n",
+		     VIRT_UM_BURST_WORKERS_MAX);
+		return NULL;
+	}
+
+	vb = talloc_zero(ctx, struct virt_um_burst);
+	if (!vb)
+		return NULL;
+	vb->vui = vui;
+	vb->block_cb = block_cb;
+	for (i = 0; i < VIRT_UM_BURST_LCHAN_HASH; i++)
+		INIT_LLIST_HEAD(&vb->lchans[i]);
+	INIT_LLIST_HEAD(&vb->partial);
+	INIT_LLIST_HEAD(&vb->free_lchans);
+	INIT_LLIST_HEAD(&vb->free_jobs);
+	INIT_LLIST_HEAD(&vb->pending);
+	INIT_LLIST_HEAD(&vb->done);
+	pthread_mutex_init(&vb->lock, NULL);
+	pthread_cond_init(&vb->work, NULL);
+	pthread_cond_init(&vb->idle, NULL);
+	vb->ctrg = rate_ctr_group_alloc(vb, &virt_um_burst_ctrg_desc, 0);
+
+	vb->done_ofd.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (vb->done_ofd.fd < 0) {
+		perror("Failed to create burst coding eventfd");
+		goto err;
+	}
+	vb->done_ofd.when = BSC_FD_READ;
+	vb->done_ofd.cb = burst_done_cb;
+	vb->done_ofd.data = vb;
+	if (osmo_fd_register(&vb->done_ofd) != 0) {
+		close(vb->done_ofd.fd);
+		goto err;
+	}
+
+	for (i = 0; i < num_workers; i++) {
+		if (pthread_create(&vb->workers[i], NULL, burst_worker, vb)) {
+			perror("Failed to start burst coding worker");
+			vb->num_workers = i;
+			virt_um_burst_destroy(vb);
+			return NULL;
+		}
+	}
+	vb->num_workers = num_workers;
+
+	return vb;
+
+err:
+	rate_ctr_group_free(vb->ctrg);
+	talloc_free(vb);
+	return NULL;
+}
+
+/**
+ * Stop the workers, jobs not completed yet are dropped.
+ */
+void virt_um_burst_destroy(struct virt_um_burst *vb)
+{
+	unsigned int i;
+
+	if (!vb)
+		return;
+
+	pthread_mutex_lock(&vb->lock);
+	vb->stop = 1;
+	pthread_cond_broadcast(&vb->work);
+	pthread_mutex_unlock(&vb->lock);
+	for (i = 0; i < vb->num_workers; i++)
+		pthread_join(vb->workers[i], NULL);
+
+	osmo_fd_unregister(&vb->done_ofd);
+	close(vb->done_ofd.fd);
+	pthread_cond_destroy(&vb->idle);
+	pthread_cond_destroy(&vb->work);
+	pthread_mutex_destroy(&vb->lock);
+	rate_ctr_group_free(vb->ctrg);
+	// jobs and logical channels are allocated from vb
+	talloc_free(vb);
+}
+
+/**
+ * Wait for the workers to code all queued jobs and complete them.
+ */
+void virt_um_burst_flush(struct virt_um_burst *vb)
+{
+	pthread_mutex_lock(&vb->lock);
+	while (vb->busy || !llist_empty(&vb->pending))
+		pthread_cond_wait(&vb->idle, &vb->lock);
+	pthread_mutex_unlock(&vb->lock);
+
+	burst_complete(vb);
+}
+
+static struct llist_head *burst_lchan_head(struct virt_um_burst *vb,
+                                           uint16_t arfcn, uint8_t tn)
+{
+	return &vb->lchans[((arfcn & GSMTAP_ARFCN_MASK) * 8 + tn)
+	                   % VIRT_UM_BURST_LCHAN_HASH];
+}
+
+/* start receiving a block of a logical channel, its first and last
+ * frame are fn and last_fn */
+static struct virt_um_burst_lchan *burst_lchan_start(struct virt_um_burst *vb,
+                const struct gsmtap_hdr *gh, uint8_t ss, uint32_t fn,
+                uint32_t last_fn)
+{
+	struct virt_um_burst_lchan *lchan, *prev;
+	struct virt_um_burst_job *job;
+
+	job = burst_job_get(vb, VIRT_UM_BURST_JOB_RX_XCCH);
+	if (!job)
+		return NULL;
+
+	if (llist_empty(&vb->free_lchans)) {
+		lchan = talloc_zero(vb, struct virt_um_burst_lchan);
+		if (!lchan) {
+			burst_job_put(vb, job);
+			return NULL;
+		}
+	} else {
+		lchan = llist_entry(vb->free_lchans.next,
+		                    struct virt_um_burst_lchan, list);
+		llist_del(&lchan->list);
+	}
+
+	// the block goes on as one frame of the logical channel
+	job->gh = *gh;
+	job->gh.hdr_len = sizeof(job->gh) / 4;
+	job->gh.type = GSMTAP_TYPE_UM;
+	job->gh.frame_number = htonl(fn);
+	job->gh.sub_type = gh->res;
+	job->gh.sub_slot = ss;
+	job->gh.res = 0;
+
+	lchan->arfcn = ntohs(gh->arfcn);
+	lchan->tn = gh->timeslot;
+	lchan->chan = gh->res;
+	lchan->ss = ss;
+	lchan->fn = fn;
+	lchan->last_fn = last_fn;
+	lchan->mask = 0;
+	lchan->job = job;
+	llist_add(&lchan->list, burst_lchan_head(vb, lchan->arfcn, lchan->tn));
+
+	// after the last block ending no later, mostly the tail
+	llist_for_each_entry_reverse(prev, &vb->partial, expire_list) {
+		if (!burst_fn_after(prev->last_fn, last_fn))
+			break;
+	}
+	llist_add(&lchan->expire_list, &prev->expire_list);
+
+	return lchan;
+}
+
+/* done with the block of a logical channel, its job is queued or put */
+static void burst_lchan_release(struct virt_um_burst *vb,
+                                struct virt_um_burst_lchan *lchan)
+{
+	llist_del(&lchan->expire_list);
+	llist_del(&lchan->list);
+	lchan->job = NULL;
+	llist_add(&lchan->list, &vb->free_lchans);
+}
+
+/* drop the partial blocks whose last frame is before fn, their missing
+ * bursts will not come any more */
+static void burst_expire(struct virt_um_burst *vb, uint32_t fn)
+{
+	struct virt_um_burst_lchan *lchan;
+
+	while (!llist_empty(&vb->partial)) {
+		lchan = llist_entry(vb->partial.next,
+		                    struct virt_um_burst_lchan, expire_list);
+		if (!burst_fn_after(fn, lchan->last_fn))
+			break;
+		rate_ctr_inc(&vb->ctrg->ctr[VIRT_UM_BURST_CTR_RX_INCOMPLETE]);
+		burst_job_put(vb, lchan->job);
+		burst_lchan_release(vb, lchan);
+	}
+}
+
+/* a normal burst, queued for decoding once its block is complete */
+static void burst_rx_normal(struct virt_um_burst *vb,
+                            const struct gsmtap_hdr *gh, const sbit_t *bits)
+{
+	uint8_t bid = VIRT_UM_BURST_SS_BID(gh->sub_slot);
+	uint8_t ss = VIRT_UM_BURST_SS_SS(gh->sub_slot);
+	uint16_t arfcn = ntohs(gh->arfcn);
+	unsigned int step = burst_fn_step(gh->res);
+	struct virt_um_burst_lchan *lchan, *found = NULL;
+	uint32_t fn;
+
+	if (bid >= VIRT_UM_BURST_PER_BLOCK) {
+		rate_ctr_inc(&vb->ctrg->ctr[VIRT_UM_BURST_CTR_RX_DROP]);
+		return;
+	}
+
+	fn = ntohl(gh->frame_number);
+	burst_expire(vb, fn);
+	fn = (fn + GSM_MAX_FN - bid * step) % GSM_MAX_FN;
+
+	llist_for_each_entry(lchan, burst_lchan_head(vb, arfcn, gh->timeslot),
+	                     list) {
+		if (lchan->arfcn == arfcn && lchan->tn == gh->timeslot
+		    && lchan->chan == gh->res && lchan->ss == ss) {
+			found = lchan;
+			break;
+		}
+	}
+	lchan = found;
+	if (lchan && (lchan->fn != fn || lchan->mask & (1 << bid))) {
+		// bursts of the previous block got lost
+		rate_ctr_inc(&vb->ctrg->ctr[VIRT_UM_BURST_CTR_RX_INCOMPLETE]);
+		burst_job_put(vb, lchan->job);
+		burst_lchan_release(vb, lchan);
+		lchan = NULL;
+	}
+	if (!lchan) {
+		lchan = burst_lchan_start(vb, gh, ss, fn,
+		                (fn + (VIRT_UM_BURST_PER_BLOCK - 1) * step)
+		                % GSM_MAX_FN);
+		if (!lchan)
+			return;
+	}
+
+	memcpy(&lchan->job->bits[bid * GSM0503_BURST_BITS], bits,
+	       GSM0503_BURST_BITS);
+	lchan->mask |= 1 << bid;
+	if (lchan->mask == (1 << VIRT_UM_BURST_PER_BLOCK) - 1) {
+		burst_job_queue(vb, lchan->job);
+		burst_lchan_release(vb, lchan);
+	}
+}
+
+/* an access burst, a block of its own */
+static void burst_rx_access(struct virt_um_burst *vb,
+                            const struct gsmtap_hdr *gh, const sbit_t *bits)
+{
+	struct virt_um_burst_job *job;
+
+	job = burst_job_get(vb, VIRT_UM_BURST_JOB_RX_RACH);
+	if (!job)
+		return;
+	job->gh = *gh;
+	job->gh.hdr_len = sizeof(job->gh) / 4;
+	job->gh.type = GSMTAP_TYPE_UM;
+	job->gh.sub_type = GSMTAP_CHANNEL_RACH;
+	job->gh.sub_slot = 0;
+	job->gh.res = 0;
+	job->bsic = vb->rach_bsic_cb ? vb->rach_bsic_cb(vb->vui,
+	                ntohs(gh->arfcn) & GSMTAP_ARFCN_MASK) : VIRT_UM_BSIC;
+	memcpy(job->bits, bits, GSM0503_RACH_BITS);
+	burst_job_queue(vb, job);
+}
+
+/**
+ * Receive a GSMTAP_TYPE_UM_BURST frame from the virt um, this frees it.
+ */
+void virt_um_burst_rx(struct virt_um_burst *vb, struct msgb *msg)
+{
+	const struct gsmtap_hdr *gh = (const struct gsmtap_hdr *) msgb_data(msg);
+	unsigned int hdr_len, len;
+	const sbit_t *bits;
+
+	rate_ctr_inc(&vb->ctrg->ctr[VIRT_UM_BURST_CTR_RX_BURSTS]);
+
+	if (msgb_length(msg) < sizeof(*gh)
+	    || msgb_length(msg) < gh->hdr_len * 4) {
+		rate_ctr_inc(&vb->ctrg->ctr[VIRT_UM_BURST_CTR_RX_DROP]);
+		goto out;
+	}
+	hdr_len = gh->hdr_len * 4;
+	len = msgb_length(msg) - hdr_len;
+	bits = (const sbit_t *) msgb_data(msg) + hdr_len;
+
+	if (gh->sub_type == GSMTAP_BURST_NORMAL && len >= GSM0503_BURST_BITS)
+		burst_rx_normal(vb, gh, bits);
+	else if (gh->sub_type == GSMTAP_BURST_ACCESS
+	         && len >= GSM0503_RACH_BITS)
+		burst_rx_access(vb, gh, bits);
+	else
+		rate_ctr_inc(&vb->ctrg->ctr[VIRT_UM_BURST_CTR_RX_DROP]);
+
+out:
+	msgb_free(msg);
+}
+
+/**
+ * Queue an L2 block of an xCCH for sending as 4 normal bursts, the first
+ * on frame fn and the others on the following frames of the channel.
+ *
+ * Blocks shorter than a MAC block are padded.
+ */
+int virt_um_burst_tx_block(struct virt_um_burst *vb, uint16_t arfcn,
+                           uint8_t tn, uint8_t chan, uint8_t ss, uint32_t fn,
+                           int8_t signal_dbm, const uint8_t *l2,
+                           unsigned int len)
+{
+	struct virt_um_burst_job *job;
+
+	job = burst_job_get(vb, VIRT_UM_BURST_JOB_TX_XCCH);
+	if (!job)
+		return -ENOMEM;
+
+	memset(&job->gh, 0, sizeof(job->gh));
+	job->gh.arfcn = htons(arfcn);
+	job->gh.timeslot = tn;
+	job->gh.sub_type = chan;
+	job->gh.sub_slot = ss;
+	job->gh.frame_number = htonl(fn);
+	job->gh.signal_dbm = signal_dbm;
+	if (len > GSM0503_XCCH_L2_LEN)
+		len = GSM0503_XCCH_L2_LEN;
+	memcpy(job->data, l2, len);
+	memset(job->data + len, VIRT_UM_BURST_PADDING,
+	       GSM0503_XCCH_L2_LEN - len);
+	burst_job_queue(vb, job);
+
+	return 0;
+}
+
+/**
+ * Queue an access burst for sending on frame fn.
+ */
+int virt_um_burst_tx_rach(struct virt_um_burst *vb, uint16_t arfcn,
+                          uint8_t tn, uint32_t fn, uint8_t ra, uint8_t bsic)
+{
+	struct virt_um_burst_job *job;
+
+	job = burst_job_get(vb, VIRT_UM_BURST_JOB_TX_RACH);
+	if (!job)
+		return -ENOMEM;
+
+	memset(&job->gh, 0, sizeof(job->gh));
+	job->gh.arfcn = htons(arfcn);
+	job->gh.timeslot = tn;
+	job->gh.sub_type = GSMTAP_CHANNEL_RACH;
+	job->gh.frame_number = htonl(fn);
+	job->bsic = bsic;
+	job->data[0] = ra;
+	burst_job_queue(vb, job);
+
+	return 0;
+}
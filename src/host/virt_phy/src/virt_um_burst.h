@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stdint.h>
+#include <pthread.h>
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/gsmtap.h>
+#include <osmocom/gsm/gsm0503.h>
+
+#include "virtual_um.h"
+
+// upper limit of coding worker threads
+#define VIRT_UM_BURST_WORKERS_MAX	16
+// jobs a worker takes from the queue at once
+#define VIRT_UM_BURST_WORKER_BATCH	8
+// jobs queued for the workers beyond which blocks are dropped
+#define VIRT_UM_BURST_QUEUE_MAX	1024
+// number of hash buckets for the logical channel lookup
+#define VIRT_UM_BURST_LCHAN_HASH	64
+// bursts of an xCCH block
+#define VIRT_UM_BURST_PER_BLOCK	4
+// frames between the bursts of the SACCH of a TCH, one per 26-multiframe
+#define VIRT_UM_BURST_TCH_SACCH_STEP	26
+
+/*
+ * Burst frames are GSMTAP_TYPE_UM_BURST frames with the burst type
+ * (GSMTAP_BURST_NORMAL or GSMTAP_BURST_ACCESS) as sub_type. As the
+ * bursts alone do not tell which logical channel they belong to, the
+ * otherwise reserved res field carries its GSMTAP_CHANNEL_* and the
+ * upper bits of sub_slot the number of the burst within its block.
+ *
+ * The payload is one soft bit per byte, -127..127 and negative for 1,
+ * so a sender may add noise: the 116 bits e(B,0..115) of a normal
+ * burst, see gsm0503.h, or the 36 coded bits of an access burst.
+ *
+ * The bursts of a block are on the frames of its channel: consecutive
+ * ones on the 51-multiframe, one per 26-multiframe for the SACCH of a
+ * TCH. The frame number of a block is that of its first burst.
+ */
+#define VIRT_UM_BURST_SS(ss, bid)	((ss) | ((bid) << 6))
+#define VIRT_UM_BURST_SS_SS(sub_slot)	((sub_slot) & 0x3f)
+#define VIRT_UM_BURST_SS_BID(sub_slot)	((sub_slot) >> 6)
+
+/* counters of the "virt_um.burst" rate_ctr group */
+enum virt_um_burst_ctr {
+	VIRT_UM_BURST_CTR_RX_BURSTS,	/* bursts received */
+	VIRT_UM_BURST_CTR_RX_BLOCKS,	/* blocks decoded */
+	VIRT_UM_BURST_CTR_RX_BAD_CRC,	/* blocks failing the CRC */
+	VIRT_UM_BURST_CTR_RX_INCOMPLETE,/* blocks missing bursts */
+	VIRT_UM_BURST_CTR_RX_DROP,	/* bursts of unknown type or length */
+	VIRT_UM_BURST_CTR_TX_BLOCKS,	/* blocks encoded and sent */
+	VIRT_UM_BURST_CTR_QUEUE_FULL,	/* blocks dropped, workers too slow */
+};
+
+enum virt_um_burst_job_type {
+	VIRT_UM_BURST_JOB_TX_XCCH,
+	VIRT_UM_BURST_JOB_TX_RACH,
+	VIRT_UM_BURST_JOB_RX_XCCH,
+	VIRT_UM_BURST_JOB_RX_RACH,
+};
+
+/* One block to be coded by a worker. */
+struct virt_um_burst_job {
+	struct llist_head list;
+	enum virt_um_burst_job_type type;
+	// GSMTAP header of the block, GSMTAP_TYPE_UM and network order
+	struct gsmtap_hdr gh;
+	uint8_t bsic;
+	// L2 block, or the ra byte of an access burst
+	uint8_t data[GSM0503_XCCH_L2_LEN];
+	// the coded bursts
+	sbit_t bits[VIRT_UM_BURST_PER_BLOCK * GSM0503_BURST_BITS];
+	// decoding only, 0 or -1 if the CRC does not match
+	int rc;
+};
+
+/* A block of one logical channel being received, it only exists until
+ * the block is complete or expires, each holds one of the queued jobs. */
+struct virt_um_burst_lchan {
+	// in the hash bucket of the channel
+	struct llist_head list;
+	// in the list of partial blocks, by last frame
+	struct llist_head expire_list;
+	uint16_t arfcn;
+	uint8_t tn;
+	uint8_t chan;
+	uint8_t ss;
+	// first and last frame of the block, bursts received of it
+	uint32_t fn;
+	uint32_t last_fn;
+	uint8_t mask;
+	struct virt_um_burst_job *job;
+};
+
+/* Burst-level coding of the frames of a virt um. */
+struct virt_um_burst {
+	struct virt_um_inst *vui;
+	// decoded blocks, as GSMTAP_TYPE_UM frames a virt um receives
+	void (*block_cb)(struct virt_um_inst *vui, struct msgb *msg);
+	// BSIC of the cell on arfcn access bursts are decoded with,
+	// VIRT_UM_BSIC if NULL
+	uint8_t (*rach_bsic_cb)(struct virt_um_inst *vui, uint16_t arfcn);
+
+	// select loop only
+	struct llist_head lchans[VIRT_UM_BURST_LCHAN_HASH];
+	// partial blocks, the one ending first at the head
+	struct llist_head partial;
+	struct llist_head free_lchans;
+	struct llist_head free_jobs;
+	unsigned int num_queued;
+	struct rate_ctr_group *ctrg;
+	// the workers signal completed jobs here
+	struct osmo_fd done_ofd;
+
+	// shared with the workers, under lock
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t idle;
+	struct llist_head pending;
+	struct llist_head done;
+	unsigned int busy;
+	int stop;
+
+	pthread_t workers[VIRT_UM_BURST_WORKERS_MAX];
+	unsigned int num_workers;
+};
+
+struct virt_um_burst *virt_um_burst_init(void *ctx, struct virt_um_inst *vui,
+                unsigned int num_workers,
+                void (*block_cb)(struct virt_um_inst *vui, struct msgb *msg));
+
+void virt_um_burst_destroy(struct virt_um_burst *vb);
+
+void virt_um_burst_rx(struct virt_um_burst *vb, struct msgb *msg);
+
+int virt_um_burst_tx_block(struct virt_um_burst *vb, uint16_t arfcn,
+                           uint8_t tn, uint8_t chan, uint8_t ss, uint32_t fn,
+                           int8_t signal_dbm, const uint8_t *l2,
+                           unsigned int len);
+
+int virt_um_burst_tx_rach(struct virt_um_burst *vb, uint16_t arfcn,
+                          uint8_t tn, uint32_t fn, uint8_t ra, uint8_t bsic);
+
+void virt_um_burst_flush(struct virt_um_burst *vb);
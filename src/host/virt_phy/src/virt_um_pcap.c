@@ -0,0 +1,649 @@
+/* Record the virtual Um to a pcap file and replay it. */
+
+/* (C) 2016 by the osmocom-bb contributors
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Recording joins the downlink (MS) and uplink (BTS) multicast groups
+ * and appends every GSMTAP frame to a pcap file as an IPv4/UDP packet
+ * addressed to the group it was received on, like tcpdump would have
+ * captured it. The file is preallocated and written through a shared
+ * mapping.
+ *
+ * Replay sends the frames of such a file (or of a tcpdump capture) to
+ * the group:port they were addressed to. Frames are paced by their
+ * GSMTAP frame number, in real time, N times as fast, or as fast as the
+ * sockets take them.
+ *
+ * usage: virt_um_pcap -w FILE [-S MiB] [-c frames]
+ *        virt_um_pcap -r FILE [-x speed | -f] [-l loops]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <osmocom/core/select.h>
+#include <osmocom/core/gsmtap.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/gsm/gsm_utils.h>
+
+#include "virtual_um.h"
+#include "osmo_mcast_sock.h"
+#include "logging.h"
+
+#define PCAP_MAGIC_NS		0xa1b23c4d
+#define PCAP_MAGIC_US		0xa1b2c3d4
+#define LINKTYPE_ETHERNET	1
+#define LINKTYPE_RAW		101
+#define LINKTYPE_IPV4		228
+#define PCAP_SNAPLEN		65535
+// largest UDP payload IPv4 can carry, datagrams are never cut when
+// recording, whatever the MTU of the interface the groups live on
+#define RECORD_MAX_DGRAM	(65535 - 20 - 8)
+
+// a TDMA frame lasts 120/26 ms
+#define GSM_FRAME_NS		4615385ULL
+// most destinations a replayed file may address
+#define PCAP_MAX_DEST		8
+
+struct pcap_file_hdr {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+} __attribute__((packed));
+
+struct pcap_rec_hdr {
+	uint32_t ts_sec;
+	uint32_t ts_frac;	// ns or us, depending on the magic
+	uint32_t incl_len;
+	uint32_t orig_len;
+} __attribute__((packed));
+
+struct ipv4_udp_hdr {
+	uint8_t ver_ihl;
+	uint8_t tos;
+	uint16_t tot_len;
+	uint16_t id;
+	uint16_t frag_off;
+	uint8_t ttl;
+	uint8_t proto;
+	uint16_t check;
+	uint32_t saddr;
+	uint32_t daddr;
+	uint16_t sport;
+	uint16_t dport;
+	uint16_t udp_len;
+	uint16_t udp_check;
+} __attribute__((packed));
+
+static volatile int quit;
+
+static void sig_cb(int sig)
+{
+	quit = 1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Recording
+ */
+
+struct pcap_writer {
+	int fd;
+	uint8_t *map;
+	size_t size;		// of the file and the mapping
+	size_t used;
+	unsigned int frames;
+	unsigned int max_frames;	// 0: until interrupted
+};
+
+static int pcap_writer_map(struct pcap_writer *pw, size_t size)
+{
+	int rc;
+
+	if (pw->map)
+		munmap(pw->map, pw->size);
+	pw->map = NULL;
+
+	// allocate the blocks now rather than on the first write fault
+	rc = posix_fallocate(pw->fd, 0, size);
+	if (rc) {
+		errno = rc;
+		return -1;
+	}
+	pw->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	               pw->fd, 0);
+	if (pw->map == MAP_FAILED) {
+		pw->map = NULL;
+		return -1;
+	}
+	pw->size = size;
+
+	return 0;
+}
+
+static int pcap_writer_open(struct pcap_writer *pw, const char *fname,
+                            size_t size)
+{
+	struct pcap_file_hdr hdr = {
+		.magic = PCAP_MAGIC_NS,
+		.version_major = 2,
+		.version_minor = 4,
+		.snaplen = PCAP_SNAPLEN,
+		.linktype = LINKTYPE_IPV4,
+	};
+
+	memset(pw, 0, sizeof(*pw));
+	pw->fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (pw->fd < 0 || pcap_writer_map(pw, size) < 0) {
+		fprintf(stderr, "%s: %s\n", fname, strerror(errno));
+		return -1;
+	}
+	memcpy(pw->map, &hdr, sizeof(hdr));
+	pw->used = sizeof(hdr);
+
+	return 0;
+}
+
+static uint16_t ip_checksum(const void *data, unsigned int len)
+{
+	const uint16_t *p = data;
+	uint32_t sum = 0;
+
+	for (; len > 1; len -= 2)
+		sum += *p++;
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum;
+}
+
+static int pcap_writer_add(struct pcap_writer *pw, const struct timespec *ts,
+                           const struct sockaddr_in *dst,
+                           const uint8_t *data, unsigned int len)
+{
+	struct pcap_rec_hdr rec;
+	struct ipv4_udp_hdr ip;
+	size_t need = sizeof(rec) + sizeof(ip) + len;
+
+	if (pw->used + need > pw->size &&
+	    pcap_writer_map(pw, pw->size * 2) < 0)
+		return -1;
+
+	memset(&ip, 0, sizeof(ip));
+	ip.ver_ihl = 0x45;
+	ip.tot_len = htons(sizeof(ip) + len);
+	ip.ttl = 1;
+	ip.proto = IPPROTO_UDP;
+	ip.saddr = htonl(INADDR_LOOPBACK);
+	ip.daddr = dst->sin_addr.s_addr;
+	ip.check = ip_checksum(&ip, 20);
+	ip.sport = dst->sin_port;
+	ip.dport = dst->sin_port;
+	ip.udp_len = htons(8 + len);
+
+	rec.ts_sec = ts->tv_sec;
+	rec.ts_frac = ts->tv_nsec;
+	rec.incl_len = rec.orig_len = sizeof(ip) + len;
+
+	memcpy(pw->map + pw->used, &rec, sizeof(rec));
+	memcpy(pw->map + pw->used + sizeof(rec), &ip, sizeof(ip));
+	memcpy(pw->map + pw->used + sizeof(rec) + sizeof(ip), data, len);
+	pw->used += need;
+	pw->frames++;
+
+	return 0;
+}
+
+static void pcap_writer_close(struct pcap_writer *pw)
+{
+	if (pw->map)
+		munmap(pw->map, pw->size);
+	// drop the preallocated space that was not used
+	if (ftruncate(pw->fd, pw->used) < 0)
+		perror("ftruncate");
+	close(pw->fd);
+}
+
+struct record_group {
+	struct pcap_writer *pw;
+	struct mcast_client_sock *sock;
+	struct sockaddr_in addr;
+};
+
+static int record_fd_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct record_group *grp = ofd->data;
+	// too large for the stack, the groups take turns using it
+	static uint8_t bufs[MCAST_SOCK_BATCH_MAX][RECORD_MAX_DGRAM];
+	struct iovec iov[MCAST_SOCK_BATCH_MAX];
+	int rx_len[MCAST_SOCK_BATCH_MAX];
+	struct timespec ts;
+	int i, rc;
+
+	if (!(what & BSC_FD_READ))
+		return 0;
+
+	for (i = 0; i < MCAST_SOCK_BATCH_MAX; i++) {
+		iov[i].iov_base = bufs[i];
+		iov[i].iov_len = sizeof(bufs[i]);
+	}
+	rc = mcast_client_sock_rx_batch(grp->sock, iov, rx_len,
+	                MCAST_SOCK_BATCH_MAX);
+	if (rc <= 0)
+		return 0;
+
+	// one batch arrived at once, one timestamp will do
+	clock_gettime(CLOCK_REALTIME, &ts);
+	for (i = 0; i < rc; i++) {
+		if (pcap_writer_add(grp->pw, &ts, &grp->addr, bufs[i],
+		                    rx_len[i]) < 0) {
+			perror("pcap");
+			quit = 1;
+			break;
+		}
+		if (grp->pw->max_frames &&
+		    grp->pw->frames >= grp->pw->max_frames) {
+			quit = 1;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static int record_group_init(struct record_group *grp,
+                             struct pcap_writer *pw, char *group,
+                             uint16_t port)
+{
+	grp->pw = pw;
+	grp->addr.sin_family = AF_INET;
+	grp->addr.sin_addr.s_addr = inet_addr(group);
+	grp->addr.sin_port = htons(port);
+	grp->sock = mcast_client_sock_setup(NULL, group, port, record_fd_cb,
+	                grp);
+
+	return grp->sock ? 0 : -1;
+}
+
+static int record(const char *fname, size_t size, unsigned int max_frames)
+{
+	struct pcap_writer pw;
+	struct record_group dl, ul;
+
+	if (pcap_writer_open(&pw, fname, size) < 0)
+		return EXIT_FAILURE;
+	pw.max_frames = max_frames;
+
+	if (record_group_init(&dl, &pw, DEFAULT_MS_MCAST_GROUP,
+	                      DEFAULT_MS_MCAST_PORT) < 0 ||
+	    record_group_init(&ul, &pw, DEFAULT_BTS_MCAST_GROUP,
+	                      DEFAULT_BTS_MCAST_PORT) < 0) {
+		fprintf(stderr, "cannot join the virtual Um groups\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("recording to %s, interrupt to stop\n", fname);
+	while (!quit)
+		osmo_select_main(0);
+
+	mcast_client_sock_close(dl.sock);
+	mcast_client_sock_close(ul.sock);
+	pcap_writer_close(&pw);
+	printf("%u frames, %zu bytes recorded\n", pw.frames, pw.used);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Replay
+ */
+
+struct replay_dest {
+	uint32_t addr;		// network byte order
+	uint16_t port;		// network byte order
+	struct mcast_server_sock *sock;
+	// frames waiting to be sent with one syscall
+	struct iovec iov[MCAST_SOCK_BATCH_MAX];
+	unsigned int num;
+};
+
+struct replay {
+	struct replay_dest dest[PCAP_MAX_DEST];
+	unsigned int num_dest;
+	double speed;		// 0: as fast as possible
+
+	// position in the file, in frames since its first frame
+	uint32_t last_fn;
+	uint64_t elapsed_fn;
+	int have_fn;
+	uint64_t start_ns;
+
+	unsigned int frames;
+	unsigned int skipped;
+	uint64_t max_late_ns;
+};
+
+static struct replay_dest *replay_dest(struct replay *rp, uint32_t addr,
+                                       uint16_t port)
+{
+	struct replay_dest *d;
+	struct in_addr in = { .s_addr = addr };
+	unsigned int i;
+
+	for (i = 0; i < rp->num_dest; i++) {
+		if (rp->dest[i].addr == addr && rp->dest[i].port == port)
+			return &rp->dest[i];
+	}
+	if (rp->num_dest == PCAP_MAX_DEST)
+		return NULL;
+
+	d = &rp->dest[rp->num_dest];
+	d->sock = mcast_server_sock_setup(NULL, inet_ntoa(in), ntohs(port), 1);
+	if (!d->sock)
+		return NULL;
+	d->addr = addr;
+	d->port = port;
+	rp->num_dest++;
+
+	return d;
+}
+
+static void replay_flush(struct replay *rp)
+{
+	unsigned int i;
+
+	for (i = 0; i < rp->num_dest; i++) {
+		struct replay_dest *d = &rp->dest[i];
+
+		if (!d->num)
+			continue;
+		if (mcast_server_sock_tx_batch(d->sock, d->iov, d->num) < 0)
+			perror("send");
+		d->num = 0;
+	}
+}
+
+/* wait until the frame numbered fn is due */
+static void replay_pace(struct replay *rp, uint32_t fn)
+{
+	uint64_t due, now;
+	uint32_t d;
+	struct timespec ts;
+
+	if (!rp->have_fn) {
+		rp->have_fn = 1;
+		rp->last_fn = fn;
+		rp->elapsed_fn = 0;
+		rp->start_ns = now_ns();
+		return;
+	}
+
+	// uplink and downlink are a few frames apart, only ever move on
+	d = (fn + GSM_MAX_FN - rp->last_fn) % GSM_MAX_FN;
+	if (d == 0 || d > GSM_MAX_FN / 2)
+		return;
+	rp->last_fn = fn;
+	rp->elapsed_fn += d;
+
+	// the frames of the previous FN go out before waiting
+	replay_flush(rp);
+
+	if (rp->speed == 0)
+		return;
+	due = rp->start_ns + rp->elapsed_fn * GSM_FRAME_NS / rp->speed;
+	now = now_ns();
+	if (now >= due) {
+		if (now - due > rp->max_late_ns)
+			rp->max_late_ns = now - due;
+		return;
+	}
+	ts.tv_sec = due / 1000000000ULL;
+	ts.tv_nsec = due % 1000000000ULL;
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+/* strip the link layer, IPv4 and UDP headers of one captured packet */
+static int replay_packet(struct replay *rp, uint32_t linktype,
+                         uint8_t *pkt, unsigned int len)
+{
+	struct ipv4_udp_hdr *ip;
+	struct replay_dest *d;
+	struct gsmtap_hdr *gh;
+	unsigned int ihl;
+	uint32_t daddr;
+	uint16_t dport, tot_len, udp_len;
+
+	if (linktype == LINKTYPE_ETHERNET) {
+		// no VLAN tags on loopback or the LAN the groups live on
+		if (len < 14 || pkt[12] != 0x08 || pkt[13] != 0x00)
+			return -1;
+		pkt += 14;
+		len -= 14;
+	}
+	if (len < sizeof(*ip))
+		return -1;
+	ip = (struct ipv4_udp_hdr *) pkt;
+	ihl = (ip->ver_ihl & 0x0f) * 4;
+	if ((ip->ver_ihl >> 4) != 4 || ip->proto != IPPROTO_UDP ||
+	    len < ihl + 8)
+		return -1;
+	// the frame may be padded, e.g. to the minimum Ethernet length
+	tot_len = ntohs(ip->tot_len);
+	if (tot_len < ihl + 8 || tot_len > len)
+		return -1;
+	len = tot_len;
+	daddr = ip->daddr;
+	// the UDP header follows the options, if there are any
+	memcpy(&dport, pkt + ihl + 2, sizeof(dport));
+	memcpy(&udp_len, pkt + ihl + 4, sizeof(udp_len));
+	udp_len = ntohs(udp_len);
+	if (udp_len < 8 || udp_len > len - ihl)
+		return -1;
+	pkt += ihl + 8;
+	len = udp_len - 8;
+
+	gh = (struct gsmtap_hdr *) pkt;
+	if (len >= sizeof(*gh) && gh->version == GSMTAP_VERSION)
+		replay_pace(rp, ntohl(gh->frame_number));
+
+	d = replay_dest(rp, daddr, dport);
+	if (!d)
+		return -1;
+	d->iov[d->num].iov_base = pkt;
+	d->iov[d->num].iov_len = len;
+	if (++d->num == MCAST_SOCK_BATCH_MAX) {
+		mcast_server_sock_tx_batch(d->sock, d->iov, d->num);
+		d->num = 0;
+	}
+	rp->frames++;
+
+	return 0;
+}
+
+static int replay(const char *fname, double speed, unsigned int loops)
+{
+	struct replay rp;
+	struct pcap_file_hdr hdr;
+	struct pcap_rec_hdr rec;
+	struct stat st;
+	uint8_t *map;
+	size_t pos;
+	uint64_t start;
+	unsigned int i, loop;
+	int fd;
+
+	fd = open(fname, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "%s: %s\n", fname, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED || st.st_size < sizeof(hdr)) {
+		fprintf(stderr, "%s: cannot map the file\n", fname);
+		return EXIT_FAILURE;
+	}
+	memcpy(&hdr, map, sizeof(hdr));
+	if ((hdr.magic != PCAP_MAGIC_NS && hdr.magic != PCAP_MAGIC_US) ||
+	    (hdr.linktype != LINKTYPE_IPV4 && hdr.linktype != LINKTYPE_RAW &&
+	     hdr.linktype != LINKTYPE_ETHERNET)) {
+		fprintf(stderr, "%s: not a pcap file of IPv4 packets in host "
+		        "byte order\n", fname);
+		return EXIT_FAILURE;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	memset(&rp, 0, sizeof(rp));
+	rp.speed = speed;
+	start = now_ns();
+	for (loop = 0; loop < loops && !quit; loop++) {
+		rp.have_fn = 0;
+		for (pos = sizeof(hdr); pos + sizeof(rec) <= st.st_size && !quit;
+		     pos += sizeof(rec) + rec.incl_len) {
+			memcpy(&rec, map + pos, sizeof(rec));
+			if (pos + sizeof(rec) + rec.incl_len > st.st_size)
+				break;
+			// the packet is read only, but the iovec is not const
+			if (replay_packet(&rp, hdr.linktype,
+			                  map + pos + sizeof(rec),
+			                  rec.incl_len) < 0)
+				rp.skipped++;
+		}
+		replay_flush(&rp);
+	}
+	start = now_ns() - start;
+
+	for (i = 0; i < rp.num_dest; i++)
+		mcast_server_sock_close(rp.dest[i].sock);
+	munmap(map, st.st_size);
+
+	printf("%u frames replayed (%u skipped) in %.3f s, %.0f frames/s",
+	       rp.frames, rp.skipped, start / 1e9, rp.frames * 1e9 / start);
+	if (speed)
+		printf(", up to %.1f ms behind", rp.max_late_ns / 1e6);
+	printf("\n");
+
+	return EXIT_SUCCESS;
+}
+
+static void print_help(void)
+{
+	printf("usage: virt_um_pcap -w FILE [-S MiB] [-c frames]\n");
+	printf("       virt_um_pcap -r FILE [-x speed | -f] [-l loops]\n");
+	printf(" -h --help		This text.\n");
+	printf(" -w --write FILE	Record both virtual Um groups to FILE.\n");
+	printf(" -S --size MiB		Preallocate MiB for the recording "
+	       "(default 64).\n");
+	printf(" -c --count N		Stop recording after N frames.\n");
+	printf(" -r --read FILE		Replay FILE onto the virtual Um.\n");
+	printf(" -x --speed X		Replay X times as fast as recorded "
+	       "(default 1).\n");
+	printf(" -f --fast		Replay as fast as possible.\n");
+	printf(" -l --loop N		Replay the file N times.\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *wfile = NULL, *rfile = NULL;
+	size_t size = 64 << 20;
+	unsigned int count = 0, loops = 1;
+	double speed = 1;
+
+	while (1) {
+		int option_index = 0, c;
+		static struct option long_options[] = {
+			{"help", 0, 0, 'h'},
+			{"write", 1, 0, 'w'},
+			{"size", 1, 0, 'S'},
+			{"count", 1, 0, 'c'},
+			{"read", 1, 0, 'r'},
+			{"speed", 1, 0, 'x'},
+			{"fast", 0, 0, 'f'},
+			{"loop", 1, 0, 'l'},
+			{0, 0, 0, 0},
+		};
+
+		c = getopt_long(argc, argv, "hw:S:c:r:x:fl:", long_options,
+		                &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'w':
+			wfile = optarg;
+			break;
+		case 'S':
+			size = (size_t)atoi(optarg) << 20;
+			break;
+		case 'c':
+			count = atoi(optarg);
+			break;
+		case 'r':
+			rfile = optarg;
+			break;
+		case 'x':
+			speed = atof(optarg);
+			break;
+		case 'f':
+			speed = 0;
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_help();
+			exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+	if (!wfile == !rfile || size < 4096 || speed < 0) {
+		print_help();
+		return EXIT_FAILURE;
+	}
+
+	ms_log_init("DL1C,1:DVIRPHY,1");
+	signal(SIGINT, sig_cb);
+	signal(SIGTERM, sig_cb);
+
+	if (wfile)
+		return record(wfile, size, count);
+	return replay(rfile, speed, loops);
+}
@@ -5,8 +5,10 @@
 #include <osmocom/core/select.h>
 #include <osmo-bts/scheduler.h>
 #include <stdint.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <getopt.h>
 #include <virt_l1_model.h>
 
 #include "virtual_um.h"
@@ -14,36 +16,127 @@
 #include "virt_l1_model.h"
 #include "gsmtapl1_if.h"
 #include "l1ctl_sap.h"
+#include "virt_l1_sched.h"
 
-int main(void)
+/* a new l23 app connected, it gets its own MS model */
+static int l1ctl_sock_accept_ms_cb(struct l1ctl_sock_client *lsc)
+{
+	struct l1_model *model = lsc->lsi->priv;
+	struct l1_model_ms *ms;
+
+	ms = l1_model_ms_init(model, lsc);
+	if (!ms)
+		return -ENOMEM;
+
+	LOGP(DVIRPHY, LOGL_INFO, "l23 app connected, serving %u MS\n",
+	     model->num_ms);
+	return 0;
+}
+
+static void l1ctl_sock_close_ms_cb(struct l1ctl_sock_client *lsc)
+{
+	struct l1_model_ms *ms = lsc->priv;
+	struct l1_model *model;
+
+	if (!ms)
+		return;
+	model = ms->model;
+	l1_model_ms_destroy(ms);
+	// its frames are not needed anymore
+	gsmtapl1_update_rx_filter(model);
+
+	LOGP(DVIRPHY, LOGL_INFO, "l23 app disconnected, serving %u MS\n",
+	     model->num_ms);
+}
+
+static enum virt_um_transport um_transport = VIRT_UM_T_MCAST;
+// coding workers of the burst-level virt um, 0 for whole L2 frames
+static unsigned int burst_workers = 0;
+
+static void print_help(void)
+{
+	printf(" -h --help		This text.\n");
+	printf(" -s --shm		Use shared memory rings instead of multicast "
+	       "for the virtual Um.\n");
+	printf(" -b --burst N		Exchange bursts instead of L2 frames on the "
+	       "virtual Um, coded by N worker threads.\n");
+}
+
+static void handle_options(int argc, char **argv)
+{
+	while (1) {
+		int option_index = 0, c;
+		static struct option long_options[] = {
+			{"help", 0, 0, 'h'},
+			{"shm", 0, 0, 's'},
+			{"burst", 1, 0, 'b'},
+			{0, 0, 0, 0},
+		};
+
+		c = getopt_long(argc, argv, "hsb:", long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 's':
+			um_transport = VIRT_UM_T_SHM;
+			break;
+		case 'b':
+			burst_workers = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_help();
+			exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+}
+
+int main(int argc, char **argv)
 {
 
 	// init loginfo
-	static struct l1_model_ms *model;
+	static struct l1_model *model;
+
+	handle_options(argc, argv);
 	ms_log_init("DL1C,1:DVIRPHY,1");
 	//ms_log_init("DL1C,8:DVIRPHY,8");
 
 	LOGP(DVIRPHY, LOGL_INFO, "Virtual physical layer starting up...\n");
 
-	model = l1_model_ms_init(NULL);
+	model = l1_model_init(NULL);
 
 	// TODO: make this configurable
-	model->vui = virt_um_init(NULL, DEFAULT_BTS_MCAST_GROUP, DEFAULT_BTS_MCAST_PORT, DEFAULT_MS_MCAST_GROUP, DEFAULT_MS_MCAST_PORT, gsmtapl1_rx_from_virt_um_inst_cb);
-	model->lsi = l1ctl_sock_init(NULL, l1ctl_sap_rx_from_l23_inst_cb, NULL);
-
-	gsmtapl1_init(model);
-	l1ctl_sap_init(model);
+	// one multicast socket for all MS, each downlink frame is received
+	// once and handed to the MS tuned to it
+	model->vui = virt_um_init(model, DEFAULT_BTS_MCAST_GROUP, DEFAULT_BTS_MCAST_PORT, DEFAULT_MS_MCAST_GROUP, DEFAULT_MS_MCAST_PORT, gsmtapl1_rx_from_virt_um_inst_cb, um_transport);
+	if (!model->vui)
+		return EXIT_FAILURE;
+	model->vui->priv = model;
+	// channel coding runs on worker threads, the select loop below
+	// only does the I/O
+	if (burst_workers && gsmtapl1_burst_init(model, burst_workers) < 0)
+		return EXIT_FAILURE;
+	// nobody is tuned yet, the kernel drops all downlink frames
+	gsmtapl1_update_rx_filter(model);
+	// every l23 app connecting to the socket is one MS
+	model->lsi = l1ctl_sock_init(model, l1ctl_sap_rx_from_l23_inst_cb, l1ctl_sock_accept_ms_cb, l1ctl_sock_close_ms_cb, NULL);
+	model->lsi->priv = model;
+	// frame clock, emits queued uplink primitives on their frame
+	model->sched = virt_l1_sched_init(model);
+	if (!model->sched)
+		return EXIT_FAILURE;
 
 	LOGP(DVIRPHY, LOGL_INFO, "Virtual physical layer ready...\n");
 
 	while (1) {
-		// handle osmocom fd READ events (l1ctl-unix-socket, virtual-um-mcast-socket)
+		// handle osmocom fd READ events (l1ctl-unix-socket,
+		// virtual-um-mcast-socket, frame clock timerfd, coded
+		// bursts eventfd)
 		osmo_select_main(0);
-		// handle outgoing l1ctl primitives to l2
-		// TODO implement scheduler for uplink messages
 	}
 
-	l1_model_ms_destroy(model);
+	l1_model_destroy(model);
 
 	// not reached
 	return EXIT_FAILURE;
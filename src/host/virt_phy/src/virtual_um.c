@@ -20,6 +20,8 @@
  */
 
 #include <unistd.h>
+#include <errno.h>
+#include <string.h>
 #include <osmocom/core/select.h>
 #include <osmocom/core/utils.h>
 #include <osmocom/core/socket.h>
@@ -29,10 +31,13 @@
 
 #include "virtual_um.h"
 #include "osmo_mcast_sock.h"
+#include "logging.h"
 
 /**
  * Virtual UM interface file descriptor callback.
  * Should be called by select.c when the fd is ready for reading.
+ *
+ * Drains up to VIRT_UM_RX_BATCH pending datagrams with a single syscall.
  */
 static int virt_um_fd_cb(struct osmo_fd *ofd, unsigned int what)
 {
@@ -40,19 +45,33 @@ static int virt_um_fd_cb(struct osmo_fd *ofd, unsigned int what)
 
 	// check if the read flag is set
 	if (what & BSC_FD_READ) {
-		// allocate message buffer of specified size
-		struct msgb *msg = msgb_alloc(VIRT_UM_MSGB_SIZE,
-		                "Virtual UM Rx");
-		int rc;
-
-		// read message from fd in message buffer
-		rc = mcast_bidir_sock_rx(vui->mcast_sock, msgb_data(msg), msgb_tailroom(msg));
-		// rc is number of bytes actually read
-		if (rc > 0) {
-			msgb_put(msg, rc);
-			// call the l1 callback function for a received msg
-			vui->recv_cb(vui, msg);
-		} else {
+		struct msgb *msgs[VIRT_UM_RX_BATCH];
+		struct iovec iov[VIRT_UM_RX_BATCH];
+		int rx_len[VIRT_UM_RX_BATCH];
+		int i, num, rc;
+
+		// allocate message buffers of specified size, the socket
+		// read overwrites them, so there is no need to clear them
+		for (num = 0; num < VIRT_UM_RX_BATCH; num++) {
+			msgs[num] = msgb_alloc_headroom_nozero(
+			                VIRT_UM_MSGB_SIZE, VIRT_UM_MSGB_HEADROOM,
+			                "Virtual UM Rx");
+			if (!msgs[num])
+				break;
+			iov[num].iov_base = msgb_data(msgs[num]);
+			iov[num].iov_len = msgb_tailroom(msgs[num]);
+		}
+		if (num == 0)
+			return -ENOMEM;
+
+		// read messages from fd in message buffers
+		rc = mcast_bidir_sock_rx_batch(vui->mcast_sock, iov, rx_len,
+		                num);
+		// rc is number of messages actually read
+		if (rc < 0 && (errno == EAGAIN || errno == EINTR)) {
+			// spurious wakeup, nothing to do
+			rc = 0;
+		} else if (rc <= 0) {
 			// TODO: this kind of error handling might be a bit harsh
 			vui->recv_cb(vui, NULL);
 			// Unregister fd from select loop
@@ -60,41 +79,253 @@ static int virt_um_fd_cb(struct osmo_fd *ofd, unsigned int what)
 			close(ofd->fd);
 			ofd->fd = -1;
 			ofd->when = 0;
+			rc = 0;
 		}
+
+		for (i = 0; i < rc; i++) {
+			if (rx_len[i] <= 0)
+				continue;
+			msgb_put(msgs[i], rx_len[i]);
+			// call the l1 callback function for a received msg,
+			// it takes ownership of the message buffer
+			vui->recv_cb(vui, msgs[i]);
+			msgs[i] = NULL;
+		}
+		// hand unused buffers back to the msgb pool
+		for (i = 0; i < num; i++)
+			msgb_free(msgs[i]);
 	}
 
 	return 0;
 }
 
+/**
+ * Shared memory ring callback, called when the writer signals new frames.
+ *
+ * Hands every frame in the ring to the l1 callback, the same way
+ * virt_um_fd_cb() does for datagrams.
+ */
+static void virt_um_shm_cb(struct shm_ring_reader *r)
+{
+	struct virt_um_inst *vui = r->data;
+	struct msgb *msg;
+	int len;
+
+	while (1) {
+		msg = msgb_alloc_headroom_nozero(VIRT_UM_MSGB_SIZE,
+		                VIRT_UM_MSGB_HEADROOM, "Virtual UM Rx");
+		if (!msg)
+			return;
+		len = shm_ring_read(r, msgb_data(msg), msgb_tailroom(msg));
+		if (len <= 0) {
+			msgb_free(msg);
+			return;
+		}
+		msgb_put(msg, len);
+		vui->recv_cb(vui, msg);
+	}
+}
+
+static void virt_um_tx_timer_cb(void *data)
+{
+	virt_um_flush(data);
+}
+
+static char *virt_um_shm_path(void *ctx, const char *group, uint16_t port)
+{
+	return talloc_asprintf(ctx, VIRT_UM_SHM_PATH_FMT, group, port);
+}
+
 struct virt_um_inst *virt_um_init(
                 void *ctx, const char *tx_mcast_group, uint16_t tx_mcast_port,
-                const char *rx_mcast_group, uint16_t rx_mcast_port, void (*recv_cb)(struct virt_um_inst *vui, struct msgb *msg))
+                const char *rx_mcast_group, uint16_t rx_mcast_port, void (*recv_cb)(struct virt_um_inst *vui, struct msgb *msg),
+                enum virt_um_transport transport)
 {
 
 	struct virt_um_inst *vui = talloc_zero(ctx, struct virt_um_inst);
-	vui->mcast_sock = mcast_bidir_sock_setup(ctx, tx_mcast_group, tx_mcast_port,
-	                rx_mcast_group, rx_mcast_port, 1, virt_um_fd_cb, vui);
+	char *path;
+
+	vui->transport = transport;
+	switch (transport) {
+	case VIRT_UM_T_MCAST:
+		vui->mcast_sock = mcast_bidir_sock_setup(ctx, tx_mcast_group,
+		                tx_mcast_port, rx_mcast_group, rx_mcast_port, 1,
+		                virt_um_fd_cb, vui);
+		break;
+	case VIRT_UM_T_SHM:
+		path = virt_um_shm_path(vui, tx_mcast_group, tx_mcast_port);
+		vui->shm_tx = shm_ring_writer_create(vui, path);
+		talloc_free(path);
+		if (!vui->shm_tx)
+			goto err;
+		path = virt_um_shm_path(vui, rx_mcast_group, rx_mcast_port);
+		vui->shm_rx = shm_ring_reader_create(vui, path, virt_um_shm_cb,
+		                vui);
+		talloc_free(path);
+		if (!vui->shm_rx)
+			goto err;
+		break;
+	}
 	vui->recv_cb = recv_cb;
+	INIT_LLIST_HEAD(&vui->tx_queue);
+	vui->tx_timer.cb = virt_um_tx_timer_cb;
+	vui->tx_timer.data = vui;
 
 	return vui;
 
+err:
+	if (vui->shm_tx)
+		shm_ring_writer_destroy(vui->shm_tx);
+	talloc_free(vui);
+	return NULL;
 }
 
 void virt_um_destroy(struct virt_um_inst *vui)
 {
-	mcast_bidir_sock_close(vui->mcast_sock);
+	virt_um_flush(vui);
+	osmo_timer_del(&vui->tx_timer);
+	virt_um_log_stats(vui, LOGL_INFO);
+	if (vui->mcast_sock)
+		mcast_bidir_sock_close(vui->mcast_sock);
+	if (vui->shm_rx)
+		shm_ring_reader_destroy(vui->shm_rx);
+	if (vui->shm_tx)
+		shm_ring_writer_destroy(vui->shm_tx);
 	talloc_free(vui);
 }
 
 /**
- * Write msg to to multicast socket and free msg afterwards
+ * Queue msg for the transport and free it once it has been sent.
+ *
+ * Queued messages are sent with one syscall at the next TDMA frame
+ * boundary, or immediately once VIRT_UM_TX_BATCH messages are pending.
+ *
+ * @return number of bytes queued.
  */
 int virt_um_write_msg(struct virt_um_inst *vui, struct msgb *msg)
 {
-	int rc;
+	int len = msgb_length(msg);
+
+	msgb_enqueue(&vui->tx_queue, msg);
+	vui->tx_queue_len++;
+
+	if (vui->tx_queue_len >= VIRT_UM_TX_BATCH)
+		virt_um_flush(vui);
+	else if (!osmo_timer_pending(&vui->tx_timer))
+		osmo_timer_schedule(&vui->tx_timer, 0, VIRT_UM_TX_FLUSH_US);
+
+	return len;
+}
+
+/* put all queued messages into the ring and wake up the readers once */
+static int virt_um_flush_shm(struct virt_um_inst *vui)
+{
+	struct msgb *msg;
+	int num = 0;
+
+	while ((msg = msgb_dequeue(&vui->tx_queue))) {
+		vui->tx_queue_len--;
+		if (shm_ring_write(vui->shm_tx, msgb_data(msg),
+		                   msgb_length(msg)) < 0)
+			LOGP(DVIRPHY, LOGL_ERROR, "Could not put msg of %u bytes "
+			     "into the shm ring\n", msgb_length(msg));
+		else
+			num++;
+		msgb_free(msg);
+	}
+	shm_ring_notify(vui->shm_tx);
+
+	return num;
+}
+
+/**
+ * Send all queued messages to the transport and free them.
+ *
+ * @return number of messages sent, or negative on error.
+ */
+int virt_um_flush(struct virt_um_inst *vui)
+{
+	struct iovec iov[VIRT_UM_TX_BATCH];
+	struct msgb *msg, *tmp;
+	int i = 0, rc;
+
+	osmo_timer_del(&vui->tx_timer);
+	if (!vui->tx_queue_len)
+		return 0;
+
+	if (vui->transport == VIRT_UM_T_SHM)
+		return virt_um_flush_shm(vui);
 
-	rc = mcast_bidir_sock_tx(vui->mcast_sock, msgb_data(msg), msgb_length(msg));
-	msgb_free(msg);
+	llist_for_each_entry(msg, &vui->tx_queue, list) {
+		if (i == VIRT_UM_TX_BATCH)
+			break;
+		iov[i].iov_base = msgb_data(msg);
+		iov[i].iov_len = msgb_length(msg);
+		i++;
+	}
+
+	rc = mcast_bidir_sock_tx_batch(vui->mcast_sock, iov, i);
+	if (rc < 0)
+		LOGP(DVIRPHY, LOGL_ERROR, "Could not send %d queued msgs: %s\n",
+		                i, strerror(errno));
+
+	// messages that could not be sent are dropped, like a failed
+	// sendto() would drop them
+	llist_for_each_entry_safe(msg, tmp, &vui->tx_queue, list) {
+		if (i-- == 0)
+			break;
+		llist_del(&msg->list);
+		msgb_free(msg);
+		vui->tx_queue_len--;
+	}
+
+	// more than one batch was queued, go on at the next frame
+	if (vui->tx_queue_len)
+		osmo_timer_schedule(&vui->tx_timer, 0, VIRT_UM_TX_FLUSH_US);
 
 	return rc;
 }
+
+/**
+ * Have the kernel drop received frames the BPF program code rejects,
+ * len 0 removes the filter.
+ *
+ * @return 0 on success, -ENOTSUP if the transport cannot filter.
+ */
+int virt_um_set_filter(struct virt_um_inst *vui, struct sock_filter *code,
+                       unsigned int len)
+{
+	if (!vui->mcast_sock)
+		return -ENOTSUP;
+	return mcast_bidir_sock_set_filter(vui->mcast_sock, code, len);
+}
+
+static void log_batch_stats(const char *name,
+                            const struct mcast_sock_batch_stats *s,
+                            int level)
+{
+	LOGP(DVIRPHY, level, "%s: %u msgs in %u batches (avg %u.%02u, max %u), "
+	                "sizes 1:%u 2-3:%u 4-7:%u 8-15:%u 16-31:%u 32+:%u\n",
+	                name, s->msgs, s->batches,
+	                s->batches ? s->msgs / s->batches : 0,
+	                s->batches ? (s->msgs * 100 / s->batches) % 100 : 0,
+	                s->max, s->hist[0], s->hist[1], s->hist[2], s->hist[3],
+	                s->hist[4], s->hist[5]);
+}
+
+/**
+ * Log the batch size statistics of the multicast sockets, or the frames
+ * lost by a shm ring reader that could not keep up.
+ */
+void virt_um_log_stats(struct virt_um_inst *vui, int level)
+{
+	if (vui->shm_rx)
+		LOGP(DVIRPHY, level, "Virtual UM Rx: %u msgs dropped from shm "
+		     "ring\n", vui->shm_rx->dropped);
+	if (!vui->mcast_sock)
+		return;
+	log_batch_stats("Virtual UM Rx", &vui->mcast_sock->rx_sock->rx_stats,
+	                level);
+	log_batch_stats("Virtual UM Tx", &vui->mcast_sock->tx_sock->tx_stats,
+	                level);
+}
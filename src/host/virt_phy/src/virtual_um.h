@@ -2,23 +2,63 @@
 
 #include <osmocom/core/select.h>
 #include <osmocom/core/msgb.h>
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/timer.h>
 #include "osmo_mcast_sock.h"
+#include "shm_ring.h"
 
 #define VIRT_UM_MSGB_SIZE	256
+// part of VIRT_UM_MSGB_SIZE kept free in front of received frames, the
+// receiver may replace the GSMTAP header by longer headers of its own
+#define VIRT_UM_MSGB_HEADROOM	32
+// maximum number of datagrams read per select() wakeup
+#define VIRT_UM_RX_BATCH	16
+// queued uplink frames are flushed once per TDMA frame (4.615 ms) ...
+#define VIRT_UM_TX_FLUSH_US	4615
+// ... or as soon as this many are queued
+#define VIRT_UM_TX_BATCH	MCAST_SOCK_BATCH_MAX
+// BSIC of the virtual cells, there is no SCH to learn it from
+#define VIRT_UM_BSIC		0
 #define DEFAULT_MS_MCAST_GROUP "224.0.0.1"
 #define DEFAULT_MS_MCAST_PORT 6666
 #define DEFAULT_BTS_MCAST_GROUP "225.0.0.1"
 #define DEFAULT_BTS_MCAST_PORT 6667
+// control socket of the shm ring carrying the frames of group:port
+#define VIRT_UM_SHM_PATH_FMT "/tmp/virt_um_%s_%u"
+
+enum virt_um_transport {
+	// GSMTAP over UDP multicast
+	VIRT_UM_T_MCAST,
+	// GSMTAP in a shared memory ring per group:port, for peers on the
+	// same host. Only one instance may transmit to a group this way.
+	VIRT_UM_T_SHM,
+};
 
 struct virt_um_inst {
 	void *priv;
+	enum virt_um_transport transport;
 	struct mcast_bidir_sock *mcast_sock;
+	// VIRT_UM_T_SHM only
+	struct shm_ring_writer *shm_tx;
+	struct shm_ring_reader *shm_rx;
 	void (*recv_cb)(struct virt_um_inst *vui, struct msgb *msg);
+	// uplink frames waiting for the next flush
+	struct llist_head tx_queue;
+	unsigned int tx_queue_len;
+	struct osmo_timer_list tx_timer;
 };
 
 struct virt_um_inst *virt_um_init(void *ctx, const char *tx_mcast_group, uint16_t tx_mcast_port, const char *rx_mcast_group, uint16_t rx_mcast_port,
-				  void (*recv_cb)(struct virt_um_inst *vui, struct msgb *msg));
+				  void (*recv_cb)(struct virt_um_inst *vui, struct msgb *msg),
+				  enum virt_um_transport transport);
 
 void virt_um_destroy(struct virt_um_inst *vui);
 
 int virt_um_write_msg(struct virt_um_inst *vui, struct msgb *msg);
+
+int virt_um_flush(struct virt_um_inst *vui);
+
+int virt_um_set_filter(struct virt_um_inst *vui, struct sock_filter *code,
+                       unsigned int len);
+
+void virt_um_log_stats(struct virt_um_inst *vui, int level);
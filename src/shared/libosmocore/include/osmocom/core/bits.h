@@ -46,6 +46,10 @@ int osmo_pbit2ubit_ext(ubit_t *out, unsigned int out_ofs,
                        const pbit_t *in, unsigned int in_ofs,
                        unsigned int num_bits, int lsb_mode);
 
+int osmo_ubit2sbit(sbit_t *out, const ubit_t *in, unsigned int num_bits);
+
+int osmo_sbit2ubit(ubit_t *out, const sbit_t *in, unsigned int num_bits);
+
 
 /* BIT REVERSAL */
 
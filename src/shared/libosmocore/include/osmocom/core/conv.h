@@ -140,6 +140,31 @@ int osmo_conv_decode_get_output(struct osmo_conv_decoder *decoder,
 int osmo_conv_decode(const struct osmo_conv_code *code,
                      const sbit_t *input, ubit_t *output);
 
+	/* Implementation selection */
+
+/*! \brief add-compare-select kernels of the decoder
+ *
+ *  All of them give the same results. The vector ones handle codes
+ *  whose state t is reached from states t/2 and t/2 + 2^(K-2), which
+ *  covers the GSM codes, with 8 to 64 states; other codes are always
+ *  decoded by the portable kernel.
+ *
+ *  With the AVX2 kernel, the trellises of GSM 05.03 are decoded by code
+ *  specialised for them. Their encoders are specialised with any
+ *  kernel.
+ */
+enum osmo_conv_acs {
+	OSMO_CONV_ACS_AUTO = 0,	/*!< \brief Fastest one the CPU supports */
+	OSMO_CONV_ACS_SCALAR,	/*!< \brief Portable C */
+	OSMO_CONV_ACS_SSE4,	/*!< \brief SSE4.1, 4 states at once */
+	OSMO_CONV_ACS_AVX2,	/*!< \brief AVX2, 8 states at once */
+};
+
+int osmo_conv_decode_set_acs(enum osmo_conv_acs acs);
+enum osmo_conv_acs osmo_conv_decode_get_acs(void);
+int osmo_conv_decode_gsm(const struct osmo_conv_code *code,
+                         const sbit_t *input, ubit_t *output, int *rv);
+
 
 /*! @} */
 
@@ -44,8 +44,26 @@ struct osmo_crcXXgen_code {
 	uintXX_t remainder; /*!< \brief Remainder of the CRC (final XOR) */
 };
 
+/*! \brief engines computing the CRCs of XX bits codes
+ *
+ *  All of them give the same results. The table and carry-less multiply
+ *  ones keep data for each polynomial and fall back to the bitwise one
+ *  once more than a few different ones are in use.
+ */
+enum osmo_crcXXgen_engine {
+	OSMO_CRCXXGEN_AUTO = 0,	/*!< \brief Fastest one the CPU supports */
+	OSMO_CRCXXGEN_BITWISE,	/*!< \brief One bit at a time */
+	OSMO_CRCXXGEN_SLICE8,	/*!< \brief Tables, 8 bytes at a time */
+	OSMO_CRCXXGEN_CLMUL,	/*!< \brief x86 PCLMULQDQ, folding 16 bytes at a time */
+};
+
+int osmo_crcXXgen_set_engine(enum osmo_crcXXgen_engine engine);
+enum osmo_crcXXgen_engine osmo_crcXXgen_get_engine(void);
+
 uintXX_t osmo_crcXXgen_compute_bits(const struct osmo_crcXXgen_code *code,
                                     const ubit_t *in, int len);
+uintXX_t osmo_crcXXgen_compute_pbits(const struct osmo_crcXXgen_code *code,
+                                     const pbit_t *in, int len);
 int osmo_crcXXgen_check_bits(const struct osmo_crcXXgen_code *code,
                              const ubit_t *in, int len, const ubit_t *crc_bits);
 void osmo_crcXXgen_set_bits(const struct osmo_crcXXgen_code *code,
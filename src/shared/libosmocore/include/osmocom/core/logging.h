@@ -20,8 +20,16 @@
 #define DEBUG
 
 #ifdef DEBUG
-#define DEBUGP(ss, fmt, args...) logp(ss, __FILE__, __LINE__, 0, fmt, ## args)
-#define DEBUGPC(ss, fmt, args...) logp(ss, __FILE__, __LINE__, 1, fmt, ## args)
+#define DEBUGP(ss, fmt, args...) \
+	do { \
+		if (log_check_level(ss, LOGL_DEBUG)) \
+			logp(ss, __FILE__, __LINE__, 0, fmt, ## args); \
+	} while (0)
+#define DEBUGPC(ss, fmt, args...) \
+	do { \
+		if (log_check_level(ss, LOGL_DEBUG)) \
+			logp(ss, __FILE__, __LINE__, 1, fmt, ## args); \
+	} while (0)
 #else
 #define DEBUGP(xss, fmt, args...)
 #define DEBUGPC(ss, fmt, args...)
@@ -38,9 +46,15 @@ void logp(int subsys, const char *file, int line, int cont, const char *format,
  *  \param[in] level logging level (e.g. \ref LOGL_NOTICE)
  *  \param[in] fmt format string
  *  \param[in] args variable argument list
+ *
+ * The arguments are not evaluated if no log target would output the
+ * message, see \ref log_check_level.
  */
 #define LOGP(ss, level, fmt, args...) \
-	logp2(ss, level, __FILE__, __LINE__, 0, fmt, ##args)
+	do { \
+		if (log_check_level(ss, level)) \
+			logp2(ss, level, __FILE__, __LINE__, 0, fmt, ##args); \
+	} while (0)
 
 /*! \brief Continue a log message through the Osmocom logging framework
  *  \param[in] ss logging subsystem (e.g. \ref DLGLOBAL)
@@ -49,7 +63,10 @@ void logp(int subsys, const char *file, int line, int cont, const char *format,
  *  \param[in] args variable argument list
  */
 #define LOGPC(ss, level, fmt, args...) \
-	logp2(ss, level, __FILE__, __LINE__, 1, fmt, ##args)
+	do { \
+		if (log_check_level(ss, level)) \
+			logp2(ss, level, __FILE__, __LINE__, 1, fmt, ##args); \
+	} while (0)
 
 /*! \brief different log levels */
 #define LOGL_DEBUG	1	/*!< \brief debugging information */
@@ -114,8 +131,27 @@ enum log_target_type {
 	LOG_TGT_TYPE_SYSLOG,	/*!< \brief syslog based logging */
 	LOG_TGT_TYPE_FILE,	/*!< \brief text file logging */
 	LOG_TGT_TYPE_STDERR,	/*!< \brief stderr logging */
+	LOG_TGT_TYPE_ASYNC,	/*!< \brief file logging from a writer thread */
+	LOG_TGT_TYPE_BINARY,	/*!< \brief unformatted records in a file */
 };
 
+/*! \brief What an asynchronous log target does if its ring is full */
+enum log_async_policy {
+	LOG_ASYNC_DROP,		/*!< \brief discard the message, count it */
+	LOG_ASYNC_BLOCK,	/*!< \brief wait for the writer thread */
+};
+
+/*! \brief Statistics of an asynchronous log target */
+struct log_async_stats {
+	uint64_t written;	/*!< \brief messages written to the file */
+	uint64_t dropped;	/*!< \brief messages lost to a full ring */
+	size_t high_water;	/*!< \brief max. bytes queued in the ring */
+	size_t size;		/*!< \brief size of the ring */
+};
+
+struct log_async_ring;
+struct log_binary_file;
+
 /*! \brief structure representing a logging target */
 struct log_target {
         struct llist_head entry;		/*!< \brief linked list */
@@ -154,6 +190,16 @@ struct log_target {
 		struct {
 			void *vty;
 		} tgt_vty;
+
+		struct {
+			const char *fname;
+			struct log_async_ring *ring;
+		} tgt_async;
+
+		struct {
+			const char *fname;
+			struct log_binary_file *file;
+		} tgt_binary;
 	};
 
 	/*! \brief call-back function to be called when the logging framework
@@ -164,8 +210,73 @@ struct log_target {
 	 */
         void (*output) (struct log_target *target, unsigned int level,
 			const char *string);
+
+	/*! \brief call-back function for targets that format messages
+	 *	   themselves, used instead of \a output if set.
+	 *  \param[in] target logging target
+	 *  \param[in] subsys log category of the message
+	 *  \param[in] level log level of the message
+	 *  \param[in] file source file of the message
+	 *  \param[in] line source line of the message
+	 *  \param[in] cont is this a continuation of a previous message
+	 *  \param[in] format printf format string
+	 *  \param[in] ap arguments of the format string
+	 */
+	void (*raw_output) (struct log_target *target, unsigned int subsys,
+			    unsigned int level, const char *file, int line,
+			    int cont, const char *format, va_list ap);
 };
 
+/*! \brief Cache of the lowest level each category is output at by any
+ *  log target, maintained by the logging core */
+struct log_level_cache {
+	/*! \brief targets or their settings changed since the last rebuild */
+	int dirty;
+	/*! \brief copy of \ref log_info.num_cat */
+	unsigned int num_cat;
+	/*! \brief copy of \ref log_info.num_cat_user */
+	unsigned int num_cat_user;
+	/*! \brief lowest level output, per category, LOG_LEVEL_NONE if
+	 *  none of the targets outputs the category at all, updated in
+	 *  place by \ref log_level_cache_rebuild */
+	uint8_t *min_level;
+};
+
+#define LOG_LEVEL_NONE	0xff
+
+extern struct log_level_cache osmo_log_level_cache;
+
+void log_level_cache_rebuild(void);
+
+/*! \brief Check whether any log target would output a message
+ *  \param[in] subsys logging subsystem (e.g. \ref DLGLOBAL)
+ *  \param[in] level logging level (e.g. \ref LOGL_NOTICE)
+ *  \returns 0 if the message would be discarded, 1 if it might be output
+ *
+ * Only the category and level settings are taken into account, the
+ * message might still be dropped by a filter.
+ */
+static inline int log_check_level(int subsys, unsigned int level)
+{
+	struct log_level_cache *cache = &osmo_log_level_cache;
+
+	uint8_t *min_level;
+
+	if (__atomic_load_n(&cache->dirty, __ATOMIC_RELAXED))
+		log_level_cache_rebuild();
+	min_level = __atomic_load_n(&cache->min_level, __ATOMIC_ACQUIRE);
+	/* logging not initialized, let the core decide */
+	if (!min_level)
+		return 1;
+
+	if (subsys < 0)
+		subsys = (subsys * -1) + (cache->num_cat_user - 1);
+	if (subsys >= cache->num_cat)
+		return 1;
+
+	return level >= __atomic_load_n(&min_level[subsys], __ATOMIC_RELAXED);
+}
+
 /* use the above macros */
 void logp2(int subsys, unsigned int level, const char *file,
 	   int line, int cont, const char *format, ...)
@@ -198,6 +309,13 @@ struct log_target *log_target_create_file(const char *fname);
 struct log_target *log_target_create_syslog(const char *ident, int option,
 					    int facility);
 int log_target_file_reopen(struct log_target *tgt);
+struct log_target *log_target_create_async(const char *fname,
+					   size_t ring_size,
+					   enum log_async_policy policy);
+void log_target_async_stats(struct log_target *target,
+			    struct log_async_stats *stats);
+void log_target_async_flush(struct log_target *target);
+struct log_target *log_target_create_binary(const char *fname);
 
 void log_add_target(struct log_target *target);
 void log_del_target(struct log_target *target);
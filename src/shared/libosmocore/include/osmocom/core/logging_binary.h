@@ -0,0 +1,135 @@
+#pragma once
+
+/*! \defgroup logging_binary Binary log files
+ *  @{
+ */
+
+/*! \file logging_binary.h
+ *  \brief File format of the binary log target and its reader
+ *
+ * A binary log file starts with a \ref log_binary_hdr, followed by
+ * records.  Each record starts with a \ref log_binary_rec giving its
+ * type and total length.  Call sites are described once by a
+ * \ref LOG_BIN_REC_SITE record, after which every message logged from
+ * there is a \ref LOG_BIN_REC_MSG record referring to the site by its
+ * id and carrying the packed arguments.  Integers are in host byte
+ * order, a record of type 0 ends the file.
+ *
+ * The arguments of a message are stored in the order the conversions
+ * of its format string consume them: integers, pointers and floating
+ * point numbers as 8 bytes, strings as a 16 bit length followed by the
+ * characters (\ref LOG_BIN_STR_NULL for a NULL pointer).
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LOG_BIN_MAGIC		"OSMOBLOG"
+#define LOG_BIN_VERSION		1
+/*! \brief Maximum length of a record, longer messages are truncated */
+#define LOG_BIN_MAX_REC		4096
+/*! \brief String length value of a NULL string */
+#define LOG_BIN_STR_NULL	0xffff
+
+/*! \brief Header at the start of a binary log file */
+struct log_binary_hdr {
+	char magic[8];		/*!< \brief \ref LOG_BIN_MAGIC */
+	uint32_t version;	/*!< \brief \ref LOG_BIN_VERSION */
+	uint32_t hdr_len;	/*!< \brief offset of the first record */
+} __attribute__((packed));
+
+/*! \brief Type of a record in a binary log file */
+enum log_binary_rec_type {
+	LOG_BIN_REC_END,	/*!< \brief end of the file */
+	LOG_BIN_REC_CAT,	/*!< \brief name of a log category */
+	LOG_BIN_REC_SITE,	/*!< \brief file, line and format string */
+	LOG_BIN_REC_MSG,	/*!< \brief a logged message */
+};
+
+/*! \brief Header of every record */
+struct log_binary_rec {
+	uint16_t type;		/*!< \brief \ref log_binary_rec_type */
+	uint16_t len;		/*!< \brief including this header */
+} __attribute__((packed));
+
+/*! \brief \ref LOG_BIN_REC_CAT, followed by the NUL terminated name */
+struct log_binary_rec_cat {
+	struct log_binary_rec hdr;
+	uint16_t subsys;
+} __attribute__((packed));
+
+/*! \brief \ref LOG_BIN_REC_SITE, followed by the NUL terminated file
+ *  name and format string */
+struct log_binary_rec_site {
+	struct log_binary_rec hdr;
+	uint32_t id;
+	uint32_t line;
+} __attribute__((packed));
+
+/*! \brief the message has been continued from a previous one */
+#define LOG_BIN_F_CONT		0x01
+/*! \brief not all arguments fit into the record */
+#define LOG_BIN_F_TRUNC		0x02
+
+/*! \brief \ref LOG_BIN_REC_MSG, followed by the packed arguments */
+struct log_binary_rec_msg {
+	struct log_binary_rec hdr;
+	uint64_t ts_ns;		/*!< \brief CLOCK_REALTIME */
+	uint32_t site;
+	uint16_t subsys;
+	uint8_t level;
+	uint8_t flags;		/*!< \brief LOG_BIN_F_* */
+} __attribute__((packed));
+
+/*! \brief Type of the argument consumed by a printf conversion */
+enum log_binary_arg {
+	LOG_BIN_ARG_NONE,	/*!< \brief %% */
+	LOG_BIN_ARG_INT,
+	LOG_BIN_ARG_LONG,
+	LOG_BIN_ARG_LLONG,
+	LOG_BIN_ARG_SIZE,
+	LOG_BIN_ARG_PTRDIFF,
+	LOG_BIN_ARG_INTMAX,
+	LOG_BIN_ARG_DOUBLE,
+	LOG_BIN_ARG_LDOUBLE,
+	LOG_BIN_ARG_STR,
+	LOG_BIN_ARG_PTR,
+	LOG_BIN_ARG_OTHER,	/*!< \brief pointer that can't be stored,
+				     e.g. %n or %ls */
+};
+
+/*! \brief One conversion of a printf format string */
+struct log_binary_conv {
+	const char *start;	/*!< \brief the '%' */
+	unsigned int len;	/*!< \brief up to and including the type */
+	enum log_binary_arg arg;
+	unsigned int star_width:1;	/*!< \brief width is an int argument */
+	unsigned int star_prec:1;	/*!< \brief precision is an int arg. */
+	int prec;		/*!< \brief literal precision or -1 */
+};
+
+const char *log_binary_next_conv(const char *fmt,
+				 struct log_binary_conv *conv);
+
+/*! \brief A message decoded by \ref log_binary_reader_next */
+struct log_binary_msg {
+	uint64_t ts_ns;
+	unsigned int subsys;
+	const char *cat_name;	/*!< \brief NULL if unknown */
+	int level;
+	const char *file;
+	int line;
+	unsigned int cont:1;
+	unsigned int truncated:1;
+	char text[LOG_BIN_MAX_REC * 2];
+};
+
+struct log_binary_reader;
+
+struct log_binary_reader *log_binary_reader_alloc(void *ctx,
+						  const uint8_t *buf,
+						  size_t len);
+int log_binary_reader_next(struct log_binary_reader *r,
+			   struct log_binary_msg *msg);
+
+/*! @} */
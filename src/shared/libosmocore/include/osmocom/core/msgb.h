@@ -68,7 +68,9 @@ struct msgb {
 };
 
 extern struct msgb *msgb_alloc(uint16_t size, const char *name);
+extern struct msgb *msgb_alloc_nozero(uint16_t size, const char *name);
 extern void msgb_free(struct msgb *m);
+extern void msgb_pool_flush(void);
 extern void msgb_enqueue(struct llist_head *queue, struct msgb *msg);
 extern struct msgb *msgb_dequeue(struct llist_head *queue);
 extern void msgb_reset(struct msgb *m);
@@ -391,6 +393,25 @@ static inline struct msgb *msgb_alloc_headroom(int size, int headroom,
 	return msg;
 }
 
+/*! \brief Allocate message buffer with specified headroom, data not cleared
+ *  \param[in] size size in bytes, including headroom
+ *  \param[in] headroom headroom in bytes
+ *  \param[in] name human-readable name
+ *  \returns allocated message buffer with specified headroom
+ *
+ * Like \ref msgb_alloc_headroom, but based on \ref msgb_alloc_nozero.
+ */
+static inline struct msgb *msgb_alloc_headroom_nozero(int size, int headroom,
+						       const char *name)
+{
+	osmo_static_assert(size > headroom, headroom_bigger);
+
+	struct msgb *msg = msgb_alloc_nozero(size, name);
+	if (msg)
+		msgb_reserve(msg, headroom);
+	return msg;
+}
+
 /* non inline functions to ease binding */
 
 uint8_t *msgb_data(const struct msgb *msg);
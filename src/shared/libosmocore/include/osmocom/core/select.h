@@ -34,12 +34,26 @@ struct osmo_fd {
 	void *data;
 	/*! private number, extending \a data */
 	unsigned int priv_nr;
+	/*! \a when as last programmed into the kernel (epoll backend
+	 * only, internal) */
+	unsigned int kernel_when;
+};
+
+/*! \brief Backend used by \ref osmo_select_main to wait for events */
+enum osmo_select_backend {
+	/*! classic select(), fd sets rebuilt on every iteration */
+	OSMO_SELECT_BACKEND_SELECT,
+	/*! Linux epoll, interest set kept in the kernel */
+	OSMO_SELECT_BACKEND_EPOLL,
 };
 
 int osmo_fd_register(struct osmo_fd *fd);
 void osmo_fd_unregister(struct osmo_fd *fd);
 int osmo_select_main(int polling);
 
+int osmo_select_set_backend(enum osmo_select_backend backend);
+enum osmo_select_backend osmo_select_get_backend(void);
+
 /*! @} */
 
 #endif /* _BSC_SELECT_H */
@@ -43,6 +43,8 @@
  *      - Use del_timer to remove the timer
  *
  *  Internally:
+ *      - Timers are kept in a hierarchical timing wheel with
+ *        millisecond slots, driven by CLOCK_MONOTONIC.
  *      - We hook into select.c to give a timeval of the
  *        nearest timer. On already passed timers we give
  *        it a 0 to immediately fire after the select
@@ -52,10 +54,10 @@
  */
 /*! \brief A structure representing a single instance of a timer */
 struct osmo_timer_list {
-	struct rb_node node;	  /*!< \brief rb-tree node header */
 	struct llist_head list;   /*!< \brief internal list header */
-	struct timeval timeout;   /*!< \brief expiration time */
+	struct timeval timeout;   /*!< \brief expiration time (CLOCK_MONOTONIC) */
 	unsigned int active  : 1; /*!< \brief is it active? */
+	unsigned long seq;	  /*!< \brief internal, order of adding */
 
 	void (*cb)(void*);	  /*!< \brief call-back called at timeout */
 	void *data;		  /*!< \brief user data for callback */
@@ -33,11 +33,40 @@
 #include <osmocom/core/select.h>
 #include <osmocom/core/msgb.h>
 
+/*! \brief how a write queue writes its messages */
+enum osmo_wqueue_mode {
+	/*! \brief one message per write event, by \ref osmo_wqueue::write_cb */
+	OSMO_WQUEUE_M_MSG,
+	/*! \brief stream socket or pipe, the queued messages are written
+	 *  by one writev(), a partial write is continued at the next event */
+	OSMO_WQUEUE_M_STREAM,
+	/*! \brief datagram socket, the queued messages are sent as one
+	 *  datagram each by one sendmmsg() */
+	OSMO_WQUEUE_M_DGRAM,
+};
+
+/*! \brief write queue statistics */
+struct osmo_wqueue_stats {
+	/*! \brief number of write syscalls, or \ref osmo_wqueue::write_cb
+	 *  calls */
+	unsigned long syscalls;
+	/*! \brief number of messages written */
+	unsigned long msgs;
+	/*! \brief number of bytes written */
+	unsigned long long bytes;
+	/*! \brief number of write errors, the message is dropped except
+	 *  in \ref OSMO_WQUEUE_M_STREAM mode */
+	unsigned long errors;
+	/*! \brief highest queue length seen */
+	unsigned int max_length;
+};
+
 /*! write queue instance */
 struct osmo_wqueue {
 	/*! \brief osmocom file descriptor */
 	struct osmo_fd bfd;
-	/*! \brief maximum length of write queue */
+	/*! \brief maximum length of write queue, \ref
+	 *  osmo_wqueue_enqueue fails beyond it */
 	unsigned int max_length;
 	/*! \brief current length of write queue */
 	unsigned int current_length;
@@ -51,6 +80,14 @@ struct osmo_wqueue {
 	int (*write_cb)(struct osmo_fd *fd, struct msgb *msg);
 	/*! \brief call-back in case qeueue has exceptions */
 	int (*except_cb)(struct osmo_fd *fd);
+
+	/*! \brief how messages are written, \ref write_cb is only used
+	 *  with \ref OSMO_WQUEUE_M_MSG */
+	enum osmo_wqueue_mode mode;
+	/*! \brief bytes of the first message written already */
+	unsigned int head_ofs;
+	/*! \brief statistics of the writes */
+	struct osmo_wqueue_stats stats;
 };
 
 void osmo_wqueue_init(struct osmo_wqueue *queue, int max_length);
@@ -58,6 +58,13 @@ void osmo_a5(int n, const uint8_t *key, uint32_t fn, ubit_t *dl, ubit_t *ul);
 void osmo_a5_1(const uint8_t *key, uint32_t fn, ubit_t *dl, ubit_t *ul);
 void osmo_a5_2(const uint8_t *key, uint32_t fn, ubit_t *dl, ubit_t *ul);
 
+/*! \brief Flags of \ref osmo_a5_batch */
+#define OSMO_A5_F_PBIT	0x01	/*!< \brief Packed bits, 15 bytes per stream */
+
+int osmo_a5_batch(int n, const uint8_t *keys, const uint32_t *fn,
+                  unsigned int count, uint8_t *dl, uint8_t *ul,
+                  unsigned int flags);
+
 /*! @} */
 
 #endif /* __OSMO_A5_H__ */
@@ -0,0 +1,125 @@
+/*
+ * gsm0503.h
+ *
+ * (C) 2013 by the osmocom-bb contributors
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __OSMO_GSM0503_H__
+#define __OSMO_GSM0503_H__
+
+#include <stdint.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/conv.h>
+
+/*! \defgroup gsm0503 GSM 05.03 channel coding
+ *  @{
+ */
+
+/*! \file gsm/gsm0503.h
+ *  \brief Osmocom GSM 05.03 channel coding header
+ *
+ *  Blocks are coded into the 116 bits e(B,0..115) of each of their
+ *  bursts: 57 data bits, the stealing flags hl(B) and hu(B), 57 data
+ *  bits. Training sequence, tail bits and ciphering are left to the
+ *  caller. Decoding takes soft bits of the same layout, negative for 1.
+ */
+
+/*! \brief bits of a normal burst the coding fills in */
+#define GSM0503_BURST_BITS	116
+/*! \brief bytes of an xCCH L2 block */
+#define GSM0503_XCCH_L2_LEN	23
+/*! \brief bytes of a TCH/FS frame, 260 bits */
+#define GSM0503_TCH_FS_LEN	33
+/*! \brief coded bits of an access burst */
+#define GSM0503_RACH_BITS	36
+/*! \brief coded bits of a synchronisation burst, both halves */
+#define GSM0503_SCH_BITS	78
+/*! \brief bytes of the SCH information, 25 bits */
+#define GSM0503_SCH_INFO_LEN	4
+
+	/* Notes:
+	 *  - L2 blocks, RACH and SCH information go LSB of each byte first,
+	 *    as GSM 04.04 sends them.
+	 *  - A TCH/FS frame holds the 260 bits d(0..259) in the order of
+	 *    GSM 05.03 Table 2, class 1a first, MSB of each byte first. The
+	 *    last 4 bits of the frame are unused.
+	 *  - xCCH blocks take 4 bursts. TCH/FS blocks are interleaved over
+	 *    8: a block fills the even bits of bursts 0 to 3 and the odd
+	 *    ones of bursts 4 to 7, so the bursts of a channel are given 4
+	 *    bursts further along for each block.
+	 *  - Decoding returns 0, or -1 if the CRC does not match; n_errors
+	 *    counts the coded bits that differ from the block re-encoded.
+	 */
+int gsm0503_xcch_encode(ubit_t *bursts, const uint8_t *l2_data);
+int gsm0503_xcch_decode(uint8_t *l2_data, const sbit_t *bursts,
+                        int *n_errors, int *n_bits_total);
+
+int gsm0503_tch_fs_encode(ubit_t *bursts, const uint8_t *frame);
+int gsm0503_tch_fs_decode(uint8_t *frame, const sbit_t *bursts,
+                          int *n_errors, int *n_bits_total);
+
+int gsm0503_rach_encode(ubit_t *burst, uint8_t ra, uint8_t bsic);
+int gsm0503_rach_decode(uint8_t *ra, const sbit_t *burst, uint8_t bsic);
+
+int gsm0503_sch_encode(ubit_t *burst, const uint8_t *sb_info);
+int gsm0503_sch_decode(uint8_t *sb_info, const sbit_t *burst);
+
+	/* Batches */
+
+/*! \brief scratch space to code batches of blocks with
+ *
+ *  It holds the decoders, so that a batch does not allocate for each
+ *  block. It is set up once with \ref gsm0503_batch_init and may be
+ *  used for any number of batches, but only by one at a time.
+ */
+struct gsm0503_batch {
+	struct osmo_conv_decoder xcch;	/*!< \brief xCCH decoder */
+	struct osmo_conv_decoder tch_fs;/*!< \brief TCH/FS class 1 decoder */
+	ubit_t u[228];			/*!< \brief uncoded bits */
+	ubit_t c[456];			/*!< \brief coded bits */
+	sbit_t s[456];			/*!< \brief coded soft bits */
+};
+
+void gsm0503_batch_init(struct gsm0503_batch *batch);
+void gsm0503_batch_deinit(struct gsm0503_batch *batch);
+
+	/* Notes:
+	 *  - count blocks, one after the other in l2_data or frames, each
+	 *    one's bursts after the other in bursts: 4 for xCCH, 8 for
+	 *    TCH/FS.
+	 *  - ok, if not NULL, is set to 1 for each block decoded with a
+	 *    matching CRC and to 0 for the others.
+	 *  - They return the number of blocks decoded with a matching CRC,
+	 *    or coded.
+	 */
+int gsm0503_xcch_encode_batch(struct gsm0503_batch *batch, ubit_t *bursts,
+                              const uint8_t *l2_data, unsigned int count);
+int gsm0503_xcch_decode_batch(struct gsm0503_batch *batch, uint8_t *l2_data,
+                              const sbit_t *bursts, unsigned int count,
+                              uint8_t *ok);
+int gsm0503_tch_fs_encode_batch(struct gsm0503_batch *batch, ubit_t *bursts,
+                                const uint8_t *frames, unsigned int count);
+int gsm0503_tch_fs_decode_batch(struct gsm0503_batch *batch, uint8_t *frames,
+                                const sbit_t *bursts, unsigned int count,
+                                uint8_t *ok);
+
+/*! @} */
+
+#endif /* __OSMO_GSM0503_H__ */
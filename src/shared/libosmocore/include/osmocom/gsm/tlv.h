@@ -2,6 +2,7 @@
 #define _TLV_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 
 #include <osmocom/core/msgb.h>
@@ -390,9 +391,15 @@ struct tlv_definition {
 	struct tlv_def def[256];
 };
 
-/*! \brief result of the TLV parser */
+/*! \brief result of the TLV parser
+ *
+ *  Only the entries of the IEs found are written, the others are left
+ *  as they are. \ref TLVP_PRESENT goes by the present bitmap, check it
+ *  before looking at an IE with \ref TLVP_LEN and \ref TLVP_VAL.
+ */
 struct tlv_parsed {
-	struct tlv_p_entry lv[256];
+	uint64_t present[256 / 64];	/*!< \brief bitmap of the IEs found */
+	struct tlv_p_entry lv[256];	/*!< \brief the IEs found, by tag */
 };
 
 extern struct tlv_definition tvlv_att_def;
@@ -406,7 +413,35 @@ int tlv_parse(struct tlv_parsed *dec, const struct tlv_definition *def,
 /* take a master (src) tlvdev and fill up all empty slots in 'dst' */
 void tlv_def_patch(struct tlv_definition *dst, const struct tlv_definition *src);
 
-#define TLVP_PRESENT(x, y)	((x)->lv[y].val)
+/*! \brief empty a \ref tlv_parsed */
+static inline void tlvp_clear(struct tlv_parsed *tp)
+{
+	memset(tp->present, 0, sizeof(tp->present));
+}
+
+/*! \brief has an IE been found */
+static inline int tlvp_present(const struct tlv_parsed *tp, uint8_t tag)
+{
+	return (tp->present[tag >> 6] >> (tag & 63)) & 1;
+}
+
+/*! \brief record an IE in a \ref tlv_parsed, replacing one of the same tag */
+static inline void tlvp_set(struct tlv_parsed *tp, uint8_t tag,
+			    const uint8_t *val, uint16_t len)
+{
+	tp->present[tag >> 6] |= 1ULL << (tag & 63);
+	tp->lv[tag].val = val;
+	tp->lv[tag].len = len;
+}
+
+/*! \brief the value of an IE, NULL if it has not been found */
+static inline const uint8_t *tlvp_present_val(const struct tlv_parsed *tp,
+					      uint8_t tag)
+{
+	return tlvp_present(tp, tag) ? tp->lv[tag].val : NULL;
+}
+
+#define TLVP_PRESENT(x, y)	tlvp_present_val(x, y)
 #define TLVP_LEN(x, y)		(x)->lv[y].len
 #define TLVP_VAL(x, y)		(x)->lv[y].val
 
@@ -1,5 +1,8 @@
 
+#include "config.h"
+
 #include <stdint.h>
+#include <string.h>
 
 #include <osmocom/core/bits.h>
 
@@ -9,9 +12,338 @@
 
 /*! \file bits.c
  *  \brief Osmocom bit level support code
+ *
+ * The conversions work on whole bytes of packed bits where they can.
+ * Those go through SSE2 or AVX2 kernels if the CPU has them and through
+ * tables otherwise; only the bits before the first and after the last
+ * whole byte are converted one by one. All of them give the same
+ * results, with unpacked bits being 0 or 1.
  */
 
 
+/* the bits of a byte, MSB first, as unpacked bits */
+#define UBITS(b) { {							\
+	(b) >> 7 & 1, (b) >> 6 & 1, (b) >> 5 & 1, (b) >> 4 & 1,		\
+	(b) >> 3 & 1, (b) >> 2 & 1, (b) >> 1 & 1, (b) & 1 } }
+#define REV(b)	(((b) & 0x01) << 7 | ((b) & 0x02) << 5 | ((b) & 0x04) << 3 | \
+		 ((b) & 0x08) << 1 | ((b) & 0x10) >> 1 | ((b) & 0x20) >> 3 | \
+		 ((b) & 0x40) >> 5 | ((b) & 0x80) >> 7)
+#define TBL4(m, b)	m(b), m((b) + 1), m((b) + 2), m((b) + 3)
+#define TBL16(m, b)	TBL4(m, b), TBL4(m, (b) + 4), \
+			TBL4(m, (b) + 8), TBL4(m, (b) + 12)
+#define TBL64(m, b)	TBL16(m, b), TBL16(m, (b) + 16), \
+			TBL16(m, (b) + 32), TBL16(m, (b) + 48)
+#define TBL256(m)	TBL64(m, 0), TBL64(m, 64), TBL64(m, 128), TBL64(m, 192)
+
+static const union {
+	ubit_t b[8];
+	uint64_t w;
+} pbit2ubit_tbl[256] = { TBL256(UBITS) };
+
+static const uint8_t revbits_tbl[256] = { TBL256(REV) };
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+
+enum bits_simd {
+	BITS_SIMD_UNKNOWN = 0,
+	BITS_SIMD_NONE,
+	BITS_SIMD_SSE2,
+	BITS_SIMD_AVX2,
+};
+
+/* the kernels to use, resolved on first use */
+static enum bits_simd bits_simd;
+
+static enum bits_simd bits_simd_get(void)
+{
+	if (bits_simd == BITS_SIMD_UNKNOWN) {
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			bits_simd = BITS_SIMD_AVX2;
+		else if (__builtin_cpu_supports("sse2"))
+			bits_simd = BITS_SIMD_SSE2;
+		else
+			bits_simd = BITS_SIMD_NONE;
+	}
+	return bits_simd;
+}
+
+/* Each kernel converts as many whole chunks as there are and returns
+ * the number of bytes of packed bits done, the caller does the rest. */
+
+__attribute__((target("avx2")))
+static unsigned int ubit2pbit_avx2(pbit_t *out, const ubit_t *in,
+                                   unsigned int n, int lsb_mode)
+{
+	/* the first bit of each byte in the MSB */
+	const __m256i rev = _mm256_setr_epi8(
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	unsigned int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)&in[8 * i]);
+		uint32_t m;
+
+		if (!lsb_mode)
+			v = _mm256_shuffle_epi8(v, rev);
+		m = _mm256_movemask_epi8(_mm256_slli_epi16(v, 7));
+		memcpy(&out[i], &m, sizeof(m));
+	}
+	return i;
+}
+
+__attribute__((target("sse2")))
+static unsigned int ubit2pbit_sse2(pbit_t *out, const ubit_t *in,
+                                   unsigned int n, int lsb_mode)
+{
+	unsigned int i;
+
+	for (i = 0; i + 2 <= n; i += 2) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&in[8 * i]);
+		unsigned int m = _mm_movemask_epi8(_mm_slli_epi16(v, 7));
+
+		if (lsb_mode) {
+			out[i] = m;
+			out[i + 1] = m >> 8;
+		} else {
+			out[i] = revbits_tbl[m & 0xff];
+			out[i + 1] = revbits_tbl[m >> 8];
+		}
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static unsigned int pbit2ubit_avx2(ubit_t *out, const pbit_t *in,
+                                   unsigned int n, int lsb_mode)
+{
+	/* byte i of the input to ubits 8i to 8i+7 */
+	const __m256i spread = _mm256_setr_epi8(
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+		2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	const __m256i msb = _mm256_set1_epi64x(0x0102040810204080ULL);
+	const __m256i lsb = _mm256_set1_epi64x(0x8040201008040201ULL);
+	const __m256i mask = lsb_mode ? lsb : msb;
+	const __m256i one = _mm256_set1_epi8(1);
+	unsigned int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		uint32_t w;
+		__m256i v;
+
+		memcpy(&w, &in[i], sizeof(w));
+		v = _mm256_shuffle_epi8(_mm256_set1_epi32(w), spread);
+		v = _mm256_cmpeq_epi8(_mm256_and_si256(v, mask), mask);
+		_mm256_storeu_si256((__m256i *)&out[8 * i],
+		                    _mm256_and_si256(v, one));
+	}
+	return i;
+}
+
+__attribute__((target("sse2")))
+static unsigned int pbit2ubit_sse2(ubit_t *out, const pbit_t *in,
+                                   unsigned int n, int lsb_mode)
+{
+	const __m128i msb = _mm_set1_epi64x(0x0102040810204080ULL);
+	const __m128i lsb = _mm_set1_epi64x(0x8040201008040201ULL);
+	const __m128i mask = lsb_mode ? lsb : msb;
+	const __m128i one = _mm_set1_epi8(1);
+	unsigned int i;
+
+	for (i = 0; i + 2 <= n; i += 2) {
+		__m128i v = _mm_cvtsi32_si128(in[i] | in[i + 1] << 8);
+
+		/* each byte 8 times */
+		v = _mm_unpacklo_epi8(v, v);
+		v = _mm_unpacklo_epi16(v, v);
+		v = _mm_unpacklo_epi32(v, v);
+		v = _mm_cmpeq_epi8(_mm_and_si128(v, mask), mask);
+		_mm_storeu_si128((__m128i *)&out[8 * i], _mm_and_si128(v, one));
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static unsigned int revbytebits_avx2(uint8_t *buf, unsigned int len)
+{
+	/* reversed nibbles, in the high and the low half of a byte */
+	const __m256i rev_hi = _mm256_setr_epi8(
+		0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
+		0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+		0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
+		0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0);
+	const __m256i rev_lo = _mm256_setr_epi8(
+		0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
+		0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf,
+		0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
+		0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf);
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	unsigned int i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)&buf[i]);
+		__m256i lo = _mm256_and_si256(v, nibble);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+
+		v = _mm256_or_si256(_mm256_shuffle_epi8(rev_hi, lo),
+		                    _mm256_shuffle_epi8(rev_lo, hi));
+		_mm256_storeu_si256((__m256i *)&buf[i], v);
+	}
+	return i;
+}
+
+__attribute__((target("sse2")))
+static unsigned int revbytebits_sse2(uint8_t *buf, unsigned int len)
+{
+	const __m128i m1 = _mm_set1_epi8(0x55);
+	const __m128i m2 = _mm_set1_epi8(0x33);
+	const __m128i m4 = _mm_set1_epi8(0x0f);
+	unsigned int i;
+
+	/* as osmo_revbytebits_32(), the masks keep the bits in their byte */
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&buf[i]);
+
+		v = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, m1), 1),
+		                 _mm_and_si128(_mm_srli_epi16(v, 1), m1));
+		v = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, m2), 2),
+		                 _mm_and_si128(_mm_srli_epi16(v, 2), m2));
+		v = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, m4), 4),
+		                 _mm_and_si128(_mm_srli_epi16(v, 4), m4));
+		_mm_storeu_si128((__m128i *)&buf[i], v);
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static unsigned int ubit2sbit_avx2(sbit_t *out, const ubit_t *in,
+                                   unsigned int n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i pos = _mm256_set1_epi8(127);
+	const __m256i flip = _mm256_set1_epi8(127 ^ -127);
+	unsigned int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)&in[i]);
+
+		v = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, zero), flip);
+		_mm256_storeu_si256((__m256i *)&out[i],
+		                    _mm256_xor_si256(v, pos));
+	}
+	return i;
+}
+
+__attribute__((target("sse2")))
+static unsigned int ubit2sbit_sse2(sbit_t *out, const ubit_t *in,
+                                   unsigned int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i pos = _mm_set1_epi8(127);
+	const __m128i flip = _mm_set1_epi8(127 ^ -127);
+	unsigned int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&in[i]);
+
+		v = _mm_andnot_si128(_mm_cmpeq_epi8(v, zero), flip);
+		_mm_storeu_si128((__m128i *)&out[i], _mm_xor_si128(v, pos));
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static unsigned int sbit2ubit_avx2(ubit_t *out, const sbit_t *in,
+                                   unsigned int n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi8(1);
+	unsigned int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)&in[i]);
+
+		v = _mm256_and_si256(_mm256_cmpgt_epi8(zero, v), one);
+		_mm256_storeu_si256((__m256i *)&out[i], v);
+	}
+	return i;
+}
+
+__attribute__((target("sse2")))
+static unsigned int sbit2ubit_sse2(ubit_t *out, const sbit_t *in,
+                                   unsigned int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	unsigned int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&in[i]);
+
+		v = _mm_and_si128(_mm_cmpgt_epi8(zero, v), one);
+		_mm_storeu_si128((__m128i *)&out[i], v);
+	}
+	return i;
+}
+#endif /* HAVE_X86_SIMD */
+
+/* n whole bytes of packed bits from 8n unpacked ones */
+static void ubit2pbit_bytes(pbit_t *out, const ubit_t *in, unsigned int n,
+                            int lsb_mode)
+{
+	unsigned int i = 0;
+
+#ifdef HAVE_X86_SIMD
+	switch (bits_simd_get()) {
+	case BITS_SIMD_AVX2:
+		i = ubit2pbit_avx2(out, in, n, lsb_mode);
+		break;
+	case BITS_SIMD_SSE2:
+		i = ubit2pbit_sse2(out, in, n, lsb_mode);
+		break;
+	default:
+		break;
+	}
+#endif
+
+	for (; i < n; i++) {
+		const ubit_t *b = &in[8 * i];
+		uint8_t byte;
+
+		byte = b[0] << 7 | b[1] << 6 | b[2] << 5 | b[3] << 4 |
+		       b[4] << 3 | b[5] << 2 | b[6] << 1 | b[7];
+		out[i] = lsb_mode ? revbits_tbl[byte] : byte;
+	}
+}
+
+/* 8n unpacked bits from n whole bytes of packed ones */
+static void pbit2ubit_bytes(ubit_t *out, const pbit_t *in, unsigned int n,
+                            int lsb_mode)
+{
+	unsigned int i = 0;
+
+#ifdef HAVE_X86_SIMD
+	switch (bits_simd_get()) {
+	case BITS_SIMD_AVX2:
+		i = pbit2ubit_avx2(out, in, n, lsb_mode);
+		break;
+	case BITS_SIMD_SSE2:
+		i = pbit2ubit_sse2(out, in, n, lsb_mode);
+		break;
+	default:
+		break;
+	}
+#endif
+
+	for (; i < n; i++) {
+		uint8_t byte = lsb_mode ? revbits_tbl[in[i]] : in[i];
+
+		memcpy(&out[8 * i], pbit2ubit_tbl[byte].b, 8);
+	}
+}
+
 /*! \brief convert unpacked bits to packed bits, return length in bytes
  *  \param[out] out output buffer of packed bits
  *  \param[in] in input buffer of unpacked bits
@@ -19,25 +351,19 @@
  */
 int osmo_ubit2pbit(pbit_t *out, const ubit_t *in, unsigned int num_bits)
 {
-	unsigned int i;
+	unsigned int i, n = num_bits / 8;
 	uint8_t curbyte = 0;
-	pbit_t *outptr = out;
-
-	for (i = 0; i < num_bits; i++) {
-		uint8_t bitnum = 7 - (i % 8);
 
-		curbyte |= (in[i] << bitnum);
+	ubit2pbit_bytes(out, in, n, 0);
 
-		if(i % 8 == 7){
-			*outptr++ = curbyte;
-			curbyte = 0;
-		}
-	}
 	/* we have a non-modulo-8 bitcount */
-	if (i % 8)
-		*outptr++ = curbyte;
+	if (num_bits % 8) {
+		for (i = 8 * n; i < num_bits; i++)
+			curbyte |= in[i] << (7 - (i % 8));
+		out[n++] = curbyte;
+	}
 
-	return outptr - out;
+	return n;
 }
 
 /*! \brief convert packed bits to unpacked bits, return length in bytes
@@ -47,38 +373,14 @@ int osmo_ubit2pbit(pbit_t *out, const ubit_t *in, unsigned int num_bits)
  */
 int osmo_pbit2ubit(ubit_t *out, const pbit_t *in, unsigned int num_bits)
 {
-	unsigned int i;
-	ubit_t *cur = out;
-	ubit_t *limit = out + num_bits;
-
-	for (i = 0; i < (num_bits/8)+1; i++) {
-		pbit_t byte = in[i];
-		*cur++ = (byte >> 7) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 6) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 5) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 4) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 3) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 2) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 1) & 1;
-		if (cur >= limit)
-			break;
-		*cur++ = (byte >> 0) & 1;
-		if (cur >= limit)
-			break;
-	}
-	return cur - out;
+	unsigned int i, n = num_bits / 8;
+
+	pbit2ubit_bytes(out, in, n, 0);
+
+	for (i = 8 * n; i < num_bits; i++)
+		out[i] = (in[n] >> (7 - (i % 8))) & 1;
+
+	return num_bits;
 }
 
 /*! \brief convert unpacked bits to packed bits (extended options)
@@ -94,14 +396,26 @@ int osmo_ubit2pbit_ext(pbit_t *out, unsigned int out_ofs,
                        const ubit_t *in, unsigned int in_ofs,
                        unsigned int num_bits, int lsb_mode)
 {
-	int i, op, bn;
-	for (i=0; i<num_bits; i++) {
+	unsigned int i = 0, n;
+	int op, bn;
+
+	/* one by one up to a byte boundary of the output, whole bytes from
+	 * there and the rest one by one again */
+	while (i < num_bits) {
+		if (!((out_ofs + i) & 7) && num_bits - i >= 8) {
+			n = (num_bits - i) / 8;
+			ubit2pbit_bytes(&out[(out_ofs + i) >> 3],
+			                &in[in_ofs + i], n, lsb_mode);
+			i += 8 * n;
+			continue;
+		}
 		op = out_ofs + i;
 		bn = lsb_mode ? (op&7) : (7-(op&7));
 		if (in[in_ofs+i])
 			out[op>>3] |= 1 << bn;
 		else
 			out[op>>3] &= ~(1 << bn);
+		i++;
 	}
 	return ((out_ofs + num_bits - 1) >> 3) + 1;
 }
@@ -119,15 +433,88 @@ int osmo_pbit2ubit_ext(ubit_t *out, unsigned int out_ofs,
                        const pbit_t *in, unsigned int in_ofs,
                        unsigned int num_bits, int lsb_mode)
 {
-	int i, ip, bn;
-	for (i=0; i<num_bits; i++) {
+	unsigned int i = 0, n;
+	int ip, bn;
+
+	/* as osmo_ubit2pbit_ext(), aligned to the bytes of the input */
+	while (i < num_bits) {
+		if (!((in_ofs + i) & 7) && num_bits - i >= 8) {
+			n = (num_bits - i) / 8;
+			pbit2ubit_bytes(&out[out_ofs + i],
+			                &in[(in_ofs + i) >> 3], n, lsb_mode);
+			i += 8 * n;
+			continue;
+		}
 		ip = in_ofs + i;
 		bn = lsb_mode ? (ip&7) : (7-(ip&7));
 		out[out_ofs+i] = !!(in[ip>>3] & (1<<bn));
+		i++;
 	}
 	return out_ofs + num_bits;
 }
 
+/*! \brief convert unpacked bits to soft bits
+ *  \param[out] out output buffer of soft bits
+ *  \param[in] in input buffer of unpacked bits
+ *  \param[in] num_bits number of bits
+ *  \returns number of soft bits
+ *
+ *  A 0 becomes 127 and a 1 becomes -127, the surest soft bits.
+ */
+int osmo_ubit2sbit(sbit_t *out, const ubit_t *in, unsigned int num_bits)
+{
+	unsigned int i = 0;
+
+#ifdef HAVE_X86_SIMD
+	switch (bits_simd_get()) {
+	case BITS_SIMD_AVX2:
+		i = ubit2sbit_avx2(out, in, num_bits);
+		break;
+	case BITS_SIMD_SSE2:
+		i = ubit2sbit_sse2(out, in, num_bits);
+		break;
+	default:
+		break;
+	}
+#endif
+
+	for (; i < num_bits; i++)
+		out[i] = in[i] ? -127 : 127;
+
+	return num_bits;
+}
+
+/*! \brief convert soft bits to unpacked bits
+ *  \param[out] out output buffer of unpacked bits
+ *  \param[in] in input buffer of soft bits
+ *  \param[in] num_bits number of bits
+ *  \returns number of unpacked bits
+ *
+ *  Negative soft bits become 1, all others 0.
+ */
+int osmo_sbit2ubit(ubit_t *out, const sbit_t *in, unsigned int num_bits)
+{
+	unsigned int i = 0;
+
+#ifdef HAVE_X86_SIMD
+	switch (bits_simd_get()) {
+	case BITS_SIMD_AVX2:
+		i = sbit2ubit_avx2(out, in, num_bits);
+		break;
+	case BITS_SIMD_SSE2:
+		i = sbit2ubit_sse2(out, in, num_bits);
+		break;
+	default:
+		break;
+	}
+#endif
+
+	for (; i < num_bits; i++)
+		out[i] = in[i] < 0;
+
+	return num_bits;
+}
+
 /* generalized bit reversal function, Chapter 7 "Hackers Delight" */
 uint32_t osmo_bit_reversal(uint32_t x, enum osmo_br_mode k)
 {
@@ -161,28 +548,26 @@ uint32_t osmo_revbytebits_8(uint8_t x)
 
 void osmo_revbytebits_buf(uint8_t *buf, int len)
 {
-	unsigned int i;
-	unsigned int unaligned_cnt;
-	int len_remain = len;
+	unsigned int i = 0;
 
-	unaligned_cnt = ((unsigned long)buf & 3);
-	for (i = 0; i < unaligned_cnt; i++) {
-		buf[i] = osmo_revbytebits_8(buf[i]);
-		len_remain--;
-		if (len_remain <= 0)
-			return;
-	}
+	if (len <= 0)
+		return;
 
-	for (i = unaligned_cnt; i < len; i += 4) {
-		uint32_t *cur = (uint32_t *) (buf + i);
-		*cur = osmo_revbytebits_32(*cur);
-		len_remain -= 4;
+#ifdef HAVE_X86_SIMD
+	switch (bits_simd_get()) {
+	case BITS_SIMD_AVX2:
+		i = revbytebits_avx2(buf, len);
+		break;
+	case BITS_SIMD_SSE2:
+		i = revbytebits_sse2(buf, len);
+		break;
+	default:
+		break;
 	}
+#endif
 
-	for (i = len - len_remain; i < len; i++) {
-		buf[i] = osmo_revbytebits_8(buf[i]);
-		len_remain--;
-	}
+	for (; i < len; i++)
+		buf[i] = revbits_tbl[buf[i]];
 }
 
 /*! @} */
@@ -40,6 +40,8 @@
 #include <osmocom/core/bits.h>
 #include <osmocom/core/conv.h>
 
+#include "conv_acs.h"
+
 
 /* ------------------------------------------------------------------------ */
 /* Common                                                                   */
@@ -216,6 +218,10 @@ osmo_conv_encode(const struct osmo_conv_code *code,
 	struct osmo_conv_encoder encoder;
 	int l;
 
+	l = osmo_conv_encode_gsm(code, input, output);
+	if (l >= 0)
+		return l;
+
 	osmo_conv_encode_init(&encoder, code);
 
 	if (code->term == CONV_TERM_TAIL_BITING) {
@@ -236,8 +242,6 @@ osmo_conv_encode(const struct osmo_conv_code *code,
 /* Decoding (viterbi)                                                       */
 /* ------------------------------------------------------------------------ */
 
-#define MAX_AE 0x00ffffff
-
 void
 osmo_conv_decode_init(struct osmo_conv_decoder *decoder,
                       const struct osmo_conv_code *code, int len, int start_state)
@@ -333,6 +337,11 @@ osmo_conv_decode_scan(struct osmo_conv_decoder *decoder,
 
 	int i_idx, p_idx;
 
+	/* Vector kernel, if the CPU and the code allow for it */
+	i_idx = osmo_conv_decode_scan_acs(decoder, input, n);
+	if (i_idx >= 0)
+		return i_idx;
+
 	/* Prepare */
 	n_states = decoder->n_states;
 
@@ -606,6 +615,9 @@ osmo_conv_decode(const struct osmo_conv_code *code,
 	struct osmo_conv_decoder decoder;
 	int rv, l;
 
+	if (osmo_conv_decode_gsm(code, input, output, &rv) == 0)
+		return rv;
+
 	osmo_conv_decode_init(&decoder, code, 0, 0);
 
 	if (code->term == CONV_TERM_TAIL_BITING) {
@@ -0,0 +1,365 @@
+/*
+ * conv_acs.c
+ *
+ * Vector add-compare-select kernels of the Viterbi decoder
+ *
+ * (C) 2013 by the osmocom-bb contributors
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*! \addtogroup conv
+ *  @{
+ */
+
+/*! \file conv_acs.c
+ *  \brief Vector add-compare-select kernels of the Viterbi decoder
+ *
+ * The kernels compute the same accumulated errors and survivors as the
+ * portable scan in conv.c, bit for bit:
+ *
+ *  - the error of a branch is the sum of ((in - out)^2 >> 9) over the
+ *    symbols that are not punctured, with out being +-127. Per symbol
+ *    that is e0 if the output bit is 0 and e0 + d if it is 1, so one
+ *    step needs the sum of all e0 plus d masked by the output bits of
+ *    each branch, which are precomputed per state.
+ *
+ *  - state t is reached from t/2 and t/2 + n/2 only. The portable scan
+ *    looks at t/2 first and only replaces its survivor by a strictly
+ *    better one, so ties go to t/2 here as well.
+ *
+ *  - accumulated errors do not grow above MAX_AE, a path whose error
+ *    would is never a survivor there.
+ *
+ * The kernels are built with function specific target options and
+ * picked at run time, the library itself does not require a CPU with
+ * any of these extensions.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/conv.h>
+
+#include "conv_acs.h"
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+
+/* largest N and number of states the vector kernels handle */
+#define ACS_MAX_N	8
+#define ACS_MAX_STATES	64
+
+/* the trellis as the kernels see it, per target state t */
+struct acs_trellis {
+	int n_states;
+	int N;
+	/* all ones where bit j (first symbol first) of the output on the
+	 * branch from t/2 (mask0) or from t/2 + n/2 (mask1) is set */
+	uint32_t mask0[ACS_MAX_N][ACS_MAX_STATES] __attribute__((aligned(32)));
+	uint32_t mask1[ACS_MAX_N][ACS_MAX_STATES] __attribute__((aligned(32)));
+	/* t/2 */
+	uint32_t pred0[ACS_MAX_STATES] __attribute__((aligned(32)));
+};
+
+/* branch errors of one step: e0 + the d[j] of all set output bits */
+struct acs_metric {
+	uint32_t e0;
+	uint32_t d[ACS_MAX_N];
+};
+
+typedef void (*acs_step_t)(const struct acs_trellis *tr,
+                           const struct acs_metric *bm,
+                           const unsigned int *ae, unsigned int *ae_next,
+                           uint8_t *state_history);
+
+__attribute__((target("sse4.1")))
+static void acs_step_sse4(const struct acs_trellis *tr,
+                          const struct acs_metric *bm,
+                          const unsigned int *ae, unsigned int *ae_next,
+                          uint8_t *state_history)
+{
+	const int half = tr->n_states / 2;
+	const __m128i max_ae = _mm_set1_epi32(MAX_AE);
+	const __m128i v_half = _mm_set1_epi32(half);
+	const __m128i e0 = _mm_set1_epi32(bm->e0);
+	__m128i d[ACS_MAX_N];
+	int t, j;
+
+	for (j = 0; j < tr->N; j++)
+		d[j] = _mm_set1_epi32(bm->d[j]);
+
+	for (t = 0; t < tr->n_states; t += 4) {
+		__m128i a0, a1, m0 = e0, m1 = e0, sel, h;
+		uint32_t h4;
+
+		/* ae[t/2] and ae[t/2 + n/2], each for two states */
+		a0 = _mm_loadl_epi64((const __m128i *)&ae[t / 2]);
+		a0 = _mm_unpacklo_epi32(a0, a0);
+		a1 = _mm_loadl_epi64((const __m128i *)&ae[t / 2 + half]);
+		a1 = _mm_unpacklo_epi32(a1, a1);
+
+		for (j = 0; j < tr->N; j++) {
+			m0 = _mm_add_epi32(m0, _mm_and_si128(d[j],
+			        _mm_load_si128((const __m128i *)&tr->mask0[j][t])));
+			m1 = _mm_add_epi32(m1, _mm_and_si128(d[j],
+			        _mm_load_si128((const __m128i *)&tr->mask1[j][t])));
+		}
+		a0 = _mm_add_epi32(a0, m0);
+		a1 = _mm_add_epi32(a1, m1);
+
+		/* errors stay below 2^31, the signed compare will do */
+		sel = _mm_cmpgt_epi32(a0, a1);
+		_mm_storeu_si128((__m128i *)&ae_next[t],
+		                 _mm_min_epu32(_mm_min_epu32(a0, a1), max_ae));
+
+		h = _mm_add_epi32(_mm_load_si128((const __m128i *)&tr->pred0[t]),
+		                  _mm_and_si128(sel, v_half));
+		h = _mm_packus_epi32(h, h);
+		h = _mm_packus_epi16(h, h);
+		h4 = _mm_cvtsi128_si32(h);
+		memcpy(&state_history[t], &h4, sizeof(h4));
+	}
+}
+
+__attribute__((target("avx2")))
+static void acs_step_avx2(const struct acs_trellis *tr,
+                          const struct acs_metric *bm,
+                          const unsigned int *ae, unsigned int *ae_next,
+                          uint8_t *state_history)
+{
+	const int half = tr->n_states / 2;
+	const __m256i dup = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	const __m256i max_ae = _mm256_set1_epi32(MAX_AE);
+	const __m256i v_half = _mm256_set1_epi32(half);
+	const __m256i e0 = _mm256_set1_epi32(bm->e0);
+	__m256i d[ACS_MAX_N];
+	int t, j;
+
+	for (j = 0; j < tr->N; j++)
+		d[j] = _mm256_set1_epi32(bm->d[j]);
+
+	for (t = 0; t < tr->n_states; t += 8) {
+		__m256i a0, a1, m0 = e0, m1 = e0, sel, h;
+		__m128i h8;
+
+		/* ae[t/2] and ae[t/2 + n/2], each for two states */
+		a0 = _mm256_castsi128_si256(
+		        _mm_loadu_si128((const __m128i *)&ae[t / 2]));
+		a0 = _mm256_permutevar8x32_epi32(a0, dup);
+		a1 = _mm256_castsi128_si256(
+		        _mm_loadu_si128((const __m128i *)&ae[t / 2 + half]));
+		a1 = _mm256_permutevar8x32_epi32(a1, dup);
+
+		for (j = 0; j < tr->N; j++) {
+			m0 = _mm256_add_epi32(m0, _mm256_and_si256(d[j],
+			        _mm256_load_si256((const __m256i *)&tr->mask0[j][t])));
+			m1 = _mm256_add_epi32(m1, _mm256_and_si256(d[j],
+			        _mm256_load_si256((const __m256i *)&tr->mask1[j][t])));
+		}
+		a0 = _mm256_add_epi32(a0, m0);
+		a1 = _mm256_add_epi32(a1, m1);
+
+		/* errors stay below 2^31, the signed compare will do */
+		sel = _mm256_cmpgt_epi32(a0, a1);
+		_mm256_storeu_si256((__m256i *)&ae_next[t],
+		        _mm256_min_epu32(_mm256_min_epu32(a0, a1), max_ae));
+
+		h = _mm256_add_epi32(
+		        _mm256_load_si256((const __m256i *)&tr->pred0[t]),
+		        _mm256_and_si256(sel, v_half));
+		h8 = _mm_packus_epi32(_mm256_castsi256_si128(h),
+		                      _mm256_extracti128_si256(h, 1));
+		h8 = _mm_packus_epi16(h8, h8);
+		_mm_storel_epi64((__m128i *)&state_history[t], h8);
+	}
+}
+
+/* build the kernel view of the trellis, -1 if it is of another shape */
+static int acs_trellis_init(struct acs_trellis *tr,
+                            const struct osmo_conv_code *code, int n_states)
+{
+	int half = n_states / 2;
+	int s, b, t, j;
+
+	if (code->N > ACS_MAX_N || n_states > ACS_MAX_STATES || n_states < 8)
+		return -1;
+
+	tr->n_states = n_states;
+	tr->N = code->N;
+
+	for (s = 0; s < n_states; s++) {
+		if (code->next_state[s][0] == code->next_state[s][1])
+			return -1;
+		for (b = 0; b < 2; b++) {
+			uint8_t out = code->next_output[s][b];
+			uint32_t (*mask)[ACS_MAX_STATES];
+
+			/* s has to be t/2 or t/2 + n/2 */
+			t = code->next_state[s][b];
+			if (t >= n_states || (t >> 1) != (s & (half - 1)))
+				return -1;
+			mask = s < half ? tr->mask0 : tr->mask1;
+			for (j = 0; j < code->N; j++)
+				mask[j][t] = (out >> (code->N - 1 - j)) & 1 ?
+				             0xffffffff : 0;
+		}
+	}
+	for (t = 0; t < n_states; t++)
+		tr->pred0[t] = t >> 1;
+
+	return 0;
+}
+
+static enum osmo_conv_acs acs_cpu_best(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return OSMO_CONV_ACS_AVX2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return OSMO_CONV_ACS_SSE4;
+	return OSMO_CONV_ACS_SCALAR;
+}
+#endif /* HAVE_X86_SIMD */
+
+/* the kernel in use, resolved on first use */
+static enum osmo_conv_acs conv_acs = OSMO_CONV_ACS_AUTO;
+
+/*! \brief Select the add-compare-select kernel of the decoder
+ *  \param[in] acs kernel to use, \ref OSMO_CONV_ACS_AUTO for the fastest
+ *  \returns 0 on success, -ENOTSUP if the CPU or the build lack it
+ *
+ *  Meant for tests and benchmarks, the decoder picks the fastest one on
+ *  its own. The setting applies to all decoders of the process.
+ */
+int osmo_conv_decode_set_acs(enum osmo_conv_acs acs)
+{
+	switch (acs) {
+	case OSMO_CONV_ACS_AUTO:
+	case OSMO_CONV_ACS_SCALAR:
+		break;
+#ifdef HAVE_X86_SIMD
+	case OSMO_CONV_ACS_SSE4:
+	case OSMO_CONV_ACS_AVX2:
+		if (acs > acs_cpu_best())
+			return -ENOTSUP;
+		break;
+#endif
+	default:
+		return -ENOTSUP;
+	}
+
+	conv_acs = acs;
+	return 0;
+}
+
+/*! \brief Get the add-compare-select kernel the decoder uses
+ *  \returns the kernel, never \ref OSMO_CONV_ACS_AUTO
+ */
+enum osmo_conv_acs osmo_conv_decode_get_acs(void)
+{
+	if (conv_acs == OSMO_CONV_ACS_AUTO) {
+#ifdef HAVE_X86_SIMD
+		conv_acs = acs_cpu_best();
+#else
+		conv_acs = OSMO_CONV_ACS_SCALAR;
+#endif
+	}
+	return conv_acs;
+}
+
+int osmo_conv_decode_scan_acs(struct osmo_conv_decoder *decoder,
+                              const sbit_t *input, int n)
+{
+#ifdef HAVE_X86_SIMD
+	const struct osmo_conv_code *code = decoder->code;
+	struct acs_trellis tr;
+	struct acs_metric bm;
+	acs_step_t step;
+	sbit_t in_sym[ACS_MAX_N];
+	int i, j, i_idx, p_idx;
+
+	switch (osmo_conv_decode_get_acs()) {
+	case OSMO_CONV_ACS_SSE4:
+		step = acs_step_sse4;
+		break;
+	case OSMO_CONV_ACS_AVX2:
+		step = acs_step_avx2;
+		break;
+	default:
+		return -1;
+	}
+	if (acs_trellis_init(&tr, code, decoder->n_states) < 0)
+		return -1;
+
+	i_idx = 0;
+	p_idx = decoder->p_idx;
+
+	for (i = 0; i < n; i++) {
+		/* Get input, as the portable scan does */
+		if (code->puncture) {
+			for (j = 0; j < code->N; j++) {
+				int idx = ((decoder->o_idx + i) * code->N) + j;
+				if (idx == code->puncture[p_idx]) {
+					in_sym[j] = 0;	/* Undefined */
+					p_idx++;
+				} else {
+					in_sym[j] = input[i_idx];
+					i_idx++;
+				}
+			}
+		} else {
+			memcpy(in_sym, &input[i_idx], code->N);
+			i_idx += code->N;
+		}
+
+		/* Error of each symbol for an output bit of 0 and 1 */
+		bm.e0 = 0;
+		for (j = 0; j < code->N; j++) {
+			int is = in_sym[j];
+			uint32_t e0 = 0, e1 = 0;
+
+			if (is) {
+				e0 = ((is - 127) * (is - 127)) >> 9;
+				e1 = ((is + 127) * (is + 127)) >> 9;
+			}
+			bm.e0 += e0;
+			bm.d[j] = e1 - e0;
+		}
+
+		step(&tr, &bm, decoder->ae, decoder->ae_next,
+		     &decoder->state_history[decoder->n_states *
+		                             (decoder->o_idx + i)]);
+		memcpy(decoder->ae, decoder->ae_next,
+		       sizeof(unsigned int) * decoder->n_states);
+	}
+
+	/* Update decoder state */
+	decoder->p_idx = p_idx;
+	decoder->o_idx += n;
+
+	return i_idx;
+#else
+	return -1;
+#endif
+}
+
+/*! @} */
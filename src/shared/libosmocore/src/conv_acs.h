@@ -0,0 +1,44 @@
+/*
+ * conv_acs.h
+ *
+ * Vector add-compare-select kernels of the Viterbi decoder and codecs
+ * specialised for the GSM codes, internal to conv.c
+ *
+ * (C) 2013 by the osmocom-bb contributors
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __OSMO_CONV_ACS_H__
+#define __OSMO_CONV_ACS_H__
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/conv.h>
+
+#define MAX_AE 0x00ffffff
+
+/* scan with the selected vector kernel, -1 if the code or the CPU
+ * needs the portable one */
+int osmo_conv_decode_scan_acs(struct osmo_conv_decoder *decoder,
+                              const sbit_t *input, int n);
+
+/* all-in-one encoding of the GSM codes, -1 if the code needs the
+ * generic path, decoding is in conv.h */
+int osmo_conv_encode_gsm(const struct osmo_conv_code *code,
+                         const ubit_t *input, ubit_t *output);
+
+#endif /* __OSMO_CONV_ACS_H__ */
@@ -0,0 +1,541 @@
+/*
+ * conv_gsm.c
+ *
+ * Convolutional encoders and decoders specialised for the GSM codes
+ *
+ * (C) 2013 by the osmocom-bb contributors
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*! \addtogroup conv
+ *  @{
+ */
+
+/*! \file conv_gsm.c
+ *  \brief Convolutional codecs specialised for the trellises of GSM 05.03
+ *
+ * GSM uses few trellises for many codes: the rate 1/2, K = 5 one of
+ * the xCCH, TCH/FS, RACH, SCH and CS-1 to CS-3 codes, and the rate 1/3,
+ * K = 7 one of TCH/HS. A code passed to \ref osmo_conv_encode or
+ * \ref osmo_conv_decode that uses one of them, with FLUSH or TRUNCATION
+ * termination, is handled here by a codec that has the trellis built
+ * in as constants; the length and the puncturing still come from the
+ * code. Codes are recognized by their tables, not by their address,
+ * so a private copy of the tables is just as fast.
+ *
+ * The codes are feed-forward, so the outputs of a step are parities of
+ * the tapped bits of the shift register. The encoder works on whole
+ * bytes of input at once: shifting the register by one delay shifts
+ * the outputs of all 8 steps by one bit, so the 8 outputs of each
+ * generator are a xor of shifted copies of the register. Only turning
+ * them into unpacked bits is done by table.
+ *
+ * The encoder is portable and always used for these codes. The decoder
+ * gives the same results as the portable one bit for bit, see
+ * conv_acs.c. It keeps all accumulated errors in AVX2 registers and
+ * the survivors as one bit per state, and is only used when the AVX2
+ * kernel is selected.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/conv.h>
+
+#include "conv_acs.h"
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* longest code, in data bits, handled here */
+#define CONV_GSM_MAX_LEN	1024
+#define CONV_GSM_MAX_K		7
+#define CONV_GSM_MAX_N		3
+#define CONV_GSM_MAX_STATES	(1 << (CONV_GSM_MAX_K - 1))
+#define CONV_GSM_MAX_STEPS	(CONV_GSM_MAX_LEN + CONV_GSM_MAX_K - 1)
+
+#define ALWAYS_INLINE		inline __attribute__((always_inline))
+
+/* loops over the taps, outputs and states are unrolled, their bounds
+ * are constants once the templates below are inlined */
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+#define UNROLL			_Pragma("GCC unroll 64")
+#else
+#define UNROLL
+#endif
+
+/* GSM 05.03, G0 = 1 + D3 + D4, G1 = 1 + D + D3 + D4 */
+static const uint8_t conv_gsm_k5_next_output[][2] = {
+	{ 0, 3 }, { 1, 2 }, { 0, 3 }, { 1, 2 },
+	{ 3, 0 }, { 2, 1 }, { 3, 0 }, { 2, 1 },
+	{ 3, 0 }, { 2, 1 }, { 3, 0 }, { 2, 1 },
+	{ 0, 3 }, { 1, 2 }, { 0, 3 }, { 1, 2 },
+};
+
+static const uint8_t conv_gsm_k5_next_state[][2] = {
+	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
+	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
+	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
+	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
+};
+
+/* GSM 05.03, G4 = 1 + D2 + D3 + D5 + D6, G5 = 1 + D + D4 + D6,
+ * G6 = 1 + D + D2 + D3 + D4 + D6 */
+static const uint8_t conv_gsm_k7_next_output[][2] = {
+	{ 0, 7 }, { 3, 4 }, { 5, 2 }, { 6, 1 },
+	{ 5, 2 }, { 6, 1 }, { 0, 7 }, { 3, 4 },
+	{ 3, 4 }, { 0, 7 }, { 6, 1 }, { 5, 2 },
+	{ 6, 1 }, { 5, 2 }, { 3, 4 }, { 0, 7 },
+	{ 4, 3 }, { 7, 0 }, { 1, 6 }, { 2, 5 },
+	{ 1, 6 }, { 2, 5 }, { 4, 3 }, { 7, 0 },
+	{ 7, 0 }, { 4, 3 }, { 2, 5 }, { 1, 6 },
+	{ 2, 5 }, { 1, 6 }, { 7, 0 }, { 4, 3 },
+	{ 7, 0 }, { 4, 3 }, { 2, 5 }, { 1, 6 },
+	{ 2, 5 }, { 1, 6 }, { 7, 0 }, { 4, 3 },
+	{ 4, 3 }, { 7, 0 }, { 1, 6 }, { 2, 5 },
+	{ 1, 6 }, { 2, 5 }, { 4, 3 }, { 7, 0 },
+	{ 3, 4 }, { 0, 7 }, { 6, 1 }, { 5, 2 },
+	{ 6, 1 }, { 5, 2 }, { 3, 4 }, { 0, 7 },
+	{ 0, 7 }, { 3, 4 }, { 5, 2 }, { 6, 1 },
+	{ 5, 2 }, { 6, 1 }, { 0, 7 }, { 3, 4 },
+};
+
+static const uint8_t conv_gsm_k7_next_state[][2] = {
+	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
+	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
+	{ 16, 17 }, { 18, 19 }, { 20, 21 }, { 22, 23 },
+	{ 24, 25 }, { 26, 27 }, { 28, 29 }, { 30, 31 },
+	{ 32, 33 }, { 34, 35 }, { 36, 37 }, { 38, 39 },
+	{ 40, 41 }, { 42, 43 }, { 44, 45 }, { 46, 47 },
+	{ 48, 49 }, { 50, 51 }, { 52, 53 }, { 54, 55 },
+	{ 56, 57 }, { 58, 59 }, { 60, 61 }, { 62, 63 },
+	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
+	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
+	{ 16, 17 }, { 18, 19 }, { 20, 21 }, { 22, 23 },
+	{ 24, 25 }, { 26, 27 }, { 28, 29 }, { 30, 31 },
+	{ 32, 33 }, { 34, 35 }, { 36, 37 }, { 38, 39 },
+	{ 40, 41 }, { 42, 43 }, { 44, 45 }, { 46, 47 },
+	{ 48, 49 }, { 50, 51 }, { 52, 53 }, { 54, 55 },
+	{ 56, 57 }, { 58, 59 }, { 60, 61 }, { 62, 63 },
+};
+
+/* Taps of the generators, bit d for the input of d steps ago, with the
+ * register holding the newest input in its LSB. The first generator
+ * gives the first output bit, the MSB of next_output. */
+#define CONV_GSM_K5_G0	0x19
+#define CONV_GSM_K5_G1	0x1b
+#define CONV_GSM_K7_G4	0x6d
+#define CONV_GSM_K7_G5	0x53
+#define CONV_GSM_K7_G6	0x5f
+
+/* whether the code uses the trellis and a termination handled here */
+static int conv_gsm_match(const struct osmo_conv_code *code, int N, int K,
+                          const uint8_t (*next_output)[2],
+                          const uint8_t (*next_state)[2])
+{
+	size_t size = sizeof(next_output[0]) << (K - 1);
+
+	if (code->N != N || code->K != K ||
+	    code->len < 0 || code->len > CONV_GSM_MAX_LEN ||
+	    code->next_term_output || code->next_term_state)
+		return 0;
+	if (code->term != CONV_TERM_FLUSH &&
+	    code->term != CONV_TERM_TRUNCATION)
+		return 0;
+	if (code->next_output != next_output &&
+	    memcmp(code->next_output, next_output, size))
+		return 0;
+	if (code->next_state != next_state &&
+	    memcmp(code->next_state, next_state, size))
+		return 0;
+
+	return 1;
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Encoding                                                                 */
+/* ------------------------------------------------------------------------ */
+
+/* the bits of a byte, MSB first, as unpacked bits at every other byte */
+#define SPREAD_EVEN(b) { {						\
+	(b) >> 7 & 1, 0, (b) >> 6 & 1, 0, (b) >> 5 & 1, 0, (b) >> 4 & 1, 0,	\
+	(b) >> 3 & 1, 0, (b) >> 2 & 1, 0, (b) >> 1 & 1, 0, (b) & 1, 0 } }
+#define SPREAD_ODD(b) { {						\
+	0, (b) >> 7 & 1, 0, (b) >> 6 & 1, 0, (b) >> 5 & 1, 0, (b) >> 4 & 1,	\
+	0, (b) >> 3 & 1, 0, (b) >> 2 & 1, 0, (b) >> 1 & 1, 0, (b) & 1 } }
+#define SPREAD4(m, b)	m(b), m((b) + 1), m((b) + 2), m((b) + 3)
+#define SPREAD16(m, b)	SPREAD4(m, b), SPREAD4(m, (b) + 4), \
+			SPREAD4(m, (b) + 8), SPREAD4(m, (b) + 12)
+#define SPREAD64(m, b)	SPREAD16(m, b), SPREAD16(m, (b) + 16), \
+			SPREAD16(m, (b) + 32), SPREAD16(m, (b) + 48)
+#define SPREAD256(m)	SPREAD64(m, 0), SPREAD64(m, 64), \
+			SPREAD64(m, 128), SPREAD64(m, 192)
+
+/* interleaves the outputs of two generators, 8 steps at a time */
+static const union {
+	ubit_t b[16];
+	uint64_t w[2];
+} conv_gsm_spread[2][256] = {
+	{ SPREAD256(SPREAD_EVEN) },
+	{ SPREAD256(SPREAD_ODD) },
+};
+
+/* xor of the register shifted by each tap: bit 7 - k of the result is
+ * the output of the k-th of the last 8 steps, bit 0 that of the last */
+static ALWAYS_INLINE unsigned int
+conv_gsm_taps(unsigned int reg, const unsigned int taps, const int K)
+{
+	unsigned int y = 0;
+	int d;
+
+	UNROLL
+	for (d = 0; d < K; d++)
+		if (taps & (1 << d))
+			y ^= reg >> d;
+
+	return y;
+}
+
+static ALWAYS_INLINE void
+conv_gsm_emit8(ubit_t *out, const unsigned int *y, const int N)
+{
+	int j, k;
+
+	if (N == 2) {
+		uint64_t w;
+
+		w = conv_gsm_spread[0][y[0]].w[0] | conv_gsm_spread[1][y[1]].w[0];
+		memcpy(&out[0], &w, sizeof(w));
+		w = conv_gsm_spread[0][y[0]].w[1] | conv_gsm_spread[1][y[1]].w[1];
+		memcpy(&out[8], &w, sizeof(w));
+		return;
+	}
+
+	UNROLL
+	for (k = 0; k < 8; k++) {
+		UNROLL
+		for (j = 0; j < N; j++)
+			out[k * N + j] = (y[j] >> (7 - k)) & 1;
+	}
+}
+
+static ALWAYS_INLINE int
+conv_gsm_encode_tpl(const struct osmo_conv_code *code,
+                    const ubit_t *input, ubit_t *output,
+                    const int N, const int K, const unsigned int g0,
+                    const unsigned int g1, const unsigned int g2)
+{
+	const unsigned int taps[CONV_GSM_MAX_N] = { g0, g1, g2 };
+	ubit_t buf[CONV_GSM_MAX_STEPS * CONV_GSM_MAX_N];
+	ubit_t *out = code->puncture ? buf : output;
+	unsigned int reg = 0, y[CONV_GSM_MAX_N];
+	int n = code->len, steps = n;
+	int i, j, k;
+
+	if (code->term == CONV_TERM_FLUSH)
+		steps += K - 1;
+
+	/* whole bytes, the register keeps the bits of all earlier ones */
+	for (i = 0; i + 8 <= n; i += 8) {
+		unsigned int byte = 0;
+
+		UNROLL
+		for (k = 0; k < 8; k++)
+			byte = (byte << 1) | input[i + k];
+		reg = (reg << 8) | byte;
+		UNROLL
+		for (j = 0; j < N; j++)
+			y[j] = conv_gsm_taps(reg, taps[j], K) & 0xff;
+		conv_gsm_emit8(&out[i * N], y, N);
+	}
+
+	/* the rest and the flush bits */
+	for (; i < steps; i++) {
+		reg = (reg << 1) | (i < n ? input[i] : 0);
+		UNROLL
+		for (j = 0; j < N; j++)
+			out[i * N + j] = conv_gsm_taps(reg, taps[j], K) & 1;
+	}
+
+	if (code->puncture) {
+		const int *p = code->puncture;
+		int o_idx = 0;
+
+		for (i = 0; i < steps * N; i++) {
+			if (i == *p)
+				p++;
+			else
+				output[o_idx++] = buf[i];
+		}
+		return o_idx;
+	}
+
+	return steps * N;
+}
+
+static int conv_gsm_encode_k5(const struct osmo_conv_code *code,
+                              const ubit_t *input, ubit_t *output)
+{
+	return conv_gsm_encode_tpl(code, input, output, 2, 5,
+	                           CONV_GSM_K5_G0, CONV_GSM_K5_G1, 0);
+}
+
+static int conv_gsm_encode_k7(const struct osmo_conv_code *code,
+                              const ubit_t *input, ubit_t *output)
+{
+	return conv_gsm_encode_tpl(code, input, output, 3, 7,
+	                           CONV_GSM_K7_G4, CONV_GSM_K7_G5,
+	                           CONV_GSM_K7_G6);
+}
+
+int osmo_conv_encode_gsm(const struct osmo_conv_code *code,
+                         const ubit_t *input, ubit_t *output)
+{
+	if (conv_gsm_match(code, 2, 5, conv_gsm_k5_next_output,
+	                   conv_gsm_k5_next_state))
+		return conv_gsm_encode_k5(code, input, output);
+	if (conv_gsm_match(code, 3, 7, conv_gsm_k7_next_output,
+	                   conv_gsm_k7_next_state))
+		return conv_gsm_encode_k7(code, input, output);
+
+	return -1;
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Decoding (viterbi)                                                       */
+/* ------------------------------------------------------------------------ */
+
+#ifdef HAVE_X86_SIMD
+
+/*
+ * Lane l of accumulated error vector v is state 8v + l. State t is
+ * reached from t/2 and t/2 + n/2, so for vector v the predecessors are
+ * the lower or upper half of vector v/2 and v/2 + n/16, each lane taken
+ * twice. The branch errors of a step only depend on the 2^N possible
+ * outputs, they are computed once into the lanes of a vector and then
+ * picked by the output of each branch.
+ */
+__attribute__((target("avx2")))
+static ALWAYS_INLINE int
+conv_gsm_decode_tpl(const struct osmo_conv_code *code,
+                    const sbit_t *input, ubit_t *output,
+                    const int N, const int K,
+                    const uint8_t (*next_output)[2])
+{
+	const int n_states = 1 << (K - 1), nv = n_states / 8;
+	const __m256i max_ae = _mm256_set1_epi32(MAX_AE);
+	const __m256i dup_lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	const __m256i dup_hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+	__m256i ae[CONV_GSM_MAX_STATES / 8];
+	__m256i out0[CONV_GSM_MAX_STATES / 8], out1[CONV_GSM_MAX_STATES / 8];
+	__m256i obit[CONV_GSM_MAX_N];
+	uint64_t hist[CONV_GSM_MAX_STEPS];
+	sbit_t buf[CONV_GSM_MAX_STEPS * CONV_GSM_MAX_N];
+	uint32_t lanes[CONV_GSM_MAX_STATES];
+	const sbit_t *in = input;
+	int n = code->len, steps = n;
+	unsigned int state, min_ae;
+	int i, j, l, v;
+
+	if (code->term == CONV_TERM_FLUSH)
+		steps += K - 1;
+
+	/* punctured symbols are erasures */
+	if (code->puncture) {
+		const int *p = code->puncture;
+		int i_idx = 0;
+
+		for (i = 0; i < steps * N; i++) {
+			if (i == *p) {
+				buf[i] = 0;
+				p++;
+			} else {
+				buf[i] = input[i_idx++];
+			}
+		}
+		in = buf;
+	}
+
+	/* output of the branches into each state, from t/2 and t/2 + n/2 */
+	for (v = 0; v < nv; v++) {
+		for (l = 0; l < 8; l++)
+			lanes[l] = next_output[4 * v + l / 2][l & 1];
+		out0[v] = _mm256_loadu_si256((const __m256i *)lanes);
+		for (l = 0; l < 8; l++)
+			lanes[l] = next_output[4 * v + l / 2 + n_states / 2][l & 1];
+		out1[v] = _mm256_loadu_si256((const __m256i *)lanes);
+	}
+
+	/* bit j, first symbol first, of each of the outputs */
+	for (j = 0; j < N; j++) {
+		for (l = 0; l < 8; l++)
+			lanes[l] = (l >> (N - 1 - j)) & 1 ? 0xffffffff : 0;
+		obit[j] = _mm256_loadu_si256((const __m256i *)lanes);
+	}
+
+	/* start in state 0 */
+	ae[0] = _mm256_insert_epi32(max_ae, 0, 0);
+	for (v = 1; v < nv; v++)
+		ae[v] = max_ae;
+
+	for (i = 0; i < steps; i++) {
+		const sbit_t *sym = &in[i * N];
+		__m256i bm = _mm256_setzero_si256(), ae_next[CONV_GSM_MAX_STATES / 8];
+		uint32_t e0 = 0;
+		uint64_t sel_bits = 0;
+
+		UNROLL
+		for (j = 0; j < N; j++) {
+			int is = sym[j];
+			uint32_t s0 = 0, s1 = 0;
+
+			if (is) {
+				s0 = ((is - 127) * (is - 127)) >> 9;
+				s1 = ((is + 127) * (is + 127)) >> 9;
+			}
+			e0 += s0;
+			bm = _mm256_add_epi32(bm, _mm256_and_si256(obit[j],
+			        _mm256_set1_epi32(s1 - s0)));
+		}
+		bm = _mm256_add_epi32(bm, _mm256_set1_epi32(e0));
+
+		UNROLL
+		for (v = 0; v < nv; v++) {
+			const __m256i dup = v & 1 ? dup_hi : dup_lo;
+			__m256i a0, a1, sel;
+
+			a0 = _mm256_add_epi32(
+			        _mm256_permutevar8x32_epi32(ae[v / 2], dup),
+			        _mm256_permutevar8x32_epi32(bm, out0[v]));
+			a1 = _mm256_add_epi32(
+			        _mm256_permutevar8x32_epi32(ae[v / 2 + nv / 2], dup),
+			        _mm256_permutevar8x32_epi32(bm, out1[v]));
+
+			/* ties go to t/2 */
+			sel = _mm256_cmpgt_epi32(a0, a1);
+			ae_next[v] = _mm256_min_epu32(_mm256_min_epu32(a0, a1),
+			                              max_ae);
+			sel_bits |= (uint64_t)_mm256_movemask_ps(
+			        _mm256_castsi256_ps(sel)) << (8 * v);
+		}
+
+		/* the flush bits are 0, no odd state is reached */
+		if (i >= n) {
+			UNROLL
+			for (v = 0; v < nv; v++)
+				ae_next[v] = _mm256_blend_epi32(ae_next[v],
+				                                max_ae, 0xaa);
+		}
+
+		UNROLL
+		for (v = 0; v < nv; v++)
+			ae[v] = ae_next[v];
+		hist[i] = sel_bits;
+	}
+
+	/* end state */
+	if (code->term == CONV_TERM_FLUSH) {
+		state = 0;
+		min_ae = _mm256_cvtsi256_si32(ae[0]);
+	} else {
+		int min_state = -1;
+
+		for (v = 0; v < nv; v++)
+			_mm256_storeu_si256((__m256i *)&lanes[8 * v], ae[v]);
+		min_ae = MAX_AE;
+		for (l = 0; l < n_states; l++) {
+			if (lanes[l] < min_ae) {
+				min_ae = lanes[l];
+				min_state = l;
+			}
+		}
+		if (min_state < 0)
+			return -1;
+		state = min_state;
+	}
+
+	/* traceback, no output for the flush bits */
+	for (i = steps - 1; i >= 0; i--) {
+		if (i < n)
+			output[i] = state & 1;
+		state = (state >> 1) +
+		        ((hist[i] >> state) & 1) * (n_states / 2);
+	}
+
+	return min_ae;
+}
+
+__attribute__((target("avx2")))
+static int conv_gsm_decode_k5(const struct osmo_conv_code *code,
+                              const sbit_t *input, ubit_t *output)
+{
+	return conv_gsm_decode_tpl(code, input, output, 2, 5,
+	                           conv_gsm_k5_next_output);
+}
+
+__attribute__((target("avx2")))
+static int conv_gsm_decode_k7(const struct osmo_conv_code *code,
+                              const sbit_t *input, ubit_t *output)
+{
+	return conv_gsm_decode_tpl(code, input, output, 3, 7,
+	                           conv_gsm_k7_next_output);
+}
+
+#endif /* HAVE_X86_SIMD */
+
+/*! \brief Decode with the decoder specialised for the GSM codes
+ *  \param[in] code description of convolutional code to be used
+ *  \param[in] input array of soft bits (coded)
+ *  \param[out] output array of unpacked bits (decoded)
+ *  \param[out] rv what \ref osmo_conv_decode would return
+ *  \returns 0 if decoded, -1 if the code, the CPU or the selected
+ *	     kernel needs the generic decoder
+ *
+ * The results are the same as those of the generic decoder, without
+ * setting up the state of a decoder. The specialised decoder is only
+ * used with the AVX2 kernel.
+ */
+int osmo_conv_decode_gsm(const struct osmo_conv_code *code,
+                         const sbit_t *input, ubit_t *output, int *rv)
+{
+#ifdef HAVE_X86_SIMD
+	if (osmo_conv_decode_get_acs() != OSMO_CONV_ACS_AVX2)
+		return -1;
+
+	if (conv_gsm_match(code, 2, 5, conv_gsm_k5_next_output,
+	                   conv_gsm_k5_next_state)) {
+		*rv = conv_gsm_decode_k5(code, input, output);
+		return 0;
+	}
+	if (conv_gsm_match(code, 3, 7, conv_gsm_k7_next_output,
+	                   conv_gsm_k7_next_state)) {
+		*rv = conv_gsm_decode_k7(code, input, output);
+		return 0;
+	}
+#endif
+
+	return -1;
+}
+
+/*! @} */
@@ -30,21 +30,314 @@
  *  \file Osmocom generic CRC routines (for max XX bits poly)
  */
 
+#include "config.h"
+
+#include <errno.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <osmocom/core/bits.h>
 #include <osmocom/core/crcXXgen.h>
 
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
 
-/*! \brief Compute the CRC value of a given array of hard-bits
- *  \param[in] code The CRC code description to apply
- *  \param[in] in Array of hard bits
- *  \param[in] len Length of the array of hard bits
- *  \returns The CRC value
+/* The engines other than the bitwise one work on packed bits with the
+ * CRC register left aligned in 64 bits: CRC bit i is bit 63 - (bits-1-i)
+ * and the polynomial, left aligned the same way, is the low part of
+ * M = x^64 + p64. They need things derived from the polynomial, which
+ * are kept for the few polynomials in use. */
+
+#define CRCXXGEN_MAX_POLYS	8
+
+struct crcXXgen_poly {
+	int bits;
+	uintXX_t poly;
+	int ready;		/* all below filled in */
+	uint64_t p64;		/* M without x^64 */
+	uint64_t mu;		/* x^128 / M without x^64, for CLMUL */
+	uint64_t k128, k192;	/* x^128 and x^192 mod M, for CLMUL */
+	uintXX_t tbl[8][256];	/* byte and k zero bytes, for SLICE8 */
+};
+
+static struct crcXXgen_poly crcXXgen_polys[CRCXXGEN_MAX_POLYS];
+static unsigned int crcXXgen_n_polys;
+
+static enum osmo_crcXXgen_engine crcXXgen_engine;
+
+static uintXX_t
+_crcXXgen_mask(int bits)
+{
+	return (uintXX_t)-1 >> (XX - bits);
+}
+
+static void
+_crcXXgen_poly_init(struct crcXXgen_poly *p, int bits, uintXX_t poly)
+{
+	uint64_t r;
+	int i, j, k;
+
+	p->bits = bits;
+	p->poly = poly;
+	p->p64 = (uint64_t)poly << (64 - bits);
+
+	/* x^128 / M by long division, the quotient bits from x^63 down */
+	p->mu = 0;
+	r = p->p64;		/* x^128 - x^64 * M, the x^64 .. x^127 terms */
+	for (i = 63; i >= 0; i--) {
+		if (r >> 63) {
+			p->mu |= 1ULL << i;
+			r = (r << 1) ^ p->p64;
+		} else
+			r <<= 1;
+	}
+
+	r = p->p64;		/* x^64 mod M */
+	for (i = 64; i < 192; i++) {
+		r = (r << 1) ^ ((r >> 63) ? p->p64 : 0);
+		if (i == 127)
+			p->k128 = r;
+	}
+	p->k192 = r;
+
+	for (i = 0; i < 256; i++) {
+		uintXX_t c = (uintXX_t)i << (XX - 8);
+
+		for (k = 0; k < 8; k++) {
+			for (j = 0; j < 8; j++)
+				c = (c << 1) ^ ((c >> (XX - 1)) ?
+					(uintXX_t)(p->p64 >> (64 - XX)) : 0);
+			p->tbl[k][i] = c;
+		}
+	}
+}
+
+/* the precomputed data of the polynomial of a code, NULL if there are
+ * too many polynomials in use already */
+static const struct crcXXgen_poly *
+_crcXXgen_poly_get(const struct osmo_crcXXgen_code *code)
+{
+	uintXX_t poly = code->poly & _crcXXgen_mask(code->bits);
+	unsigned int i, n;
+
+	n = __atomic_load_n(&crcXXgen_n_polys, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n; i++) {
+		struct crcXXgen_poly *p = &crcXXgen_polys[i];
+
+		if (__atomic_load_n(&p->ready, __ATOMIC_ACQUIRE) &&
+		    p->bits == code->bits && p->poly == poly)
+			return p;
+	}
+
+	/* claim the next slot, the count never goes past the table. Slots
+	 * are only ever added, a concurrent caller may add the same
+	 * polynomial again and use up one more slot */
+	do {
+		if (n >= CRCXXGEN_MAX_POLYS)
+			return NULL;
+		i = n;
+	} while (!__atomic_compare_exchange_n(&crcXXgen_n_polys, &n, n + 1, 0,
+	                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+	_crcXXgen_poly_init(&crcXXgen_polys[i], code->bits, poly);
+	__atomic_store_n(&crcXXgen_polys[i].ready, 1, __ATOMIC_RELEASE);
+
+	return &crcXXgen_polys[i];
+}
+
+static uint64_t
+_crcXXgen_load_be(const pbit_t *in, int n)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		v = (v << 8) | in[i];
+	return v;
+}
+
+/* the first len bits of in (1..7), MSB first, one by one */
+static uint64_t
+_crcXXgen_update_tail(const struct crcXXgen_poly *p, uint64_t crc,
+                      pbit_t in, int len)
+{
+	crc ^= (uint64_t)(in & (0xff << (8 - len))) << 56;
+	while (len--)
+		crc = (crc << 1) ^ ((crc >> 63) ? p->p64 : 0);
+	return crc;
+}
+
+static uint64_t
+_crcXXgen_update_slice8(const struct crcXXgen_poly *p, uint64_t crc64,
+                        const pbit_t *in, int len)
+{
+	uintXX_t crc = crc64 >> (64 - XX);
+
+	/* the register is XX bits here, it xors into the first bytes */
+	for (; len >= 64; len -= 64, in += 8) {
+		uint64_t d = _crcXXgen_load_be(in, 8) ^
+		             ((uint64_t)crc << (64 - XX));
+
+		crc = p->tbl[7][d >> 56] ^ p->tbl[6][(d >> 48) & 0xff] ^
+		      p->tbl[5][(d >> 40) & 0xff] ^ p->tbl[4][(d >> 32) & 0xff] ^
+		      p->tbl[3][(d >> 24) & 0xff] ^ p->tbl[2][(d >> 16) & 0xff] ^
+		      p->tbl[1][(d >>  8) & 0xff] ^ p->tbl[0][d & 0xff];
+	}
+	for (; len >= 8; len -= 8, in++)
+		crc = (uintXX_t)(crc << 8) ^
+		      p->tbl[0][(uint8_t)(crc >> (XX - 8)) ^ *in];
+
+	crc64 = (uint64_t)crc << (64 - XX);
+	if (len)
+		crc64 = _crcXXgen_update_tail(p, crc64, *in, len);
+	return crc64;
+}
+
+#ifdef HAVE_X86_SIMD
+/* v * x^64 mod M, by Barrett reduction */
+__attribute__((target("pclmul")))
+static inline uint64_t
+_crcXXgen_barrett(const struct crcXXgen_poly *p, uint64_t v)
+{
+	__m128i k = _mm_set_epi64x(p->p64, p->mu);
+	__m128i q, x = _mm_set_epi64x(0, v);
+	uint64_t r;
+
+	/* q = v * (x^64 + mu) / x^64, r = q * (x^64 + p64) mod x^64 */
+	q = _mm_clmulepi64_si128(x, k, 0x00);
+	q = _mm_xor_si128(_mm_srli_si128(q, 8), x);
+	q = _mm_clmulepi64_si128(q, k, 0x10);
+	_mm_storel_epi64((__m128i *)&r, q);
+	return r;
+}
+
+/* 16 bytes or more: they are folded into a 128 bit remainder, two
+ * independent multiplies for each 16 bytes, and that is reduced once */
+__attribute__((target("pclmul,ssse3")))
+static uint64_t
+_crcXXgen_fold(const struct crcXXgen_poly *p, uint64_t crc,
+               const pbit_t *in, int n)
+{
+	const __m128i bswap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+	                                    7, 6, 5, 4, 3, 2, 1, 0);
+	__m128i k = _mm_set_epi64x(p->k192, p->k128);
+	__m128i a, d;
+	uint64_t x[2], al;
+
+	a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)in), bswap);
+	a = _mm_xor_si128(a, _mm_set_epi64x(crc, 0));
+	for (n--, in += 16; n; n--, in += 16) {
+		d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)in), bswap);
+		a = _mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x11),
+		                  _mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x00), d));
+	}
+
+	/* a * x^64 = a_hi * x^128 + a_lo * x^64 */
+	_mm_storel_epi64((__m128i *)&al, a);
+	_mm_storeu_si128((__m128i *)x, _mm_clmulepi64_si128(a, k, 0x01));
+	return _crcXXgen_barrett(p, x[1] ^ al) ^ x[0];
+}
+
+__attribute__((target("pclmul,ssse3")))
+static uint64_t
+_crcXXgen_update_clmul(const struct crcXXgen_poly *p, uint64_t crc,
+                       const pbit_t *in, int len)
+{
+	uint64_t v;
+	int n;
+
+	if (len >= 128) {
+		n = len / 128;
+		crc = _crcXXgen_fold(p, crc, in, n);
+		in += 16 * n;
+		len -= 128 * n;
+	}
+	for (; len >= 64; len -= 64, in += 8)
+		crc = _crcXXgen_barrett(p, crc ^ _crcXXgen_load_be(in, 8));
+	if (!len)
+		return crc;
+
+	/* the last 1 to 63 bits: the ones shifted out of the register are
+	 * reduced, the ones left in it are not */
+	n = (len + 7) / 8;
+	v = crc ^ ((_crcXXgen_load_be(in, n) << (64 - 8 * n)) &
+	           ~(~0ULL >> len));
+	return _crcXXgen_barrett(p, v >> (64 - len)) ^ (v << len);
+}
+
+static enum osmo_crcXXgen_engine
+_crcXXgen_cpu_best(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("pclmul") &&
+	    __builtin_cpu_supports("ssse3"))
+		return OSMO_CRCXXGEN_CLMUL;
+	return OSMO_CRCXXGEN_SLICE8;
+}
+#endif
+
+/*! \brief Select the engine the CRC routines of this width use
+ *  \param[in] engine the engine, \ref OSMO_CRCXXGEN_AUTO for the fastest
+ *  \returns 0 on success, -ENOTSUP if the CPU does not have it
  */
-uintXX_t
-osmo_crcXXgen_compute_bits(const struct osmo_crcXXgen_code *code,
-                           const ubit_t *in, int len)
+int
+osmo_crcXXgen_set_engine(enum osmo_crcXXgen_engine engine)
+{
+	switch (engine) {
+	case OSMO_CRCXXGEN_AUTO:
+	case OSMO_CRCXXGEN_BITWISE:
+	case OSMO_CRCXXGEN_SLICE8:
+		break;
+#ifdef HAVE_X86_SIMD
+	case OSMO_CRCXXGEN_CLMUL:
+		if (_crcXXgen_cpu_best() != OSMO_CRCXXGEN_CLMUL)
+			return -ENOTSUP;
+		break;
+#endif
+	default:
+		return -ENOTSUP;
+	}
+
+	crcXXgen_engine = engine;
+	return 0;
+}
+
+/*! \brief Get the engine the CRC routines of this width use
+ *  \returns the engine, never \ref OSMO_CRCXXGEN_AUTO
+ */
+enum osmo_crcXXgen_engine
+osmo_crcXXgen_get_engine(void)
+{
+	if (crcXXgen_engine == OSMO_CRCXXGEN_AUTO) {
+#ifdef HAVE_X86_SIMD
+		crcXXgen_engine = _crcXXgen_cpu_best();
+#else
+		crcXXgen_engine = OSMO_CRCXXGEN_SLICE8;
+#endif
+	}
+	return crcXXgen_engine;
+}
+
+/* feeds len packed bits to the left aligned register, NULL p for the
+ * bitwise engine */
+static uint64_t
+_crcXXgen_update(const struct crcXXgen_poly *p, uint64_t crc,
+                 const pbit_t *in, int len)
+{
+	switch (osmo_crcXXgen_get_engine()) {
+#ifdef HAVE_X86_SIMD
+	case OSMO_CRCXXGEN_CLMUL:
+		return _crcXXgen_update_clmul(p, crc, in, len);
+#endif
+	default:
+		return _crcXXgen_update_slice8(p, crc, in, len);
+	}
+}
+
+/* the code as it always was, one bit per iteration */
+static uintXX_t
+_crcXXgen_compute_bitwise(const struct osmo_crcXXgen_code *code,
+                          const ubit_t *in, int len)
 {
 	const uintXX_t poly = code->poly;
 	uintXX_t crc = code->init;
@@ -53,13 +346,13 @@ osmo_crcXXgen_compute_bits(const struct osmo_crcXXgen_code *code,
 	for (i=0; i<len; i++) {
 		uintXX_t bit = in[i] & 1;
 		crc ^= (bit << n);
-		if (crc & (1 << n)) {
+		if (crc & ((uintXX_t)1 << n)) {
 			crc <<= 1;
 			crc ^= poly;
 		} else {
 			crc <<= 1;
 		}
-		crc &= (1ULL << code->bits) - 1;
+		crc &= _crcXXgen_mask(code->bits);
 	}
 
 	crc ^= code->remainder;
@@ -67,6 +360,80 @@ osmo_crcXXgen_compute_bits(const struct osmo_crcXXgen_code *code,
 	return crc;
 }
 
+/*! \brief Compute the CRC value of a given array of hard-bits
+ *  \param[in] code The CRC code description to apply
+ *  \param[in] in Array of hard bits
+ *  \param[in] len Length of the array of hard bits
+ *  \returns The CRC value
+ *
+ * The bits are packed a chunk at a time and go through the engine of
+ * osmo_crcXXgen_compute_pbits().
+ */
+uintXX_t
+osmo_crcXXgen_compute_bits(const struct osmo_crcXXgen_code *code,
+                           const ubit_t *in, int len)
+{
+	const struct crcXXgen_poly *p;
+	pbit_t buf[64];
+	uint64_t crc;
+	int n;
+
+	if (len <= 0 || osmo_crcXXgen_get_engine() == OSMO_CRCXXGEN_BITWISE ||
+	    !(p = _crcXXgen_poly_get(code)))
+		return _crcXXgen_compute_bitwise(code, in, len);
+
+	crc = (uint64_t)(code->init & _crcXXgen_mask(code->bits)) <<
+	      (64 - code->bits);
+	for (; len > 0; len -= n, in += n) {
+		n = len < 8 * sizeof(buf) ? len : 8 * sizeof(buf);
+		osmo_ubit2pbit(buf, in, n);
+		crc = _crcXXgen_update(p, crc, buf, n);
+	}
+
+	return (crc >> (64 - code->bits)) ^ code->remainder;
+}
+
+/*! \brief Compute the CRC value of a given array of packed bits
+ *  \param[in] code The CRC code description to apply
+ *  \param[in] in Array of packed bits, MSB first
+ *  \param[in] len Number of bits in the array
+ *  \returns The CRC value, the same osmo_crcXXgen_compute_bits() gives
+ *           for the unpacked bits
+ */
+uintXX_t
+osmo_crcXXgen_compute_pbits(const struct osmo_crcXXgen_code *code,
+                            const pbit_t *in, int len)
+{
+	const struct crcXXgen_poly *p;
+	ubit_t bits[8];
+	uintXX_t crc;
+	uint64_t c;
+	int i;
+
+	if (len > 0 && osmo_crcXXgen_get_engine() != OSMO_CRCXXGEN_BITWISE &&
+	    (p = _crcXXgen_poly_get(code))) {
+		c = (uint64_t)(code->init & _crcXXgen_mask(code->bits)) <<
+		    (64 - code->bits);
+		c = _crcXXgen_update(p, c, in, len);
+		return (c >> (64 - code->bits)) ^ code->remainder;
+	}
+
+	/* bit by bit, a byte at a time, picking up the CRC register the
+	 * previous byte left */
+	crc = code->init;
+	for (i = 0; i < len; i += 8) {
+		struct osmo_crcXXgen_code c8 = *code;
+
+		c8.init = crc;
+		c8.remainder = 0;
+		osmo_pbit2ubit(bits, &in[i / 8], 8);
+		crc = _crcXXgen_compute_bitwise(&c8, bits,
+		                                len - i < 8 ? len - i : 8);
+	}
+
+	return crc ^ code->remainder;
+}
+
 
 /*! \brief Checks the CRC value of a given array of hard-bits
  *  \param[in] code The CRC code description to apply
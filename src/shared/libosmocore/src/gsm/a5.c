@@ -34,8 +34,12 @@
  *  \brief Osmocom GSM A5 ciphering algorithm implementation
  */
 
+#include "config.h"
+
+#include <errno.h>
 #include <string.h>
 
+#include <osmocom/core/utils.h>
 #include <osmocom/gsm/a5.h>
 
 /*! \brief Main method to generate a A5/x cipher stream
@@ -364,4 +368,391 @@ osmo_a5_2(const uint8_t *key, uint32_t fn, ubit_t *dl, ubit_t *ul)
 	}
 }
 
+
+/* ------------------------------------------------------------------------ */
+/* Batches (bitsliced)                                                      */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Many generators run at once, one per bit lane of a word: word i of a
+ * register holds bit i of that register for every lane. The conditional
+ * clocking turns into a select per lane, so all lanes step together and
+ * a step costs about as much as one step of a single generator.
+ *
+ * A word is a GCC vector of 256 lanes, which the compiler maps to one
+ * AVX2, two SSE2 or four general purpose registers. Keys, frame counts
+ * and keystreams are moved in and out of the lanes by transposing 64x64
+ * bit matrices.
+ */
+
+typedef uint64_t a5_bs_t __attribute__((vector_size(32)));
+
+#define A5_BS_LANES	256
+#define A5_BS_SLICES	(A5_BS_LANES / 64)
+#define A5_BS_STEPS	228
+/* fewer keystreams than this are generated one by one */
+#define A5_BS_MIN	8
+
+#define ALWAYS_INLINE	inline __attribute__((always_inline))
+
+#define A5_BS_MAJ(a, b, c)	(((a) & (b)) | ((a) & (c)) | ((b) & (c)))
+
+/* feedback of each register, from the taps in A5_Rx_TAPS */
+#define A5_BS_R1_FB(r)	((r)[13] ^ (r)[16] ^ (r)[17] ^ (r)[18])
+#define A5_BS_R2_FB(r)	((r)[20] ^ (r)[21])
+#define A5_BS_R3_FB(r)	((r)[7] ^ (r)[20] ^ (r)[21] ^ (r)[22])
+#define A5_BS_R4_FB(r)	((r)[11] ^ (r)[16])
+
+/*! \brief State of \ref A5_BS_LANES generators */
+struct a5_bs {
+	a5_bs_t r[4][A5_R3_LEN];	/*!< \brief R1 to R4, bit by bit */
+	a5_bs_t key[64];		/*!< \brief key bits, LSB of Kc first */
+	a5_bs_t fn[22];			/*!< \brief frame count bits */
+	a5_bs_t out[A5_BS_STEPS];	/*!< \brief DL then UL keystream */
+};
+
+/*! \brief Transposes a 64x64 bit matrix
+ *  \param[inout] m Bit c of m[r] becomes bit r of m[c]
+ */
+static void
+_a5_bs_transpose(uint64_t m[64])
+{
+	uint64_t mask = 0x00000000ffffffffULL, t;
+	int j, k;
+
+	for (j = 32; j; j >>= 1, mask ^= mask << j) {
+		for (k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+			t = ((m[k] >> j) ^ m[k | j]) & mask;
+			m[k] ^= t << j;
+			m[k | j] ^= t;
+		}
+	}
+}
+
+/*! \brief Clocks the register of all lanes
+ *  \param[inout] r Register
+ *  \param[in] len Register length
+ *  \param[in] fb Feedback bits
+ */
+static ALWAYS_INLINE void
+_a5_bs_shift(a5_bs_t *r, int len, const a5_bs_t *fb)
+{
+	int i;
+
+	for (i = len - 1; i > 0; i--)
+		r[i] = r[i - 1];
+	r[0] = *fb;
+}
+
+/*! \brief Clocks the register of the lanes set in a mask
+ *  \param[inout] r Register
+ *  \param[in] len Register length
+ *  \param[in] fb Feedback bits
+ *  \param[in] m Lanes to clock
+ */
+static ALWAYS_INLINE void
+_a5_bs_clock(a5_bs_t *r, int len, const a5_bs_t *fb, const a5_bs_t *m)
+{
+	int i;
+
+	for (i = len - 1; i > 0; i--)
+		r[i] ^= (r[i] ^ r[i - 1]) & *m;
+	r[0] ^= (r[0] ^ *fb) & *m;
+}
+
+/*! \brief Runs all lanes of A5/1 or A5/2 from key load to keystream
+ *  \param[inout] s State with the key and frame count bits loaded
+ *  \param[in] n 1 or 2, for A5/1 or A5/2
+ */
+static ALWAYS_INLINE void
+_a5_bs_gen(struct a5_bs *s, int n)
+{
+	a5_bs_t *r1 = s->r[0], *r2 = s->r[1], *r3 = s->r[2], *r4 = s->r[3];
+	const a5_bs_t ones = ~(a5_bs_t){ 0 };
+	a5_bs_t fb, c0, c1, c2, maj, m;
+	int i, mix = n == 1 ? 100 : 99;
+
+	memset(s->r, 0, sizeof(s->r));
+
+	/* Key and frame count load, all registers clocked */
+	for (i = 0; i < 64 + 22; i++) {
+		const a5_bs_t *b = i < 64 ? &s->key[i] : &s->fn[i - 64];
+
+		fb = A5_BS_R1_FB(r1);
+		_a5_bs_shift(r1, A5_R1_LEN, &fb);
+		fb = A5_BS_R2_FB(r2);
+		_a5_bs_shift(r2, A5_R2_LEN, &fb);
+		fb = A5_BS_R3_FB(r3);
+		_a5_bs_shift(r3, A5_R3_LEN, &fb);
+
+		r1[0] ^= *b;
+		r2[0] ^= *b;
+		r3[0] ^= *b;
+
+		if (n == 2) {
+			fb = A5_BS_R4_FB(r4);
+			_a5_bs_shift(r4, A5_R4_LEN, &fb);
+			r4[0] ^= *b;
+		}
+	}
+
+	if (n == 2) {
+		r1[15] = ones;
+		r2[16] = ones;
+		r3[18] = ones;
+		r4[10] = ones;
+	}
+
+	/* Mix and output, majority clocked */
+	for (i = 0; i < mix + A5_BS_STEPS; i++) {
+		if (n == 1) {
+			c0 = r1[8];
+			c1 = r2[10];
+			c2 = r3[10];
+		} else {
+			c0 = r4[10];
+			c1 = r4[3];
+			c2 = r4[7];
+		}
+		maj = A5_BS_MAJ(c0, c1, c2);
+
+		fb = A5_BS_R1_FB(r1);
+		m = ~(c0 ^ maj);
+		_a5_bs_clock(r1, A5_R1_LEN, &fb, &m);
+		fb = A5_BS_R2_FB(r2);
+		m = ~(c1 ^ maj);
+		_a5_bs_clock(r2, A5_R2_LEN, &fb, &m);
+		fb = A5_BS_R3_FB(r3);
+		m = ~(c2 ^ maj);
+		_a5_bs_clock(r3, A5_R3_LEN, &fb, &m);
+
+		if (n == 2) {
+			fb = A5_BS_R4_FB(r4);
+			_a5_bs_shift(r4, A5_R4_LEN, &fb);
+		}
+
+		if (i < mix)
+			continue;
+
+		s->out[i - mix] = r1[A5_R1_LEN - 1] ^ r2[A5_R2_LEN - 1] ^
+		                  r3[A5_R3_LEN - 1];
+		if (n == 2)
+			s->out[i - mix] ^=
+				A5_BS_MAJ(r1[15], ~r1[14], r1[12]) ^
+				A5_BS_MAJ(~r2[16], r2[13], r2[9]) ^
+				A5_BS_MAJ(r3[18], r3[16], ~r3[13]);
+	}
+}
+
+static void
+_a5_bs_gen_generic(struct a5_bs *s, int n)
+{
+	_a5_bs_gen(s, n);
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("avx2")))
+static void
+_a5_bs_gen_avx2(struct a5_bs *s, int n)
+{
+	_a5_bs_gen(s, n);
+}
+#endif
+
+/*! \brief Loads keys and frame counts into the lanes
+ *  \param[out] s State
+ *  \param[in] keys num keys of 8 bytes
+ *  \param[in] fn num frame numbers
+ *  \param[in] num Number of lanes in use
+ */
+static void
+_a5_bs_load(struct a5_bs *s, const uint8_t *keys, const uint32_t *fn,
+            unsigned int num)
+{
+	uint64_t m[64];
+	unsigned int i, l, q;
+
+	for (q = 0; q < A5_BS_SLICES; q++) {
+		/* bit i of the key is bit i&7 of byte 7 - i/8 */
+		for (l = 0; l < 64; l++) {
+			const uint8_t *key = &keys[8 * (64 * q + l)];
+
+			m[l] = 0;
+			if (64 * q + l >= num)
+				continue;
+			for (i = 0; i < 8; i++)
+				m[l] = (m[l] << 8) | key[i];
+		}
+		_a5_bs_transpose(m);
+		for (i = 0; i < 64; i++)
+			s->key[i][q] = m[i];
+
+		for (l = 0; l < 64; l++)
+			m[l] = 64 * q + l < num ?
+			       osmo_a5_fn_count(fn[64 * q + l]) : 0;
+		_a5_bs_transpose(m);
+		for (i = 0; i < 22; i++)
+			s->fn[i][q] = m[i];
+	}
+}
+
+/*! \brief Writes the 114 bits of a keystream
+ *  \param[in] w Keystream bits of a lane, DL then UL, LSB first
+ *  \param[in] ofs Offset of the keystream in w
+ *  \param[out] out 114 unpacked bits or 15 bytes of packed ones
+ *  \param[in] flags OSMO_A5_F_* flags
+ */
+static void
+_a5_bs_put(const uint64_t *w, unsigned int ofs, uint8_t *out,
+           unsigned int flags)
+{
+	unsigned int i, o;
+	uint64_t v;
+
+	if (!(flags & OSMO_A5_F_PBIT)) {
+		for (i = 0; i < 114; i++) {
+			o = ofs + i;
+			out[i] = (w[o >> 6] >> (o & 63)) & 1;
+		}
+		return;
+	}
+
+	for (i = 0; i < 15; i++) {
+		o = ofs + 8 * i;
+		v = w[o >> 6] >> (o & 63);
+		if ((o & 63) > 56)
+			v |= w[(o >> 6) + 1] << (64 - (o & 63));
+		out[i] = osmo_revbytebits_8(v & 0xff);
+	}
+	/* 114 is 14 bytes and 2 bits */
+	out[14] &= 0xc0;
+}
+
+/*! \brief Writes the keystreams of all lanes in use
+ *  \param[in] s State after \ref _a5_bs_gen
+ *  \param[in] num Number of lanes in use
+ *  \param[out] dl Downlink keystreams or NULL
+ *  \param[out] ul Uplink keystreams or NULL
+ *  \param[in] flags OSMO_A5_F_* flags
+ */
+static void
+_a5_bs_store(const struct a5_bs *s, unsigned int num, uint8_t *dl,
+             uint8_t *ul, unsigned int flags)
+{
+	unsigned int len = flags & OSMO_A5_F_PBIT ? 15 : 114;
+	uint64_t m[4][64], w[4];
+	unsigned int b, k, l, q;
+
+	for (q = 0; q < A5_BS_SLICES && 64 * q < num; q++) {
+		/* lane l of 64 steps each into one word per lane */
+		for (b = 0; b < 4; b++) {
+			for (k = 0; k < 64; k++)
+				m[b][k] = 64 * b + k < A5_BS_STEPS ?
+				          s->out[64 * b + k][q] : 0;
+			_a5_bs_transpose(m[b]);
+		}
+
+		for (l = 0; l < 64 && 64 * q + l < num; l++) {
+			unsigned int i = 64 * q + l;
+
+			for (b = 0; b < 4; b++)
+				w[b] = m[b][l];
+			if (dl)
+				_a5_bs_put(w, 0, &dl[i * len], flags);
+			if (ul)
+				_a5_bs_put(w, 114, &ul[i * len], flags);
+		}
+	}
+}
+
+/*! \brief Generates the keystreams of a batch one by one
+ *  \param[in] n Which A5/x method to use
+ *  \param[in] key 8 byte array for the key
+ *  \param[in] fn Frame number
+ *  \param[out] dl Downlink keystream or NULL
+ *  \param[out] ul Uplink keystream or NULL
+ *  \param[in] flags OSMO_A5_F_* flags
+ */
+static void
+_a5_batch_one(int n, const uint8_t *key, uint32_t fn, uint8_t *dl,
+              uint8_t *ul, unsigned int flags)
+{
+	ubit_t dl_u[114], ul_u[114];
+
+	if (!(flags & OSMO_A5_F_PBIT)) {
+		osmo_a5(n, key, fn, dl, ul);
+		return;
+	}
+
+	osmo_a5(n, key, fn, dl ? dl_u : NULL, ul ? ul_u : NULL);
+	if (dl)
+		osmo_ubit2pbit(dl, dl_u, 114);
+	if (ul)
+		osmo_ubit2pbit(ul, ul_u, 114);
+}
+
+/*! \brief Generate A5/x cipher streams for many keys and frame numbers
+ *  \param[in] n Which A5/x method to use
+ *  \param[in] keys count keys of 8 bytes each, one after the other
+ *  \param[in] fn count frame numbers
+ *  \param[in] count Number of keystreams
+ *  \param[out] dl count downlink cipher streams or NULL
+ *  \param[out] ul count uplink cipher streams or NULL
+ *  \param[in] flags OSMO_A5_F_* flags
+ *  \returns 0 on success, -ENOTSUP for an unsupported A5/x
+ *
+ * Gives the same cipher streams as calling \ref osmo_a5 for each key and
+ * frame number, but generates up to 256 of them at once. Each stream is
+ * 114 unpacked bits, or 15 bytes of packed bits with \ref OSMO_A5_F_PBIT.
+ * Currently A5/[0-2] are supported.
+ */
+int
+osmo_a5_batch(int n, const uint8_t *keys, const uint32_t *fn,
+              unsigned int count, uint8_t *dl, uint8_t *ul,
+              unsigned int flags)
+{
+	unsigned int len = flags & OSMO_A5_F_PBIT ? 15 : 114;
+	unsigned int base, num, i;
+	struct a5_bs s;
+
+	switch (n) {
+	case 0:
+		if (dl)
+			memset(dl, 0x00, count * len);
+		if (ul)
+			memset(ul, 0x00, count * len);
+		return 0;
+	case 1:
+	case 2:
+		break;
+	default:
+		return -ENOTSUP;
+	}
+
+	for (base = 0; base < count; base += num) {
+		num = OSMO_MIN(count - base, A5_BS_LANES);
+
+		if (num < A5_BS_MIN) {
+			for (i = base; i < base + num; i++)
+				_a5_batch_one(n, &keys[8 * i], fn[i],
+				              dl ? &dl[i * len] : NULL,
+				              ul ? &ul[i * len] : NULL, flags);
+			continue;
+		}
+
+		_a5_bs_load(&s, &keys[8 * base], &fn[base], num);
+#ifdef HAVE_X86_SIMD
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			_a5_bs_gen_avx2(&s, n);
+		else
+#endif
+			_a5_bs_gen_generic(&s, n);
+		_a5_bs_store(&s, num, dl ? &dl[base * len] : NULL,
+		             ul ? &ul[base * len] : NULL, flags);
+	}
+
+	return 0;
+}
+
 /*! @} */
@@ -0,0 +1,592 @@
+/*
+ * gsm0503.c
+ *
+ * (C) 2013 by the osmocom-bb contributors
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*! \addtogroup gsm0503
+ *  @{
+ */
+
+/*! \file gsm0503.c
+ *  \brief Osmocom GSM 05.03 channel coding
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/conv.h>
+#include <osmocom/core/crcgen.h>
+#include <osmocom/gsm/gsm0503.h>
+
+
+/* ------------------------------------------------------------------------ */
+/* Codes                                                                    */
+/* ------------------------------------------------------------------------ */
+
+/* G0 = 1 + D^3 + D^4, G1 = 1 + D + D^3 + D^4, the code of all the
+ * channels here (GSM 05.03 section 4.1.3) */
+static const uint8_t gsm0503_k5_next_output[][2] = {
+	{ 0, 3 }, { 1, 2 }, { 0, 3 }, { 1, 2 },
+	{ 3, 0 }, { 2, 1 }, { 3, 0 }, { 2, 1 },
+	{ 3, 0 }, { 2, 1 }, { 3, 0 }, { 2, 1 },
+	{ 0, 3 }, { 1, 2 }, { 0, 3 }, { 1, 2 },
+};
+
+static const uint8_t gsm0503_k5_next_state[][2] = {
+	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
+	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
+	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
+	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
+};
+
+/* 184 data bits and 40 parity bits */
+static const struct osmo_conv_code gsm0503_xcch = {
+	.N = 2,
+	.K = 5,
+	.len = 224,
+	.term = CONV_TERM_FLUSH,
+	.next_output = gsm0503_k5_next_output,
+	.next_state  = gsm0503_k5_next_state,
+};
+
+/* 182 class 1 bits and 3 parity bits */
+static const struct osmo_conv_code gsm0503_tch_fs = {
+	.N = 2,
+	.K = 5,
+	.len = 185,
+	.term = CONV_TERM_FLUSH,
+	.next_output = gsm0503_k5_next_output,
+	.next_state  = gsm0503_k5_next_state,
+};
+
+/* 8 data bits and 6 parity bits */
+static const struct osmo_conv_code gsm0503_rach = {
+	.N = 2,
+	.K = 5,
+	.len = 14,
+	.term = CONV_TERM_FLUSH,
+	.next_output = gsm0503_k5_next_output,
+	.next_state  = gsm0503_k5_next_state,
+};
+
+/* 25 data bits and 10 parity bits */
+static const struct osmo_conv_code gsm0503_sch = {
+	.N = 2,
+	.K = 5,
+	.len = 35,
+	.term = CONV_TERM_FLUSH,
+	.next_output = gsm0503_k5_next_output,
+	.next_state  = gsm0503_k5_next_state,
+};
+
+/* (D^23 + 1)(D^17 + D^3 + 1), the fire code of section 4.1.2 */
+static const struct osmo_crc64gen_code gsm0503_fire_crc40 = {
+	.bits = 40,
+	.poly = 0x0004820009ULL,
+	.init = 0x0000000000ULL,
+	.remainder = 0xffffffffffULL,
+};
+
+/* D^3 + D + 1, section 3.1.2.1 */
+static const struct osmo_crc8gen_code gsm0503_tch_fs_crc3 = {
+	.bits = 3,
+	.poly = 0x3,
+	.init = 0x0,
+	.remainder = 0x7,
+};
+
+/* D^6 + D^5 + D^3 + D^2 + D + 1, section 4.6 */
+static const struct osmo_crc8gen_code gsm0503_rach_crc6 = {
+	.bits = 6,
+	.poly = 0x2f,
+	.init = 0x00,
+	.remainder = 0x3f,
+};
+
+/* D^10 + D^8 + D^6 + D^5 + D^4 + D^2 + 1, section 4.7 */
+static const struct osmo_crc16gen_code gsm0503_sch_crc10 = {
+	.bits = 10,
+	.poly = 0x175,
+	.init = 0x000,
+	.remainder = 0x3ff,
+};
+
+
+/* ------------------------------------------------------------------------ */
+/* Interleaving and burst mapping                                           */
+/* ------------------------------------------------------------------------ */
+
+/* Where coded bit k goes in the bursts, interleaving (sections 4.1.4 and
+ * 3.1.3) and mapping to e(B,j) (section 4.1.5) at once: burst
+ * B = k mod 4 (xCCH) or k mod 8 (TCH/FS), i(B,j) with
+ * j = 2((49k) mod 57) + ((k mod 8) div 4) and e(B,j) = i(B,j) below 57,
+ * e(B,j+2) = i(B,j) from there, past the stealing flags. Filled in
+ * when the library is loaded. */
+static uint16_t gsm0503_xcch_pos[456];
+static uint16_t gsm0503_tch_fs_pos[456];
+
+static __attribute__((constructor)) void on_dso_load_gsm0503(void)
+{
+	int k, j;
+
+	for (k = 0; k < 456; k++) {
+		j = 2 * ((49 * k) % 57) + ((k % 8) >> 2);
+		if (j >= 57)
+			j += 2;
+		gsm0503_xcch_pos[k] = (k % 4) * GSM0503_BURST_BITS + j;
+		gsm0503_tch_fs_pos[k] = (k % 8) * GSM0503_BURST_BITS + j;
+	}
+}
+
+static int
+_gsm0503_conv_decode(struct osmo_conv_decoder *dec,
+                     const struct osmo_conv_code *code,
+                     const sbit_t *in, ubit_t *out)
+{
+	int l, rv;
+
+	/* the specialised decoder needs no state, the others use the one
+	 * the batch set up once */
+	if (!dec)
+		return osmo_conv_decode(code, in, out);
+	if (osmo_conv_decode_gsm(code, in, out, &rv) == 0)
+		return rv;
+
+	osmo_conv_decode_reset(dec, 0);
+	l = osmo_conv_decode_scan(dec, in, code->len);
+	osmo_conv_decode_flush(dec, &in[l]);
+	return osmo_conv_decode_get_output(dec, out, 1, 0);
+}
+
+/* the coded bits whose hard decision is not what the decoded bits give */
+static int
+_gsm0503_count_errors(const struct osmo_conv_code *code, const ubit_t *u,
+                      const sbit_t *s, ubit_t *c)
+{
+	int i, l, n = 0;
+
+	l = osmo_conv_encode(code, u, c);
+	for (i = 0; i < l; i++)
+		n += c[i] != (s[i] < 0);
+
+	return n;
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* xCCH                                                                     */
+/* ------------------------------------------------------------------------ */
+
+static void
+_gsm0503_xcch_encode(ubit_t *bursts, const uint8_t *l2_data, ubit_t *u,
+                     ubit_t *c)
+{
+	int k, b;
+
+	osmo_pbit2ubit_ext(u, 0, l2_data, 0, 184, 1);
+	osmo_crc64gen_set_bits(&gsm0503_fire_crc40, u, 184, u + 184);
+	osmo_conv_encode(&gsm0503_xcch, u, c);
+
+	for (k = 0; k < 456; k++)
+		bursts[gsm0503_xcch_pos[k]] = c[k];
+
+	/* both stealing flags set, section 4.1.5 */
+	for (b = 0; b < 4; b++) {
+		bursts[b * GSM0503_BURST_BITS + 57] = 1;
+		bursts[b * GSM0503_BURST_BITS + 58] = 1;
+	}
+}
+
+static int
+_gsm0503_xcch_decode(struct osmo_conv_decoder *dec, uint8_t *l2_data,
+                     const sbit_t *bursts, int *n_errors, ubit_t *u,
+                     ubit_t *c, sbit_t *s)
+{
+	int k;
+
+	for (k = 0; k < 456; k++)
+		s[k] = bursts[gsm0503_xcch_pos[k]];
+
+	_gsm0503_conv_decode(dec, &gsm0503_xcch, s, u);
+	if (n_errors)
+		*n_errors = _gsm0503_count_errors(&gsm0503_xcch, u, s, c);
+
+	if (osmo_crc64gen_check_bits(&gsm0503_fire_crc40, u, 184, u + 184))
+		return -1;
+
+	osmo_ubit2pbit_ext(l2_data, 0, u, 0, 184, 1);
+
+	return 0;
+}
+
+/*! \brief Encode an xCCH L2 block
+ *  \param[out] bursts 4 bursts of \ref GSM0503_BURST_BITS bits
+ *  \param[in] l2_data \ref GSM0503_XCCH_L2_LEN bytes
+ *  \returns 0
+ */
+int
+gsm0503_xcch_encode(ubit_t *bursts, const uint8_t *l2_data)
+{
+	ubit_t u[228], c[456];
+
+	_gsm0503_xcch_encode(bursts, l2_data, u, c);
+
+	return 0;
+}
+
+/*! \brief Decode an xCCH L2 block
+ *  \param[out] l2_data \ref GSM0503_XCCH_L2_LEN bytes, written if the
+ *              CRC matches
+ *  \param[in] bursts soft bits of 4 bursts of \ref GSM0503_BURST_BITS
+ *  \param[out] n_errors coded bits in error, or NULL
+ *  \param[out] n_bits_total coded bits, or NULL
+ *  \returns 0, or -1 if the CRC does not match
+ */
+int
+gsm0503_xcch_decode(uint8_t *l2_data, const sbit_t *bursts,
+                    int *n_errors, int *n_bits_total)
+{
+	ubit_t u[228], c[456];
+	sbit_t s[456];
+
+	if (n_bits_total)
+		*n_bits_total = 456;
+
+	return _gsm0503_xcch_decode(NULL, l2_data, bursts, n_errors, u, c, s);
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* TCH/FS                                                                   */
+/* ------------------------------------------------------------------------ */
+
+static void
+_gsm0503_tch_fs_encode(ubit_t *bursts, const uint8_t *frame, ubit_t *u,
+                       ubit_t *c)
+{
+	ubit_t d[260], p[3];
+	int i, k, b;
+
+	osmo_pbit2ubit(d, frame, 260);
+
+	/* class 1: parity on class 1a, then reordered, section 3.1.2 */
+	osmo_crc8gen_set_bits(&gsm0503_tch_fs_crc3, d, 50, p);
+	for (i = 0; i < 91; i++) {
+		u[i] = d[2 * i];
+		u[184 - i] = d[2 * i + 1];
+	}
+	for (i = 0; i < 3; i++)
+		u[91 + i] = p[i];
+	osmo_conv_encode(&gsm0503_tch_fs, u, c);
+
+	/* class 2, uncoded */
+	memcpy(&c[378], &d[182], 78);
+
+	for (k = 0; k < 456; k++)
+		bursts[gsm0503_tch_fs_pos[k]] = c[k];
+
+	/* speech, not stolen: hu(B) of the even bits in bursts 0..3,
+	 * hl(B) of the odd ones in bursts 4..7, section 3.1.4 */
+	for (b = 0; b < 4; b++) {
+		bursts[b * GSM0503_BURST_BITS + 58] = 0;
+		bursts[(b + 4) * GSM0503_BURST_BITS + 57] = 0;
+	}
+}
+
+static int
+_gsm0503_tch_fs_decode(struct osmo_conv_decoder *dec, uint8_t *frame,
+                       const sbit_t *bursts, int *n_errors, ubit_t *u,
+                       ubit_t *c, sbit_t *s)
+{
+	ubit_t d[260];
+	int i, k;
+
+	for (k = 0; k < 456; k++)
+		s[k] = bursts[gsm0503_tch_fs_pos[k]];
+
+	_gsm0503_conv_decode(dec, &gsm0503_tch_fs, s, u);
+	if (n_errors)
+		*n_errors = _gsm0503_count_errors(&gsm0503_tch_fs, u, s, c);
+
+	for (i = 0; i < 91; i++) {
+		d[2 * i] = u[i];
+		d[2 * i + 1] = u[184 - i];
+	}
+	if (osmo_crc8gen_check_bits(&gsm0503_tch_fs_crc3, d, 50, &u[91]))
+		return -1;
+
+	osmo_sbit2ubit(&d[182], &s[378], 78);
+	osmo_ubit2pbit(frame, d, 260);
+
+	return 0;
+}
+
+/*! \brief Encode a TCH/FS frame
+ *  \param[out] bursts 8 bursts of \ref GSM0503_BURST_BITS bits, only the
+ *              bits of this block are written
+ *  \param[in] frame \ref GSM0503_TCH_FS_LEN bytes
+ *  \returns 0
+ */
+int
+gsm0503_tch_fs_encode(ubit_t *bursts, const uint8_t *frame)
+{
+	ubit_t u[228], c[456];
+
+	_gsm0503_tch_fs_encode(bursts, frame, u, c);
+
+	return 0;
+}
+
+/*! \brief Decode a TCH/FS frame
+ *  \param[out] frame \ref GSM0503_TCH_FS_LEN bytes, written if the CRC
+ *              matches
+ *  \param[in] bursts soft bits of 8 bursts of \ref GSM0503_BURST_BITS
+ *  \param[out] n_errors class 1 coded bits in error, or NULL
+ *  \param[out] n_bits_total class 1 coded bits, or NULL
+ *  \returns 0, or -1 if the CRC does not match (a bad frame)
+ */
+int
+gsm0503_tch_fs_decode(uint8_t *frame, const sbit_t *bursts,
+                      int *n_errors, int *n_bits_total)
+{
+	ubit_t u[228], c[456];
+	sbit_t s[456];
+
+	if (n_bits_total)
+		*n_bits_total = 378;
+
+	return _gsm0503_tch_fs_decode(NULL, frame, bursts, n_errors, u, c, s);
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* RACH and SCH                                                             */
+/* ------------------------------------------------------------------------ */
+
+/*! \brief Encode an access burst
+ *  \param[out] burst \ref GSM0503_RACH_BITS bits
+ *  \param[in] ra the 8 bit random access information
+ *  \param[in] bsic BSIC of the cell, added to the parity bits
+ *  \returns 0
+ */
+int
+gsm0503_rach_encode(ubit_t *burst, uint8_t ra, uint8_t bsic)
+{
+	ubit_t u[14];
+	int i;
+
+	osmo_pbit2ubit_ext(u, 0, &ra, 0, 8, 1);
+	osmo_crc8gen_set_bits(&gsm0503_rach_crc6, u, 8, u + 8);
+	for (i = 0; i < 6; i++)
+		u[8 + i] ^= (bsic >> (5 - i)) & 1;
+	osmo_conv_encode(&gsm0503_rach, u, burst);
+
+	return 0;
+}
+
+/*! \brief Decode an access burst
+ *  \param[out] ra the 8 bit random access information
+ *  \param[in] burst \ref GSM0503_RACH_BITS soft bits
+ *  \param[in] bsic BSIC of the cell
+ *  \returns 0, or -1 if the CRC does not match
+ */
+int
+gsm0503_rach_decode(uint8_t *ra, const sbit_t *burst, uint8_t bsic)
+{
+	ubit_t u[14];
+	int i;
+
+	osmo_conv_decode(&gsm0503_rach, burst, u);
+	for (i = 0; i < 6; i++)
+		u[8 + i] ^= (bsic >> (5 - i)) & 1;
+	if (osmo_crc8gen_check_bits(&gsm0503_rach_crc6, u, 8, u + 8))
+		return -1;
+
+	*ra = 0;
+	osmo_ubit2pbit_ext(ra, 0, u, 0, 8, 1);
+
+	return 0;
+}
+
+/*! \brief Encode a synchronisation burst
+ *  \param[out] burst \ref GSM0503_SCH_BITS bits, the first 39 go before
+ *              the extended training sequence, the others after it
+ *  \param[in] sb_info \ref GSM0503_SCH_INFO_LEN bytes
+ *  \returns 0
+ */
+int
+gsm0503_sch_encode(ubit_t *burst, const uint8_t *sb_info)
+{
+	ubit_t u[35];
+
+	osmo_pbit2ubit_ext(u, 0, sb_info, 0, 25, 1);
+	osmo_crc16gen_set_bits(&gsm0503_sch_crc10, u, 25, u + 25);
+	osmo_conv_encode(&gsm0503_sch, u, burst);
+
+	return 0;
+}
+
+/*! \brief Decode a synchronisation burst
+ *  \param[out] sb_info \ref GSM0503_SCH_INFO_LEN bytes
+ *  \param[in] burst \ref GSM0503_SCH_BITS soft bits
+ *  \returns 0, or -1 if the CRC does not match
+ */
+int
+gsm0503_sch_decode(uint8_t *sb_info, const sbit_t *burst)
+{
+	ubit_t u[35];
+
+	osmo_conv_decode(&gsm0503_sch, burst, u);
+	if (osmo_crc16gen_check_bits(&gsm0503_sch_crc10, u, 25, u + 25))
+		return -1;
+
+	memset(sb_info, 0, GSM0503_SCH_INFO_LEN);
+	osmo_ubit2pbit_ext(sb_info, 0, u, 0, 25, 1);
+
+	return 0;
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Batches                                                                  */
+/* ------------------------------------------------------------------------ */
+
+/*! \brief Set up the scratch space of batches
+ *  \param[out] batch the scratch space
+ */
+void
+gsm0503_batch_init(struct gsm0503_batch *batch)
+{
+	osmo_conv_decode_init(&batch->xcch, &gsm0503_xcch, 0, 0);
+	osmo_conv_decode_init(&batch->tch_fs, &gsm0503_tch_fs, 0, 0);
+}
+
+/*! \brief Release the scratch space of batches
+ *  \param[in] batch the scratch space
+ */
+void
+gsm0503_batch_deinit(struct gsm0503_batch *batch)
+{
+	osmo_conv_decode_deinit(&batch->xcch);
+	osmo_conv_decode_deinit(&batch->tch_fs);
+}
+
+/*! \brief Encode xCCH L2 blocks
+ *  \param[in] batch scratch space
+ *  \param[out] bursts 4 bursts of \ref GSM0503_BURST_BITS bits per block
+ *  \param[in] l2_data \ref GSM0503_XCCH_L2_LEN bytes per block
+ *  \param[in] count number of blocks
+ *  \returns count
+ */
+int
+gsm0503_xcch_encode_batch(struct gsm0503_batch *batch, ubit_t *bursts,
+                          const uint8_t *l2_data, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		_gsm0503_xcch_encode(&bursts[i * 4 * GSM0503_BURST_BITS],
+		                     &l2_data[i * GSM0503_XCCH_L2_LEN],
+		                     batch->u, batch->c);
+
+	return count;
+}
+
+/*! \brief Decode xCCH L2 blocks
+ *  \param[in] batch scratch space
+ *  \param[out] l2_data \ref GSM0503_XCCH_L2_LEN bytes per block
+ *  \param[in] bursts soft bits of 4 bursts per block
+ *  \param[in] count number of blocks
+ *  \param[out] ok whether the CRC of each block matches, or NULL
+ *  \returns number of blocks whose CRC matches
+ */
+int
+gsm0503_xcch_decode_batch(struct gsm0503_batch *batch, uint8_t *l2_data,
+                          const sbit_t *bursts, unsigned int count,
+                          uint8_t *ok)
+{
+	unsigned int i;
+	int rc, n = 0;
+
+	for (i = 0; i < count; i++) {
+		rc = _gsm0503_xcch_decode(&batch->xcch,
+		                          &l2_data[i * GSM0503_XCCH_L2_LEN],
+		                          &bursts[i * 4 * GSM0503_BURST_BITS],
+		                          NULL, batch->u, batch->c, batch->s);
+		if (ok)
+			ok[i] = rc == 0;
+		n += rc == 0;
+	}
+
+	return n;
+}
+
+/*! \brief Encode TCH/FS frames
+ *  \param[in] batch scratch space
+ *  \param[out] bursts 8 bursts of \ref GSM0503_BURST_BITS bits per frame
+ *  \param[in] frames \ref GSM0503_TCH_FS_LEN bytes per frame
+ *  \param[in] count number of frames
+ *  \returns count
+ */
+int
+gsm0503_tch_fs_encode_batch(struct gsm0503_batch *batch, ubit_t *bursts,
+                            const uint8_t *frames, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		_gsm0503_tch_fs_encode(&bursts[i * 8 * GSM0503_BURST_BITS],
+		                       &frames[i * GSM0503_TCH_FS_LEN],
+		                       batch->u, batch->c);
+
+	return count;
+}
+
+/*! \brief Decode TCH/FS frames
+ *  \param[in] batch scratch space
+ *  \param[out] frames \ref GSM0503_TCH_FS_LEN bytes per frame
+ *  \param[in] bursts soft bits of 8 bursts per frame
+ *  \param[in] count number of frames
+ *  \param[out] ok whether the CRC of each frame matches, or NULL
+ *  \returns number of frames whose CRC matches
+ */
+int
+gsm0503_tch_fs_decode_batch(struct gsm0503_batch *batch, uint8_t *frames,
+                            const sbit_t *bursts, unsigned int count,
+                            uint8_t *ok)
+{
+	unsigned int i;
+	int rc, n = 0;
+
+	for (i = 0; i < count; i++) {
+		rc = _gsm0503_tch_fs_decode(&batch->tch_fs,
+		                            &frames[i * GSM0503_TCH_FS_LEN],
+		                            &bursts[i * 8 * GSM0503_BURST_BITS],
+		                            NULL, batch->u, batch->c, batch->s);
+		if (ok)
+			ok[i] = rc == 0;
+		n += rc == 0;
+	}
+
+	return n;
+}
+
+/*! @} */
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <osmocom/core/utils.h>
 #include <osmocom/gsm/tlv.h>
 
@@ -11,13 +12,133 @@
 struct tlv_definition tvlv_att_def;
 struct tlv_definition vtvlv_gan_att_def;
 
+/* tlv_parse() compiles the definitions it is given into a decode table
+ * the first time: single octet TV IEs are resolved for every tag and TV
+ * IEs become fixed length ones. The tables are kept for the few
+ * definitions in use, by their address, so a definition must not change
+ * once it was used for parsing, other than by tlv_def_patch(), and its
+ * address must not be reused for another one.
+ *
+ * A table is never changed once it is published. tlv_def_patch()
+ * compiles a new one and swaps it in, the old one is not freed as a
+ * concurrent tlv_parse() may still be using it. */
+
+#define TLV_MAX_COMPILED	32
+
+enum tlv_dec_kind {
+	TLV_DEC_NONE,
+	TLV_DEC_SINGLE_TV,
+	TLV_DEC_T,
+	TLV_DEC_FIXED,		/* and TV */
+	TLV_DEC_TLV,
+	TLV_DEC_TvLV,
+	TLV_DEC_TL16V,
+	TLV_DEC_vTvLV_GAN,
+};
+
+struct tlv_compiled {
+	uint8_t kind[256];		/* enum tlv_dec_kind */
+	uint8_t fixed_len[256];		/* length of TLV_DEC_FIXED */
+};
+
+static struct {
+	const struct tlv_definition *def;
+	const struct tlv_compiled *c;	/* NULL until def is set */
+} tlv_compiled[TLV_MAX_COMPILED];
+static unsigned int tlv_n_compiled;
+
+/* a new decode table of a definition, NULL if out of memory */
+static struct tlv_compiled *_tlv_compile(const struct tlv_definition *def)
+{
+	const struct tlv_def *d = def->def;
+	struct tlv_compiled *c;
+	int i;
+
+	c = malloc(sizeof(*c));
+	if (!c)
+		return NULL;
+
+	for (i = 0; i < 256; i++) {
+		c->fixed_len[i] = 0;
+		if (d[i & 0xf0].type == TLV_TYPE_SINGLE_TV) {
+			c->kind[i] = TLV_DEC_SINGLE_TV;
+			continue;
+		}
+		switch (d[i].type) {
+		case TLV_TYPE_T:
+			c->kind[i] = TLV_DEC_T;
+			break;
+		case TLV_TYPE_TV:
+			c->kind[i] = TLV_DEC_FIXED;
+			c->fixed_len[i] = 1;
+			break;
+		case TLV_TYPE_FIXED:
+			c->kind[i] = TLV_DEC_FIXED;
+			c->fixed_len[i] = d[i].fixed_len;
+			break;
+		case TLV_TYPE_TLV:
+			c->kind[i] = TLV_DEC_TLV;
+			break;
+		case TLV_TYPE_TvLV:
+			c->kind[i] = TLV_DEC_TvLV;
+			break;
+		case TLV_TYPE_TL16V:
+			c->kind[i] = TLV_DEC_TL16V;
+			break;
+		case TLV_TYPE_vTvLV_GAN:
+			c->kind[i] = TLV_DEC_vTvLV_GAN;
+			break;
+		default:
+			c->kind[i] = TLV_DEC_NONE;
+			break;
+		}
+	}
+
+	return c;
+}
+
+/* the decode table of a definition, NULL if there are too many
+ * definitions in use already */
+static const struct tlv_compiled *_tlv_compiled_get(const struct tlv_definition *def)
+{
+	const struct tlv_compiled *c;
+	struct tlv_compiled *new;
+	unsigned int i, n;
+
+	n = __atomic_load_n(&tlv_n_compiled, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n; i++) {
+		c = __atomic_load_n(&tlv_compiled[i].c, __ATOMIC_ACQUIRE);
+		if (c && tlv_compiled[i].def == def)
+			return c;
+	}
+
+	/* claim the next slot, the count never goes past the table. Slots
+	 * are only ever added, a concurrent caller may add the same
+	 * definition again and use up one more slot */
+	do {
+		if (n >= TLV_MAX_COMPILED)
+			return NULL;
+		i = n;
+	} while (!__atomic_compare_exchange_n(&tlv_n_compiled, &n, n + 1, 0,
+	                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	/* the slot stays unused if this fails */
+	new = _tlv_compile(def);
+	if (!new)
+		return NULL;
+	tlv_compiled[i].def = def;
+	__atomic_store_n(&tlv_compiled[i].c, new, __ATOMIC_RELEASE);
+
+	return new;
+}
+
 /*! \brief Dump pasred TLV structure to stdout */
 int tlv_dump(struct tlv_parsed *dec)
 {
 	int i;
 
 	for (i = 0; i <= 0xff; i++) {
-		if (!dec->lv[i].val)
+		if (!tlvp_present(dec, i))
 			continue;
 		printf("T=%02x L=%d\n", i, dec->lv[i].len);
 	}
@@ -124,6 +245,83 @@ tlv:		/* GSM TS 04.07 11.2.4: Type 4 TLV */
 	return len;
 }
 
+/* the IEs following the initial LV ones, like tlv_parse_one() would */
+static int _tlv_parse_compiled(struct tlv_parsed *dec,
+			       const struct tlv_compiled *c,
+			       const uint8_t *buf, int buf_len, int ofs,
+			       int num_parsed)
+{
+	while (ofs < buf_len) {
+		const uint8_t *p = &buf[ofs];
+		int left = buf_len - ofs;
+		uint8_t tag = *p;
+		uint16_t len;
+		int n;
+
+		switch (c->kind[tag]) {
+		case TLV_DEC_SINGLE_TV:
+			tlvp_set(dec, tag & 0xf0, p, 1);
+			n = 1;
+			break;
+		case TLV_DEC_T:
+			tlvp_set(dec, tag, p, 0);
+			n = 1;
+			break;
+		case TLV_DEC_FIXED:
+			len = c->fixed_len[tag];
+			tlvp_set(dec, tag, p + 1, len);
+			n = len + 1;
+			break;
+		case TLV_DEC_TvLV:
+			/* like TL16V, unless the highest bit of len is set */
+			if (!(p[1] & 0x80))
+				goto tl16v;
+			len = p[1] & 0x7f;
+			n = len + 2;
+			if (n > left)
+				return -2;
+			tlvp_set(dec, tag, p + 2, len);
+			break;
+		case TLV_DEC_vTvLV_GAN:
+			/* like TLV, unless the highest bit of len is set */
+			if (!(p[1] & 0x80))
+				goto tlv;
+			if (2 > left)
+				return -1;
+			len = (p[1] & 0x7f) << 8 | p[2];
+			n = len + 3;
+			if (n > left)
+				return -2;
+			tlvp_set(dec, tag, p + 3, len);
+			break;
+		case TLV_DEC_TLV:
+tlv:
+			len = p[1];
+			n = len + 2;
+			if (n > left)
+				return -2;
+			tlvp_set(dec, tag, p + 2, len);
+			break;
+		case TLV_DEC_TL16V:
+tl16v:
+			if (2 > left)
+				return -1;
+			len = p[1] << 8 | p[2];
+			n = len + 3;
+			if (n > left)
+				return -2;
+			tlvp_set(dec, tag, p + 3, len);
+			break;
+		default:
+			return -3;
+		}
+		ofs += n;
+		num_parsed++;
+	}
+
+	return num_parsed;
+}
+
 /*! \brief Parse an entire buffer of TLV encoded Information Eleemnts
  *  \param[out] dec caller-allocated pointer to \ref tlv_parsed
  *  \param[in] def structure defining the valid TLV tags / configurations
@@ -132,21 +330,26 @@ tlv:		/* GSM TS 04.07 11.2.4: Type 4 TLV */
  *  \param[in] lv_tag an initial LV tag at the start of the buffer
  *  \param[in] lv_tag2 a second initial LV tag following the \a lv_tag
  *  \returns number of bytes consumed by the TLV entry / IE parsed
+ *
+ *  The decode table compiled from \a def is kept by its address. \a def
+ *  must not change afterwards other than by tlv_def_patch(), and must
+ *  not be freed and its address reused for another definition.
  */
 int tlv_parse(struct tlv_parsed *dec, const struct tlv_definition *def,
 	      const uint8_t *buf, int buf_len, uint8_t lv_tag,
 	      uint8_t lv_tag2)
 {
+	const struct tlv_compiled *c;
 	int ofs = 0, num_parsed = 0;
 	uint16_t len;
 
-	memset(dec, 0, sizeof(*dec));
+	/* only the present bitmap, the entries are written as found */
+	tlvp_clear(dec);
 
 	if (lv_tag) {
 		if (ofs > buf_len)
 			return -1;
-		dec->lv[lv_tag].val = &buf[ofs+1];
-		dec->lv[lv_tag].len = buf[ofs];
+		tlvp_set(dec, lv_tag, &buf[ofs+1], buf[ofs]);
 		len = dec->lv[lv_tag].len + 1;
 		if (ofs + len > buf_len)
 			return -2;
@@ -156,8 +359,7 @@ int tlv_parse(struct tlv_parsed *dec, const struct tlv_definition *def,
 	if (lv_tag2) {
 		if (ofs > buf_len)
 			return -1;
-		dec->lv[lv_tag2].val = &buf[ofs+1];
-		dec->lv[lv_tag2].len = buf[ofs];
+		tlvp_set(dec, lv_tag2, &buf[ofs+1], buf[ofs]);
 		len = dec->lv[lv_tag2].len + 1;
 		if (ofs + len > buf_len)
 			return -2;
@@ -165,6 +367,11 @@ int tlv_parse(struct tlv_parsed *dec, const struct tlv_definition *def,
 		ofs += len;
 	}
 
+	c = _tlv_compiled_get(def);
+	if (c)
+		return _tlv_parse_compiled(dec, c, buf, buf_len, ofs,
+					   num_parsed);
+
 	while (ofs < buf_len) {
 		int rv;
 		uint8_t tag;
@@ -174,8 +381,7 @@ int tlv_parse(struct tlv_parsed *dec, const struct tlv_definition *def,
 		                   &buf[ofs], buf_len-ofs);
 		if (rv < 0)
 			return rv;
-		dec->lv[tag].val = val;
-		dec->lv[tag].len = len;
+		tlvp_set(dec, tag, val, len);
 		ofs += rv;
 		num_parsed++;
 	}
@@ -186,6 +392,7 @@ int tlv_parse(struct tlv_parsed *dec, const struct tlv_definition *def,
 /*! \brief take a master (src) tlvdev and fill up all empty slots in 'dst' */
 void tlv_def_patch(struct tlv_definition *dst, const struct tlv_definition *src)
 {
+	unsigned int n;
 	int i;
 
 	for (i = 0; i < ARRAY_SIZE(dst->def); i++) {
@@ -194,6 +401,20 @@ void tlv_def_patch(struct tlv_definition *dst, const struct tlv_definition *src)
 		if (dst->def[i].type == TLV_TYPE_NONE)
 			dst->def[i] = src->def[i];
 	}
+
+	/* replace the decode table if dst was used for parsing already */
+	n = __atomic_load_n(&tlv_n_compiled, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n; i++) {
+		struct tlv_compiled *c;
+
+		if (!__atomic_load_n(&tlv_compiled[i].c, __ATOMIC_ACQUIRE) ||
+		    tlv_compiled[i].def != dst)
+			continue;
+		/* without a new table, dst is compiled again in a new slot
+		 * the next time it is used */
+		c = _tlv_compile(dst);
+		__atomic_store_n(&tlv_compiled[i].c, c, __ATOMIC_RELEASE);
+	}
 }
 
 static __attribute__((constructor)) void on_dso_load_tlv(void)
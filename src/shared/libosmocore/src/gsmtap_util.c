@@ -206,6 +206,8 @@ int gsmtap_source_add_sink_fd(int gsmtap_fd)
 /*! \brief Send a \ref msgb through a GSMTAP source
  *  \param[in] gti GSMTAP instance
  *  \param[in] msgb message buffer
+ *  \returns 0 on success, negative on error; the caller keeps the
+ *  message then
  */
 int gsmtap_sendmsg(struct gsmtap_inst *gti, struct msgb *msg)
 {
@@ -240,6 +242,7 @@ int gsmtap_send_ex(struct gsmtap_inst *gti, uint8_t type, uint16_t arfcn, uint8_
 		unsigned int len)
 {
 	struct msgb *msg;
+	int rc;
 
 	if (!gti)
 		return -ENODEV;
@@ -249,7 +252,10 @@ int gsmtap_send_ex(struct gsmtap_inst *gti, uint8_t type, uint16_t arfcn, uint8_
 	if (!msg)
 		return -ENOMEM;
 
-	return gsmtap_sendmsg(gti, msg);
+	rc = gsmtap_sendmsg(gti, msg);
+	if (rc < 0)
+		msgb_free(msg);
+	return rc;
 }
 
 /*! \brief send a message from L1/L2 through GSMTAP.
@@ -264,24 +270,6 @@ int gsmtap_send(struct gsmtap_inst *gti, uint16_t arfcn, uint8_t ts,
 		signal_dbm, snr, data, len);
 }
 
-/* Callback from select layer if we can write to the socket */
-static int gsmtap_wq_w_cb(struct osmo_fd *ofd, struct msgb *msg)
-{
-	int rc;
-
-	rc = write(ofd->fd, msg->data, msg->len);
-	if (rc < 0) {
-		perror("writing msgb to gsmtap fd");
-		return rc;
-	}
-	if (rc != msg->len) {
-		perror("short write to gsmtap fd");
-		return -EIO;
-	}
-
-	return 0;
-}
-
 /* Callback from select layer if we can read from the sink socket */
 static int gsmtap_sink_fd_cb(struct osmo_fd *fd, unsigned int flags)
 {
@@ -351,7 +339,7 @@ struct gsmtap_inst *gsmtap_source_init(const char *host, uint16_t port,
 
 	if (ofd_wq_mode) {
 		osmo_wqueue_init(&gti->wq, 64);
-		gti->wq.write_cb = &gsmtap_wq_w_cb;
+		gti->wq.mode = OSMO_WQUEUE_M_DGRAM;
 
 		osmo_fd_register(&gti->wq.bfd);
 	}
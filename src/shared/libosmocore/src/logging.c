@@ -40,6 +40,10 @@
 #include <time.h>
 #include <errno.h>
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/utils.h>
 #include <osmocom/core/logging.h>
@@ -119,6 +123,93 @@ const char *loglevel_descriptions[LOGLEVEL_DEFS+1] = {
 	NULL,
 };
 
+struct log_level_cache osmo_log_level_cache = { .dirty = 1 };
+
+#ifdef HAVE_PTHREAD_H
+/* serializes rebuilds, log_check_level() may be called from any thread */
+static pthread_mutex_t log_level_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define log_level_cache_lock()		pthread_mutex_lock(&log_level_cache_mutex)
+#define log_level_cache_unlock()	pthread_mutex_unlock(&log_level_cache_mutex)
+#else
+#define log_level_cache_lock()		do { } while (0)
+#define log_level_cache_unlock()	do { } while (0)
+#endif
+
+/* targets or their level settings changed */
+static void log_level_cache_invalidate(void)
+{
+	__atomic_store_n(&osmo_log_level_cache.dirty, 1, __ATOMIC_SEQ_CST);
+}
+
+/*! \brief Rebuild \ref osmo_log_level_cache from the current targets
+ *
+ * Called by \ref log_check_level whenever the cache is out of date.
+ * Rebuilds are serialized, the new levels are computed aside and then
+ * stored entry by entry, so concurrent readers see either the old or
+ * the new level of a category, never a half-built table.
+ */
+void log_level_cache_rebuild(void)
+{
+	struct log_level_cache *cache = &osmo_log_level_cache;
+	struct log_target *tar;
+	uint8_t *min_level;
+	unsigned int i;
+
+	if (!osmo_log_info)
+		return;
+
+	log_level_cache_lock();
+	/* done by another thread meanwhile */
+	if (!__atomic_load_n(&cache->dirty, __ATOMIC_SEQ_CST))
+		goto out;
+	/* a change during the rebuild marks it dirty again */
+	__atomic_store_n(&cache->dirty, 0, __ATOMIC_SEQ_CST);
+
+	min_level = talloc_array(tall_log_ctx, uint8_t, osmo_log_info->num_cat);
+	if (!min_level) {
+		log_level_cache_invalidate();
+		goto out;
+	}
+	memset(min_level, LOG_LEVEL_NONE, osmo_log_info->num_cat);
+
+	/* same checks as in osmo_vlogp(), minus the filters */
+	llist_for_each_entry(tar, &osmo_log_target_list, entry) {
+		for (i = 0; i < osmo_log_info->num_cat; i++) {
+			const struct log_category *category;
+			uint8_t level;
+
+			category = &tar->categories[i];
+			if (!category->enabled)
+				continue;
+
+			if (tar->loglevel != 0)
+				level = tar->loglevel;
+			else
+				level = category->loglevel;
+
+			if (level < min_level[i])
+				min_level[i] = level;
+		}
+	}
+
+	if (cache->min_level && cache->num_cat == osmo_log_info->num_cat) {
+		for (i = 0; i < cache->num_cat; i++)
+			__atomic_store_n(&cache->min_level[i], min_level[i],
+					 __ATOMIC_RELAXED);
+		talloc_free(min_level);
+	} else {
+		/* first rebuild after log_init(), which must not race
+		 * with logging from other threads anyway */
+		talloc_free(cache->min_level);
+		cache->num_cat = osmo_log_info->num_cat;
+		cache->num_cat_user = osmo_log_info->num_cat_user;
+		__atomic_store_n(&cache->min_level, min_level,
+				 __ATOMIC_RELEASE);
+	}
+out:
+	log_level_cache_unlock();
+}
+
 /* special magic for negative (library-internal) log subsystem numbers */
 static int subsys_lib2index(int subsys)
 {
@@ -205,6 +296,7 @@ void log_parse_category_mask(struct log_target* target, const char *_mask)
 	} while ((category_token = strtok(NULL, ":")));
 
 	free(mask);
+	log_level_cache_invalidate();
 }
 
 static const char* color(int subsys)
@@ -234,11 +326,17 @@ static void _output(struct log_target *target, unsigned int subsys,
 	}
 	if (!cont) {
 		if (target->print_timestamp) {
-			char *timestr;
+			/* formatting the time is costly, and it only
+			 * changes once a second */
+			static __thread time_t last_tm;
+			static __thread char timestr[32];
 			time_t tm;
 			tm = time(NULL);
-			timestr = ctime(&tm);
-			timestr[strlen(timestr)-1] = '\0';
+			if (tm != last_tm || !timestr[0]) {
+				ctime_r(&tm, timestr);
+				timestr[strlen(timestr)-1] = '\0';
+				last_tm = tm;
+			}
 			ret = snprintf(buf + offset, rem, "%s ", timestr);
 			if (ret < 0)
 				goto err;
@@ -273,6 +371,10 @@ void osmo_vlogp(int subsys, int level, const char *file, int line,
 {
 	struct log_target *tar;
 
+	/* nobody is interested, don't walk the targets */
+	if (!log_check_level(subsys, level))
+		return;
+
 	if (subsys < 0)
 		subsys = subsys_lib2index(subsys);
 
@@ -313,7 +415,12 @@ void osmo_vlogp(int subsys, int level, const char *file, int line,
 		 * in undefined state. Since _output uses vsnprintf and it may
 		 * be called several times, we have to pass a copy of ap. */
 		va_copy(bp, ap);
-		_output(tar, subsys, level, file, line, cont, format, bp);
+		if (tar->raw_output)
+			tar->raw_output(tar, subsys, level, file, line, cont,
+					format, bp);
+		else
+			_output(tar, subsys, level, file, line, cont, format,
+				bp);
 		va_end(bp);
 	}
 }
@@ -343,6 +450,7 @@ void logp2(int subsys, unsigned int level, const char *file, int line, int cont,
 void log_add_target(struct log_target *target)
 {
 	llist_add_tail(&target->entry, &osmo_log_target_list);
+	log_level_cache_invalidate();
 }
 
 /*! \brief Unregister a log target from the logging core
@@ -351,6 +459,7 @@ void log_add_target(struct log_target *target)
 void log_del_target(struct log_target *target)
 {
 	llist_del(&target->entry);
+	log_level_cache_invalidate();
 }
 
 /*! \brief Reset (clear) the logging context */
@@ -429,6 +538,7 @@ void log_set_print_filename(struct log_target *target, int print_filename)
 void log_set_log_level(struct log_target *target, int log_level)
 {
 	target->loglevel = log_level;
+	log_level_cache_invalidate();
 }
 
 void log_set_category_filter(struct log_target *target, int category,
@@ -438,6 +548,7 @@ void log_set_category_filter(struct log_target *target, int category,
 		return;
 	target->categories[category].enabled = !!enable;
 	target->categories[category].loglevel = level;
+	log_level_cache_invalidate();
 }
 
 static void _file_output(struct log_target *target, unsigned int level,
@@ -766,6 +877,7 @@ int log_init(const struct log_info *inf, void *ctx)
 			&internal_cat[i], sizeof(struct log_info_cat));
 	}
 
+	log_level_cache_invalidate();
 	return 0;
 }
 
@@ -0,0 +1,422 @@
+/* Asynchronous file logging from a writer thread */
+
+/* (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*! \addtogroup logging
+ *  @{
+ */
+
+/*! \file logging_async.c
+ *
+ * Formatted messages are copied into a ring buffer and written to the
+ * file by a dedicated thread, so a slow disk never stalls the thread
+ * that is logging.
+ *
+ * Any number of threads may log to the target.  A producer reserves
+ * space in the ring by advancing its head with a compare-and-swap,
+ * copies the message and then marks the record as committed.  The
+ * writer thread consumes committed records in order, collects them in
+ * a large buffer and clears the space before handing it back.
+ */
+
+#include "../config.h"
+
+#ifdef HAVE_PTHREAD_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/logging.h>
+
+/* the writer thread collects messages in a buffer of this size */
+#define LOG_ASYNC_WRITE_BUF	65536
+#define LOG_ASYNC_MIN_SIZE	4096
+/* in case a wakeup is missed, the writer looks at the ring anyway */
+#define LOG_ASYNC_POLL_MS	100
+
+enum log_async_rec_state {
+	REC_FREE = 0,
+	REC_DATA,
+	REC_PAD,	/* rest of the ring up to its end is unused */
+};
+
+/* header of a record, all records are 8 byte aligned */
+struct log_async_rec {
+	uint32_t len;		/* length of the data following */
+	uint32_t state;		/* enum log_async_rec_state */
+	char data[0];
+};
+
+struct log_async_ring {
+	uint8_t *buf;
+	size_t size;		/* power of two */
+	enum log_async_policy policy;
+
+	/* bytes ever reserved by producers and released by the writer,
+	 * the offset into buf is taken modulo size */
+	uint64_t head;
+	uint64_t tail;
+
+	int fd;
+	/* the writer collects records here, LOG_ASYNC_WRITE_BUF bytes */
+	char *out;
+	/* the writer is blocked in a read of wake[0] */
+	int sleeping;
+	int wake[2];
+	int stop;
+	pthread_t thread;
+
+	uint64_t written;
+	uint64_t dropped;
+	uint64_t high_water;
+};
+
+#define REC_ALIGN(len)	(((len) + 7) & ~7)
+
+static inline struct log_async_rec *ring_rec(struct log_async_ring *ring,
+					     uint64_t pos)
+{
+	return (struct log_async_rec *) &ring->buf[pos & (ring->size - 1)];
+}
+
+/* a full pipe is fine, the writer is woken up anyway then */
+static void wake_write(int fd)
+{
+	char c = 0;
+
+	while (write(fd, &c, 1) < 0 && errno == EINTR)
+		;
+}
+
+static void ring_wake_writer(struct log_async_ring *ring)
+{
+	if (__atomic_exchange_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST))
+		wake_write(ring->wake[1]);
+}
+
+/* reserve \a need bytes for a record, returns 0 if the ring is full */
+static int ring_reserve(struct log_async_ring *ring, uint32_t need,
+			uint64_t *pos, uint32_t *pad)
+{
+	uint64_t head, tail, used;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	do {
+		uint64_t off = head & (ring->size - 1);
+
+		tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		/* records never wrap, pad up to the end of the ring */
+		*pad = off + need > ring->size ? ring->size - off : 0;
+		if (head + *pad + need - tail > ring->size)
+			return 0;
+	} while (!__atomic_compare_exchange_n(&ring->head, &head,
+					      head + *pad + need, 1,
+					      __ATOMIC_ACQ_REL,
+					      __ATOMIC_RELAXED));
+
+	*pos = head;
+
+	used = head + *pad + need - tail;
+	head = __atomic_load_n(&ring->high_water, __ATOMIC_RELAXED);
+	while (used > head &&
+	       !__atomic_compare_exchange_n(&ring->high_water, &head, used,
+					    1, __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+
+	return 1;
+}
+
+static void _async_output(struct log_target *target, unsigned int level,
+			  const char *log)
+{
+	struct log_async_ring *ring = target->tgt_async.ring;
+	size_t len = strlen(log);
+	struct log_async_rec *rec;
+	uint32_t need, pad;
+	uint64_t pos;
+
+	need = sizeof(*rec) + REC_ALIGN(len);
+	if (need > ring->size / 2) {
+		__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	while (!ring_reserve(ring, need, &pos, &pad)) {
+		if (ring->policy == LOG_ASYNC_DROP) {
+			__atomic_add_fetch(&ring->dropped, 1,
+					   __ATOMIC_RELAXED);
+			return;
+		}
+		ring_wake_writer(ring);
+		sched_yield();
+	}
+
+	if (pad) {
+		rec = ring_rec(ring, pos);
+		rec->len = pad - sizeof(*rec);
+		__atomic_store_n(&rec->state, REC_PAD, __ATOMIC_RELEASE);
+		pos += pad;
+	}
+
+	rec = ring_rec(ring, pos);
+	rec->len = len;
+	memcpy(rec->data, log, len);
+	__atomic_store_n(&rec->state, REC_DATA, __ATOMIC_RELEASE);
+
+	ring_wake_writer(ring);
+}
+
+/* write all of buf, resuming after short writes and interruptions */
+static void write_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t rc = write(fd, buf, len);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0 && errno == EAGAIN) {
+			/* e.g. a non-blocking fifo, wait until it drains */
+			struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+			poll(&pfd, 1, LOG_ASYNC_POLL_MS);
+			continue;
+		}
+		/* nowhere to report an error to */
+		if (rc <= 0)
+			return;
+		buf += rc;
+		len -= rc;
+	}
+}
+
+/* write all committed records, returns the number of them */
+static unsigned int ring_drain(struct log_async_ring *ring, char *out)
+{
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	size_t out_len = 0;
+	unsigned int num = 0;
+
+	while (tail != head) {
+		struct log_async_rec *rec = ring_rec(ring, tail);
+		uint32_t state, total;
+
+		state = __atomic_load_n(&rec->state, __ATOMIC_ACQUIRE);
+		/* reserved, but not committed yet */
+		if (state == REC_FREE)
+			break;
+
+		if (state == REC_DATA) {
+			if (out_len + rec->len > LOG_ASYNC_WRITE_BUF) {
+				write_all(ring->fd, out, out_len);
+				out_len = 0;
+				__atomic_store_n(&ring->tail, tail,
+						 __ATOMIC_RELEASE);
+			}
+			memcpy(out + out_len, rec->data, rec->len);
+			out_len += rec->len;
+			num++;
+		}
+
+		/* producers rely on free space being zeroed */
+		total = sizeof(*rec) + REC_ALIGN(rec->len);
+		memset(rec, 0, total);
+		tail += total;
+	}
+
+	/* space is released once its messages are in the file, so an
+	 * empty ring means everything has been written */
+	if (out_len)
+		write_all(ring->fd, out, out_len);
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&ring->written, num, __ATOMIC_RELAXED);
+
+	return num;
+}
+
+static int ring_empty(struct log_async_ring *ring)
+{
+	return __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) ==
+	       __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+}
+
+static void *log_async_writer(void *data)
+{
+	struct log_async_ring *ring = data;
+
+	while (1) {
+		struct pollfd pfd = { .fd = ring->wake[0], .events = POLLIN };
+		char c[64];
+
+		if (ring_drain(ring, ring->out))
+			continue;
+		if (!ring_empty(ring)) {
+			/* a producer is still copying its message */
+			sched_yield();
+			continue;
+		}
+		if (__atomic_load_n(&ring->stop, __ATOMIC_ACQUIRE))
+			break;
+
+		__atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+		if (!ring_empty(ring) ||
+		    __atomic_load_n(&ring->stop, __ATOMIC_ACQUIRE)) {
+			__atomic_store_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		poll(&pfd, 1, LOG_ASYNC_POLL_MS);
+		__atomic_store_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST);
+		while (read(ring->wake[0], c, sizeof(c)) == sizeof(c))
+			;
+	}
+
+	return NULL;
+}
+
+/* called when the target is freed by log_target_destroy() */
+static int log_async_destructor(struct log_target *target)
+{
+	struct log_async_ring *ring = target->tgt_async.ring;
+
+	/* the writer empties the ring before it stops */
+	__atomic_store_n(&ring->stop, 1, __ATOMIC_RELEASE);
+	wake_write(ring->wake[1]);
+	pthread_join(ring->thread, NULL);
+
+	close(ring->wake[0]);
+	close(ring->wake[1]);
+	close(ring->fd);
+
+	return 0;
+}
+
+/*! \brief Create a new file logging target written by a separate thread
+ *  \param[in] fname File name of the new log file
+ *  \param[in] ring_size Bytes of messages that may be queued, rounded
+ *		up to a power of two
+ *  \param[in] policy What to do with messages that don't fit the ring
+ *  \returns Log target in case of success, NULL otherwise
+ *
+ * Messages are appended to the file in the order they were logged.
+ * The target must be destroyed with \ref log_target_destroy to get
+ * the queued messages written before the program exits.
+ */
+struct log_target *log_target_create_async(const char *fname,
+					   size_t ring_size,
+					   enum log_async_policy policy)
+{
+	struct log_target *target;
+	struct log_async_ring *ring;
+	size_t size = LOG_ASYNC_MIN_SIZE;
+
+	while (size < ring_size)
+		size <<= 1;
+
+	target = log_target_create();
+	if (!target)
+		return NULL;
+
+	ring = talloc_zero(target, struct log_async_ring);
+	if (!ring)
+		goto err;
+	ring->buf = talloc_zero_size(ring, size);
+	if (!ring->buf)
+		goto err;
+	/* allocated here, a writer without it would never empty the ring
+	 * and have producers wait for it forever */
+	ring->out = talloc_size(ring, LOG_ASYNC_WRITE_BUF);
+	if (!ring->out)
+		goto err;
+	ring->size = size;
+	ring->policy = policy;
+
+	ring->fd = open(fname, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+			0666);
+	if (ring->fd < 0)
+		goto err;
+	if (pipe(ring->wake) < 0) {
+		close(ring->fd);
+		goto err;
+	}
+	fcntl(ring->wake[0], F_SETFL, O_NONBLOCK);
+	fcntl(ring->wake[1], F_SETFL, O_NONBLOCK);
+
+	if (pthread_create(&ring->thread, NULL, log_async_writer, ring)) {
+		close(ring->wake[0]);
+		close(ring->wake[1]);
+		close(ring->fd);
+		goto err;
+	}
+
+	target->type = LOG_TGT_TYPE_ASYNC;
+	target->tgt_async.fname = talloc_strdup(target, fname);
+	target->tgt_async.ring = ring;
+	target->output = _async_output;
+	talloc_set_destructor(target, log_async_destructor);
+
+	return target;
+
+err:
+	talloc_free(target);
+	return NULL;
+}
+
+/*! \brief Get the statistics of an asynchronous log target
+ *  \param[in] target Log target created by \ref log_target_create_async
+ *  \param[out] stats Current statistics
+ */
+void log_target_async_stats(struct log_target *target,
+			    struct log_async_stats *stats)
+{
+	struct log_async_ring *ring = target->tgt_async.ring;
+
+	stats->written = __atomic_load_n(&ring->written, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+	stats->high_water = __atomic_load_n(&ring->high_water,
+					    __ATOMIC_RELAXED);
+	stats->size = ring->size;
+}
+
+/*! \brief Wait until all queued messages have been written
+ *  \param[in] target Log target created by \ref log_target_create_async
+ */
+void log_target_async_flush(struct log_target *target)
+{
+	struct log_async_ring *ring = target->tgt_async.ring;
+
+	ring_wake_writer(ring);
+	while (!ring_empty(ring)) {
+		struct timespec ts = { 0, 100000 };
+		nanosleep(&ts, NULL);
+	}
+}
+
+#endif /* HAVE_PTHREAD_H */
+
+/*! @} */
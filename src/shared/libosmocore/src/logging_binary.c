@@ -0,0 +1,899 @@
+/* Binary log files, formatted offline */
+
+/* (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*! \addtogroup logging_binary
+ *  @{
+ */
+
+/*! \file logging_binary.c
+ *
+ * The binary log target does not format messages.  It stores the
+ * arguments of every message together with a reference to its call
+ * site in a memory mapped file, the osmo-log-decode utility turns the
+ * file into text later on.  Walking the format string to find the
+ * argument types is much cheaper than vsnprintf(), so debug logging
+ * can stay enabled under load.
+ *
+ * The target is not thread safe, like the other targets it is meant to
+ * be used from the thread running the select loop.
+ */
+
+#include "../config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/logging.h>
+#include <osmocom/core/logging_binary.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+/*! \brief Find the next conversion in a printf format string
+ *  \param[in] fmt Format string, or the return value of a previous call
+ *  \param[out] conv Description of the conversion
+ *  \returns Text following the conversion, NULL if there is none
+ *
+ * The text between \a fmt and conv->start is to be copied literally.
+ */
+const char *log_binary_next_conv(const char *fmt,
+				 struct log_binary_conv *conv)
+{
+	const char *p = fmt;
+	int lng = 0;
+	char len_mod = 0;
+
+	while ((p = strchr(p, '%'))) {
+		memset(conv, 0, sizeof(*conv));
+		conv->start = p++;
+		conv->prec = -1;
+
+		/* flags */
+		while (*p && strchr("-+ #0'", *p))
+			p++;
+		/* width */
+		if (*p == '*') {
+			conv->star_width = 1;
+			p++;
+		} else {
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+		/* precision */
+		if (*p == '.') {
+			p++;
+			if (*p == '*') {
+				conv->star_prec = 1;
+				p++;
+			} else {
+				conv->prec = 0;
+				while (*p >= '0' && *p <= '9')
+					conv->prec = conv->prec * 10 + *p++ - '0';
+			}
+		}
+		/* length modifier */
+		for (lng = 0, len_mod = 0; *p; p++) {
+			/* h and hh take an int as well */
+			if (*p == 'l')
+				lng++;
+			else if (*p == 'h')
+				continue;
+			else if (strchr("Lqjzt", *p))
+				len_mod = *p;
+			else
+				break;
+		}
+
+		switch (*p) {
+		case '\0':
+			/* incomplete conversion, treat it as text */
+			return NULL;
+		case 'd': case 'i': case 'o': case 'u':
+		case 'x': case 'X': case 'c':
+			if (len_mod == 'j')
+				conv->arg = LOG_BIN_ARG_INTMAX;
+			else if (len_mod == 'z')
+				conv->arg = LOG_BIN_ARG_SIZE;
+			else if (len_mod == 't')
+				conv->arg = LOG_BIN_ARG_PTRDIFF;
+			else if (lng >= 2 || len_mod == 'q' || len_mod == 'L')
+				conv->arg = LOG_BIN_ARG_LLONG;
+			else if (lng == 1)
+				conv->arg = LOG_BIN_ARG_LONG;
+			else
+				conv->arg = LOG_BIN_ARG_INT;
+			break;
+		case 'e': case 'E': case 'f': case 'F':
+		case 'g': case 'G': case 'a': case 'A':
+			conv->arg = len_mod == 'L' ? LOG_BIN_ARG_LDOUBLE
+						   : LOG_BIN_ARG_DOUBLE;
+			break;
+		case 's':
+			conv->arg = lng ? LOG_BIN_ARG_OTHER : LOG_BIN_ARG_STR;
+			break;
+		case 'p':
+			conv->arg = LOG_BIN_ARG_PTR;
+			break;
+		case 'n': case 'C': case 'S':
+			conv->arg = LOG_BIN_ARG_OTHER;
+			break;
+		default:
+			/* %%, %m and whatever the C library may know */
+			conv->arg = LOG_BIN_ARG_NONE;
+			break;
+		}
+		p++;
+		conv->len = p - conv->start;
+		return p;
+	}
+
+	return NULL;
+}
+
+#ifdef HAVE_SYS_MMAN_H
+
+extern struct log_info *osmo_log_info;
+
+/* the file is mapped in windows of this size */
+#define LOG_BIN_MAP_SIZE	(1 << 20)
+#define LOG_BIN_SITES_MIN	256
+
+/* a call site is told apart by its format string, file and line, the
+ * compiler may merge equal format strings of different files */
+struct log_binary_site {
+	const char *format;	/* NULL if the slot is unused */
+	const char *file;
+	int line;
+	uint32_t id;
+};
+
+struct log_binary_file {
+	int fd;
+	uint8_t *map;		/* NULL if mapping the file failed */
+	off_t map_off;
+	size_t pos;		/* write position inside the window */
+	long page_size;
+
+	/* call sites by format string, file and line, open addressing */
+	struct log_binary_site *sites;
+	unsigned int sites_size;	/* power of two */
+	unsigned int num_sites;
+};
+
+/* map the window containing the current end of the file */
+static int bf_remap(struct log_binary_file *bf)
+{
+	off_t end = bf->map_off + bf->pos;
+	off_t off = end & ~((off_t)bf->page_size - 1);
+
+	if (bf->map)
+		munmap(bf->map, LOG_BIN_MAP_SIZE);
+	bf->map = NULL;
+
+	if (ftruncate(bf->fd, off + LOG_BIN_MAP_SIZE) < 0)
+		return -errno;
+	bf->map = mmap(NULL, LOG_BIN_MAP_SIZE, PROT_READ | PROT_WRITE,
+		       MAP_SHARED, bf->fd, off);
+	if (bf->map == MAP_FAILED) {
+		bf->map = NULL;
+		return -errno;
+	}
+	bf->map_off = off;
+	bf->pos = end - off;
+
+	return 0;
+}
+
+static int bf_write(struct log_binary_file *bf, const void *data,
+		    size_t len)
+{
+	/* one record less than a window: space for the END record */
+	if (!bf->map || bf->pos + len + sizeof(struct log_binary_rec)
+				> LOG_BIN_MAP_SIZE) {
+		if (bf_remap(bf) < 0)
+			return -ENOSPC;
+	}
+
+	memcpy(bf->map + bf->pos, data, len);
+	bf->pos += len;
+
+	return 0;
+}
+
+static int bf_write_rec(struct log_binary_file *bf, uint16_t type,
+			const void *hdr, size_t hdr_len,
+			const char *str1, const char *str2)
+{
+	uint8_t buf[LOG_BIN_MAX_REC];
+	struct log_binary_rec *rec = (struct log_binary_rec *) buf;
+	size_t len1 = strlen(str1) + 1;
+	size_t len2 = str2 ? strlen(str2) + 1 : 0;
+	size_t len = hdr_len + len1 + len2;
+
+	if (len > sizeof(buf))
+		return -EMSGSIZE;
+
+	memcpy(buf, hdr, hdr_len);
+	memcpy(buf + hdr_len, str1, len1);
+	if (str2)
+		memcpy(buf + hdr_len + len1, str2, len2);
+	rec->type = type;
+	rec->len = len;
+
+	return bf_write(bf, buf, len);
+}
+
+static inline unsigned int site_hash(const char *format, const char *file,
+				     int line)
+{
+	return ((uintptr_t)format >> 3) ^ ((uintptr_t)file >> 1) ^
+	       (line * 2654435761U);
+}
+
+static struct log_binary_site *site_slot(struct log_binary_site *sites,
+					 unsigned int size, const char *format,
+					 const char *file, int line)
+{
+	unsigned int i = site_hash(format, file, line) & (size - 1);
+
+	while (sites[i].format &&
+	       (sites[i].format != format || sites[i].file != file ||
+		sites[i].line != line))
+		i = (i + 1) & (size - 1);
+
+	return &sites[i];
+}
+
+static int sites_grow(struct log_binary_file *bf)
+{
+	unsigned int i, size = bf->sites_size * 2;
+	struct log_binary_site *sites;
+
+	sites = talloc_zero_array(bf, struct log_binary_site, size);
+	if (!sites)
+		return -ENOMEM;
+
+	for (i = 0; i < bf->sites_size; i++) {
+		struct log_binary_site *s = &bf->sites[i];
+		if (s->format)
+			*site_slot(sites, size, s->format, s->file,
+				   s->line) = *s;
+	}
+	talloc_free(bf->sites);
+	bf->sites = sites;
+	bf->sites_size = size;
+
+	return 0;
+}
+
+/* look up the id of a call site, describe it in the file if new */
+static int site_id(struct log_binary_file *bf, const char *format,
+		   const char *file, int line, uint32_t *id)
+{
+	struct log_binary_site *s;
+	struct log_binary_rec_site rec;
+
+	s = site_slot(bf->sites, bf->sites_size, format, file, line);
+	if (s->format) {
+		*id = s->id;
+		return 0;
+	}
+
+	rec.id = bf->num_sites;
+	rec.line = line;
+	if (bf_write_rec(bf, LOG_BIN_REC_SITE, &rec, sizeof(rec),
+			 file ? file : "", format) < 0)
+		return -ENOSPC;
+
+	s->format = format;
+	s->file = file;
+	s->line = line;
+	s->id = *id = bf->num_sites++;
+
+	/* keep the table at most half full */
+	if (bf->num_sites * 2 >= bf->sites_size)
+		sites_grow(bf);
+
+	return 0;
+}
+
+static inline int pack_u64(uint8_t **p, uint8_t *end, uint64_t v)
+{
+	if (end - *p < sizeof(v))
+		return -1;
+	memcpy(*p, &v, sizeof(v));
+	*p += sizeof(v);
+	return 0;
+}
+
+static inline int pack_double(uint8_t **p, uint8_t *end, double v)
+{
+	if (end - *p < sizeof(v))
+		return -1;
+	memcpy(*p, &v, sizeof(v));
+	*p += sizeof(v);
+	return 0;
+}
+
+static int pack_str(uint8_t **p, uint8_t *end, const char *s, int prec)
+{
+	uint16_t len = LOG_BIN_STR_NULL;
+	size_t slen;
+	int rc = 0;
+
+	if (end - *p < sizeof(len))
+		return -1;
+
+	if (s) {
+		slen = prec >= 0 ? strnlen(s, prec) : strlen(s);
+		if (slen > end - *p - sizeof(len)) {
+			slen = end - *p - sizeof(len);
+			rc = -1;
+		}
+		len = slen;
+	}
+	memcpy(*p, &len, sizeof(len));
+	*p += sizeof(len);
+	if (s) {
+		memcpy(*p, s, len);
+		*p += len;
+	}
+
+	return rc;
+}
+
+/* store the arguments consumed by format, returns -1 if they don't fit */
+static int pack_args(uint8_t **p, uint8_t *end, const char *format,
+		     va_list ap)
+{
+	struct log_binary_conv conv;
+	int prec;
+
+	while ((format = log_binary_next_conv(format, &conv))) {
+		prec = conv.prec;
+		if (conv.star_width) {
+			if (pack_u64(p, end, va_arg(ap, int)) < 0)
+				return -1;
+		}
+		if (conv.star_prec) {
+			prec = va_arg(ap, int);
+			if (pack_u64(p, end, prec) < 0)
+				return -1;
+		}
+
+		switch (conv.arg) {
+		case LOG_BIN_ARG_NONE:
+			continue;
+		case LOG_BIN_ARG_INT:
+			if (pack_u64(p, end, va_arg(ap, int)) < 0)
+				return -1;
+			break;
+		case LOG_BIN_ARG_LONG:
+			if (pack_u64(p, end, va_arg(ap, long)) < 0)
+				return -1;
+			break;
+		case LOG_BIN_ARG_LLONG:
+			if (pack_u64(p, end, va_arg(ap, long long)) < 0)
+				return -1;
+			break;
+		case LOG_BIN_ARG_SIZE:
+			if (pack_u64(p, end, va_arg(ap, size_t)) < 0)
+				return -1;
+			break;
+		case LOG_BIN_ARG_PTRDIFF:
+			if (pack_u64(p, end, va_arg(ap, ptrdiff_t)) < 0)
+				return -1;
+			break;
+		case LOG_BIN_ARG_INTMAX:
+			if (pack_u64(p, end, va_arg(ap, intmax_t)) < 0)
+				return -1;
+			break;
+		case LOG_BIN_ARG_DOUBLE:
+			if (pack_double(p, end, va_arg(ap, double)) < 0)
+				return -1;
+			break;
+		case LOG_BIN_ARG_LDOUBLE:
+			if (pack_double(p, end, va_arg(ap, long double)) < 0)
+				return -1;
+			break;
+		case LOG_BIN_ARG_STR:
+			if (pack_str(p, end, va_arg(ap, const char *), prec) < 0)
+				return -1;
+			break;
+		case LOG_BIN_ARG_PTR:
+			if (pack_u64(p, end, (uintptr_t) va_arg(ap, void *)) < 0)
+				return -1;
+			break;
+		case LOG_BIN_ARG_OTHER:
+			/* only consumed, the decoder prints a placeholder */
+			va_arg(ap, void *);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static void _binary_output(struct log_target *target, unsigned int subsys,
+			   unsigned int level, const char *file, int line,
+			   int cont, const char *format, va_list ap)
+{
+	struct log_binary_file *bf = target->tgt_binary.file;
+	uint8_t buf[LOG_BIN_MAX_REC];
+	struct log_binary_rec_msg *rec = (struct log_binary_rec_msg *) buf;
+	uint8_t *p = buf + sizeof(*rec);
+	struct timespec ts;
+	uint32_t id;
+
+	if (site_id(bf, format, file, line, &id) < 0)
+		return;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	rec->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	rec->site = id;
+	rec->subsys = subsys;
+	rec->level = level;
+	rec->flags = cont ? LOG_BIN_F_CONT : 0;
+	if (pack_args(&p, buf + sizeof(buf), format, ap) < 0)
+		rec->flags |= LOG_BIN_F_TRUNC;
+	rec->hdr.type = LOG_BIN_REC_MSG;
+	rec->hdr.len = p - buf;
+
+	bf_write(bf, buf, p - buf);
+}
+
+static int log_binary_destructor(struct log_target *target)
+{
+	struct log_binary_file *bf = target->tgt_binary.file;
+
+	if (bf->map)
+		munmap(bf->map, LOG_BIN_MAP_SIZE);
+	/* cut off the unused part of the last window, if that fails the
+	 * zeroes read as the end of the file */
+	ftruncate(bf->fd, bf->map_off + bf->pos);
+	close(bf->fd);
+
+	return 0;
+}
+
+/*! \brief Create a log target writing unformatted records to a file
+ *  \param[in] fname File name of the new log file, it is truncated
+ *  \returns Log target in case of success, NULL otherwise
+ *
+ * Use the osmo-log-decode utility to read the file.
+ */
+struct log_target *log_target_create_binary(const char *fname)
+{
+	struct log_target *target;
+	struct log_binary_file *bf;
+	struct log_binary_hdr hdr;
+	unsigned int i;
+
+	target = log_target_create();
+	if (!target)
+		return NULL;
+
+	bf = talloc_zero(target, struct log_binary_file);
+	if (!bf)
+		goto err;
+	bf->page_size = sysconf(_SC_PAGESIZE);
+	bf->sites_size = LOG_BIN_SITES_MIN;
+	bf->sites = talloc_zero_array(bf, struct log_binary_site,
+				      bf->sites_size);
+	if (!bf->sites)
+		goto err;
+
+	bf->fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0660);
+	if (bf->fd < 0)
+		goto err;
+
+	target->type = LOG_TGT_TYPE_BINARY;
+	target->tgt_binary.fname = talloc_strdup(target, fname);
+	target->tgt_binary.file = bf;
+	target->raw_output = _binary_output;
+	talloc_set_destructor(target, log_binary_destructor);
+
+	memcpy(hdr.magic, LOG_BIN_MAGIC, sizeof(hdr.magic));
+	hdr.version = LOG_BIN_VERSION;
+	hdr.hdr_len = sizeof(hdr);
+	if (bf_write(bf, &hdr, sizeof(hdr)) < 0)
+		goto err;
+
+	/* the decoder prints category names rather than numbers */
+	for (i = 0; i < osmo_log_info->num_cat; i++) {
+		struct log_binary_rec_cat rec;
+
+		if (!osmo_log_info->cat[i].name)
+			continue;
+		rec.subsys = i;
+		bf_write_rec(bf, LOG_BIN_REC_CAT, &rec, sizeof(rec),
+			     osmo_log_info->cat[i].name, NULL);
+	}
+
+	return target;
+
+err:
+	talloc_free(target);
+	return NULL;
+}
+
+#endif /* HAVE_SYS_MMAN_H */
+
+struct log_binary_reader {
+	const uint8_t *buf;
+	size_t len;
+	size_t pos;
+
+	struct {
+		const char *file;
+		const char *format;
+		int line;
+	} *sites;
+	unsigned int num_sites;
+	unsigned int sites_size;
+
+	const char **cats;
+	unsigned int num_cats;
+};
+
+/*! \brief Start reading a binary log file
+ *  \param[in] ctx talloc context of the reader
+ *  \param[in] buf Contents of the file, must stay valid while reading
+ *  \param[in] len Length of the file
+ *  \returns Reader, NULL if the file is not a binary log file
+ */
+struct log_binary_reader *log_binary_reader_alloc(void *ctx,
+						  const uint8_t *buf,
+						  size_t len)
+{
+	struct log_binary_reader *r;
+	struct log_binary_hdr hdr;
+
+	if (len < sizeof(hdr))
+		return NULL;
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (memcmp(hdr.magic, LOG_BIN_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.version != LOG_BIN_VERSION || hdr.hdr_len > len)
+		return NULL;
+
+	r = talloc_zero(ctx, struct log_binary_reader);
+	if (!r)
+		return NULL;
+	r->buf = buf;
+	r->len = len;
+	r->pos = hdr.hdr_len;
+
+	return r;
+}
+
+/* a NUL terminated string at p, NULL if it exceeds end */
+static const char *rec_str(const uint8_t **p, const uint8_t *end)
+{
+	const char *s = (const char *) *p;
+	const uint8_t *nul = memchr(*p, '\0', end - *p);
+
+	if (!nul)
+		return NULL;
+	*p = nul + 1;
+	return s;
+}
+
+struct fmt_out {
+	char *o;
+	size_t rem;
+};
+
+static void out_put(struct fmt_out *out, const char *s, size_t len)
+{
+	if (len >= out->rem)
+		len = out->rem - 1;
+	memcpy(out->o, s, len);
+	out->o += len;
+	out->rem -= len;
+	*out->o = '\0';
+}
+
+static void out_ret(struct fmt_out *out, int ret)
+{
+	if (ret < 0)
+		return;
+	if (ret >= out->rem)
+		ret = out->rem - 1;
+	out->o += ret;
+	out->rem -= ret;
+}
+
+static int unpack_u64(const uint8_t **p, const uint8_t *end, uint64_t *v)
+{
+	if (end - *p < sizeof(*v))
+		return -1;
+	memcpy(v, *p, sizeof(*v));
+	*p += sizeof(*v);
+	return 0;
+}
+
+/* printf the value with the width and precision taken from arguments
+ * if the conversion has them */
+#define OUT_CONV(out, conv, spec, w, pr, val)				\
+	do {								\
+		int __ret;						\
+		if ((conv)->star_width && (conv)->star_prec)		\
+			__ret = snprintf((out)->o, (out)->rem, spec,	\
+					 w, pr, val);			\
+		else if ((conv)->star_width)				\
+			__ret = snprintf((out)->o, (out)->rem, spec,	\
+					 w, val);			\
+		else if ((conv)->star_prec)				\
+			__ret = snprintf((out)->o, (out)->rem, spec,	\
+					 pr, val);			\
+		else							\
+			__ret = snprintf((out)->o, (out)->rem, spec, val); \
+		out_ret(out, __ret);					\
+	} while (0)
+
+/* format the arguments at p according to format, returns -1 if they end
+ * before the format string does, -2 if a conversion cannot be decoded */
+static int format_args(struct fmt_out *out, const char *format,
+		       const uint8_t *p, const uint8_t *end)
+{
+	struct log_binary_conv conv;
+	const char *next;
+	char spec[32];
+	char str[LOG_BIN_MAX_REC];
+	uint64_t v, w = 0, pr = 0;
+	uint16_t slen;
+	double d;
+
+	while ((next = log_binary_next_conv(format, &conv))) {
+		out_put(out, format, conv.start - format);
+		format = next;
+
+		if (conv.arg == LOG_BIN_ARG_NONE) {
+			/* nothing we could pass to printf */
+			if (conv.start[conv.len - 1] == '%')
+				out_put(out, "%", 1);
+			else
+				out_put(out, conv.start, conv.len);
+			continue;
+		}
+		if (conv.arg == LOG_BIN_ARG_OTHER) {
+			out_put(out, "?", 1);
+			continue;
+		}
+		/* its argument is in the record, it can't be skipped */
+		if (conv.len >= sizeof(spec))
+			return -2;
+		memcpy(spec, conv.start, conv.len);
+		spec[conv.len] = '\0';
+
+		if (conv.star_width && unpack_u64(&p, end, &w) < 0)
+			return -1;
+		if (conv.star_prec && unpack_u64(&p, end, &pr) < 0)
+			return -1;
+
+		switch (conv.arg) {
+		case LOG_BIN_ARG_STR:
+			if (end - p < sizeof(slen))
+				return -1;
+			memcpy(&slen, p, sizeof(slen));
+			p += sizeof(slen);
+			if (slen == LOG_BIN_STR_NULL) {
+				OUT_CONV(out, &conv, spec, (int) w, (int) pr,
+					 "(null)");
+				break;
+			}
+			if (slen > end - p)
+				return -1;
+			if (slen >= sizeof(str))
+				return -2;
+			memcpy(str, p, slen);
+			str[slen] = '\0';
+			p += slen;
+			OUT_CONV(out, &conv, spec, (int) w, (int) pr, str);
+			break;
+		case LOG_BIN_ARG_DOUBLE:
+		case LOG_BIN_ARG_LDOUBLE:
+			if (end - p < sizeof(d))
+				return -1;
+			memcpy(&d, p, sizeof(d));
+			p += sizeof(d);
+			if (conv.arg == LOG_BIN_ARG_LDOUBLE)
+				OUT_CONV(out, &conv, spec, (int) w, (int) pr,
+					 (long double) d);
+			else
+				OUT_CONV(out, &conv, spec, (int) w, (int) pr,
+					 d);
+			break;
+		default:
+			if (unpack_u64(&p, end, &v) < 0)
+				return -1;
+			switch (conv.arg) {
+			case LOG_BIN_ARG_INT:
+				OUT_CONV(out, &conv, spec, (int) w, (int) pr,
+					 (int) v);
+				break;
+			case LOG_BIN_ARG_LONG:
+				OUT_CONV(out, &conv, spec, (int) w, (int) pr,
+					 (long) v);
+				break;
+			case LOG_BIN_ARG_LLONG:
+				OUT_CONV(out, &conv, spec, (int) w, (int) pr,
+					 (long long) v);
+				break;
+			case LOG_BIN_ARG_SIZE:
+				OUT_CONV(out, &conv, spec, (int) w, (int) pr,
+					 (size_t) v);
+				break;
+			case LOG_BIN_ARG_PTRDIFF:
+				OUT_CONV(out, &conv, spec, (int) w, (int) pr,
+					 (ptrdiff_t) v);
+				break;
+			case LOG_BIN_ARG_INTMAX:
+				OUT_CONV(out, &conv, spec, (int) w, (int) pr,
+					 (intmax_t) v);
+				break;
+			default:
+				OUT_CONV(out, &conv, spec, (int) w, (int) pr,
+					 (void *)(uintptr_t) v);
+				break;
+			}
+			break;
+		}
+	}
+	out_put(out, format, strlen(format));
+
+	return 0;
+}
+
+static int read_msg(struct log_binary_reader *r, const uint8_t *p,
+		    const uint8_t *end, struct log_binary_msg *msg)
+{
+	struct log_binary_rec_msg rec;
+	struct fmt_out out = { msg->text, sizeof(msg->text) };
+	int rc;
+
+	if (end - p < sizeof(rec))
+		return -EBADMSG;
+	memcpy(&rec, p, sizeof(rec));
+	if (rec.site >= r->num_sites)
+		return -EBADMSG;
+
+	msg->ts_ns = rec.ts_ns;
+	msg->subsys = rec.subsys;
+	msg->cat_name = rec.subsys < r->num_cats ? r->cats[rec.subsys] : NULL;
+	msg->level = rec.level;
+	msg->file = r->sites[rec.site].file;
+	msg->line = r->sites[rec.site].line;
+	msg->cont = !!(rec.flags & LOG_BIN_F_CONT);
+	msg->truncated = !!(rec.flags & LOG_BIN_F_TRUNC);
+	msg->text[0] = '\0';
+
+	rc = format_args(&out, r->sites[rec.site].format, p + sizeof(rec),
+			 end);
+	/* arguments of truncated messages may be missing */
+	if (rc == -2 || (rc < 0 && !msg->truncated))
+		return -EBADMSG;
+
+	return 0;
+}
+
+/*! \brief Read the next message from a binary log file
+ *  \param[in] r Reader from \ref log_binary_reader_alloc
+ *  \param[out] msg The message, formatted
+ *  \returns 1 if a message was read, 0 at the end of the file,
+ *	     -EBADMSG if a message could not be decoded, the next call
+ *	     goes on with the record after it, other negative values if
+ *	     the file is corrupt
+ */
+int log_binary_reader_next(struct log_binary_reader *r,
+			   struct log_binary_msg *msg)
+{
+	struct log_binary_rec hdr;
+	const uint8_t *p, *end;
+	const char *s1, *s2;
+	int rc;
+
+	while (r->pos + sizeof(hdr) <= r->len) {
+		memcpy(&hdr, r->buf + r->pos, sizeof(hdr));
+		if (hdr.type == LOG_BIN_REC_END)
+			return 0;
+		if (hdr.len < sizeof(hdr) || hdr.len > LOG_BIN_MAX_REC ||
+		    hdr.len > r->len - r->pos)
+			return -EINVAL;
+		p = r->buf + r->pos;
+		end = p + hdr.len;
+		r->pos += hdr.len;
+
+		switch (hdr.type) {
+		case LOG_BIN_REC_CAT: {
+			struct log_binary_rec_cat rec;
+
+			if (hdr.len < sizeof(rec))
+				return -EINVAL;
+			memcpy(&rec, p, sizeof(rec));
+			p += sizeof(rec);
+			if (!(s1 = rec_str(&p, end)))
+				return -EINVAL;
+			if (rec.subsys >= r->num_cats) {
+				const char **cats;
+
+				cats = talloc_realloc(r, r->cats, const char *,
+						      rec.subsys + 1);
+				if (!cats)
+					return -ENOMEM;
+				memset(cats + r->num_cats, 0, (rec.subsys + 1 -
+				       r->num_cats) * sizeof(*cats));
+				r->cats = cats;
+				r->num_cats = rec.subsys + 1;
+			}
+			r->cats[rec.subsys] = s1;
+			break;
+		}
+		case LOG_BIN_REC_SITE: {
+			struct log_binary_rec_site rec;
+
+			if (hdr.len < sizeof(rec))
+				return -EINVAL;
+			memcpy(&rec, p, sizeof(rec));
+			p += sizeof(rec);
+			if (!(s1 = rec_str(&p, end)) || !(s2 = rec_str(&p, end)))
+				return -EINVAL;
+			/* sites are numbered in the order they appear */
+			if (rec.id != r->num_sites)
+				return -EINVAL;
+			if (r->num_sites == r->sites_size) {
+				unsigned int size = r->sites_size ?
+						r->sites_size * 2 : 64;
+				void *sites;
+
+				sites = talloc_realloc_size(r, r->sites,
+						size * sizeof(*r->sites));
+				if (!sites)
+					return -ENOMEM;
+				r->sites = sites;
+				r->sites_size = size;
+			}
+			r->sites[r->num_sites].file = s1;
+			r->sites[r->num_sites].format = s2;
+			r->sites[r->num_sites].line = rec.line;
+			r->num_sites++;
+			break;
+		}
+		case LOG_BIN_REC_MSG:
+			rc = read_msg(r, p, end, msg);
+			return rc < 0 ? rc : 1;
+		default:
+			/* written by a newer version, skip it */
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/*! @} */
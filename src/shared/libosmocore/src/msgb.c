@@ -32,10 +32,112 @@
 #include <osmocom/core/msgb.h>
 //#include <openbsc/gsm_data.h>
 #include <osmocom/core/talloc.h>
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/utils.h>
 //#include <openbsc/debug.h>
 
 void *tall_msgb_ctx;
 
+/* Freed message buffers of a few common sizes are not returned to
+ * talloc but kept on a per-size freelist, from which the next
+ * allocation of the same size class is served. */
+
+/* maximum number of buffers cached on the freelist of one size class */
+#define MSGB_POOL_MAX_FREE	1024
+
+enum msgb_pool_ctr {
+	MSGB_POOL_CTR_ALLOC_HIT,
+	MSGB_POOL_CTR_ALLOC_MISS,
+	MSGB_POOL_CTR_FREE_CACHED,
+	MSGB_POOL_CTR_FREE_RELEASED,
+};
+
+static const struct rate_ctr_desc msgb_pool_ctr_description[] = {
+	[MSGB_POOL_CTR_ALLOC_HIT]	= { "alloc.hit",	"Allocations served from the freelist" },
+	[MSGB_POOL_CTR_ALLOC_MISS]	= { "alloc.miss",	"Allocations that had to use talloc   " },
+	[MSGB_POOL_CTR_FREE_CACHED]	= { "free.cached",	"Buffers put back on the freelist     " },
+	[MSGB_POOL_CTR_FREE_RELEASED]	= { "free.released",	"Buffers released to talloc           " },
+};
+
+static const struct rate_ctr_group_desc msgb_pool_ctrg_desc = {
+	.group_name_prefix = "msgb.pool",
+	.group_description = "Message buffer pool statistics",
+	.num_ctr = ARRAY_SIZE(msgb_pool_ctr_description),
+	.ctr_desc = msgb_pool_ctr_description,
+};
+
+struct msgb_pool {
+	/* size of the data array of buffers in this class */
+	uint16_t size;
+	unsigned int num_free;
+	struct llist_head free;
+	/* counter group, index is the size of the class */
+	struct rate_ctr_group *ctrg;
+};
+
+static struct msgb_pool msgb_pools[] = {
+	{ .size = 256, .free = LLIST_HEAD_INIT(msgb_pools[0].free) },
+	{ .size = 512, .free = LLIST_HEAD_INIT(msgb_pools[1].free) },
+	{ .size = 2048, .free = LLIST_HEAD_INIT(msgb_pools[2].free) },
+};
+
+static struct msgb_pool *msgb_pool_by_size(uint16_t size)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(msgb_pools); i++) {
+		if (size <= msgb_pools[i].size)
+			return &msgb_pools[i];
+	}
+
+	return NULL;
+}
+
+static void msgb_pool_ctr_inc(struct msgb_pool *pool, enum msgb_pool_ctr ctr)
+{
+	if (!pool->ctrg) {
+		pool->ctrg = rate_ctr_group_alloc(NULL, &msgb_pool_ctrg_desc,
+						  pool->size);
+		if (!pool->ctrg)
+			return;
+	}
+	rate_ctr_inc(&pool->ctrg->ctr[ctr]);
+}
+
+/* get a buffer of at least \a size octets, its contents are undefined */
+static struct msgb *_msgb_alloc(uint16_t size)
+{
+	struct msgb_pool *pool = msgb_pool_by_size(size);
+	struct msgb *msg;
+
+	if (!pool)
+		return talloc_size(tall_msgb_ctx, sizeof(*msg) + size);
+
+	if (pool->num_free) {
+		msgb_pool_ctr_inc(pool, MSGB_POOL_CTR_ALLOC_HIT);
+		msg = llist_entry(pool->free.next, struct msgb, list);
+		llist_del(&msg->list);
+		pool->num_free--;
+		return msg;
+	}
+
+	msgb_pool_ctr_inc(pool, MSGB_POOL_CTR_ALLOC_MISS);
+	return talloc_size(tall_msgb_ctx, sizeof(*msg) + pool->size);
+}
+
+static void msgb_init(struct msgb *msg, uint16_t size, const char *name)
+{
+	memset(msg, 0, sizeof(*msg));
+	talloc_set_name_const(msg, name);
+
+	msg->data_len = size;
+	msg->len = 0;
+	msg->data = msg->_data;
+	msg->head = msg->_data;
+	msg->tail = msg->_data;
+}
+
 /*! \brief Allocate a new message buffer
  * \param[in] size Length in octets, including headroom
  * \param[in] name Human-readable name to be associated with msgb
@@ -48,18 +150,36 @@ struct msgb *msgb_alloc(uint16_t size, const char *name)
 {
 	struct msgb *msg;
 
-	msg = _talloc_zero(tall_msgb_ctx, sizeof(*msg) + size, name);
+	msg = _msgb_alloc(size);
 
 	if (!msg) {
 		//LOGP(DRSL, LOGL_FATAL, "unable to allocate msgb\n");
 		return NULL;
 	}
 
-	msg->data_len = size;
-	msg->len = 0;
-	msg->data = msg->_data;
-	msg->head = msg->_data;
-	msg->tail = msg->_data;
+	msgb_init(msg, size, name);
+	memset(msg->_data, 0, size);
+
+	return msg;
+}
+
+/*! \brief Allocate a new message buffer without clearing its data
+ * \param[in] size Length in octets, including headroom
+ * \param[in] name Human-readable name to be associated with msgb
+ *
+ * Like \ref msgb_alloc, but the contents of the data array are
+ * undefined.  Use this for buffers that are completely overwritten,
+ * e.g. by reading from a socket.
+ */
+struct msgb *msgb_alloc_nozero(uint16_t size, const char *name)
+{
+	struct msgb *msg;
+
+	msg = _msgb_alloc(size);
+	if (!msg)
+		return NULL;
+
+	msgb_init(msg, size, name);
 
 	return msg;
 }
@@ -69,7 +189,48 @@ struct msgb *msgb_alloc(uint16_t size, const char *name)
  */
 void msgb_free(struct msgb *m)
 {
-	talloc_free(m);
+	struct msgb_pool *pool;
+	size_t size;
+
+	if (!m)
+		return;
+
+	/* only buffers allocated with the exact size of a class can be
+	 * re-used, which is all buffers that went through the pool */
+	size = talloc_get_size(m) - sizeof(*m);
+	pool = msgb_pool_by_size(size);
+	if (!pool || pool->size != size) {
+		talloc_free(m);
+		return;
+	}
+
+	if (pool->num_free >= MSGB_POOL_MAX_FREE) {
+		msgb_pool_ctr_inc(pool, MSGB_POOL_CTR_FREE_RELEASED);
+		talloc_free(m);
+		return;
+	}
+
+	msgb_pool_ctr_inc(pool, MSGB_POOL_CTR_FREE_CACHED);
+	talloc_set_name_const(m, "msgb pool");
+	llist_add(&m->list, &pool->free);
+	pool->num_free++;
+}
+
+/*! \brief Release all message buffers cached by the msgb pool */
+void msgb_pool_flush(void)
+{
+	struct msgb *msg, *tmp;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(msgb_pools); i++) {
+		struct msgb_pool *pool = &msgb_pools[i];
+
+		llist_for_each_entry_safe(msg, tmp, &pool->free, list) {
+			llist_del(&msg->list);
+			talloc_free(msg);
+		}
+		pool->num_free = 0;
+	}
 }
 
 /*! \brief Enqueue message buffer to tail of a queue
@@ -150,6 +311,8 @@ uint16_t msgb_length(const struct msgb *msg)
  */
 void msgb_set_talloc_ctx(void *ctx)
 {
+	/* cached buffers belong to the previous context */
+	msgb_pool_flush();
 	tall_msgb_ctx = ctx;
 }
 
@@ -21,6 +21,8 @@
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
 
 #include <osmocom/core/select.h>
 #include <osmocom/core/linuxlist.h>
@@ -30,6 +32,10 @@
 
 #ifdef HAVE_SYS_SELECT_H
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 /*! \addtogroup select
  *  @{
  */
@@ -41,6 +47,138 @@
 static int maxfd = 0;
 static LLIST_HEAD(osmo_fds);
 static int unregistered_count;
+static enum osmo_select_backend select_backend = OSMO_SELECT_BACKEND_SELECT;
+
+#ifdef HAVE_SYS_EPOLL_H
+/* maximum number of events fetched by a single epoll_wait() */
+#define EPOLL_MAX_EVENTS	64
+
+static int epoll_fd = -1;
+static struct epoll_event epoll_events[EPOLL_MAX_EVENTS];
+/* events of the current round and the one being dispatched */
+static int epoll_nevents;
+static int epoll_cur;
+
+static uint32_t when_to_epoll(unsigned int when)
+{
+	uint32_t events = 0;
+
+	if (when & BSC_FD_READ)
+		events |= EPOLLIN;
+	if (when & BSC_FD_WRITE)
+		events |= EPOLLOUT;
+	if (when & BSC_FD_EXCEPT)
+		events |= EPOLLPRI;
+
+	return events;
+}
+
+static unsigned int epoll_to_what(uint32_t events)
+{
+	unsigned int what = 0;
+
+	/* select() reports hangup and error conditions as readable
+	 * (and errors also as writable), keep the same semantics */
+	if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+		what |= BSC_FD_READ;
+	if (events & (EPOLLOUT | EPOLLERR))
+		what |= BSC_FD_WRITE;
+	if (events & EPOLLPRI)
+		what |= BSC_FD_EXCEPT;
+
+	return what;
+}
+
+/* bring the kernel interest set of one fd in line with its \a when.
+ * File descriptors without any interest are removed from the set, as
+ * epoll would otherwise keep reporting hangups on them. */
+static int epoll_sync_fd(struct osmo_fd *ufd)
+{
+	struct epoll_event ev;
+	int rc;
+
+	if (ufd->when == ufd->kernel_when)
+		return 0;
+
+	if (!ufd->when) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, ufd->fd, NULL);
+		ufd->kernel_when = 0;
+		return 0;
+	}
+
+	ev.events = when_to_epoll(ufd->when);
+	ev.data.ptr = ufd;
+
+	if (ufd->kernel_when) {
+		rc = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, ufd->fd, &ev);
+		if (rc < 0 && errno == ENOENT)
+			rc = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ufd->fd, &ev);
+	} else {
+		rc = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ufd->fd, &ev);
+		if (rc < 0 && errno == EEXIST)
+			rc = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, ufd->fd, &ev);
+	}
+	if (rc < 0)
+		return -errno;
+
+	ufd->kernel_when = ufd->when;
+	return 0;
+}
+
+static int osmo_epoll_main(int polling)
+{
+	struct osmo_fd *ufd;
+	struct timeval *tv;
+	int work = 0, timeout, rc;
+
+	/* the callbacks (and everybody else) modify ufd->when directly,
+	 * so pick up those changes.  This is a plain integer compare per
+	 * fd, system calls are only made for fds whose interest changed */
+	llist_for_each_entry(ufd, &osmo_fds, list)
+		epoll_sync_fd(ufd);
+
+	osmo_timers_check();
+
+	if (!polling) {
+		osmo_timers_prepare();
+		tv = osmo_timers_nearest();
+		if (tv) {
+			/* round up, waking up before the timer is due
+			 * would only result in a spurious iteration */
+			timeout = tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000;
+		} else
+			timeout = -1;
+	} else
+		timeout = 0;
+
+	rc = epoll_wait(epoll_fd, epoll_events, EPOLL_MAX_EVENTS, timeout);
+	if (rc < 0)
+		return 0;
+
+	/* fire timers */
+	osmo_timers_update();
+
+	/* call registered callback functions of ready fds only */
+	epoll_nevents = rc;
+	for (epoll_cur = 0; epoll_cur < epoll_nevents; epoll_cur++) {
+		unsigned int flags;
+
+		ufd = epoll_events[epoll_cur].data.ptr;
+		/* unregistered by an earlier callback of this round */
+		if (!ufd)
+			continue;
+
+		flags = epoll_to_what(epoll_events[epoll_cur].events) & ufd->when;
+		if (flags) {
+			work = 1;
+			ufd->cb(ufd, flags);
+		}
+	}
+	epoll_nevents = 0;
+
+	return work;
+}
+#endif /* HAVE_SYS_EPOLL_H */
 
 /*! \brief Register a new file descriptor with select loop abstraction
  *  \param[in] fd osmocom file descriptor to be registered
@@ -83,6 +221,17 @@ int osmo_fd_register(struct osmo_fd *fd)
 
 	llist_add_tail(&fd->list, &osmo_fds);
 
+#ifdef HAVE_SYS_EPOLL_H
+	fd->kernel_when = 0;
+	if (select_backend == OSMO_SELECT_BACKEND_EPOLL) {
+		int rc = epoll_sync_fd(fd);
+		if (rc < 0) {
+			llist_del(&fd->list);
+			return rc;
+		}
+	}
+#endif
+
 	return 0;
 }
 
@@ -93,6 +242,76 @@ void osmo_fd_unregister(struct osmo_fd *fd)
 {
 	unregistered_count++;
 	llist_del(&fd->list);
+
+#ifdef HAVE_SYS_EPOLL_H
+	if (select_backend == OSMO_SELECT_BACKEND_EPOLL) {
+		int i;
+
+		/* the fd might already be closed, in which case the
+		 * kernel has dropped it from the interest set itself */
+		if (fd->kernel_when)
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd->fd, NULL);
+		fd->kernel_when = 0;
+
+		/* make sure we don't dispatch events of this round to
+		 * an osmo_fd that may be gone by now */
+		for (i = epoll_cur + 1; i < epoll_nevents; i++) {
+			if (epoll_events[i].data.ptr == fd)
+				epoll_events[i].data.ptr = NULL;
+		}
+	}
+#endif
+}
+
+/*! \brief Select the backend used by \ref osmo_select_main
+ *  \param[in] backend the backend to be used from now on
+ *  \returns 0 on success, negative errno on error
+ *
+ * Already registered file descriptors are migrated to the new
+ * backend.  Must not be called from within a file descriptor
+ * call-back.
+ */
+int osmo_select_set_backend(enum osmo_select_backend backend)
+{
+	struct osmo_fd *ufd;
+
+	if (backend == select_backend)
+		return 0;
+
+	switch (backend) {
+	case OSMO_SELECT_BACKEND_SELECT:
+#ifdef HAVE_SYS_EPOLL_H
+		close(epoll_fd);
+		epoll_fd = -1;
+		llist_for_each_entry(ufd, &osmo_fds, list)
+			ufd->kernel_when = 0;
+#endif
+		break;
+	case OSMO_SELECT_BACKEND_EPOLL:
+#ifdef HAVE_SYS_EPOLL_H
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_fd < 0)
+			return -errno;
+		/* the fds get added to the kernel interest set by the
+		 * next osmo_select_main() iteration */
+		llist_for_each_entry(ufd, &osmo_fds, list)
+			ufd->kernel_when = 0;
+		break;
+#else
+		return -ENOTSUP;
+#endif
+	default:
+		return -EINVAL;
+	}
+
+	select_backend = backend;
+	return 0;
+}
+
+/*! \brief Get the backend currently used by \ref osmo_select_main */
+enum osmo_select_backend osmo_select_get_backend(void)
+{
+	return select_backend;
 }
 
 /*! \brief select main loop integration
@@ -105,6 +324,11 @@ int osmo_select_main(int polling)
 	int work = 0, rc;
 	struct timeval no_time = {0, 0};
 
+#ifdef HAVE_SYS_EPOLL_H
+	if (select_backend == OSMO_SELECT_BACKEND_EPOLL)
+		return osmo_epoll_main(polling);
+#endif
+
 	FD_ZERO(&readset);
 	FD_ZERO(&writeset);
 	FD_ZERO(&exceptset);
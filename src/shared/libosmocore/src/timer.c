@@ -37,41 +37,259 @@ static struct timeval *nearest_p;
 #include <assert.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
+#include <time.h>
 #include <osmocom/core/timer.h>
 #include <osmocom/core/timer_compat.h>
 #include <osmocom/core/linuxlist.h>
 
-static struct rb_root timer_root = RB_ROOT;
+/*
+ * Timers are kept in a hierarchical timing wheel, similar to the one
+ * the Linux kernel used up to 4.7.  Time is counted in ticks of one
+ * millisecond.  The first level has one slot per tick for the next
+ * 256 ticks, each further level covers 64 times the range of the
+ * previous one.  Whenever the first level wraps around, the next slot
+ * of the second level is cascaded (re-sorted) into the first level,
+ * and so on.  Adding and deleting a timer is O(1).
+ *
+ * A timer is put into the slot of the tick it expires in, but it only
+ * fires once its exact (microsecond) timeout has passed, so we don't
+ * lose any precision compared to a sorted list of timers.
+ */
+
+#define TICK_USEC	1000
+
+#define WHEEL0_BITS	8
+#define WHEELN_BITS	6
+#define WHEEL0_SIZE	(1 << WHEEL0_BITS)
+#define WHEELN_SIZE	(1 << WHEELN_BITS)
+#define WHEEL0_MASK	(WHEEL0_SIZE - 1)
+#define WHEELN_MASK	(WHEELN_SIZE - 1)
+#define WHEEL_LEVELS	5
+
+/* index of the slot in level \a n (1..4) for tick \a t */
+#define WHEELN_IDX(t, n) \
+	(((t) >> (WHEEL0_BITS + ((n) - 1) * WHEELN_BITS)) & WHEELN_MASK)
+
+static struct llist_head wheel0[WHEEL0_SIZE];
+static struct llist_head wheeln[WHEEL_LEVELS - 1][WHEELN_SIZE];
+
+/* one bit per slot, set when a timer is added to the slot.  Bits are
+ * cleared lazily once the slot is found to be empty again. */
+static uint64_t wheel0_map[WHEEL0_SIZE / 64];
+static uint64_t wheeln_map[WHEEL_LEVELS - 1];
+
+/* the tick up to which the wheel has been processed */
+static uint64_t wheel_tick;
+static int wheel_initialized;
+static unsigned int timer_count;
+/* counts the timers added, to fire timers of the same timeout in the
+ * order they were added */
+static unsigned long timer_seq;
+
+/* cached monotonic time in microseconds, see osmo_timers_update() */
+static uint64_t now_usec;
+static int now_valid;
+
+static uint64_t clock_read(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t clock_now(void)
+{
+	if (!now_valid) {
+		now_usec = clock_read();
+		now_valid = 1;
+	}
+	return now_usec;
+}
+
+static inline uint64_t tv2usec(const struct timeval *tv)
+{
+	return (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static void wheel_init(void)
+{
+	int i, j;
+
+	for (i = 0; i < WHEEL0_SIZE; i++)
+		INIT_LLIST_HEAD(&wheel0[i]);
+	for (i = 0; i < WHEEL_LEVELS - 1; i++) {
+		for (j = 0; j < WHEELN_SIZE; j++)
+			INIT_LLIST_HEAD(&wheeln[i][j]);
+	}
+	wheel_tick = clock_now() / TICK_USEC;
+	wheel_initialized = 1;
+}
 
 static void __add_timer(struct osmo_timer_list *timer)
 {
-	struct rb_node **new = &(timer_root.rb_node);
-	struct rb_node *parent = NULL;
+	uint64_t expires = tv2usec(&timer->timeout) / TICK_USEC;
+	uint64_t delta;
+	struct llist_head *slot;
+	int level, idx;
+
+	if (expires < wheel_tick)
+		expires = wheel_tick;
+	delta = expires - wheel_tick;
+
+	if (delta < WHEEL0_SIZE) {
+		idx = expires & WHEEL0_MASK;
+		slot = &wheel0[idx];
+		wheel0_map[idx / 64] |= 1ULL << (idx % 64);
+		llist_add_tail(&timer->list, slot);
+		return;
+	}
+
+	for (level = 1; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < 1ULL << (WHEEL0_BITS + level * WHEELN_BITS))
+			break;
+	}
+	/* timers beyond the range of the last level are parked in its
+	 * farthest slot and get re-sorted once it is cascaded */
+	if (level == WHEEL_LEVELS - 1 &&
+	    delta >= 1ULL << (WHEEL0_BITS + level * WHEELN_BITS))
+		expires = wheel_tick +
+			  (1ULL << (WHEEL0_BITS + level * WHEELN_BITS)) - 1;
+
+	idx = WHEELN_IDX(expires, level);
+	wheeln_map[level - 1] |= 1ULL << idx;
+	llist_add_tail(&timer->list, &wheeln[level - 1][idx]);
+}
+
+/* re-sort all timers of one higher level slot into the lower levels */
+static int cascade(int level, int idx)
+{
+	struct llist_head list;
+	struct osmo_timer_list *this, *tmp;
 
-	while (*new) {
-		struct osmo_timer_list *this;
+	INIT_LLIST_HEAD(&list);
+	llist_splice_init(&wheeln[level - 1][idx], &list);
+	wheeln_map[level - 1] &= ~(1ULL << idx);
 
-		this = container_of(*new, struct osmo_timer_list, node);
+	llist_for_each_entry_safe(this, tmp, &list, list)
+		__add_timer(this);
 
-		parent = *new;
-		if (timercmp(&timer->timeout, &this->timeout, <))
-			new = &((*new)->rb_left);
-		else
-			new = &((*new)->rb_right);
-        }
+	return idx;
+}
 
-        rb_link_node(&timer->node, parent, new);
-        rb_insert_color(&timer->node, &timer_root);
+/* advance the wheel by one tick, cascading higher levels as needed */
+static void wheel_advance(void)
+{
+	int level;
+
+	wheel_tick++;
+	if (wheel_tick & WHEEL0_MASK)
+		return;
+
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		if (cascade(level, WHEELN_IDX(wheel_tick, level)))
+			break;
+	}
+}
+
+/* find the first non-empty slot in level 0 within [from, to) */
+static int wheel0_find(int from, int to)
+{
+	int idx = from;
+
+	while (idx < to) {
+		uint64_t word = wheel0_map[idx / 64] >> (idx % 64);
+		if (!word) {
+			idx = (idx | 63) + 1;
+			continue;
+		}
+		idx += __builtin_ctzll(word);
+		if (idx >= to)
+			break;
+		if (!llist_empty(&wheel0[idx]))
+			return idx;
+		wheel0_map[idx / 64] &= ~(1ULL << (idx % 64));
+		idx++;
+	}
+
+	return -1;
+}
+
+static int wheeln_empty(void)
+{
+	int level, idx;
+
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		uint64_t map = wheeln_map[level - 1];
+		while (map) {
+			idx = __builtin_ctzll(map);
+			if (!llist_empty(&wheeln[level - 1][idx]))
+				return 0;
+			map &= ~(1ULL << idx);
+		}
+		wheeln_map[level - 1] = 0;
+	}
+
+	return 1;
+}
+
+static uint64_t slot_earliest(struct llist_head *slot)
+{
+	struct osmo_timer_list *this;
+	uint64_t earliest = UINT64_MAX, t;
+
+	llist_for_each_entry(this, slot, list) {
+		t = tv2usec(&this->timeout);
+		if (t < earliest)
+			earliest = t;
+	}
+
+	return earliest;
+}
+
+/* does timer a fire before timer b */
+static int timer_before(const struct osmo_timer_list *a,
+			const struct osmo_timer_list *b)
+{
+	uint64_t ta = tv2usec(&a->timeout), tb = tv2usec(&b->timeout);
+
+	if (ta != tb)
+		return ta < tb;
+	return (long)(a->seq - b->seq) < 0;
+}
+
+/* move a due timer to the eviction list, which is kept in the order
+ * the timers expire.  A slot holds the timers of a whole tick in the
+ * order they were added or cascaded, so sort them here.  The list is
+ * mostly in order already, so search from its end. */
+static void evict(struct osmo_timer_list *timer, struct llist_head *list)
+{
+	struct llist_head *pos;
+
+	for (pos = list->prev; pos != list; pos = pos->prev) {
+		if (timer_before(llist_entry(pos, struct osmo_timer_list, list),
+				 timer))
+			break;
+	}
+	llist_del(&timer->list);
+	llist_add(&timer->list, pos);
 }
 
 /*! \brief add a new timer to the timer management
  *  \param[in] timer the timer that should be added
+ *
+ * The \a timeout of the timer is an absolute time on the
+ * CLOCK_MONOTONIC clock, not wall clock time.
  */
 void osmo_timer_add(struct osmo_timer_list *timer)
 {
 	osmo_timer_del(timer);
+	if (!wheel_initialized)
+		wheel_init();
 	timer->active = 1;
-	INIT_LLIST_HEAD(&timer->list);
+	timer->seq = timer_seq++;
+	timer_count++;
 	__add_timer(timer);
 }
 
@@ -84,16 +302,18 @@ void osmo_timer_add(struct osmo_timer_list *timer)
  * specified number of seconds+microseconds in the future.  It will
  * internally add it to the timer management data structures, thus
  * osmo_timer_add() is automatically called.
+ *
+ * "now" is the time cached when the select loop last woke up, so
+ * timers (re-)scheduled from call-backs don't need to read the clock.
  */
 void
 osmo_timer_schedule(struct osmo_timer_list *timer, int seconds, int microseconds)
 {
-	struct timeval current_time;
+	uint64_t expires;
 
-	gettimeofday(&current_time, NULL);
-	timer->timeout.tv_sec = seconds;
-	timer->timeout.tv_usec = microseconds;
-	timeradd(&timer->timeout, &current_time, &timer->timeout);
+	expires = clock_now() + (int64_t)seconds * 1000000 + microseconds;
+	timer->timeout.tv_sec = expires / 1000000;
+	timer->timeout.tv_usec = expires % 1000000;
 	osmo_timer_add(timer);
 }
 
@@ -107,10 +327,10 @@ void osmo_timer_del(struct osmo_timer_list *timer)
 {
 	if (timer->active) {
 		timer->active = 0;
-		rb_erase(&timer->node, &timer_root);
-		/* make sure this is not already scheduled for removal. */
-		if (!llist_empty(&timer->list))
-			llist_del_init(&timer->list);
+		timer_count--;
+		/* unlinks it from its wheel slot or from the list of
+		 * timers scheduled for removal. */
+		llist_del(&timer->list);
 	}
 }
 
@@ -128,7 +348,7 @@ int osmo_timer_pending(struct osmo_timer_list *timer)
 
 /*! \brief compute the remaining time of a timer
  *  \param[in] timer the to-be-checked timer
- *  \param[in] the current time (NULL if not known)
+ *  \param[in] the current monotonic time (NULL if not known)
  *  \param[out] remaining remaining time until timer fires
  *  \return 0 if timer has not expired yet, -1 if it has
  *
@@ -142,11 +362,13 @@ int osmo_timer_remaining(const struct osmo_timer_list *timer,
 	struct timeval current_time;
 
 	if (!now) {
-		gettimeofday(&current_time, NULL);
+		uint64_t t = clock_read();
+		current_time.tv_sec = t / 1000000;
+		current_time.tv_usec = t % 1000000;
 		now = &current_time;
 	}
 
-	timersub(&timer->timeout, &current_time, remaining);
+	timersub(&timer->timeout, now, remaining);
 
 	if (remaining->tv_sec < 0)
 		return -1;
@@ -168,20 +390,17 @@ struct timeval *osmo_timers_nearest(void)
 	return nearest_p;
 }
 
-static void update_nearest(struct timeval *cand, struct timeval *current)
+static void update_nearest(uint64_t cand, uint64_t current)
 {
-	if (cand->tv_sec != LONG_MAX) {
-		if (timercmp(cand, current, >))
-			timersub(cand, current, &nearest);
-		else {
-			/* loop again inmediately */
-			nearest.tv_sec = 0;
-			nearest.tv_usec = 0;
-		}
-		nearest_p = &nearest;
+	if (cand > current) {
+		nearest.tv_sec = (cand - current) / 1000000;
+		nearest.tv_usec = (cand - current) % 1000000;
 	} else {
-		nearest_p = NULL;
+		/* loop again inmediately */
+		nearest.tv_sec = 0;
+		nearest.tv_usec = 0;
 	}
+	nearest_p = &nearest;
 }
 
 /*
@@ -189,19 +408,37 @@ static void update_nearest(struct timeval *cand, struct timeval *current)
  */
 void osmo_timers_prepare(void)
 {
-	struct rb_node *node;
-	struct timeval current;
+	uint64_t current;
+	int cur, idx;
 
-	gettimeofday(&current, NULL);
+	now_usec = current = clock_read();
+	now_valid = 1;
 
-	node = rb_first(&timer_root);
-	if (node) {
-		struct osmo_timer_list *this;
-		this = container_of(node, struct osmo_timer_list, node);
-		update_nearest(&this->timeout, &current);
-	} else {
+	if (!timer_count) {
 		nearest_p = NULL;
+		return;
+	}
+
+	/* anything left in level 0 during this round of the wheel? */
+	cur = wheel_tick & WHEEL0_MASK;
+	idx = wheel0_find(cur, WHEEL0_SIZE);
+	if (idx >= 0) {
+		update_nearest(slot_earliest(&wheel0[idx]), current);
+		return;
+	}
+
+	/* the higher levels need to be cascaded once level 0 wraps */
+	if (!wheeln_empty()) {
+		update_nearest((wheel_tick - cur + WHEEL0_SIZE) * TICK_USEC,
+			       current);
+		return;
 	}
+
+	idx = wheel0_find(0, cur);
+	if (idx >= 0)
+		update_nearest(slot_earliest(&wheel0[idx]), current);
+	else
+		nearest_p = NULL;
 }
 
 /*
@@ -209,22 +446,35 @@ void osmo_timers_prepare(void)
  */
 int osmo_timers_update(void)
 {
-	struct timeval current_time;
-	struct rb_node *node;
 	struct llist_head timer_eviction_list;
-	struct osmo_timer_list *this;
+	struct osmo_timer_list *this, *tmp;
+	uint64_t current, current_tick;
 	int work = 0;
 
-	gettimeofday(&current_time, NULL);
+	/* sample the clock once after the select loop woke up, timers
+	 * (re-)scheduled by the call-backs of this iteration use it */
+	now_usec = current = clock_read();
+	now_valid = 1;
+	current_tick = current / TICK_USEC;
+
+	if (!timer_count) {
+		wheel_tick = current_tick;
+		return 0;
+	}
 
 	INIT_LLIST_HEAD(&timer_eviction_list);
-	for (node = rb_first(&timer_root); node; node = rb_next(node)) {
-		this = container_of(node, struct osmo_timer_list, node);
 
-		if (timercmp(&this->timeout, &current_time, >))
-			break;
+	/* all slots of ticks that have passed completely are due */
+	while (wheel_tick < current_tick) {
+		llist_for_each_entry_safe(this, tmp, &wheel0[wheel_tick & WHEEL0_MASK], list)
+			evict(this, &timer_eviction_list);
+		wheel_advance();
+	}
 
-		llist_add(&this->list, &timer_eviction_list);
+	/* from the slot of the current tick only the ones that are due */
+	llist_for_each_entry_safe(this, tmp, &wheel0[wheel_tick & WHEEL0_MASK], list) {
+		if (tv2usec(&this->timeout) <= current)
+			evict(this, &timer_eviction_list);
 	}
 
 	/*
@@ -239,26 +489,21 @@ int osmo_timers_update(void)
 	 * timer B from the A's callback, we continue with B in the next
 	 * iteration step, leading to an access-after-release.
 	 */
-restart:
-	llist_for_each_entry(this, &timer_eviction_list, list) {
+	while (!llist_empty(&timer_eviction_list)) {
+		this = llist_entry(timer_eviction_list.next,
+				   struct osmo_timer_list, list);
 		osmo_timer_del(this);
 		this->cb(this->data);
 		work = 1;
-		goto restart;
 	}
 
 	return work;
 }
 
+/*! \brief return the number of pending timers */
 int osmo_timers_check(void)
 {
-	struct rb_node *node;
-	int i = 0;
-
-	for (node = rb_first(&timer_root); node; node = rb_next(node)) {
-		i++;
-	}
-	return i;
+	return timer_count;
 }
 
 /*! @} */
@@ -177,8 +177,7 @@ DEFUN(logging_level,
 		return CMD_WARNING;
 	}
 
-	tgt->categories[category].enabled = 1;
-	tgt->categories[category].loglevel = level;
+	log_set_category_filter(tgt, category, 1, level);
 
 	return CMD_SUCCESS;
 }
@@ -517,6 +516,9 @@ static int config_write_log_single(struct vty *vty, struct log_target *tgt)
 
 	switch (tgt->type) {
 	case LOG_TGT_TYPE_VTY:
+	/* created by the application, can't be configured */
+	case LOG_TGT_TYPE_ASYNC:
+	case LOG_TGT_TYPE_BINARY:
 		return 1;
 		break;
 	case LOG_TGT_TYPE_STDERR:
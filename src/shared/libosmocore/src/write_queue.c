@@ -21,7 +21,29 @@
  *
  */
 
+#define _GNU_SOURCE	/* sendmmsg() */
+
+#include "../config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
 #include <osmocom/core/write_queue.h>
+#include <osmocom/core/utils.h>
+
+/* messages written by one syscall at most */
+#define WQUEUE_BATCH	64
+#if defined(IOV_MAX) && IOV_MAX < WQUEUE_BATCH
+#undef WQUEUE_BATCH
+#define WQUEUE_BATCH	IOV_MAX
+#endif
 
 /*! \addtogroup write_queue
  *  @{
@@ -29,12 +51,123 @@
 
 /*! \file write_queue.c */
 
+/* a message is done with, written or dropped */
+static void wqueue_free_head(struct osmo_wqueue *queue)
+{
+	struct msgb *msg = msgb_dequeue(&queue->msg_queue);
+
+	--queue->current_length;
+	queue->head_ofs = 0;
+	msgb_free(msg);
+}
+
+#ifdef HAVE_SYS_SOCKET_H
+/* the queued messages as one stream, from where the last write ended,
+ * -1 on a write error. Nothing is dropped then, the rest of a message
+ * written in part would break the stream. */
+static int wqueue_write_stream(struct osmo_wqueue *queue)
+{
+	struct iovec iov[WQUEUE_BATCH];
+	struct msgb *msg;
+	ssize_t rc;
+	int n = 0;
+
+	llist_for_each_entry(msg, &queue->msg_queue, list) {
+		if (n == ARRAY_SIZE(iov))
+			break;
+		iov[n].iov_base = msg->data;
+		iov[n].iov_len = msg->len;
+		n++;
+	}
+	iov[0].iov_base = (uint8_t *)iov[0].iov_base + queue->head_ofs;
+	iov[0].iov_len -= queue->head_ofs;
+
+	rc = writev(queue->bfd.fd, iov, n);
+	if (rc < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		queue->stats.errors++;
+		return -1;
+	}
+	queue->stats.syscalls++;
+	queue->stats.bytes += rc;
+
+	while (!llist_empty(&queue->msg_queue)) {
+		unsigned int left;
+
+		msg = llist_entry(queue->msg_queue.next, struct msgb, list);
+		left = msg->len - queue->head_ofs;
+		if (rc < (ssize_t)left) {
+			queue->head_ofs += rc;
+			break;
+		}
+		rc -= left;
+		queue->stats.msgs++;
+		wqueue_free_head(queue);
+	}
+
+	return 0;
+}
+
+/* the queued messages as one datagram each */
+static void wqueue_write_dgram(struct osmo_wqueue *queue)
+{
+	struct msgb *msg;
+	int rc, i;
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr mm[WQUEUE_BATCH];
+	struct iovec iov[WQUEUE_BATCH];
+	int n = 0;
+
+	llist_for_each_entry(msg, &queue->msg_queue, list) {
+		if (n == ARRAY_SIZE(iov))
+			break;
+		iov[n].iov_base = msg->data;
+		iov[n].iov_len = msg->len;
+		memset(&mm[n], 0, sizeof(mm[n]));
+		mm[n].msg_hdr.msg_iov = &iov[n];
+		mm[n].msg_hdr.msg_iovlen = 1;
+		n++;
+	}
+
+	rc = sendmmsg(queue->bfd.fd, mm, n, 0);
+	if (rc < 0 && errno == ENOSYS)
+#endif
+	{
+		/* one datagram at a time then */
+		msg = llist_entry(queue->msg_queue.next, struct msgb, list);
+		rc = write(queue->bfd.fd, msg->data, msg->len);
+		if (rc >= 0)
+			rc = 1;
+	}
+	if (rc < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return;
+		queue->stats.errors++;
+		wqueue_free_head(queue);
+		return;
+	}
+	queue->stats.syscalls++;
+
+	for (i = 0; i < rc; i++) {
+		msg = llist_entry(queue->msg_queue.next, struct msgb, list);
+		queue->stats.msgs++;
+		queue->stats.bytes += msg->len;
+		wqueue_free_head(queue);
+	}
+}
+#endif /* HAVE_SYS_SOCKET_H */
+
 /*! \brief Select loop function for write queue handling
  *  \param[in] fd osmocom file descriptor
  *  \param[in] what bit-mask of events that have happened
  *
  * This function is provided so that it can be registered with the
  * select loop abstraction code (\ref osmo_fd::cb).
+ *
+ * A write error in \ref OSMO_WQUEUE_M_STREAM mode stops the writes
+ * until the next message is enqueued, and \ref osmo_wqueue::except_cb
+ * is called if set, with errno telling the error.
  */
 int osmo_wqueue_bfd_cb(struct osmo_fd *fd, unsigned int what)
 {
@@ -50,16 +183,41 @@ int osmo_wqueue_bfd_cb(struct osmo_fd *fd, unsigned int what)
 
 	if (what & BSC_FD_WRITE) {
 		struct msgb *msg;
+		int rc;
 
 		fd->when &= ~BSC_FD_WRITE;
 
 		/* the queue might have been emptied */
 		if (!llist_empty(&queue->msg_queue)) {
-			--queue->current_length;
+			switch (queue->mode) {
+#ifdef HAVE_SYS_SOCKET_H
+			case OSMO_WQUEUE_M_STREAM:
+				if (wqueue_write_stream(queue) < 0) {
+					/* the callback may free the queue */
+					if (queue->except_cb)
+						queue->except_cb(fd);
+					return 0;
+				}
+				break;
+			case OSMO_WQUEUE_M_DGRAM:
+				wqueue_write_dgram(queue);
+				break;
+#endif
+			default:
+				--queue->current_length;
 
-			msg = msgb_dequeue(&queue->msg_queue);
-			queue->write_cb(fd, msg);
-			msgb_free(msg);
+				msg = msgb_dequeue(&queue->msg_queue);
+				rc = queue->write_cb(fd, msg);
+				queue->stats.syscalls++;
+				if (rc < 0) {
+					queue->stats.errors++;
+				} else {
+					queue->stats.msgs++;
+					queue->stats.bytes += msg->len;
+				}
+				msgb_free(msg);
+				break;
+			}
 
 			if (!llist_empty(&queue->msg_queue))
 				fd->when |= BSC_FD_WRITE;
@@ -72,6 +230,10 @@ int osmo_wqueue_bfd_cb(struct osmo_fd *fd, unsigned int what)
 /*! \brief Initialize a \ref osmo_wqueue structure
  *  \param[in] queue Write queue to operate on
  *  \param[in] max_length Maximum length of write queue
+ *
+ * The queue hands one message at a time to \ref osmo_wqueue::write_cb,
+ * set \ref osmo_wqueue::mode after this to have it write all queued
+ * messages with one syscall instead.
  */
 void osmo_wqueue_init(struct osmo_wqueue *queue, int max_length)
 {
@@ -80,19 +242,27 @@ void osmo_wqueue_init(struct osmo_wqueue *queue, int max_length)
 	queue->read_cb = NULL;
 	queue->write_cb = NULL;
 	queue->bfd.cb = osmo_wqueue_bfd_cb;
+	queue->mode = OSMO_WQUEUE_M_MSG;
+	queue->head_ofs = 0;
+	memset(&queue->stats, 0, sizeof(queue->stats));
 	INIT_LLIST_HEAD(&queue->msg_queue);
 }
 
 /*! \brief Enqueue a new \ref msgb into a write queue
  *  \param[in] queue Write queue to be used
  *  \param[in] data to-be-enqueued message buffer
+ *  \returns 0 on success, -ENOSPC if the queue holds \ref
+ *  osmo_wqueue::max_length messages already; the caller keeps the
+ *  message then
  */
 int osmo_wqueue_enqueue(struct osmo_wqueue *queue, struct msgb *data)
 {
-//	if (queue->current_length + 1 >= queue->max_length)
-//		LOGP(DMSC, LOGL_ERROR, "The queue is full. Dropping not yet implemented.\n");
+	if (queue->current_length >= queue->max_length)
+		return -ENOSPC;
 
 	++queue->current_length;
+	if (queue->current_length > queue->stats.max_length)
+		queue->stats.max_length = queue->current_length;
 	msgb_enqueue(&queue->msg_queue, data);
 	queue->bfd.when |= BSC_FD_WRITE;
 
@@ -112,6 +282,7 @@ void osmo_wqueue_clear(struct osmo_wqueue *queue)
 	}
 
 	queue->current_length = 0;
+	queue->head_ofs = 0;
 	queue->bfd.when &= ~BSC_FD_WRITE;
 }
 
@@ -0,0 +1,119 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* A5/1 and A5/2 keystreams per second, each one a DL and an UL burst,
+ * generated one by one with osmo_a5() and in batches of several sizes
+ * with osmo_a5_batch(). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/a5.h>
+
+#define MAX_COUNT	1024
+/* keystreams generated per measurement are scaled to take about this long */
+#define RUN_NS		300000000ULL
+
+static uint8_t keys[8 * MAX_COUNT];
+static uint32_t fns[MAX_COUNT];
+static uint8_t dl[114 * MAX_COUNT], ul[114 * MAX_COUNT];
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* count = 0 for osmo_a5() */
+static void run(int n, unsigned int count, unsigned int flags,
+		unsigned int rounds)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < rounds; i++) {
+		if (count) {
+			osmo_a5_batch(n, keys, fns, count, dl, ul, flags);
+			continue;
+		}
+		for (j = 0; j < MAX_COUNT; j++)
+			osmo_a5(n, &keys[8 * j], fns[j], &dl[114 * j],
+				&ul[114 * j]);
+	}
+}
+
+static double streams_per_s(int n, unsigned int count, unsigned int flags)
+{
+	unsigned int rounds = 1;
+	uint64_t t;
+
+	/* double the rounds until the run is long enough to tell */
+	while (1) {
+		t = now_ns();
+		run(n, count, flags, rounds);
+		t = now_ns() - t;
+		if (t >= RUN_NS / 4)
+			break;
+		rounds *= 2;
+	}
+	rounds = rounds * RUN_NS / t + 1;
+
+	t = now_ns();
+	run(n, count, flags, rounds);
+	t = now_ns() - t;
+
+	return (double)rounds * (count ? count : MAX_COUNT) * 1e9 / t;
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned int counts[] = { 8, 64, 256, 1024 };
+	double base, rate;
+	int n, i, f;
+
+	srandom(1);
+	for (i = 0; i < ARRAY_SIZE(keys); i++)
+		keys[i] = random();
+	for (i = 0; i < ARRAY_SIZE(fns); i++)
+		fns[i] = random() % (26 * 51 * 2048);
+
+	for (n = 1; n <= 2; n++) {
+		base = streams_per_s(n, 0, 0);
+		printf("A5/%d one by one               %10.0f streams/s  1.00x\n",
+		       n, base);
+		for (i = 0; i < ARRAY_SIZE(counts); i++) {
+			for (f = 0; f < 2; f++) {
+				rate = streams_per_s(n, counts[i],
+						     f ? OSMO_A5_F_PBIT : 0);
+				printf("A5/%d batch of %4u, %-8s %10.0f "
+				       "streams/s %5.2fx\n", n, counts[i],
+				       f ? "packed" : "unpacked", rate,
+				       rate / base);
+			}
+		}
+	}
+
+	return 0;
+}
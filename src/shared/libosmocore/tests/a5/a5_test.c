@@ -50,8 +50,54 @@ binstr(ubit_t *d, int n)
 	return str;
 }
 
+/* a batch gives the same streams as osmo_a5() for each key and fn */
+static int
+test_batch(int n, unsigned int count, unsigned int flags)
+{
+	unsigned int len = flags & OSMO_A5_F_PBIT ? 15 : 114;
+	uint8_t *keys = malloc(8 * count);
+	uint32_t *fns = malloc(sizeof(uint32_t) * count);
+	uint8_t *dl = malloc(len * count), *ul = malloc(len * count);
+	ubit_t exp_dl[114], exp_ul[114];
+	pbit_t exp_p[15];
+	unsigned int i;
+	int rc = 0;
+
+	for (i=0; i<8*count; i++)
+		keys[i] = random();
+	for (i=0; i<count; i++)
+		fns[i] = random() % (26 * 51 * 2048);
+
+	osmo_a5_batch(n, keys, fns, count, dl, ul, flags);
+
+	for (i=0; i<count; i++) {
+		osmo_a5(n, &keys[8*i], fns[i], exp_dl, exp_ul);
+		if (flags & OSMO_A5_F_PBIT) {
+			osmo_ubit2pbit(exp_p, exp_dl, 114);
+			rc |= memcmp(exp_p, &dl[len*i], len);
+			osmo_ubit2pbit(exp_p, exp_ul, 114);
+			rc |= memcmp(exp_p, &ul[len*i], len);
+		} else {
+			rc |= memcmp(exp_dl, &dl[len*i], len);
+			rc |= memcmp(exp_ul, &ul[len*i], len);
+		}
+	}
+
+	printf("A5/%d - batch of %3u, %-8s bits => %s\n", n, count,
+		flags & OSMO_A5_F_PBIT ? "packed" : "unpacked",
+		rc ? "BAD" : "OK");
+
+	free(ul);
+	free(dl);
+	free(fns);
+	free(keys);
+	return rc;
+}
+
 int main(int argc, char **argv)
 {
+	static const unsigned int counts[] = { 1, 9, 64, 300 };
+	int f;
 	ubit_t exp[114];
 	ubit_t out[114];
 	int n, i;
@@ -94,5 +140,18 @@ int main(int argc, char **argv)
 		}
 	}
 
+	srandom(1);
+	for (n=0; n<3; n++) {
+		for (i=0; i<ARRAY_SIZE(counts); i++) {
+			for (f=0; f<2; f++) {
+				if (test_batch(n, counts[i],
+				               f ? OSMO_A5_F_PBIT : 0)) {
+					fprintf(stderr, "[!] A5/%d batch failed", n);
+					exit(1);
+				}
+			}
+		}
+	}
+
 	return 0;
 }
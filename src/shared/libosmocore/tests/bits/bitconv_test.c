@@ -0,0 +1,196 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* The bit conversions against bit by bit versions of them, for lengths
+ * and offsets around the vector and byte sizes. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <osmocom/core/utils.h>
+#include <osmocom/core/bits.h>
+
+#define MAX_BITS	600
+#define MAX_OFS		17
+
+static ubit_t u_in[MAX_BITS + MAX_OFS], u_out[MAX_BITS + MAX_OFS];
+static ubit_t u_ref[MAX_BITS + MAX_OFS];
+static pbit_t p_in[MAX_BITS / 8 + 4], p_out[MAX_BITS / 8 + 4];
+static pbit_t p_ref[MAX_BITS / 8 + 4];
+static sbit_t s_in[MAX_BITS], s_out[MAX_BITS], s_ref[MAX_BITS];
+
+static int failed;
+
+static void check(const char *what, const void *out, const void *ref,
+		  size_t len, unsigned int num_bits, unsigned int ofs,
+		  int lsb_mode)
+{
+	if (!memcmp(out, ref, len))
+		return;
+	printf("%s: %u bits at %u%s differ\n", what, num_bits, ofs,
+	       lsb_mode ? " (LSB first)" : "");
+	failed = 1;
+}
+
+static int bit_pos(unsigned int i, int lsb_mode)
+{
+	return lsb_mode ? (i & 7) : 7 - (i & 7);
+}
+
+static void random_bits(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(u_in); i++)
+		u_in[i] = random() & 1;
+	for (i = 0; i < ARRAY_SIZE(p_in); i++)
+		p_in[i] = random();
+	for (i = 0; i < ARRAY_SIZE(s_in); i++)
+		s_in[i] = random();
+}
+
+static void test_plain(unsigned int n)
+{
+	unsigned int i;
+	int rc, rc_ref;
+
+	/* osmo_ubit2pbit() */
+	memset(p_ref, 0, sizeof(p_ref));
+	for (i = 0; i < n; i++)
+		p_ref[i / 8] |= u_in[i] << bit_pos(i, 0);
+	rc_ref = (n + 7) / 8;
+	memset(p_out, 0xa5, sizeof(p_out));
+	rc = osmo_ubit2pbit(p_out, u_in, n);
+	if (rc != rc_ref) {
+		printf("osmo_ubit2pbit: %u bits gave %d\n", n, rc);
+		failed = 1;
+	}
+	check("osmo_ubit2pbit", p_out, p_ref, rc_ref, n, 0, 0);
+
+	/* osmo_pbit2ubit() */
+	for (i = 0; i < n; i++)
+		u_ref[i] = (p_in[i / 8] >> bit_pos(i, 0)) & 1;
+	memset(u_out, 0xa5, sizeof(u_out));
+	rc = osmo_pbit2ubit(u_out, p_in, n);
+	if (rc != n) {
+		printf("osmo_pbit2ubit: %u bits gave %d\n", n, rc);
+		failed = 1;
+	}
+	check("osmo_pbit2ubit", u_out, u_ref, n, n, 0, 0);
+	if (u_out[n] != 0xa5) {
+		printf("osmo_pbit2ubit: %u bits wrote past the end\n", n);
+		failed = 1;
+	}
+
+	/* osmo_ubit2sbit() and osmo_sbit2ubit() */
+	for (i = 0; i < n; i++)
+		s_ref[i] = u_in[i] ? -127 : 127;
+	rc = osmo_ubit2sbit(s_out, u_in, n);
+	check("osmo_ubit2sbit", s_out, s_ref, n, n, 0, 0);
+	for (i = 0; i < n; i++)
+		u_ref[i] = s_in[i] < 0;
+	rc = osmo_sbit2ubit(u_out, s_in, n);
+	check("osmo_sbit2ubit", u_out, u_ref, n, n, 0, 0);
+}
+
+static void test_ext(unsigned int n, unsigned int ofs, int lsb_mode)
+{
+	unsigned int i;
+	int rc, rc_ref;
+
+	/* osmo_ubit2pbit_ext(), the bits around the output stay */
+	memcpy(p_ref, p_in, sizeof(p_ref));
+	for (i = 0; i < n; i++) {
+		unsigned int o = ofs + i;
+		uint8_t m = 1 << bit_pos(o, lsb_mode);
+
+		p_ref[o / 8] = u_in[i + 3] ? p_ref[o / 8] | m : p_ref[o / 8] & ~m;
+	}
+	rc_ref = ((ofs + n - 1) >> 3) + 1;
+	memcpy(p_out, p_in, sizeof(p_out));
+	rc = osmo_ubit2pbit_ext(p_out, ofs, u_in, 3, n, lsb_mode);
+	if (n && rc != rc_ref) {
+		printf("osmo_ubit2pbit_ext: %u bits at %u gave %d\n",
+		       n, ofs, rc);
+		failed = 1;
+	}
+	check("osmo_ubit2pbit_ext", p_out, p_ref, sizeof(p_ref), n, ofs,
+	      lsb_mode);
+
+	/* osmo_pbit2ubit_ext() */
+	memcpy(u_ref, u_in, sizeof(u_ref));
+	for (i = 0; i < n; i++)
+		u_ref[5 + i] = (p_in[(ofs + i) / 8] >>
+				bit_pos(ofs + i, lsb_mode)) & 1;
+	memcpy(u_out, u_in, sizeof(u_out));
+	rc = osmo_pbit2ubit_ext(u_out, 5, p_in, ofs, n, lsb_mode);
+	if (rc != 5 + n) {
+		printf("osmo_pbit2ubit_ext: %u bits at %u gave %d\n",
+		       n, ofs, rc);
+		failed = 1;
+	}
+	check("osmo_pbit2ubit_ext", u_out, u_ref, sizeof(u_ref), n, ofs,
+	      lsb_mode);
+}
+
+static void test_revbytebits(unsigned int n, unsigned int ofs)
+{
+	unsigned int i;
+
+	memcpy(p_ref, p_in, sizeof(p_ref));
+	for (i = 0; i < n; i++)
+		p_ref[ofs + i] = osmo_revbytebits_8(p_in[ofs + i]);
+	memcpy(p_out, p_in, sizeof(p_out));
+	osmo_revbytebits_buf(p_out + ofs, n);
+	check("osmo_revbytebits_buf", p_out, p_ref, sizeof(p_ref), n, ofs, 0);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int n, ofs;
+	int lsb_mode;
+
+	srandom(argc > 1 ? atoi(argv[1]) : 1);
+
+	random_bits();
+	for (n = 0; n <= MAX_BITS; n++)
+		test_plain(n);
+	printf("ubit/pbit/sbit conversions: %s\n", failed ? "FAIL" : "OK");
+
+	failed = 0;
+	for (n = 0; n <= MAX_BITS - MAX_OFS; n++) {
+		random_bits();
+		for (ofs = 0; ofs < MAX_OFS; ofs++)
+			for (lsb_mode = 0; lsb_mode < 2; lsb_mode++)
+				test_ext(n, ofs, lsb_mode);
+	}
+	printf("ubit/pbit conversions at offsets: %s\n",
+	       failed ? "FAIL" : "OK");
+
+	failed = 0;
+	for (n = 0; n <= MAX_BITS / 8 - MAX_OFS; n++)
+		for (ofs = 0; ofs < MAX_OFS; ofs++)
+			test_revbytebits(n, ofs);
+	printf("bit reversal of buffers: %s\n", failed ? "FAIL" : "OK");
+
+	return 0;
+}
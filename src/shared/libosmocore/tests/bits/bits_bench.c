@@ -0,0 +1,216 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* Conversions per second of a burst (114 bits) and of a block (456
+ * bits), with the library functions and with plain bit by bit loops
+ * like the ones they replaced. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/utils.h>
+
+#define MAX_BITS	456
+/* conversions per measurement are scaled to take about this long */
+#define RUN_NS		200000000ULL
+
+static ubit_t ubits[MAX_BITS];
+static pbit_t pbits[MAX_BITS / 8 + 1];
+static sbit_t sbits[MAX_BITS];
+
+static void naive_ubit2pbit(unsigned int n)
+{
+	unsigned int i;
+	uint8_t b = 0;
+
+	for (i = 0; i < n; i++) {
+		b |= ubits[i] << (7 - (i % 8));
+		if (i % 8 == 7) {
+			pbits[i / 8] = b;
+			b = 0;
+		}
+	}
+	if (n % 8)
+		pbits[n / 8] = b;
+}
+
+static void naive_pbit2ubit(unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		ubits[i] = (pbits[i / 8] >> (7 - (i % 8))) & 1;
+}
+
+static void naive_ubit2pbit_lsb(unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (ubits[i])
+			pbits[i >> 3] |= 1 << (i & 7);
+		else
+			pbits[i >> 3] &= ~(1 << (i & 7));
+	}
+}
+
+static void naive_pbit2ubit_lsb(unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		ubits[i] = !!(pbits[i >> 3] & (1 << (i & 7)));
+}
+
+static void naive_ubit2sbit(unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		sbits[i] = ubits[i] ? -127 : 127;
+}
+
+static void naive_sbit2ubit(unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		ubits[i] = sbits[i] < 0;
+}
+
+static void naive_revbytebits(unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < (n + 7) / 8; i++)
+		pbits[i] = osmo_revbytebits_8(pbits[i]);
+}
+
+static void lib_ubit2pbit(unsigned int n)
+{
+	osmo_ubit2pbit(pbits, ubits, n);
+}
+
+static void lib_pbit2ubit(unsigned int n)
+{
+	osmo_pbit2ubit(ubits, pbits, n);
+}
+
+static void lib_ubit2pbit_lsb(unsigned int n)
+{
+	osmo_ubit2pbit_ext(pbits, 0, ubits, 0, n, 1);
+}
+
+static void lib_pbit2ubit_lsb(unsigned int n)
+{
+	osmo_pbit2ubit_ext(ubits, 0, pbits, 0, n, 1);
+}
+
+static void lib_ubit2sbit(unsigned int n)
+{
+	osmo_ubit2sbit(sbits, ubits, n);
+}
+
+static void lib_sbit2ubit(unsigned int n)
+{
+	osmo_sbit2ubit(ubits, sbits, n);
+}
+
+static void lib_revbytebits(unsigned int n)
+{
+	osmo_revbytebits_buf(pbits, (n + 7) / 8);
+}
+
+static const struct {
+	const char *name;
+	void (*naive)(unsigned int n);
+	void (*lib)(unsigned int n);
+} convs[] = {
+	{ "ubit2pbit", naive_ubit2pbit, lib_ubit2pbit },
+	{ "pbit2ubit", naive_pbit2ubit, lib_pbit2ubit },
+	{ "ubit2pbit_ext lsb", naive_ubit2pbit_lsb, lib_ubit2pbit_lsb },
+	{ "pbit2ubit_ext lsb", naive_pbit2ubit_lsb, lib_pbit2ubit_lsb },
+	{ "ubit2sbit", naive_ubit2sbit, lib_ubit2sbit },
+	{ "sbit2ubit", naive_sbit2ubit, lib_sbit2ubit },
+	{ "revbytebits_buf", naive_revbytebits, lib_revbytebits },
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double convs_per_s(void (*fn)(unsigned int n), unsigned int bits)
+{
+	unsigned int i, rounds = 1000;
+	uint64_t t;
+
+	/* double the rounds until the run is long enough to tell */
+	while (1) {
+		t = now_ns();
+		for (i = 0; i < rounds; i++)
+			fn(bits);
+		t = now_ns() - t;
+		if (t >= RUN_NS / 4)
+			break;
+		rounds *= 2;
+	}
+	rounds = rounds * RUN_NS / t + 1;
+
+	t = now_ns();
+	for (i = 0; i < rounds; i++)
+		fn(bits);
+	t = now_ns() - t;
+
+	return (double)rounds * 1e9 / t;
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned int sizes[] = { 114, 456 };
+	double naive, lib;
+	int c, s, i;
+
+	srandom(1);
+	for (i = 0; i < ARRAY_SIZE(ubits); i++)
+		ubits[i] = random() & 1;
+	for (i = 0; i < ARRAY_SIZE(pbits); i++)
+		pbits[i] = random();
+	for (i = 0; i < ARRAY_SIZE(sbits); i++)
+		sbits[i] = random();
+
+	for (c = 0; c < ARRAY_SIZE(convs); c++) {
+		for (s = 0; s < ARRAY_SIZE(sizes); s++) {
+			naive = convs_per_s(convs[c].naive, sizes[s]);
+			lib = convs_per_s(convs[c].lib, sizes[s]);
+			printf("%-18s %3u bits %11.0f/s naive %11.0f/s "
+			       "%6.2fx\n", convs[c].name, sizes[s], naive, lib,
+			       lib / naive);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,262 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* Viterbi decoding throughput of each decoder kernel the CPU has, in
+ * blocks per second, for the GSM xCCH, TCH/FS, RACH and TCH/HS codes,
+ * and that of the generic and the specialised encoder. The first three
+ * use the rate 1/2, K = 5 code of GSM 05.03 and differ in length,
+ * TCH/HS the rate 1/3, K = 7 one. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/conv.h>
+#include <osmocom/core/utils.h>
+
+#define MAX_LEN_BITS	512
+/* blocks decoded per measurement are scaled to take about this long */
+#define RUN_NS		300000000ULL
+
+static const uint8_t conv_gsm_next_output[][2] = {
+	{ 0, 3 }, { 1, 2 }, { 0, 3 }, { 1, 2 },
+	{ 3, 0 }, { 2, 1 }, { 3, 0 }, { 2, 1 },
+	{ 3, 0 }, { 2, 1 }, { 3, 0 }, { 2, 1 },
+	{ 0, 3 }, { 1, 2 }, { 0, 3 }, { 1, 2 },
+};
+
+static const uint8_t conv_gsm_next_state[][2] = {
+	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
+	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
+	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
+	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
+};
+
+/* 184 data bits and 40 parity bits */
+static const struct osmo_conv_code conv_gsm_xcch = {
+	.N = 2,
+	.K = 5,
+	.len = 224,
+	.term = CONV_TERM_FLUSH,
+	.next_output = conv_gsm_next_output,
+	.next_state  = conv_gsm_next_state,
+};
+
+/* 182 class 1 bits and 3 parity bits */
+static const struct osmo_conv_code conv_gsm_tch_fs = {
+	.N = 2,
+	.K = 5,
+	.len = 185,
+	.term = CONV_TERM_FLUSH,
+	.next_output = conv_gsm_next_output,
+	.next_state  = conv_gsm_next_state,
+};
+
+/* 8 data bits and 6 parity bits */
+static const struct osmo_conv_code conv_gsm_rach = {
+	.N = 2,
+	.K = 5,
+	.len = 14,
+	.term = CONV_TERM_FLUSH,
+	.next_output = conv_gsm_next_output,
+	.next_state  = conv_gsm_next_state,
+};
+
+static const uint8_t conv_gsm_tch_hs_next_output[][2] = {
+	{ 0, 7 }, { 3, 4 }, { 5, 2 }, { 6, 1 },
+	{ 5, 2 }, { 6, 1 }, { 0, 7 }, { 3, 4 },
+	{ 3, 4 }, { 0, 7 }, { 6, 1 }, { 5, 2 },
+	{ 6, 1 }, { 5, 2 }, { 3, 4 }, { 0, 7 },
+	{ 4, 3 }, { 7, 0 }, { 1, 6 }, { 2, 5 },
+	{ 1, 6 }, { 2, 5 }, { 4, 3 }, { 7, 0 },
+	{ 7, 0 }, { 4, 3 }, { 2, 5 }, { 1, 6 },
+	{ 2, 5 }, { 1, 6 }, { 7, 0 }, { 4, 3 },
+	{ 7, 0 }, { 4, 3 }, { 2, 5 }, { 1, 6 },
+	{ 2, 5 }, { 1, 6 }, { 7, 0 }, { 4, 3 },
+	{ 4, 3 }, { 7, 0 }, { 1, 6 }, { 2, 5 },
+	{ 1, 6 }, { 2, 5 }, { 4, 3 }, { 7, 0 },
+	{ 3, 4 }, { 0, 7 }, { 6, 1 }, { 5, 2 },
+	{ 6, 1 }, { 5, 2 }, { 3, 4 }, { 0, 7 },
+	{ 0, 7 }, { 3, 4 }, { 5, 2 }, { 6, 1 },
+	{ 5, 2 }, { 6, 1 }, { 0, 7 }, { 3, 4 },
+};
+
+static const uint8_t conv_gsm_tch_hs_next_state[][2] = {
+	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
+	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
+	{ 16, 17 }, { 18, 19 }, { 20, 21 }, { 22, 23 },
+	{ 24, 25 }, { 26, 27 }, { 28, 29 }, { 30, 31 },
+	{ 32, 33 }, { 34, 35 }, { 36, 37 }, { 38, 39 },
+	{ 40, 41 }, { 42, 43 }, { 44, 45 }, { 46, 47 },
+	{ 48, 49 }, { 50, 51 }, { 52, 53 }, { 54, 55 },
+	{ 56, 57 }, { 58, 59 }, { 60, 61 }, { 62, 63 },
+	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
+	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
+	{ 16, 17 }, { 18, 19 }, { 20, 21 }, { 22, 23 },
+	{ 24, 25 }, { 26, 27 }, { 28, 29 }, { 30, 31 },
+	{ 32, 33 }, { 34, 35 }, { 36, 37 }, { 38, 39 },
+	{ 40, 41 }, { 42, 43 }, { 44, 45 }, { 46, 47 },
+	{ 48, 49 }, { 50, 51 }, { 52, 53 }, { 54, 55 },
+	{ 56, 57 }, { 58, 59 }, { 60, 61 }, { 62, 63 },
+};
+
+/* 95 class 1 bits and 3 parity bits, not punctured */
+static const struct osmo_conv_code conv_gsm_tch_hs = {
+	.N = 3,
+	.K = 7,
+	.len = 98,
+	.term = CONV_TERM_FLUSH,
+	.next_output = conv_gsm_tch_hs_next_output,
+	.next_state  = conv_gsm_tch_hs_next_state,
+};
+
+static const struct {
+	const char *name;
+	const struct osmo_conv_code *code;
+} codes[] = {
+	{ "xCCH", &conv_gsm_xcch },
+	{ "TCH/FS", &conv_gsm_tch_fs },
+	{ "RACH", &conv_gsm_rach },
+	{ "TCH/HS", &conv_gsm_tch_hs },
+};
+
+static const struct {
+	const char *name;
+	enum osmo_conv_acs acs;
+} kernels[] = {
+	{ "scalar", OSMO_CONV_ACS_SCALAR },
+	{ "sse4", OSMO_CONV_ACS_SSE4 },
+	{ "avx2", OSMO_CONV_ACS_AVX2 },
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* osmo_conv_encode() without the specialised encoders */
+static void encode_generic(const struct osmo_conv_code *code,
+			   const ubit_t *bu, ubit_t *out)
+{
+	struct osmo_conv_encoder encoder;
+	int l;
+
+	osmo_conv_encode_init(&encoder, code);
+	l = osmo_conv_encode_raw(&encoder, bu, out, code->len);
+	osmo_conv_encode_flush(&encoder, &out[l]);
+}
+
+/* encode is 1 for the generic encoder, 2 for osmo_conv_encode() */
+static void run(const struct osmo_conv_code *code, int encode,
+		const ubit_t *bu, const sbit_t *bs, ubit_t *out, unsigned int n)
+{
+	unsigned int i;
+
+	if (encode == 1) {
+		for (i = 0; i < n; i++)
+			encode_generic(code, bu, out);
+	} else if (encode) {
+		for (i = 0; i < n; i++)
+			osmo_conv_encode(code, bu, out);
+	} else {
+		for (i = 0; i < n; i++)
+			osmo_conv_decode(code, bs, out);
+	}
+}
+
+static double blocks_per_s(const struct osmo_conv_code *code, int encode,
+			   const ubit_t *bu, const sbit_t *bs, ubit_t *out)
+{
+	unsigned int n = 100;
+	uint64_t t;
+
+	/* double the blocks until the run is long enough to tell */
+	while (1) {
+		t = now_ns();
+		run(code, encode, bu, bs, out, n);
+		t = now_ns() - t;
+		if (t >= RUN_NS / 4)
+			break;
+		n *= 2;
+	}
+	n = n * RUN_NS / t;
+
+	t = now_ns();
+	run(code, encode, bu, bs, out, n);
+	t = now_ns() - t;
+
+	return n * 1e9 / t;
+}
+
+int main(int argc, char **argv)
+{
+	ubit_t bu[MAX_LEN_BITS], coded[MAX_LEN_BITS], out[MAX_LEN_BITS];
+	sbit_t bs[MAX_LEN_BITS];
+	double base;
+	int c, k, i, l, e;
+
+	srandom(1);
+
+	for (c = 0; c < ARRAY_SIZE(codes); c++) {
+		/* a received block with some noise on it */
+		for (i = 0; i < codes[c].code->len; i++)
+			bu[i] = random() & 1;
+		l = osmo_conv_encode(codes[c].code, bu, coded);
+		for (i = 0; i < l; i++)
+			bs[i] = (coded[i] ? -100 : 100) +
+				(int)(random() % 55) - 27;
+
+		base = 0;
+		for (k = 0; k < ARRAY_SIZE(kernels); k++) {
+			double rate;
+
+			if (osmo_conv_decode_set_acs(kernels[k].acs) < 0) {
+				printf("%-7s decode  %-7s not supported\n",
+				       codes[c].name, kernels[k].name);
+				continue;
+			}
+			rate = blocks_per_s(codes[c].code, 0, bu, bs, out);
+			if (!base)
+				base = rate;
+			printf("%-7s decode  %-7s %10.0f blocks/s %6.2fx\n",
+			       codes[c].name, kernels[k].name, rate, rate / base);
+		}
+
+		/* the encoder does not depend on the decoder kernel */
+		base = 0;
+		for (e = 1; e <= 2; e++) {
+			double rate = blocks_per_s(codes[c].code, e, bu, bs, out);
+
+			if (!base)
+				base = rate;
+			printf("%-7s encode  %-7s %10.0f blocks/s %6.2fx\n",
+			       codes[c].name, e == 1 ? "generic" : "gsm",
+			       rate, rate / base);
+		}
+	}
+	osmo_conv_decode_set_acs(OSMO_CONV_ACS_AUTO);
+
+	return 0;
+}
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include <osmocom/core/bits.h>
@@ -230,6 +231,76 @@ static const struct osmo_conv_code conv_trunc = {
 	.next_state  = conv_gsm_xcch_next_state,
 };
 
+/* GSM TCH/HS -> Non-recursive code, flushed, not punctured */
+static const uint8_t conv_gsm_tch_hs_next_output[][2] = {
+	{ 0, 7 }, { 3, 4 }, { 5, 2 }, { 6, 1 },
+	{ 5, 2 }, { 6, 1 }, { 0, 7 }, { 3, 4 },
+	{ 3, 4 }, { 0, 7 }, { 6, 1 }, { 5, 2 },
+	{ 6, 1 }, { 5, 2 }, { 3, 4 }, { 0, 7 },
+	{ 4, 3 }, { 7, 0 }, { 1, 6 }, { 2, 5 },
+	{ 1, 6 }, { 2, 5 }, { 4, 3 }, { 7, 0 },
+	{ 7, 0 }, { 4, 3 }, { 2, 5 }, { 1, 6 },
+	{ 2, 5 }, { 1, 6 }, { 7, 0 }, { 4, 3 },
+	{ 7, 0 }, { 4, 3 }, { 2, 5 }, { 1, 6 },
+	{ 2, 5 }, { 1, 6 }, { 7, 0 }, { 4, 3 },
+	{ 4, 3 }, { 7, 0 }, { 1, 6 }, { 2, 5 },
+	{ 1, 6 }, { 2, 5 }, { 4, 3 }, { 7, 0 },
+	{ 3, 4 }, { 0, 7 }, { 6, 1 }, { 5, 2 },
+	{ 6, 1 }, { 5, 2 }, { 3, 4 }, { 0, 7 },
+	{ 0, 7 }, { 3, 4 }, { 5, 2 }, { 6, 1 },
+	{ 5, 2 }, { 6, 1 }, { 0, 7 }, { 3, 4 },
+};
+
+static const uint8_t conv_gsm_tch_hs_next_state[][2] = {
+	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
+	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
+	{ 16, 17 }, { 18, 19 }, { 20, 21 }, { 22, 23 },
+	{ 24, 25 }, { 26, 27 }, { 28, 29 }, { 30, 31 },
+	{ 32, 33 }, { 34, 35 }, { 36, 37 }, { 38, 39 },
+	{ 40, 41 }, { 42, 43 }, { 44, 45 }, { 46, 47 },
+	{ 48, 49 }, { 50, 51 }, { 52, 53 }, { 54, 55 },
+	{ 56, 57 }, { 58, 59 }, { 60, 61 }, { 62, 63 },
+	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
+	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
+	{ 16, 17 }, { 18, 19 }, { 20, 21 }, { 22, 23 },
+	{ 24, 25 }, { 26, 27 }, { 28, 29 }, { 30, 31 },
+	{ 32, 33 }, { 34, 35 }, { 36, 37 }, { 38, 39 },
+	{ 40, 41 }, { 42, 43 }, { 44, 45 }, { 46, 47 },
+	{ 48, 49 }, { 50, 51 }, { 52, 53 }, { 54, 55 },
+	{ 56, 57 }, { 58, 59 }, { 60, 61 }, { 62, 63 },
+};
+
+static const struct osmo_conv_code conv_gsm_tch_hs = {
+	.N = 3,
+	.K = 7,
+	.len = 98,
+	.term = CONV_TERM_FLUSH,
+	.next_output = conv_gsm_tch_hs_next_output,
+	.next_state  = conv_gsm_tch_hs_next_state,
+};
+
+
+/* Random code -> Non recursive code, flushed, punctured */
+static const int conv_punct_puncture[] = {
+	  2,   5,   8,  11,  14,  17,  20,  23,  26,  29,  32,  35,
+	 38,  41,  44,  47,  50,  53,  56,  59,  62,  65,  68,  71,
+	 74,  77,  80,  83,  86,  89,  92,  95,  98, 101, 104, 107,
+	110, 113, 116, 119, 122, 125, 128, 131, 134, 137, 140, 143,
+	146, 149, 152, 155, 158, 161, 164, 167, 170, 173, 176, 179,
+	182, 185, 188, 191, 194, 197, 200, 203, 206,
+	-1, /* end */
+};
+
+static const struct osmo_conv_code conv_punct = {
+	.N = 2,
+	.K = 5,
+	.len = 100,
+	.term = CONV_TERM_FLUSH,
+	.next_output = conv_gsm_xcch_next_output,
+	.next_state  = conv_gsm_xcch_next_state,
+	.puncture    = conv_punct_puncture,
+};
+
 
 /* ------------------------------------------------------------------------ */
 /* Test vectors                                                             */
@@ -320,6 +391,32 @@ static const struct conv_test_vector tests[] = {
 		             0x61, 0x15, 0xaa, 0x4d, 0x94, 0xed, 0xb3, 0x3a,
 		             0x5d, 0x1b, 0x09, 0xc2, 0x99, 0x01, 0xec, 0x68 },
 	},
+	{
+		.name = "GSM TCH/HS (non-recursive, flushed, not punctured)",
+		.code = &conv_gsm_tch_hs,
+		.in_len  = 98,
+		.out_len = 312,
+		.has_vec = 1,
+		.vec_in  = { 0x33, 0x7a, 0x82, 0xb6, 0xfb, 0x45, 0x9d, 0x51,
+		             0x47, 0x6e, 0xea, 0x53, 0xc0 },
+		.vec_out = { 0x03, 0xcc, 0x0b, 0xa1, 0x6f, 0xc6, 0x54, 0x99,
+		             0x03, 0x58, 0xd4, 0xe9, 0x97, 0x71, 0x39, 0xd1,
+		             0x2c, 0xfd, 0x36, 0x66, 0xa4, 0x2a, 0xe4, 0x4b,
+		             0xf7, 0x62, 0xc6, 0x73, 0x69, 0x70, 0x78, 0x86,
+		             0x55, 0x3b, 0xe3, 0xb0, 0xac, 0x7a, 0x1f },
+	},
+	{
+		.name = "??? (non-recursive, flushed, punctured)",
+		.code = &conv_punct,
+		.in_len  = 100,
+		.out_len = 139,
+		.has_vec = 1,
+		.vec_in  = { 0xc3, 0x91, 0x0a, 0xdb, 0xb7, 0x2a, 0x71, 0x8f,
+		             0xc1, 0x91, 0x1a, 0xd6, 0xb0 },
+		.vec_out = { 0xcd, 0xd9, 0x92, 0xf7, 0x31, 0x0b, 0x94, 0xd9,
+		             0xc8, 0x16, 0x15, 0x4d, 0xbc, 0xc2, 0xa4, 0x83,
+		             0x25, 0x20 },
+	},
 	{ /* end */ },
 };
 
@@ -354,6 +451,88 @@ sbit_to_ubit(ubit_t *dst, sbit_t *src, int n)
 		dst[i] = src[i] < 0;
 }
 
+/* noisy soft bits, some of them erased */
+static void
+add_noise(sbit_t *b, int n)
+{
+	int i;
+	for (i=0; i<n; i++) {
+		int v = b[i] + (int)(random() % 301) - 150;
+		if (random() % 16 == 0)
+			v = 0;
+		b[i] = v > 127 ? 127 : v < -127 ? -127 : v;
+	}
+}
+
+/* what osmo_conv_encode() does for codes without a specialised encoder */
+static int
+encode_generic(const struct osmo_conv_code *code, const ubit_t *input,
+               ubit_t *output)
+{
+	struct osmo_conv_encoder encoder;
+	int l;
+
+	osmo_conv_encode_init(&encoder, code);
+	if (code->term == CONV_TERM_TAIL_BITING)
+		osmo_conv_encode_load_state(&encoder,
+		                            &input[code->len - code->K + 1]);
+	l = osmo_conv_encode_raw(&encoder, input, output, code->len);
+	if (code->term == CONV_TERM_FLUSH)
+		l += osmo_conv_encode_flush(&encoder, &output[l]);
+
+	return l;
+}
+
+/* the encoder gives the same bits as the generic one, and all decoder
+ * kernels the CPU has decode the same bits, with the same path error,
+ * as the portable one */
+static int
+test_acs(const struct conv_test_vector *tst, ubit_t *bu0, ubit_t *bu1,
+         sbit_t *bs)
+{
+	static const enum osmo_conv_acs acs[] = {
+		OSMO_CONV_ACS_SSE4, OSMO_CONV_ACS_AVX2,
+	};
+	int i, j, l, rv, rv_ref;
+	ubit_t *ref = malloc(sizeof(ubit_t) * MAX_LEN_BITS * 2);
+	ubit_t *out = ref + MAX_LEN_BITS;
+
+	for (i=0; i<20; i++) {
+		fill_random(bu0, tst->in_len);
+		l = encode_generic(tst->code, bu0, bu1);
+		if (osmo_conv_encode(tst->code, bu0, out) != l ||
+		    memcmp(out, bu1, l)) {
+			fprintf(stderr, "[!] Encoding differs\n");
+			goto err;
+		}
+		ubit_to_sbit(bs, bu1, l);
+		add_noise(bs, l);
+
+		osmo_conv_decode_set_acs(OSMO_CONV_ACS_SCALAR);
+		rv_ref = osmo_conv_decode(tst->code, bs, ref);
+
+		for (j=0; j<ARRAY_SIZE(acs); j++) {
+			if (osmo_conv_decode_set_acs(acs[j]) < 0)
+				continue;
+			rv = osmo_conv_decode(tst->code, bs, out);
+			if (rv != rv_ref || memcmp(ref, out, tst->in_len)) {
+				fprintf(stderr, "[!] Kernel %d: path error %d, "
+					"expected %d\n", acs[j], rv, rv_ref);
+				goto err;
+			}
+		}
+	}
+
+	osmo_conv_decode_set_acs(OSMO_CONV_ACS_AUTO);
+	free(ref);
+	return 0;
+
+err:
+	osmo_conv_decode_set_acs(OSMO_CONV_ACS_AUTO);
+	free(ref);
+	return -1;
+}
+
 
 int main(int argc, char argv[])
 {
@@ -474,6 +653,14 @@ int main(int argc, char argv[])
 			printf("OK\n");
 		}
 
+		/* Check the decoder kernels */
+		printf("[..] Decoder kernels agree on noisy input : ");
+		if (test_acs(tst, bu0, bu1, bs)) {
+			printf("ERROR !\n");
+			return -1;
+		}
+		printf("OK\n");
+
 		/* Spacing */
 		printf("\n");
 	}
@@ -0,0 +1,178 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* CRCs per second of each engine the CPU has, from unpacked and from
+ * packed bits: the 40 bit fire code of an xCCH block (184 bits), the
+ * 10 bit one of SCH (25 bits), the 3 bit one of TCH/FS (50 bits) and
+ * CRC-32 over 1500 bytes. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/crcgen.h>
+#include <osmocom/core/utils.h>
+
+#define MAX_LEN_BITS	12000
+/* CRCs per measurement are scaled to take about this long */
+#define RUN_NS		200000000ULL
+
+static const struct osmo_crc64gen_code fire = {
+	40, 0x0004820009ULL, 0, 0xffffffffffULL
+};
+
+static const struct osmo_crc16gen_code sch = { 10, 0x175, 0, 0x3ff };
+
+static const struct osmo_crc8gen_code tch_fs = { 3, 0x3, 0, 0x7 };
+
+static const struct osmo_crc32gen_code crc32 = {
+	32, 0x04c11db7, 0xffffffff, 0xffffffff
+};
+
+enum bench_code { FIRE, SCH, TCH_FS, CRC32 };
+
+static const struct {
+	const char *name;
+	enum bench_code code;
+	int len;
+} benches[] = {
+	{ "xCCH", FIRE, 184 },
+	{ "SCH", SCH, 25 },
+	{ "TCH/FS", TCH_FS, 50 },
+	{ "CRC-32", CRC32, MAX_LEN_BITS },
+};
+
+static const char *engine_names[] = { "auto", "bitwise", "slice8", "clmul" };
+
+static ubit_t ubits[MAX_LEN_BITS];
+static pbit_t pbits[MAX_LEN_BITS / 8];
+static volatile uint64_t sink;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int set_engine(enum bench_code code, int engine)
+{
+	switch (code) {
+	case FIRE:
+		return osmo_crc64gen_set_engine(engine);
+	case SCH:
+		return osmo_crc16gen_set_engine(engine);
+	case TCH_FS:
+		return osmo_crc8gen_set_engine(engine);
+	default:
+		return osmo_crc32gen_set_engine(engine);
+	}
+}
+
+static void run(enum bench_code code, int len, int packed, unsigned int n)
+{
+	uint64_t crc = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		switch (code) {
+		case FIRE:
+			crc ^= packed ? osmo_crc64gen_compute_pbits(&fire, pbits, len) :
+			       osmo_crc64gen_compute_bits(&fire, ubits, len);
+			break;
+		case SCH:
+			crc ^= packed ? osmo_crc16gen_compute_pbits(&sch, pbits, len) :
+			       osmo_crc16gen_compute_bits(&sch, ubits, len);
+			break;
+		case TCH_FS:
+			crc ^= packed ? osmo_crc8gen_compute_pbits(&tch_fs, pbits, len) :
+			       osmo_crc8gen_compute_bits(&tch_fs, ubits, len);
+			break;
+		default:
+			crc ^= packed ? osmo_crc32gen_compute_pbits(&crc32, pbits, len) :
+			       osmo_crc32gen_compute_bits(&crc32, ubits, len);
+			break;
+		}
+	}
+	sink = crc;
+}
+
+static double crcs_per_s(enum bench_code code, int len, int packed)
+{
+	unsigned int n = 10;
+	uint64_t t;
+
+	/* double the CRCs until the run is long enough to tell */
+	while (1) {
+		t = now_ns();
+		run(code, len, packed, n);
+		t = now_ns() - t;
+		if (t >= RUN_NS / 4)
+			break;
+		n *= 2;
+	}
+	n = n * RUN_NS / t + 1;
+
+	t = now_ns();
+	run(code, len, packed, n);
+	t = now_ns() - t;
+
+	return n * 1e9 / t;
+}
+
+int main(int argc, char **argv)
+{
+	double base, rate;
+	int b, e, packed, i;
+
+	srandom(1);
+	for (i = 0; i < MAX_LEN_BITS; i++)
+		ubits[i] = random() & 1;
+	osmo_ubit2pbit(pbits, ubits, MAX_LEN_BITS);
+
+	for (b = 0; b < ARRAY_SIZE(benches); b++) {
+		for (packed = 0; packed < 2; packed++) {
+			base = 0;
+			for (e = OSMO_CRC8GEN_BITWISE; e <= OSMO_CRC8GEN_CLMUL; e++) {
+				if (set_engine(benches[b].code, e) < 0) {
+					printf("%-7s %5d bits %-8s %-7s not supported\n",
+					       benches[b].name, benches[b].len,
+					       packed ? "packed" : "unpacked",
+					       engine_names[e]);
+					continue;
+				}
+				rate = crcs_per_s(benches[b].code, benches[b].len,
+						  packed);
+				if (!base)
+					base = rate;
+				printf("%-7s %5d bits %-8s %-7s %11.0f CRCs/s %6.2fx\n",
+				       benches[b].name, benches[b].len,
+				       packed ? "packed" : "unpacked",
+				       engine_names[e], rate, rate / base);
+			}
+			set_engine(benches[b].code, 0);
+		}
+	}
+
+	return 0;
+}
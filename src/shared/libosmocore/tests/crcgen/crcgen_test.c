@@ -0,0 +1,178 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* The CRCs of each engine, from unpacked and from packed bits, against
+ * a bit by bit computation, for the GSM codes and a few common ones. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/crcgen.h>
+#include <osmocom/core/utils.h>
+
+#define MAX_LEN_BITS	700
+
+struct test_code {
+	const char *name;
+	int bits;
+	uint64_t poly;
+	uint64_t init;
+	uint64_t remainder;
+};
+
+static const struct test_code codes[] = {
+	{ "TCH/FS class 1a",  3, 0x3, 0x0, 0x7 },
+	{ "RACH",  6, 0x2f, 0x0, 0x3f },
+	{ "CRC-8",  8, 0x07, 0xff, 0x00 },
+	{ "SCH", 10, 0x175, 0x0, 0x3ff },
+	{ "CRC-16-CCITT", 16, 0x1021, 0xffff, 0xffff },
+	{ "CRC-32", 32, 0x04c11db7, 0xffffffff, 0xffffffff },
+	{ "xCCH fire", 40, 0x0004820009ULL, 0x0, 0xffffffffffULL },
+	{ "CRC-64-ECMA", 64, 0x42f0e1eba9ea3693ULL, 0x0, 0x0 },
+};
+
+static const char *engine_names[] = { "auto", "bitwise", "slice8", "clmul" };
+
+static ubit_t ubits[MAX_LEN_BITS];
+static pbit_t pbits[MAX_LEN_BITS / 8 + 1];
+
+static uint64_t ref_crc(const struct test_code *c, const ubit_t *in, int len)
+{
+	uint64_t top = 1ULL << (c->bits - 1);
+	uint64_t mask = top | (top - 1);
+	uint64_t crc = c->init;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		crc ^= (uint64_t)in[i] << (c->bits - 1);
+		crc = (crc & top) ? (crc << 1) ^ c->poly : crc << 1;
+		crc &= mask;
+	}
+	return len ? crc ^ c->remainder : c->init ^ c->remainder;
+}
+
+/* the CRC of the given width, 0 for the widths the code does not fit */
+static int compute(const struct test_code *c, int width, int packed,
+		   int len, uint64_t *crc)
+{
+	if (c->bits > width)
+		return -1;
+
+	switch (width) {
+	case 8: {
+		struct osmo_crc8gen_code code = { c->bits, c->poly, c->init,
+						  c->remainder };
+		*crc = packed ? osmo_crc8gen_compute_pbits(&code, pbits, len) :
+		       osmo_crc8gen_compute_bits(&code, ubits, len);
+		break;
+	}
+	case 16: {
+		struct osmo_crc16gen_code code = { c->bits, c->poly, c->init,
+						   c->remainder };
+		*crc = packed ? osmo_crc16gen_compute_pbits(&code, pbits, len) :
+		       osmo_crc16gen_compute_bits(&code, ubits, len);
+		break;
+	}
+	case 32: {
+		struct osmo_crc32gen_code code = { c->bits, c->poly, c->init,
+						   c->remainder };
+		*crc = packed ? osmo_crc32gen_compute_pbits(&code, pbits, len) :
+		       osmo_crc32gen_compute_bits(&code, ubits, len);
+		break;
+	}
+	default: {
+		struct osmo_crc64gen_code code = { c->bits, c->poly, c->init,
+						   c->remainder };
+		*crc = packed ? osmo_crc64gen_compute_pbits(&code, pbits, len) :
+		       osmo_crc64gen_compute_bits(&code, ubits, len);
+		break;
+	}
+	}
+	return 0;
+}
+
+static int set_engine(int width, int engine)
+{
+	switch (width) {
+	case 8:
+		return osmo_crc8gen_set_engine(engine);
+	case 16:
+		return osmo_crc16gen_set_engine(engine);
+	case 32:
+		return osmo_crc32gen_set_engine(engine);
+	default:
+		return osmo_crc64gen_set_engine(engine);
+	}
+}
+
+static void test_code(const struct test_code *c)
+{
+	static const int widths[] = { 8, 16, 32, 64 };
+	int w, e, len, packed, failed = 0;
+	uint64_t crc, ref;
+
+	for (len = 0; len <= MAX_LEN_BITS; len++) {
+		ref = ref_crc(c, ubits, len);
+		for (w = 0; w < ARRAY_SIZE(widths); w++) {
+			for (e = OSMO_CRC8GEN_BITWISE; e <= OSMO_CRC8GEN_CLMUL; e++) {
+				if (set_engine(widths[w], e) < 0)
+					continue;
+				for (packed = 0; packed < 2; packed++) {
+					if (compute(c, widths[w], packed, len, &crc) < 0)
+						continue;
+					if (crc == ref)
+						continue;
+					printf("%s: %d bits, crc%dgen %s %s: "
+					       "%llx != %llx\n", c->name, len,
+					       widths[w], engine_names[e],
+					       packed ? "packed" : "unpacked",
+					       (unsigned long long)crc,
+					       (unsigned long long)ref);
+					failed = 1;
+				}
+			}
+			set_engine(widths[w], 0);
+		}
+	}
+
+	printf("%-16s %2d bits: %s\n", c->name, c->bits,
+	       failed ? "FAIL" : "OK");
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	srandom(argc > 1 ? atoi(argv[1]) : 1);
+
+	for (i = 0; i < MAX_LEN_BITS; i++)
+		ubits[i] = random() & 1;
+	osmo_ubit2pbit(pbits, ubits, MAX_LEN_BITS);
+	/* junk after the last bit of a partial byte is not fed in */
+	pbits[MAX_LEN_BITS / 8] |= 0x0f;
+
+	for (i = 0; i < ARRAY_SIZE(codes); i++)
+		test_code(&codes[i]);
+
+	return 0;
+}
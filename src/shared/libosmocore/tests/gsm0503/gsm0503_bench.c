@@ -0,0 +1,186 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* xCCH and TCH/FS blocks coded per second, one by one and in batches,
+ * with each Viterbi kernel the CPU has. The channels column is how many
+ * channels of each that rate keeps up with on one core: a TCH/FS
+ * channel carries 50 frames a second each way, an SDCCH/8 about 17
+ * blocks counting its SACCH. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/conv.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/gsm0503.h>
+
+#define BATCH		64
+#define BB		GSM0503_BURST_BITS
+/* blocks per measurement are scaled to take about this long */
+#define RUN_NS		200000000ULL
+
+static uint8_t data[BATCH * GSM0503_TCH_FS_LEN];
+static ubit_t bursts[BATCH * 8 * BB];
+static sbit_t soft[BATCH * 8 * BB];
+static struct gsm0503_batch batch;
+
+enum bench_op { XCCH_ENC, XCCH_DEC, TCH_ENC, TCH_DEC };
+
+static const struct {
+	const char *name;
+	enum bench_op op;
+	double blocks_per_chan;
+} ops[] = {
+	{ "xCCH encode", XCCH_ENC, 17 },
+	{ "xCCH decode", XCCH_DEC, 17 },
+	{ "TCH/FS encode", TCH_ENC, 50 },
+	{ "TCH/FS decode", TCH_DEC, 50 },
+};
+
+static const struct {
+	const char *name;
+	enum osmo_conv_acs acs;
+} kernels[] = {
+	{ "scalar", OSMO_CONV_ACS_SCALAR },
+	{ "sse4", OSMO_CONV_ACS_SSE4 },
+	{ "avx2", OSMO_CONV_ACS_AVX2 },
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* rounds of BATCH blocks */
+static void run(enum bench_op op, int batched, unsigned int rounds)
+{
+	unsigned int r, i;
+
+	for (r = 0; r < rounds; r++) {
+		if (batched) {
+			switch (op) {
+			case XCCH_ENC:
+				gsm0503_xcch_encode_batch(&batch, bursts, data, BATCH);
+				break;
+			case XCCH_DEC:
+				gsm0503_xcch_decode_batch(&batch, data, soft, BATCH, NULL);
+				break;
+			case TCH_ENC:
+				gsm0503_tch_fs_encode_batch(&batch, bursts, data, BATCH);
+				break;
+			case TCH_DEC:
+				gsm0503_tch_fs_decode_batch(&batch, data, soft, BATCH, NULL);
+				break;
+			}
+			continue;
+		}
+		for (i = 0; i < BATCH; i++) {
+			switch (op) {
+			case XCCH_ENC:
+				gsm0503_xcch_encode(&bursts[i * 4 * BB],
+					&data[i * GSM0503_XCCH_L2_LEN]);
+				break;
+			case XCCH_DEC:
+				gsm0503_xcch_decode(&data[i * GSM0503_XCCH_L2_LEN],
+					&soft[i * 4 * BB], NULL, NULL);
+				break;
+			case TCH_ENC:
+				gsm0503_tch_fs_encode(&bursts[i * 8 * BB],
+					&data[i * GSM0503_TCH_FS_LEN]);
+				break;
+			case TCH_DEC:
+				gsm0503_tch_fs_decode(&data[i * GSM0503_TCH_FS_LEN],
+					&soft[i * 8 * BB], NULL, NULL);
+				break;
+			}
+		}
+	}
+}
+
+static double blocks_per_s(enum bench_op op, int batched)
+{
+	unsigned int rounds = 1;
+	uint64_t t;
+
+	/* double the rounds until the run is long enough to tell */
+	while (1) {
+		t = now_ns();
+		run(op, batched, rounds);
+		t = now_ns() - t;
+		if (t >= RUN_NS / 4)
+			break;
+		rounds *= 2;
+	}
+	rounds = rounds * RUN_NS / t + 1;
+
+	t = now_ns();
+	run(op, batched, rounds);
+	t = now_ns() - t;
+
+	return (double)rounds * BATCH * 1e9 / t;
+}
+
+int main(int argc, char **argv)
+{
+	double rate;
+	int o, k, b, i;
+
+	srandom(1);
+	for (i = 0; i < ARRAY_SIZE(data); i++)
+		data[i] = random();
+
+	gsm0503_batch_init(&batch);
+
+	/* coded blocks with a few errors to decode */
+	gsm0503_xcch_encode_batch(&batch, bursts, data, BATCH);
+	for (i = 0; i < BATCH * 4 * BB; i++)
+		soft[i] = (bursts[i] ? -100 : 100) + (int)(random() % 55) - 27;
+	gsm0503_tch_fs_encode_batch(&batch, bursts, data, BATCH);
+	for (i = 0; i < ARRAY_SIZE(soft); i++)
+		soft[i] = (bursts[i] ? -100 : 100) + (int)(random() % 55) - 27;
+
+	for (o = 0; o < ARRAY_SIZE(ops); o++) {
+		for (k = 0; k < ARRAY_SIZE(kernels); k++) {
+			if (osmo_conv_decode_set_acs(kernels[k].acs) < 0) {
+				printf("%-14s %-7s not supported\n",
+				       ops[o].name, kernels[k].name);
+				continue;
+			}
+			for (b = 0; b < 2; b++) {
+				rate = blocks_per_s(ops[o].op, b);
+				printf("%-14s %-7s %-9s %10.0f blocks/s %8.0f channels\n",
+				       ops[o].name, kernels[k].name,
+				       b ? "batch" : "one by one", rate,
+				       rate / ops[o].blocks_per_chan);
+			}
+		}
+	}
+	osmo_conv_decode_set_acs(OSMO_CONV_ACS_AUTO);
+
+	gsm0503_batch_deinit(&batch);
+
+	return 0;
+}
@@ -0,0 +1,375 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* The coders against the formulas of GSM 05.03 written out bit by bit,
+ * then back through the decoders, clean, with noise and with too many
+ * errors, one by one and in batches. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/gsm0503.h>
+
+#define N_BLOCKS	40
+#define BB		GSM0503_BURST_BITS
+
+/* remainder of d(0..n-1) D^bits divided by the generator, inverted */
+static void ref_parity(const ubit_t *d, int n, uint64_t gen, int bits,
+		       ubit_t *p)
+{
+	uint64_t r = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		int fb = ((r >> (bits - 1)) & 1) ^ d[i];
+		r = (r << 1) & ((1ULL << bits) - 1);
+		if (fb)
+			r ^= gen;
+	}
+	for (i = 0; i < bits; i++)
+		p[i] = !((r >> (bits - 1 - i)) & 1);
+}
+
+/* G0 = 1 + D^3 + D^4, G1 = 1 + D + D^3 + D^4, 4 tail bits */
+static void ref_conv(const ubit_t *u, int n, ubit_t *c)
+{
+	int k;
+
+#define U(i)	((i) >= 0 && (i) < n ? u[i] : 0)
+	for (k = 0; k < n + 4; k++) {
+		c[2 * k] = U(k) ^ U(k - 3) ^ U(k - 4);
+		c[2 * k + 1] = U(k) ^ U(k - 1) ^ U(k - 3) ^ U(k - 4);
+	}
+#undef U
+}
+
+static int ref_pos(int k, int n_bursts)
+{
+	int b = k % n_bursts;
+	int j = 2 * ((49 * k) % 57) + ((k % 8) / 4);
+
+	return b * BB + (j < 57 ? j : j + 2);
+}
+
+static void ref_xcch(ubit_t *bursts, const uint8_t *l2)
+{
+	ubit_t u[224], c[456];
+	int k;
+
+	for (k = 0; k < 184; k++)
+		u[k] = (l2[k / 8] >> (k % 8)) & 1;
+	ref_parity(u, 184, 0x0004820009ULL, 40, u + 184);
+	ref_conv(u, 224, c);
+	memset(bursts, 1, 4 * BB);
+	for (k = 0; k < 456; k++)
+		bursts[ref_pos(k, 4)] = c[k];
+}
+
+static void ref_tch_fs(ubit_t *bursts, const uint8_t *frame)
+{
+	ubit_t d[260], u[185], c[456];
+	int k;
+
+	for (k = 0; k < 260; k++)
+		d[k] = (frame[k / 8] >> (7 - k % 8)) & 1;
+	for (k = 0; k < 91; k++) {
+		u[k] = d[2 * k];
+		u[184 - k] = d[2 * k + 1];
+	}
+	ref_parity(d, 50, 0x3, 3, u + 91);
+	ref_conv(u, 185, c);
+	for (k = 0; k < 78; k++)
+		c[378 + k] = d[182 + k];
+	for (k = 0; k < 456; k++)
+		bursts[ref_pos(k, 8)] = c[k];
+	for (k = 0; k < 4; k++) {
+		bursts[k * BB + 58] = 0;
+		bursts[(k + 4) * BB + 57] = 0;
+	}
+}
+
+static void ref_rach(ubit_t *burst, uint8_t ra, uint8_t bsic)
+{
+	ubit_t u[14];
+	int k;
+
+	for (k = 0; k < 8; k++)
+		u[k] = (ra >> k) & 1;
+	ref_parity(u, 8, 0x2f, 6, u + 8);
+	for (k = 0; k < 6; k++)
+		u[8 + k] ^= (bsic >> (5 - k)) & 1;
+	ref_conv(u, 14, burst);
+}
+
+static void ref_sch(ubit_t *burst, const uint8_t *info)
+{
+	ubit_t u[35];
+	int k;
+
+	for (k = 0; k < 25; k++)
+		u[k] = (info[k / 8] >> (k % 8)) & 1;
+	ref_parity(u, 25, 0x175, 10, u + 25);
+	ref_conv(u, 35, burst);
+}
+
+/* soft bits of the bursts, flipping flips of the coded ones at random */
+static void to_soft(sbit_t *s, const ubit_t *u, int n, int flips)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		s[i] = u[i] ? -100 : 100;
+	for (i = 0; i < flips; i++)
+		s[random() % n] *= -1;
+}
+
+/* n errors the code corrects, spread out over the coded bits: K = 5
+ * only guarantees to correct 3 errors close together */
+static void add_errors(sbit_t *s, int n_bursts, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		s[ref_pos(i * (456 / n) + random() % 20, n_bursts)] *= -1;
+}
+
+static void random_bytes(uint8_t *b, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		b[i] = random();
+}
+
+static int check(const char *name, int failed)
+{
+	printf("%-36s %s\n", name, failed ? "FAIL" : "OK");
+	return failed;
+}
+
+static void test_xcch(void)
+{
+	uint8_t l2[GSM0503_XCCH_L2_LEN], out[GSM0503_XCCH_L2_LEN];
+	ubit_t bursts[4 * BB], ref[4 * BB];
+	sbit_t soft[4 * BB];
+	int i, rc, n_err, n_tot, failed;
+
+	failed = 0;
+	for (i = 0; i < N_BLOCKS; i++) {
+		random_bytes(l2, sizeof(l2));
+		gsm0503_xcch_encode(bursts, l2);
+		ref_xcch(ref, l2);
+		failed |= memcmp(bursts, ref, sizeof(ref)) != 0;
+	}
+	check("xCCH encode", failed);
+
+	failed = 0;
+	for (i = 0; i < N_BLOCKS; i++) {
+		random_bytes(l2, sizeof(l2));
+		gsm0503_xcch_encode(bursts, l2);
+		to_soft(soft, bursts, sizeof(soft), 0);
+		if (!(i % 2))
+			add_errors(soft, 4, 5);
+		rc = gsm0503_xcch_decode(out, soft, &n_err, &n_tot);
+		failed |= rc || memcmp(out, l2, sizeof(l2)) || n_tot != 456 ||
+			  (i % 2 ? n_err != 0 : n_err != 5);
+	}
+	check("xCCH decode", failed);
+
+	failed = 0;
+	for (i = 0; i < N_BLOCKS; i++) {
+		random_bytes(l2, sizeof(l2));
+		gsm0503_xcch_encode(bursts, l2);
+		to_soft(soft, bursts, sizeof(soft), 200);
+		failed |= gsm0503_xcch_decode(out, soft, NULL, NULL) != -1;
+	}
+	check("xCCH decode, too many errors", failed);
+}
+
+static void test_tch_fs(void)
+{
+	uint8_t frame[GSM0503_TCH_FS_LEN], out[GSM0503_TCH_FS_LEN];
+	ubit_t bursts[8 * BB], ref[8 * BB];
+	sbit_t soft[8 * BB];
+	int i, rc, n_err, n_tot, failed;
+
+	failed = 0;
+	for (i = 0; i < N_BLOCKS; i++) {
+		random_bytes(frame, sizeof(frame));
+		frame[32] &= 0xf0;
+		/* the bits of the other blocks stay */
+		random_bytes(bursts, sizeof(bursts));
+		memcpy(ref, bursts, sizeof(ref));
+		gsm0503_tch_fs_encode(bursts, frame);
+		ref_tch_fs(ref, frame);
+		failed |= memcmp(bursts, ref, sizeof(ref)) != 0;
+	}
+	check("TCH/FS encode", failed);
+
+	/* the block clears hu(B) of its even bits in bursts 0..3 and hl(B)
+	 * of its odd bits in bursts 4..7, the other flags belong to the
+	 * blocks before and after it */
+	memset(frame, 0, sizeof(frame));
+	memset(bursts, 1, sizeof(bursts));
+	gsm0503_tch_fs_encode(bursts, frame);
+	failed = 0;
+	for (i = 0; i < 4; i++) {
+		failed |= bursts[i * BB + 57] != 1 || bursts[i * BB + 58] != 0;
+		failed |= bursts[(i + 4) * BB + 57] != 0 ||
+			  bursts[(i + 4) * BB + 58] != 1;
+	}
+	check("TCH/FS stealing flags", failed);
+
+	failed = 0;
+	for (i = 0; i < N_BLOCKS; i++) {
+		random_bytes(frame, sizeof(frame));
+		frame[32] &= 0xf0;
+		gsm0503_tch_fs_encode(bursts, frame);
+		/* only class 1 may be noisy to get the frame back */
+		to_soft(soft, bursts, sizeof(soft), 0);
+		if (!(i % 2))
+			add_errors(soft, 8, 4);
+		rc = gsm0503_tch_fs_decode(out, soft, &n_err, &n_tot);
+		failed |= rc || memcmp(out, frame, sizeof(frame)) ||
+			  n_tot != 378 ||
+			  (i % 2 ? n_err != 0 : n_err != 4);
+	}
+	check("TCH/FS decode", failed);
+
+	/* 3 parity bits let about one bad frame in 8 through */
+	n_err = 0;
+	for (i = 0; i < N_BLOCKS; i++) {
+		random_bytes(frame, sizeof(frame));
+		gsm0503_tch_fs_encode(bursts, frame);
+		to_soft(soft, bursts, sizeof(soft), 300);
+		n_err += gsm0503_tch_fs_decode(out, soft, NULL, NULL) == -1;
+	}
+	check("TCH/FS decode, too many errors", n_err < N_BLOCKS / 2);
+}
+
+static void test_rach_sch(void)
+{
+	uint8_t info[GSM0503_SCH_INFO_LEN], out[GSM0503_SCH_INFO_LEN], ra;
+	ubit_t burst[GSM0503_SCH_BITS], ref[GSM0503_SCH_BITS];
+	sbit_t soft[GSM0503_SCH_BITS];
+	int i, failed;
+
+	failed = 0;
+	for (i = 0; i < 256; i++) {
+		uint8_t bsic = random() % 64;
+
+		gsm0503_rach_encode(burst, i, bsic);
+		ref_rach(ref, i, bsic);
+		failed |= memcmp(burst, ref, GSM0503_RACH_BITS) != 0;
+		to_soft(soft, burst, GSM0503_RACH_BITS, i % 2);
+		failed |= gsm0503_rach_decode(&ra, soft, bsic) || ra != i;
+		failed |= !gsm0503_rach_decode(&ra, soft, bsic ^ 0x21);
+	}
+	check("RACH", failed);
+
+	failed = 0;
+	for (i = 0; i < N_BLOCKS; i++) {
+		random_bytes(info, sizeof(info));
+		info[3] &= 0x01;
+		gsm0503_sch_encode(burst, info);
+		ref_sch(ref, info);
+		failed |= memcmp(burst, ref, GSM0503_SCH_BITS) != 0;
+		to_soft(soft, burst, GSM0503_SCH_BITS, i % 3);
+		failed |= gsm0503_sch_decode(out, soft) ||
+			  memcmp(out, info, sizeof(info));
+	}
+	check("SCH", failed);
+}
+
+static void test_batch(void)
+{
+	static uint8_t l2[N_BLOCKS * GSM0503_XCCH_L2_LEN];
+	static uint8_t frames[N_BLOCKS * GSM0503_TCH_FS_LEN];
+	static uint8_t out[N_BLOCKS * GSM0503_TCH_FS_LEN];
+	static ubit_t bursts[N_BLOCKS * 8 * BB], one[8 * BB];
+	static sbit_t soft[N_BLOCKS * 8 * BB];
+	struct gsm0503_batch batch;
+	uint8_t ok[N_BLOCKS];
+	int i, n, failed;
+
+	gsm0503_batch_init(&batch);
+
+	failed = 0;
+	random_bytes(l2, sizeof(l2));
+	n = gsm0503_xcch_encode_batch(&batch, bursts, l2, N_BLOCKS);
+	failed |= n != N_BLOCKS;
+	for (i = 0; i < N_BLOCKS; i++) {
+		gsm0503_xcch_encode(one, &l2[i * GSM0503_XCCH_L2_LEN]);
+		failed |= memcmp(one, &bursts[i * 4 * BB], 4 * BB) != 0;
+	}
+	/* every third block garbled beyond repair */
+	for (i = 0; i < N_BLOCKS; i++) {
+		to_soft(&soft[i * 4 * BB], &bursts[i * 4 * BB], 4 * BB,
+			i % 3 ? 0 : 200);
+		if (i % 3)
+			add_errors(&soft[i * 4 * BB], 4, 5);
+	}
+	n = gsm0503_xcch_decode_batch(&batch, out, soft, N_BLOCKS, ok);
+	for (i = 0; i < N_BLOCKS; i++) {
+		failed |= ok[i] != !!(i % 3);
+		if (ok[i])
+			failed |= memcmp(&out[i * GSM0503_XCCH_L2_LEN],
+					 &l2[i * GSM0503_XCCH_L2_LEN],
+					 GSM0503_XCCH_L2_LEN) != 0;
+		n -= ok[i];
+	}
+	failed |= n != 0;
+	check("xCCH batch", failed);
+
+	failed = 0;
+	random_bytes(frames, sizeof(frames));
+	for (i = 0; i < N_BLOCKS; i++)
+		frames[i * GSM0503_TCH_FS_LEN + 32] &= 0xf0;
+	memset(bursts, 0, sizeof(bursts));
+	n = gsm0503_tch_fs_encode_batch(&batch, bursts, frames, N_BLOCKS);
+	failed |= n != N_BLOCKS;
+	for (i = 0; i < N_BLOCKS; i++) {
+		memset(one, 0, sizeof(one));
+		gsm0503_tch_fs_encode(one, &frames[i * GSM0503_TCH_FS_LEN]);
+		failed |= memcmp(one, &bursts[i * 8 * BB], 8 * BB) != 0;
+	}
+	to_soft(soft, bursts, N_BLOCKS * 8 * BB, 0);
+	n = gsm0503_tch_fs_decode_batch(&batch, out, soft, N_BLOCKS, NULL);
+	failed |= n != N_BLOCKS || memcmp(out, frames, sizeof(frames));
+	check("TCH/FS batch", failed);
+
+	gsm0503_batch_deinit(&batch);
+}
+
+int main(int argc, char **argv)
+{
+	srandom(argc > 1 ? atoi(argv[1]) : 1);
+
+	test_xcch();
+	test_tch_fs();
+	test_rach_sch();
+	test_batch();
+
+	return 0;
+}
@@ -182,6 +182,7 @@ static int ms_to_bts_l1_cb(struct osmo_prim_hdr *oph, void *_ctx)
 	/* i stuff it into the LAPDm channel of the BTS */
 	rc = send(oph->msg, state->bts);
 	msgb_free(oph->msg);
+	return rc;
 }
 
 static int ms_to_bts_tx_cb(struct msgb *msg, struct lapdm_entity *le, void *_ctx)
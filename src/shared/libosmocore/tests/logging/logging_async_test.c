@@ -0,0 +1,149 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <osmocom/core/logging.h>
+#include <osmocom/core/utils.h>
+
+#define NUM_THREADS	3
+#define NUM_LINES	2000
+
+enum {
+	DTEST,
+};
+
+static const struct log_info_cat default_categories[] = {
+	[DTEST] = {
+		.name = "DTEST",
+		.description = "Test",
+		.enabled = 1, .loglevel = LOGL_DEBUG,
+	},
+};
+
+static const struct log_info log_info = {
+	.cat = default_categories,
+	.num_cat = ARRAY_SIZE(default_categories),
+};
+
+static void *log_thread(void *data)
+{
+	int id = (intptr_t) data, i;
+
+	for (i = 0; i < NUM_LINES; i++)
+		LOGP(DTEST, LOGL_NOTICE, "thread %d line %d\n", id, i);
+
+	return NULL;
+}
+
+static struct log_target *create(const char *fname,
+				 enum log_async_policy policy)
+{
+	struct log_target *tgt;
+
+	unlink(fname);
+	tgt = log_target_create_async(fname, 4096, policy);
+	if (!tgt) {
+		fprintf(stderr, "could not create the target\n");
+		exit(1);
+	}
+	log_set_all_filter(tgt, 1);
+	log_set_use_color(tgt, 0);
+	log_set_print_filename(tgt, 0);
+	log_add_target(tgt);
+
+	return tgt;
+}
+
+/* check that the lines of every thread are complete and in order */
+static int check_file(const char *fname, int *num_lines)
+{
+	int next[NUM_THREADS] = { 0 };
+	char line[128];
+	FILE *f;
+	int ok = 1;
+
+	*num_lines = 0;
+	f = fopen(fname, "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f)) {
+		int id, nr;
+
+		if (sscanf(line, "thread %d line %d", &id, &nr) != 2
+		    || id < 0 || id >= NUM_THREADS || nr < next[id])
+			ok = 0;
+		else
+			next[id] = nr + 1;
+		(*num_lines)++;
+	}
+	fclose(f);
+	unlink(fname);
+
+	return ok;
+}
+
+static void test_policy(enum log_async_policy policy)
+{
+	char fname[] = "/tmp/logging_async_test.XXXXXX";
+	pthread_t threads[NUM_THREADS];
+	struct log_async_stats stats;
+	struct log_target *tgt;
+	int i, ok, num_lines;
+
+	close(mkstemp(fname));
+	tgt = create(fname, policy);
+
+	for (i = 0; i < NUM_THREADS; i++)
+		pthread_create(&threads[i], NULL, log_thread,
+			       (void *) (intptr_t) i);
+	for (i = 0; i < NUM_THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	log_target_async_flush(tgt);
+	log_target_async_stats(tgt, &stats);
+	log_target_destroy(tgt);
+
+	ok = check_file(fname, &num_lines);
+	printf("%s: lines in order: %d, written + dropped: %llu, "
+	       "in file: %s, high water in range: %d\n",
+	       policy == LOG_ASYNC_BLOCK ? "block" : "drop", ok,
+	       (unsigned long long) (stats.written + stats.dropped),
+	       num_lines == stats.written ? "all written" : "MISMATCH",
+	       stats.high_water > 0 && stats.high_water <= stats.size);
+	if (policy == LOG_ASYNC_BLOCK)
+		printf("block: nothing dropped: %d\n", stats.dropped == 0);
+}
+
+int main(int argc, char **argv)
+{
+	log_init(&log_info, NULL);
+	/* build the level cache before the threads use it */
+	log_check_level(DTEST, LOGL_NOTICE);
+
+	test_policy(LOG_ASYNC_BLOCK);
+	test_policy(LOG_ASYNC_DROP);
+
+	return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* Cost of a suppressed debug message per received frame, as in the
+ * L1CTL receive path of virt_phy which hexdumps every message.  The
+ * LOGP() macro checks the level cache before the arguments are
+ * evaluated, calling logp2() directly evaluates them and only then
+ * discards the message.
+ *
+ * With debug enabled, a text file target is compared with the binary
+ * target, which leaves the formatting to osmo-log-decode. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <osmocom/core/logging.h>
+#include <osmocom/core/utils.h>
+
+#define ITERATIONS	200000
+#define NUM_TARGETS	4
+
+enum {
+	DL1C,
+};
+
+static const struct log_info_cat default_categories[] = {
+	[DL1C] = {
+		.name = "DL1C",
+		.description = "Layer 1 Control",
+		.enabled = 1, .loglevel = LOGL_NOTICE,
+	},
+};
+
+static const struct log_info log_info = {
+	.cat = default_categories,
+	.num_cat = ARRAY_SIZE(default_categories),
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* cost per message of logging to a target with debug enabled */
+static double enabled_ns(struct log_target *tgt)
+{
+	uint64_t start;
+	int i;
+
+	log_set_all_filter(tgt, 1);
+	log_set_category_filter(tgt, DL1C, 1, LOGL_DEBUG);
+	log_add_target(tgt);
+
+	start = now_ns();
+	for (i = 0; i < ITERATIONS; i++)
+		LOGP(DL1C, LOGL_DEBUG, "Received %s frame FN %d on ARFCN %u "
+		     "TS %u, RSSI %d dBm\n", "SACCH", i, 871, 2, -62);
+	start = now_ns() - start;
+
+	log_target_destroy(tgt);
+
+	return (double)start / ITERATIONS;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t frame[23] = { 0x55, 0x06, 0x19, 0x8f, 0xb3, 0x00, 0x00 };
+	const char *fname = "logging_bench.blog";
+	uint64_t start, gated, ungated;
+	struct log_target *tgts[NUM_TARGETS];
+	double text, binary;
+	int i;
+
+	log_init(&log_info, NULL);
+	for (i = 0; i < NUM_TARGETS; i++) {
+		struct log_target *tgt = log_target_create_stderr();
+
+		log_set_all_filter(tgt, 1);
+		log_add_target(tgt);
+		tgts[i] = tgt;
+	}
+
+	start = now_ns();
+	for (i = 0; i < ITERATIONS; i++)
+		LOGP(DL1C, LOGL_DEBUG, "Received frame: %s\n",
+		     osmo_hexdump(frame, sizeof(frame)));
+	gated = now_ns() - start;
+
+	start = now_ns();
+	for (i = 0; i < ITERATIONS; i++)
+		logp2(DL1C, LOGL_DEBUG, __FILE__, __LINE__, 0,
+		      "Received frame: %s\n",
+		      osmo_hexdump(frame, sizeof(frame)));
+	ungated = now_ns() - start;
+
+	printf("%d targets, debug disabled, per frame:\n", NUM_TARGETS);
+	printf("  LOGP():            %6.1f ns\n", (double)gated / ITERATIONS);
+	printf("  logp2() directly:  %6.1f ns\n", (double)ungated / ITERATIONS);
+
+	for (i = 0; i < NUM_TARGETS; i++)
+		log_target_destroy(tgts[i]);
+
+	text = enabled_ns(log_target_create_file("/dev/null"));
+	binary = enabled_ns(log_target_create_binary(fname));
+	unlink(fname);
+
+	printf("1 target, debug enabled, per message:\n");
+	printf("  text file:         %6.1f ns\n", text);
+	printf("  binary file:       %6.1f ns\n", binary);
+
+	return 0;
+}
@@ -0,0 +1,290 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <osmocom/core/logging.h>
+#include <osmocom/core/logging_binary.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+
+/* enough messages to need more than one mapping of the file */
+#define NUM_BULK	50000
+
+enum {
+	DRLL,
+	DCC,
+};
+
+static const struct log_info_cat default_categories[] = {
+	[DRLL] = {
+		.name = "DRLL",
+		.description = "A-bis Radio Link Layer (RLL)",
+		.enabled = 1, .loglevel = LOGL_DEBUG,
+	},
+	[DCC] = {
+		.name = "DCC",
+		.description = "Layer3 Call Control (CC)",
+		.enabled = 1, .loglevel = LOGL_DEBUG,
+	},
+};
+
+static const struct log_info log_info = {
+	.cat = default_categories,
+	.num_cat = ARRAY_SIZE(default_categories),
+};
+
+static const char *long_str(void)
+{
+	static char str[LOG_BIN_MAX_REC + 100];
+
+	memset(str, 'x', sizeof(str) - 1);
+	return str;
+}
+
+static void log_messages(void)
+{
+	const char *null_str = NULL;
+	int i;
+
+	LOGP(DRLL, LOGL_NOTICE, "plain text\n");
+	LOGP(DRLL, LOGL_DEBUG, "int %d %i %u %x %05X %c|%%|\n",
+	     -42, 7, 3000000000U, 0xbeef, 0x2a, 'z');
+	LOGP(DCC, LOGL_INFO, "long %ld %lu %lld %llx %zu %td %jd\n",
+	     -1L, 2UL, -3LL, 0x123456789abcULL, (size_t) 5, (ptrdiff_t) -6,
+	     (intmax_t) 7);
+	LOGP(DCC, LOGL_ERROR, "short %hhd %hu\n", (char) -1, (unsigned short) 65535);
+	LOGP(DCC, LOGL_NOTICE, "double %f %.2e %g %Lf\n", 3.25, 1234.5, 0.1,
+	     (long double) 2.5);
+	LOGP(DRLL, LOGL_NOTICE, "str '%s' '%10s' '%-4s|' '%.3s' '%s'\n",
+	     "abc", "right", "l", "truncated", null_str);
+	LOGP(DRLL, LOGL_NOTICE, "star '%*d' '%-*d' '%.*s' '%*.*s'\n",
+	     6, 42, 4, 1, 2, "abcdef", 5, 1, "xyz");
+	LOGP(DRLL, LOGL_NOTICE, "continued");
+	LOGPC(DRLL, LOGL_NOTICE, " %s", "line");
+	LOGPC(DRLL, LOGL_NOTICE, "\n");
+	LOGP(DCC, LOGL_NOTICE, "huge %s\n", long_str());
+
+	/* the same call site is described only once */
+	for (i = 0; i < 3; i++)
+		LOGP(DCC, LOGL_NOTICE, "loop %d\n", i);
+}
+
+static void log_bulk(void)
+{
+	int i;
+
+	for (i = 0; i < NUM_BULK; i++)
+		LOGP(DRLL, LOGL_DEBUG, "bulk %d of %d: %s\n", i, NUM_BULK,
+		     "padding to make the record a little longer");
+}
+
+static uint8_t *read_file(const char *fname, size_t *len)
+{
+	FILE *f = fopen(fname, "r");
+	uint8_t *buf;
+
+	if (!f)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	*len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buf = malloc(*len);
+	if (fread(buf, 1, *len, f) != *len) {
+		free(buf);
+		buf = NULL;
+	}
+	fclose(f);
+
+	return buf;
+}
+
+static void decode(const char *fname)
+{
+	struct log_binary_reader *r;
+	struct log_binary_msg *msg;
+	size_t len;
+	uint8_t *buf;
+	char expect[256];
+	int rc, bulk = 0, bulk_ok = 0;
+
+	buf = read_file(fname, &len);
+	if (!buf) {
+		printf("could not read the file\n");
+		return;
+	}
+	printf("file is %s than 1 MiB\n", len > 1 << 20 ? "longer" : "shorter");
+
+	r = log_binary_reader_alloc(NULL, buf, len);
+	if (!r) {
+		printf("not a binary log file\n");
+		free(buf);
+		return;
+	}
+	msg = talloc_zero(r, struct log_binary_msg);
+
+	while ((rc = log_binary_reader_next(r, msg)) > 0) {
+		if (!strncmp(msg->text, "bulk ", 5)) {
+			snprintf(expect, sizeof(expect), "bulk %d of %d: %s\n",
+				 bulk, NUM_BULK,
+				 "padding to make the record a little longer");
+			if (!strcmp(msg->text, expect))
+				bulk_ok++;
+			bulk++;
+			continue;
+		}
+		if (!strncmp(msg->text, "huge ", 5)) {
+			printf("%s %s: huge message of %zu chars%s\n",
+			       msg->cat_name, log_level_str(msg->level),
+			       strlen(msg->text),
+			       msg->truncated ? ", truncated" : "");
+			continue;
+		}
+		if (msg->cont)
+			printf("%s", msg->text);
+		else
+			printf("%s %s %s:%s", msg->cat_name,
+			       log_level_str(msg->level),
+			       strcmp(msg->file, __FILE__) ? "?" : "file",
+			       msg->text);
+	}
+	printf("end of file: %d\n", rc);
+	printf("%d bulk messages, %d correct\n", bulk, bulk_ok);
+
+	talloc_free(r);
+	free(buf);
+}
+
+/* call sites only differing by file, and a conversion too long for the
+ * decoder, which must reject its message instead of skipping the
+ * argument and formatting the next ones with the wrong values */
+static void test_sites(void)
+{
+	const char *fname = "logging_binary_test2.blog";
+	static const char *fmt = "site %d\n";
+	struct log_binary_reader *r;
+	struct log_binary_msg *msg;
+	struct log_target *tgt;
+	size_t len;
+	uint8_t *buf;
+	int rc;
+
+	unlink(fname);
+	tgt = log_target_create_binary(fname);
+	log_set_all_filter(tgt, 1);
+	log_add_target(tgt);
+	logp2(DRLL, LOGL_NOTICE, "a.c", 10, 0, fmt, 1);
+	logp2(DRLL, LOGL_NOTICE, "b.c", 10, 0, fmt, 2);
+	LOGP(DRLL, LOGL_NOTICE, "wide %0000000000000000000000000000000008d %d\n",
+	     1, 2);
+	LOGP(DRLL, LOGL_NOTICE, "after\n");
+	log_target_destroy(tgt);
+
+	buf = read_file(fname, &len);
+	r = log_binary_reader_alloc(NULL, buf, len);
+	msg = talloc_zero(r, struct log_binary_msg);
+	while ((rc = log_binary_reader_next(r, msg)) != 0) {
+		if (rc < 0)
+			printf("rejected: %d\n", rc);
+		else if (!strncmp(msg->text, "site ", 5))
+			printf("%s:%d: %s", msg->file, msg->line, msg->text);
+		else
+			printf("%s", msg->text);
+	}
+
+	talloc_free(r);
+	free(buf);
+	unlink(fname);
+}
+
+/* a record longer than the writer ever makes, with a string argument
+ * longer than the decoder could format */
+static void test_long_record(void)
+{
+	static uint8_t buf[32768];
+	struct log_binary_hdr fh;
+	struct log_binary_rec_site site;
+	struct log_binary_rec_msg rec;
+	struct log_binary_reader *r;
+	struct log_binary_msg *msg;
+	uint16_t slen = 20000;
+	size_t ofs = 0;
+
+	memcpy(fh.magic, LOG_BIN_MAGIC, sizeof(fh.magic));
+	fh.version = LOG_BIN_VERSION;
+	fh.hdr_len = sizeof(fh);
+	memcpy(buf, &fh, sizeof(fh));
+	ofs += sizeof(fh);
+
+	memset(&site, 0, sizeof(site));
+	site.hdr.type = LOG_BIN_REC_SITE;
+	site.hdr.len = sizeof(site) + sizeof("x.c") + sizeof("%s\n");
+	memcpy(buf + ofs, &site, sizeof(site));
+	memcpy(buf + ofs + sizeof(site), "x.c\0%s\n", site.hdr.len -
+	       sizeof(site));
+	ofs += site.hdr.len;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.hdr.type = LOG_BIN_REC_MSG;
+	rec.hdr.len = sizeof(rec) + sizeof(slen) + slen;
+	rec.level = LOGL_NOTICE;
+	memcpy(buf + ofs, &rec, sizeof(rec));
+	memcpy(buf + ofs + sizeof(rec), &slen, sizeof(slen));
+	memset(buf + ofs + sizeof(rec) + sizeof(slen), 'a', slen);
+	ofs += rec.hdr.len;
+
+	r = log_binary_reader_alloc(NULL, buf, ofs);
+	msg = talloc_zero(r, struct log_binary_msg);
+	printf("long record: %d\n", log_binary_reader_next(r, msg));
+	talloc_free(r);
+}
+
+int main(int argc, char **argv)
+{
+	const char *fname = "logging_binary_test.blog";
+	struct log_target *tgt;
+
+	log_init(&log_info, NULL);
+
+	unlink(fname);
+	tgt = log_target_create_binary(fname);
+	if (!tgt) {
+		fprintf(stderr, "could not create the target\n");
+		return 1;
+	}
+	log_set_all_filter(tgt, 1);
+	log_add_target(tgt);
+
+	log_messages();
+	log_bulk();
+	log_target_destroy(tgt);
+
+	decode(fname);
+	unlink(fname);
+
+	test_sites();
+	test_long_record();
+
+	return 0;
+}
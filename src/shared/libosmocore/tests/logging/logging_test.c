@@ -48,6 +48,14 @@ static const struct log_info_cat default_categories[] = {
 	},
 };
 
+static int num_evaluated;
+
+static const char *evaluated(void)
+{
+	num_evaluated++;
+	return "";
+}
+
 const struct log_info log_info = {
 	.cat = default_categories,
 	.num_cat = ARRAY_SIZE(default_categories),
@@ -72,5 +80,22 @@ int main(int argc, char **argv)
 	DEBUGP(DCC, "You should see this\n");
 	DEBUGP(DMM, "You should not see this\n");
 
+	/* arguments of suppressed messages must not be evaluated */
+	log_set_category_filter(stderr_target, DRLL, 1, LOGL_NOTICE);
+	LOGP(DRLL, LOGL_NOTICE, "You should see this%s\n", evaluated());
+	LOGP(DRLL, LOGL_DEBUG, "You should not see this%s\n", evaluated());
+	printf("arguments evaluated: %d\n", num_evaluated);
+
+	printf("DRLL debug: %d notice: %d\n",
+	       log_check_level(DRLL, LOGL_DEBUG),
+	       log_check_level(DRLL, LOGL_NOTICE));
+	log_set_category_filter(stderr_target, DRLL, 0, LOGL_NOTICE);
+	printf("DRLL disabled, notice: %d\n",
+	       log_check_level(DRLL, LOGL_NOTICE));
+
+	log_del_target(stderr_target);
+	DEBUGP(DCC, "You should not see this%s\n", evaluated());
+	printf("arguments evaluated without targets: %d\n", num_evaluated);
+
 	return 0;
 }
@@ -0,0 +1,119 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/talloc.h>
+
+static void print_pool_ctrs(unsigned int size)
+{
+	struct rate_ctr_group *ctrg;
+
+	ctrg = rate_ctr_get_group_by_name_idx("msgb.pool", size);
+	if (!ctrg) {
+		printf("  pool %u: no counters\n", size);
+		return;
+	}
+
+	printf("  pool %u: hit=%llu miss=%llu cached=%llu released=%llu\n",
+		size,
+		(unsigned long long) rate_ctr_get_by_name(ctrg, "alloc.hit")->current,
+		(unsigned long long) rate_ctr_get_by_name(ctrg, "alloc.miss")->current,
+		(unsigned long long) rate_ctr_get_by_name(ctrg, "free.cached")->current,
+		(unsigned long long) rate_ctr_get_by_name(ctrg, "free.released")->current);
+}
+
+static int is_zero(const uint8_t *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (buf[i])
+			return 0;
+	}
+	return 1;
+}
+
+static void test_pool_reuse(void)
+{
+	struct msgb *msg, *msg2;
+
+	printf("Testing msgb pool re-use\n");
+
+	msg = msgb_alloc_headroom(200, 20, "test");
+	memset(msgb_put(msg, 100), 0xaa, 100);
+	msgb_free(msg);
+
+	msg2 = msgb_alloc(256, "test2");
+	printf("  re-used: %s\n", msg2 == msg ? "yes" : "no");
+	printf("  data_len=%u len=%u headroom=%u zero=%d\n", msg2->data_len,
+		msg2->len, msgb_headroom(msg2), is_zero(msg2->_data, 256));
+	memset(msgb_put(msg2, 100), 0x55, 100);
+	msgb_free(msg2);
+
+	msg = msgb_alloc_nozero(100, "test3");
+	printf("  re-used: %s\n", msg2 == msg ? "yes" : "no");
+	printf("  data_len=%u len=%u name=%s\n", msg->data_len, msg->len,
+		talloc_get_name(msg));
+	msgb_free(msg);
+
+	print_pool_ctrs(256);
+}
+
+static void test_pool_classes(void)
+{
+	struct msgb *msg;
+
+	printf("Testing msgb pool size classes\n");
+
+	msg = msgb_alloc(300, "test");
+	printf("  300: data_len=%u\n", msg->data_len);
+	msgb_free(msg);
+
+	msg = msgb_alloc(2048, "test");
+	printf("  2048: data_len=%u\n", msg->data_len);
+	msgb_free(msg);
+
+	/* larger than the largest class, not pooled at all */
+	msg = msgb_alloc(4096, "test");
+	printf("  4096: data_len=%u\n", msg->data_len);
+	msgb_free(msg);
+
+	print_pool_ctrs(512);
+	print_pool_ctrs(2048);
+
+	msgb_pool_flush();
+	msg = msgb_alloc(300, "test");
+	msgb_free(msg);
+	print_pool_ctrs(512);
+}
+
+int main(int argc, char **argv)
+{
+	test_pool_reuse();
+	test_pool_classes();
+
+	printf("Done\n");
+	return 0;
+}
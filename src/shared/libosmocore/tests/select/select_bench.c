@@ -0,0 +1,120 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* Compare the select() and epoll backends of osmo_select_main() with a
+ * growing number of registered, mostly idle file descriptors.  In every
+ * iteration one of them is made readable, so the cost measured is the
+ * per-iteration overhead of the select loop itself. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/eventfd.h>
+
+#include <osmocom/core/select.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+
+#define ITERATIONS	20000
+
+static unsigned int dispatched;
+
+static int bench_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	uint64_t val;
+
+	read(ofd->fd, &val, sizeof(val));
+	dispatched++;
+	return 0;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double run(enum osmo_select_backend backend, int num_fds)
+{
+	struct osmo_fd *ofds;
+	uint64_t one = 1, start, stop;
+	int i;
+
+	if (osmo_select_set_backend(backend) < 0) {
+		fprintf(stderr, "backend not supported\n");
+		exit(1);
+	}
+
+	ofds = talloc_zero_array(NULL, struct osmo_fd, num_fds);
+	for (i = 0; i < num_fds; i++) {
+		ofds[i].fd = eventfd(0, 0);
+		if (ofds[i].fd < 0) {
+			perror("eventfd");
+			exit(1);
+		}
+		ofds[i].when = BSC_FD_READ;
+		ofds[i].cb = bench_cb;
+		osmo_fd_register(&ofds[i]);
+	}
+
+	/* warm-up, lets the epoll backend populate its interest set */
+	osmo_select_main(1);
+
+	dispatched = 0;
+	start = now_ns();
+	for (i = 0; i < ITERATIONS; i++) {
+		write(ofds[(i * 7919) % num_fds].fd, &one, sizeof(one));
+		osmo_select_main(0);
+	}
+	stop = now_ns();
+
+	if (dispatched != ITERATIONS)
+		fprintf(stderr, "dispatched %u of %u events\n",
+			dispatched, ITERATIONS);
+
+	for (i = 0; i < num_fds; i++) {
+		osmo_fd_unregister(&ofds[i]);
+		close(ofds[i].fd);
+	}
+	talloc_free(ofds);
+
+	return (double)(stop - start) / ITERATIONS;
+}
+
+int main(int argc, char **argv)
+{
+	static const int num_fds[] = { 10, 100, 1000 };
+	int i;
+
+	printf("%8s %14s %14s\n", "fds", "select ns/it", "epoll ns/it");
+	for (i = 0; i < ARRAY_SIZE(num_fds); i++) {
+		double t_select, t_epoll;
+
+		t_select = run(OSMO_SELECT_BACKEND_SELECT, num_fds[i]);
+		t_epoll = run(OSMO_SELECT_BACKEND_EPOLL, num_fds[i]);
+		printf("%8d %14.0f %14.0f\n", num_fds[i], t_select, t_epoll);
+	}
+
+	return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <osmocom/core/select.h>
+#include <osmocom/core/utils.h>
+
+#define NUM_FDS	3
+
+static struct osmo_fd ofds[NUM_FDS];
+static int pipes[NUM_FDS][2];
+/* index of an fd that the call-back of ofds[0] shall unregister */
+static int victim = -1;
+
+static int fd_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	char buf[16];
+
+	printf("  fd %u:%s%s\n", ofd->priv_nr,
+		what & BSC_FD_READ ? " READ" : "",
+		what & BSC_FD_WRITE ? " WRITE" : "");
+
+	if (what & BSC_FD_READ)
+		read(ofd->fd, buf, sizeof(buf));
+
+	if (what & BSC_FD_WRITE)
+		ofd->when &= ~BSC_FD_WRITE;
+
+	if (ofd->priv_nr == 0 && victim >= 0) {
+		printf("  unregistering fd %d\n", victim);
+		osmo_fd_unregister(&ofds[victim]);
+		victim = -1;
+	}
+
+	return 0;
+}
+
+static void run_round(const char *name)
+{
+	int rc;
+
+	printf(" %s\n", name);
+	rc = osmo_select_main(1);
+	printf(" work=%d\n", rc);
+}
+
+static void test_backend(enum osmo_select_backend backend, const char *name)
+{
+	int i;
+
+	printf("Testing %s backend\n", name);
+
+	if (osmo_select_set_backend(backend) < 0) {
+		fprintf(stderr, "cannot use %s backend\n", name);
+		exit(1);
+	}
+
+	for (i = 0; i < NUM_FDS; i++) {
+		if (pipe(pipes[i]) < 0)
+			exit(1);
+		ofds[i].fd = pipes[i][0];
+		ofds[i].when = BSC_FD_READ;
+		/* fd 2 starts out without any interest */
+		if (i == 2) {
+			ofds[i].fd = pipes[i][1];
+			ofds[i].when = 0;
+		}
+		ofds[i].cb = fd_cb;
+		ofds[i].priv_nr = i;
+		osmo_fd_register(&ofds[i]);
+	}
+
+	run_round("nothing ready");
+
+	write(pipes[1][1], "x", 1);
+	run_round("fd 1 readable");
+
+	/* interest changed behind the back of the select code */
+	ofds[2].when = BSC_FD_WRITE;
+	run_round("fd 2 write interest");
+	run_round("fd 2 write interest dropped");
+
+	/* fd 1 is ready but becomes unregistered by the call-back of fd 0 */
+	write(pipes[0][1], "x", 1);
+	write(pipes[1][1], "x", 1);
+	victim = 1;
+	run_round("fd 0 unregisters fd 1");
+
+	osmo_fd_unregister(&ofds[0]);
+	osmo_fd_unregister(&ofds[2]);
+	for (i = 0; i < NUM_FDS; i++) {
+		close(pipes[i][0]);
+		close(pipes[i][1]);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	test_backend(OSMO_SELECT_BACKEND_SELECT, "select");
+	test_backend(OSMO_SELECT_BACKEND_EPOLL, "epoll");
+	test_backend(OSMO_SELECT_BACKEND_SELECT, "select");
+
+	printf("Done\n");
+	return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* Measure the cost of arming, cancelling and expiring osmo_timers while
+ * a large number of timers (as with many MS instances running LAPDm and
+ * RR timers) is pending. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/timer.h>
+
+#define NUM_TIMERS	100000
+#define NUM_EXPIRE	10000
+
+static unsigned int fired;
+
+static void timer_cb(void *data)
+{
+	fired++;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	struct osmo_timer_list *timers, *expire;
+	uint64_t start, stop;
+	int i;
+
+	timers = talloc_zero_array(NULL, struct osmo_timer_list, NUM_TIMERS);
+	expire = talloc_zero_array(NULL, struct osmo_timer_list, NUM_EXPIRE);
+	srandom(1);
+
+	/* arm: populate with timers between 1 and 60 seconds from now */
+	start = now_ns();
+	for (i = 0; i < NUM_TIMERS; i++) {
+		timers[i].cb = timer_cb;
+		osmo_timer_schedule(&timers[i], 1 + random() % 60,
+				    random() % 1000000);
+	}
+	stop = now_ns();
+	printf("arm:     %6.1f ns/timer (%u live)\n",
+		(double)(stop - start) / NUM_TIMERS, osmo_timers_check());
+
+	/* re-arm: what LAPDm T200/T203 do on every frame */
+	start = now_ns();
+	for (i = 0; i < NUM_TIMERS; i++)
+		osmo_timer_schedule(&timers[i], 1 + random() % 60,
+				    random() % 1000000);
+	stop = now_ns();
+	printf("re-arm:  %6.1f ns/timer\n", (double)(stop - start) / NUM_TIMERS);
+
+	/* expire: timers that are due right away, with all the others
+	 * still pending */
+	for (i = 0; i < NUM_EXPIRE; i++) {
+		expire[i].cb = timer_cb;
+		osmo_timer_schedule(&expire[i], 0, 0);
+	}
+	start = now_ns();
+	osmo_timers_prepare();
+	osmo_timers_update();
+	stop = now_ns();
+	printf("expire:  %6.1f ns/timer (%u fired)\n",
+		(double)(stop - start) / NUM_EXPIRE, fired);
+
+	/* cancel */
+	start = now_ns();
+	for (i = 0; i < NUM_TIMERS; i++)
+		osmo_timer_del(&timers[i]);
+	stop = now_ns();
+	printf("cancel:  %6.1f ns/timer (%u live)\n",
+		(double)(stop - start) / NUM_TIMERS, osmo_timers_check());
+
+	talloc_free(timers);
+	talloc_free(expire);
+
+	return 0;
+}
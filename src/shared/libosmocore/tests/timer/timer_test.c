@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include <getopt.h>
 #include <unistd.h>
@@ -139,6 +140,34 @@ static void secondary_timer_fired(void *data)
 	}
 }
 
+static char fired[8];
+
+static void order_timer_fired(void *data)
+{
+	strncat(fired, data, 1);
+}
+
+/* timers fire in the order of their timeouts, those of the same timeout
+ * in the order they were added */
+static void test_order(void)
+{
+	static struct osmo_timer_list t[4];
+	static const int usec[4] = { 5500, 5200, 5500, 4000 };
+	static const char *names = "ABCD";
+	int i;
+
+	osmo_timers_prepare();
+	for (i = 0; i < 4; i++) {
+		t[i].cb = order_timer_fired;
+		t[i].data = (void *) &names[i];
+		osmo_timer_schedule(&t[i], 0, usec[i]);
+	}
+	usleep(20000);
+	osmo_timers_update();
+
+	fprintf(stdout, "timer order: %s\n", fired);
+}
+
 static void alarm_handler(int signum)
 {
 	fprintf(stderr, "ERROR: We took too long to run the timer test, "
@@ -170,6 +199,8 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	test_order();
+
 	fprintf(stdout, "Running timer test for %u steps, accepting "
 		"imprecision of %u.%.6u seconds\n",
 		timer_nsteps, TIMER_PRES_SECS, TIMER_PRES_USECS);
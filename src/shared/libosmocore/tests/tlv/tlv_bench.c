@@ -0,0 +1,165 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* Time per message to parse the corpus and look at its IEs, the way
+ * tlv_parse() did it before the present bitmap, clearing all 256
+ * entries and going through tlv_parse_one(), and as it does now. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "tlv_corpus.h"
+
+/* messages per measurement are scaled to take about this long */
+#define RUN_NS		200000000ULL
+
+static volatile unsigned int sink;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct legacy_parsed {
+	struct tlv_p_entry lv[256];
+};
+
+static int legacy_parse(struct legacy_parsed *dec,
+			const struct tlv_definition *def,
+			const uint8_t *buf, int buf_len)
+{
+	int ofs = 0, num_parsed = 0;
+
+	memset(dec, 0, sizeof(*dec));
+
+	while (ofs < buf_len) {
+		int rv;
+		uint8_t tag;
+		uint16_t len;
+		const uint8_t *val;
+
+		rv = tlv_parse_one(&tag, &len, &val, def,
+		                   &buf[ofs], buf_len-ofs);
+		if (rv < 0)
+			return rv;
+		dec->lv[tag].val = val;
+		dec->lv[tag].len = len;
+		ofs += rv;
+		num_parsed++;
+	}
+
+	return num_parsed;
+}
+
+/* parse every message of a group and check for a few IEs, like the
+ * receive path of a protocol does */
+static void run(const char *prefix, int legacy, unsigned int n)
+{
+	const struct tlv_definition *defs[ARRAY_SIZE(tlv_corpus)];
+	struct legacy_parsed lp;
+	struct tlv_parsed tp;
+	unsigned int acc = 0, i;
+	int m;
+
+	for (m = 0; m < ARRAY_SIZE(tlv_corpus); m++)
+		defs[m] = tlv_corpus_def(&tlv_corpus[m]);
+
+	for (i = 0; i < n; i++) {
+		for (m = 0; m < ARRAY_SIZE(tlv_corpus); m++) {
+			const struct tlv_corpus_msg *c = &tlv_corpus[m];
+
+			if (strncmp(c->name, prefix, strlen(prefix)))
+				continue;
+			if (legacy) {
+				acc += legacy_parse(&lp, defs[m], c->buf, c->len);
+				acc += lp.lv[c->buf[0]].len;
+				acc += !!lp.lv[0x01].val + !!lp.lv[0x17].val;
+			} else {
+				acc += tlv_parse(&tp, defs[m], c->buf, c->len,
+						 0, 0);
+				acc += TLVP_LEN(&tp, c->buf[0]);
+				acc += !!TLVP_PRESENT(&tp, 0x01) +
+				       !!TLVP_PRESENT(&tp, 0x17);
+			}
+		}
+	}
+	sink = acc;
+}
+
+static double ns_per_msg(const char *prefix, int legacy)
+{
+	unsigned int n = 10, msgs = 0;
+	uint64_t t;
+	int m;
+
+	for (m = 0; m < ARRAY_SIZE(tlv_corpus); m++) {
+		if (!strncmp(tlv_corpus[m].name, prefix, strlen(prefix)))
+			msgs++;
+	}
+
+	/* double the rounds until the run is long enough to tell */
+	while (1) {
+		t = now_ns();
+		run(prefix, legacy, n);
+		t = now_ns() - t;
+		if (t >= RUN_NS / 4)
+			break;
+		n *= 2;
+	}
+	n = n * RUN_NS / t + 1;
+
+	t = now_ns();
+	run(prefix, legacy, n);
+	t = now_ns() - t;
+
+	return (double)t / ((double)n * msgs);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		const char *name;
+		const char *prefix;
+	} groups[] = {
+		{ "RSL", "rsl_" },
+		{ "04.08 CC", "cc_" },
+		{ "04.08 RR", "rr_" },
+		{ "04.08 MM", "mm_" },
+		{ "08.08", "bssmap_" },
+		{ "BSSGP", "bssgp_" },
+	};
+	double legacy, now;
+	int g;
+
+	for (g = 0; g < ARRAY_SIZE(groups); g++) {
+		legacy = ns_per_msg(groups[g].prefix, 1);
+		now = ns_per_msg(groups[g].prefix, 0);
+		printf("%-12s legacy %7.1f ns/msg  tlv_parse %7.1f ns/msg %6.2fx\n",
+		       groups[g].name, legacy, now, legacy / now);
+	}
+
+	return 0;
+}
@@ -0,0 +1,250 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* The IE part of messages as the stack parses them, after the header
+ * of each protocol: RSL as seen by a BTS and BSC, GSM 04.08 CC, RR and
+ * MM, GSM 08.08 BSSMAP and BSSGP. */
+
+#include <stdint.h>
+
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/tlv.h>
+#include <osmocom/gsm/gsm48.h>
+#include <osmocom/gsm/gsm0808.h>
+#include <osmocom/gsm/rsl.h>
+#include <osmocom/gsm/protocol/gsm_04_08.h>
+#include <osmocom/gsm/protocol/gsm_08_08.h>
+#include <osmocom/gsm/protocol/gsm_08_58.h>
+#include <osmocom/gprs/protocol/gsm_08_18.h>
+
+#define L2_FILL		0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b
+
+/* RSL */
+
+static const uint8_t rsl_data_ind[] = {
+	RSL_IE_CHAN_NR, 0x20,
+	RSL_IE_LINK_IDENT, 0x00,
+	RSL_IE_L3_INFO, 0x00, 0x17,
+		0x01, 0x03, 0x41, 0x05, 0x08, 0x11, 0x02, 0xf8,
+		0x10, 0x00, 0x01, 0x33, 0x08, 0x49, 0x06, 0x10,
+		0x32, 0x54, 0x76, 0x98, 0x2b, 0x2b, 0x2b,
+};
+
+static const uint8_t rsl_meas_res[] = {
+	RSL_IE_CHAN_NR, 0x20,
+	RSL_IE_MEAS_RES_NR, 0x2a,
+	RSL_IE_UPLINK_MEAS, 0x03, 0x2c, 0x2b, 0x12,
+	RSL_IE_BS_POWER, 0x00,
+	RSL_IE_L1_INFO, 0x05, 0x01,
+	RSL_IE_L3_INFO, 0x00, 0x12,
+		0x06, 0x15, 0x2c, 0x2b, 0x12, 0x40, 0x10, 0x22,
+		0x33, 0x18, 0x44, 0x12, 0x0a, 0x50, 0x21, 0x00,
+		0x00, 0x00,
+	RSL_IE_MS_TIMING_OFFSET, 0x02,
+};
+
+static const uint8_t rsl_chan_activ[] = {
+	RSL_IE_CHAN_NR, 0x20,
+	RSL_IE_ACT_TYPE, 0x00,
+	RSL_IE_CHAN_MODE, 0x04, 0x00, 0x00, 0x03, 0x00,
+	RSL_IE_BS_POWER, 0x00,
+	RSL_IE_MS_POWER, 0x05,
+	RSL_IE_TIMING_ADVANCE, 0x01,
+	RSL_IE_MS_POWER_PARAM, 0x00,
+};
+
+static const uint8_t rsl_chan_rqd[] = {
+	RSL_IE_CHAN_NR, 0x90,
+	RSL_IE_REQ_REFERENCE, 0x0e, 0x0b, 0x5c,
+	RSL_IE_ACCESS_DELAY, 0x01,
+};
+
+static const uint8_t rsl_paging_cmd[] = {
+	RSL_IE_CHAN_NR, 0x90,
+	RSL_IE_PAGING_GROUP, 0x03,
+	RSL_IE_MS_IDENTITY, 0x05, 0xf4, 0x12, 0x34, 0x56, 0x78,
+	RSL_IE_CHAN_NEEDED, 0x00,
+};
+
+static const uint8_t rsl_imm_ass_cmd[] = {
+	RSL_IE_CHAN_NR, 0x90,
+	RSL_IE_FULL_IMM_ASS_INFO, 0x17,
+		0x2d, 0x06, 0x3f, 0x03, 0x40, 0xe0, 0x0e, 0x0b,
+		0x5c, 0x01, 0x00, L2_FILL, 0x2b, 0x2b, 0x2b, 0x2b,
+};
+
+static const uint8_t rsl_bcch_info[] = {
+	RSL_IE_CHAN_NR, 0x80,
+	RSL_IE_SYSINFO_TYPE, 0x02,
+	RSL_IE_FULL_BCCH_INFO, 0x17,
+		0x55, 0x06, 0x19, 0x8f, 0x81, 0x40, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x2b,
+};
+
+static const uint8_t rsl_ipac_crcx_ack[] = {
+	RSL_IE_CHAN_NR, 0x09,
+	RSL_IE_IPAC_CONN_ID, 0x00, 0x01,
+	RSL_IE_IPAC_LOCAL_PORT, 0x0f, 0xa0,
+	RSL_IE_IPAC_LOCAL_IP, 0xc0, 0xa8, 0x00, 0x02,
+	RSL_IE_IPAC_SPEECH_MODE, 0x10,
+	RSL_IE_IPAC_RTP_PAYLOAD2, 0x62,
+};
+
+/* GSM 04.08 */
+
+static const uint8_t cc_setup_mt[] = {
+	GSM48_IE_BEARER_CAP, 0x03, 0xa0, 0x04, 0x01,
+	GSM48_IE_PROGR_IND, 0x02, 0xe1, 0x88,
+	GSM48_IE_SIGNAL, 0x00,
+	GSM48_IE_CALLING_BCD, 0x07, 0x21, 0x80, 0x21, 0x43, 0x65, 0x87, 0xf9,
+	GSM48_IE_FACILITY, 0x04, 0xa1, 0x02, 0x02, 0x01,
+};
+
+static const uint8_t cc_release[] = {
+	GSM48_IE_CAUSE, 0x02, 0xe0, 0x90,
+	GSM48_IE_FACILITY, 0x03, 0xa2, 0x01, 0x00,
+};
+
+static const uint8_t rr_ass_cmd[] = {
+	/* the mandatory part is parsed by the caller */
+	GSM48_IE_CHANMODE_1, 0x01,
+	GSM48_IE_CIP_MODE_SET | 0x03,
+	GSM48_IE_MUL_RATE_CFG, 0x04, 0x20, 0x14, 0x00, 0x00,
+	GSM48_IE_START_TIME, 0x5c, 0x0e,
+};
+
+static const uint8_t mm_loc_upd_acc[] = {
+	GSM48_IE_MOBILE_ID, 0x05, 0xf4, 0x11, 0x22, 0x33, 0x44,
+	GSM48_IE_FOLLOW_ON_PROC,
+	GSM48_IE_PRIORITY_LEV | 0x02,
+};
+
+static const uint8_t mm_info[] = {
+	GSM48_IE_NAME_LONG, 0x08, 0x81, 0x4f, 0x73, 0x6d, 0x6f, 0x63, 0x6f,
+		0x6d,
+	GSM48_IE_NET_TIME_TZ, 0x31, 0x20, 0x11, 0x21, 0x43, 0x05, 0x40,
+	GSM48_IE_UTC, 0x40,
+};
+
+/* GSM 08.08 */
+
+static const uint8_t bssmap_ass_req[] = {
+	GSM0808_IE_CHANNEL_TYPE, 0x03, 0x01, 0x08, 0x01,
+	GSM0808_IE_CIRCUIT_IDENTITY_CODE, 0x00, 0x1f,
+};
+
+static const uint8_t bssmap_compl_l3[] = {
+	GSM0808_IE_CELL_IDENTIFIER, 0x05, 0x01, 0x00, 0x01, 0x00, 0x01,
+	GSM0808_IE_LAYER_3_INFORMATION, 0x11,
+		0x05, 0x08, 0x70, 0x00, 0xf1, 0x10, 0x00, 0x01,
+		0x33, 0x08, 0x49, 0x06, 0x10, 0x32, 0x54, 0x76,
+		0x98,
+	GSM0808_IE_CHOSEN_CHANNEL, 0x09,
+};
+
+static const uint8_t bssmap_paging[] = {
+	GSM0808_IE_IMSI, 0x08, 0x29, 0x10, 0x32, 0x54, 0x76, 0x98, 0x10, 0xf2,
+	GSM0808_IE_CELL_IDENTIFIER_LIST, 0x03, 0x05, 0x00, 0x01,
+	GSM0808_IE_CHANNEL_NEEDED, 0x00,
+};
+
+/* BSSGP, every IE has its length in one or two octets */
+
+static const uint8_t bssgp_ul_unitdata[] = {
+	/* TLLI and QoS are in the header, parsed by the caller */
+	BSSGP_IE_CELL_ID, 0x88, 0x00, 0xf1, 0x10, 0x00, 0x01, 0x01, 0x00, 0x01,
+	BSSGP_IE_ALIGNMENT, 0x80,
+	BSSGP_IE_LLC_PDU, 0x9b,
+		0x01, 0xc0, 0x01, 0x08, 0x01, 0x02, 0xf5, 0xe0,
+		0x21, 0x08, 0x02, 0x05, 0xf4, 0x11, 0x22, 0x33,
+		0x44, 0x00, 0xf1, 0x10, 0x00, 0x01, 0xff, 0x00,
+		0x12, 0x34, 0x56,
+};
+
+static const uint8_t bssgp_dl_unitdata[] = {
+	BSSGP_IE_PDU_LIFETIME, 0x82, 0x02, 0x58,
+	BSSGP_IE_MS_RADIO_ACCESS_CAP, 0x87,
+		0x13, 0x63, 0x21, 0x44, 0x46, 0x02, 0x00,
+	BSSGP_IE_PRIORITY, 0x81, 0x00,
+	BSSGP_IE_DRX_PARAMS, 0x82, 0x00, 0x00,
+	BSSGP_IE_IMSI, 0x88, 0x29, 0x10, 0x32, 0x54, 0x76, 0x98, 0x10, 0xf2,
+	BSSGP_IE_ALIGNMENT, 0x81, 0x00,
+	/* a long PDU has a two octet length */
+	BSSGP_IE_LLC_PDU, 0x00, 0x90,
+		L2_FILL, L2_FILL, L2_FILL, L2_FILL, L2_FILL, L2_FILL,
+		L2_FILL, L2_FILL, L2_FILL, L2_FILL, L2_FILL, L2_FILL,
+		L2_FILL, L2_FILL, L2_FILL, L2_FILL, L2_FILL, L2_FILL,
+};
+
+static const uint8_t bssgp_paging_ps[] = {
+	BSSGP_IE_IMSI, 0x88, 0x29, 0x10, 0x32, 0x54, 0x76, 0x98, 0x10, 0xf2,
+	BSSGP_IE_DRX_PARAMS, 0x82, 0x00, 0x00,
+	BSSGP_IE_BVCI, 0x82, 0x00, 0x02,
+	BSSGP_IE_QOS_PROFILE, 0x83, 0x00, 0x64, 0x20,
+	BSSGP_IE_TMSI, 0x84, 0xc0, 0x01, 0x02, 0x03,
+};
+
+static const uint8_t bssgp_fc_bvc[] = {
+	BSSGP_IE_TAG, 0x81, 0x05,
+	BSSGP_IE_BVC_BUCKET_SIZE, 0x82, 0x10, 0x00,
+	BSSGP_IE_BUCKET_LEAK_RATE, 0x82, 0x00, 0x64,
+	BSSGP_IE_BMAX_DEFAULT_MS, 0x82, 0x02, 0x00,
+	BSSGP_IE_R_DEFAULT_MS, 0x82, 0x00, 0x10,
+};
+
+struct tlv_corpus_msg {
+	const char *name;
+	const struct tlv_definition *def;
+	const uint8_t *buf;
+	int len;
+};
+
+#define CORPUS_MSG(n, d)	{ #n, d, n, sizeof(n) }
+
+static const struct tlv_corpus_msg tlv_corpus[] = {
+	CORPUS_MSG(rsl_data_ind, &rsl_att_tlvdef),
+	CORPUS_MSG(rsl_meas_res, &rsl_att_tlvdef),
+	CORPUS_MSG(rsl_chan_activ, &rsl_att_tlvdef),
+	CORPUS_MSG(rsl_chan_rqd, &rsl_att_tlvdef),
+	CORPUS_MSG(rsl_paging_cmd, &rsl_att_tlvdef),
+	CORPUS_MSG(rsl_imm_ass_cmd, &rsl_att_tlvdef),
+	CORPUS_MSG(rsl_bcch_info, &rsl_att_tlvdef),
+	CORPUS_MSG(rsl_ipac_crcx_ack, &rsl_att_tlvdef),
+	CORPUS_MSG(cc_setup_mt, &gsm48_att_tlvdef),
+	CORPUS_MSG(cc_release, &gsm48_att_tlvdef),
+	CORPUS_MSG(rr_ass_cmd, &gsm48_rr_att_tlvdef),
+	CORPUS_MSG(mm_loc_upd_acc, &gsm48_mm_att_tlvdef),
+	CORPUS_MSG(mm_info, &gsm48_mm_att_tlvdef),
+	CORPUS_MSG(bssmap_ass_req, NULL),
+	CORPUS_MSG(bssmap_compl_l3, NULL),
+	CORPUS_MSG(bssmap_paging, NULL),
+	CORPUS_MSG(bssgp_ul_unitdata, &tvlv_att_def),
+	CORPUS_MSG(bssgp_dl_unitdata, &tvlv_att_def),
+	CORPUS_MSG(bssgp_paging_ps, &tvlv_att_def),
+	CORPUS_MSG(bssgp_fc_bvc, &tvlv_att_def),
+};
+
+/* the definition of a corpus message, the 08.08 one is not exported */
+static inline const struct tlv_definition *
+tlv_corpus_def(const struct tlv_corpus_msg *m)
+{
+	return m->def ? m->def : gsm0808_att_tlvdef();
+}
@@ -0,0 +1,329 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "tlv_corpus.h"
+
+/* tlv_parse() compiles the tables of up to 32 definitions, the
+ * definitions beyond are parsed one IE at a time */
+#define NUM_RANDOM_DEFS		40
+#define FUZZ_ROUNDS		2000
+#define FUZZ_MAX_LEN		64
+/* tlv_parse_one() may look at up to two octets past the buffer */
+#define FUZZ_SLACK		4
+
+/* what tlv_parse() did before the present bitmap */
+struct ref_parsed {
+	struct tlv_p_entry lv[256];
+};
+
+static int ref_parse(struct ref_parsed *dec, const struct tlv_definition *def,
+		     const uint8_t *buf, int buf_len, uint8_t lv_tag,
+		     uint8_t lv_tag2)
+{
+	int ofs = 0, num_parsed = 0;
+	uint16_t len;
+
+	memset(dec, 0, sizeof(*dec));
+
+	if (lv_tag) {
+		if (ofs > buf_len)
+			return -1;
+		dec->lv[lv_tag].val = &buf[ofs+1];
+		dec->lv[lv_tag].len = buf[ofs];
+		len = dec->lv[lv_tag].len + 1;
+		if (ofs + len > buf_len)
+			return -2;
+		num_parsed++;
+		ofs += len;
+	}
+	if (lv_tag2) {
+		if (ofs > buf_len)
+			return -1;
+		dec->lv[lv_tag2].val = &buf[ofs+1];
+		dec->lv[lv_tag2].len = buf[ofs];
+		len = dec->lv[lv_tag2].len + 1;
+		if (ofs + len > buf_len)
+			return -2;
+		num_parsed++;
+		ofs += len;
+	}
+
+	while (ofs < buf_len) {
+		int rv;
+		uint8_t tag;
+		const uint8_t *val;
+
+		rv = tlv_parse_one(&tag, &len, &val, def,
+		                   &buf[ofs], buf_len-ofs);
+		if (rv < 0)
+			return rv;
+		dec->lv[tag].val = val;
+		dec->lv[tag].len = len;
+		ofs += rv;
+		num_parsed++;
+	}
+
+	return num_parsed;
+}
+
+/* parse with both and compare all tags, the parsed result of tlv_parse()
+ * starts out with stale entries */
+static int check_parse(const char *name, const struct tlv_definition *def,
+		       const uint8_t *buf, int len, uint8_t lv_tag,
+		       uint8_t lv_tag2)
+{
+	struct ref_parsed ref;
+	struct tlv_parsed tp;
+	int rc_ref, rc, i;
+
+	memset(&tp, 0xa5, sizeof(tp));
+	rc_ref = ref_parse(&ref, def, buf, len, lv_tag, lv_tag2);
+	rc = tlv_parse(&tp, def, buf, len, lv_tag, lv_tag2);
+	if (rc != rc_ref) {
+		printf("%s: rc %d, expected %d\n", name, rc, rc_ref);
+		return -1;
+	}
+	/* the entries are only meaningful if the buffer was parsed */
+	if (rc < 0)
+		return 0;
+
+	for (i = 0; i < 256; i++) {
+		if (TLVP_PRESENT(&tp, i) != ref.lv[i].val ||
+		    (ref.lv[i].val && (TLVP_VAL(&tp, i) != ref.lv[i].val ||
+				       TLVP_LEN(&tp, i) != ref.lv[i].len))) {
+			printf("%s: IE 0x%02x differs\n", name, i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void test_corpus(void)
+{
+	int i, ok = 1;
+
+	for (i = 0; i < ARRAY_SIZE(tlv_corpus); i++) {
+		const struct tlv_corpus_msg *m = &tlv_corpus[i];
+		struct tlv_parsed tp;
+		int rc;
+
+		if (check_parse(m->name, tlv_corpus_def(m), m->buf, m->len,
+				0, 0) < 0)
+			ok = 0;
+
+		/* every message of the corpus parses to the end */
+		rc = tlv_parse(&tp, tlv_corpus_def(m), m->buf, m->len, 0, 0);
+		if (rc <= 0) {
+			printf("%s: rc %d\n", m->name, rc);
+			ok = 0;
+		}
+	}
+
+	printf("corpus: %s\n", ok ? "OK" : "FAIL");
+}
+
+static void test_lookup(void)
+{
+	static const uint8_t tags[] = { RSL_IE_UPLINK_MEAS };
+	struct tlv_parsed tp;
+	int ok = 1, i;
+
+	tlv_parse(&tp, &rsl_att_tlvdef, rsl_meas_res, sizeof(rsl_meas_res),
+		  0, 0);
+	if (!TLVP_PRESENT(&tp, RSL_IE_UPLINK_MEAS) ||
+	    TLVP_LEN(&tp, RSL_IE_UPLINK_MEAS) != 3 ||
+	    TLVP_VAL(&tp, RSL_IE_UPLINK_MEAS)[2] != 0x12)
+		ok = 0;
+	if (TLVP_LEN(&tp, RSL_IE_L3_INFO) != 0x12)
+		ok = 0;
+	if (TLVP_PRESENT(&tp, RSL_IE_LINK_IDENT))
+		ok = 0;
+	/* the arguments are evaluated once */
+	i = 0;
+	if (TLVP_PRESENT(&tp, tags[i++]) != TLVP_VAL(&tp, RSL_IE_UPLINK_MEAS) ||
+	    i != 1)
+		ok = 0;
+
+	/* single octet TV IEs go by their upper nibble */
+	tlv_parse(&tp, &gsm48_rr_att_tlvdef, rr_ass_cmd, sizeof(rr_ass_cmd),
+		  0, 0);
+	if (!TLVP_PRESENT(&tp, GSM48_IE_CIP_MODE_SET) ||
+	    (*TLVP_VAL(&tp, GSM48_IE_CIP_MODE_SET) & 0x0f) != 0x03 ||
+	    TLVP_PRESENT(&tp, GSM48_IE_CIP_MODE_SET | 0x03))
+		ok = 0;
+
+	/* a long PDU has a two octet length */
+	tlv_parse(&tp, &tvlv_att_def, bssgp_dl_unitdata,
+		  sizeof(bssgp_dl_unitdata), 0, 0);
+	if (TLVP_LEN(&tp, BSSGP_IE_LLC_PDU) != 0x90 ||
+	    TLVP_LEN(&tp, BSSGP_IE_ALIGNMENT) != 1)
+		ok = 0;
+
+	printf("lookup: %s\n", ok ? "OK" : "FAIL");
+}
+
+static void test_lv_tags(void)
+{
+	/* a message with two mandatory LV IEs in front of the TLV ones */
+	static const uint8_t buf[] = {
+		0x02, 0xaa, 0xbb,
+		0x01, 0xcc,
+		GSM48_IE_CAUSE, 0x02, 0xe0, 0x90,
+	};
+	int ok = 1;
+
+	if (check_parse("lv", &gsm48_att_tlvdef, buf, sizeof(buf), 0xf1, 0) < 0
+	 || check_parse("lv2", &gsm48_att_tlvdef, buf, sizeof(buf), 0xf1, 0xf2) < 0
+	 || check_parse("lv short", &gsm48_att_tlvdef, buf, 2, 0xf1, 0) < 0
+	 || check_parse("lv2 short", &gsm48_att_tlvdef, buf, 4, 0xf1, 0xf2) < 0)
+		ok = 0;
+
+	printf("lv tags: %s\n", ok ? "OK" : "FAIL");
+}
+
+static void test_def_patch(void)
+{
+	static struct tlv_definition def, master;
+	static const uint8_t buf[] = {
+		0x01, 0x02, 0xaa, 0xbb,
+		0x42, 0x01, 0xcc,
+	};
+	struct tlv_parsed tp;
+	int ok = 1;
+
+	def.def[0x01].type = TLV_TYPE_TLV;
+	master.def[0x42].type = TLV_TYPE_TLV;
+
+	/* unknown IE before the patch, known after it */
+	if (tlv_parse(&tp, &def, buf, sizeof(buf), 0, 0) != -3)
+		ok = 0;
+	tlv_def_patch(&def, &master);
+	if (tlv_parse(&tp, &def, buf, sizeof(buf), 0, 0) != 2 ||
+	    TLVP_LEN(&tp, 0x42) != 1)
+		ok = 0;
+
+	printf("def patch: %s\n", ok ? "OK" : "FAIL");
+}
+
+static const uint8_t tlv_types[] = {
+	TLV_TYPE_NONE, TLV_TYPE_FIXED, TLV_TYPE_T, TLV_TYPE_TV,
+	TLV_TYPE_TLV, TLV_TYPE_TL16V, TLV_TYPE_TvLV, TLV_TYPE_SINGLE_TV,
+	TLV_TYPE_vTvLV_GAN,
+};
+
+static void random_def(struct tlv_definition *def)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		def->def[i].type = tlv_types[rand() % ARRAY_SIZE(tlv_types)];
+		/* keep the single octet IEs rare, like they are */
+		if (def->def[i].type == TLV_TYPE_SINGLE_TV && (rand() & 7))
+			def->def[i].type = TLV_TYPE_TLV;
+		def->def[i].fixed_len = rand() % 8;
+	}
+}
+
+/* random buffers, built from IEs of the definition now and then so they
+ * get further than the first octet */
+static int random_buf(const struct tlv_definition *def, uint8_t *buf)
+{
+	int len = rand() % FUZZ_MAX_LEN, ofs = 0, i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = rand();
+	for (i = len; i < len + FUZZ_SLACK; i++)
+		buf[i] = 0;
+	if (rand() & 1)
+		return len;
+
+	while (ofs + 2 < len) {
+		uint8_t tag = buf[ofs];
+
+		switch (def->def[tag].type) {
+		case TLV_TYPE_TLV:
+		case TLV_TYPE_TvLV:
+		case TLV_TYPE_vTvLV_GAN:
+			buf[ofs + 1] = rand() % 8;
+			if (rand() & 1)
+				buf[ofs + 1] |= 0x80;
+			ofs += 2 + (buf[ofs + 1] & 0x7f);
+			break;
+		case TLV_TYPE_TL16V:
+			buf[ofs + 1] = 0;
+			buf[ofs + 2] = rand() % 8;
+			ofs += 3 + buf[ofs + 2];
+			break;
+		default:
+			ofs++;
+			break;
+		}
+	}
+
+	return len;
+}
+
+static void test_fuzz(void)
+{
+	static struct tlv_definition defs[NUM_RANDOM_DEFS];
+	static const struct tlv_definition *known[] = {
+		&rsl_att_tlvdef, &gsm48_att_tlvdef, &gsm48_rr_att_tlvdef,
+		&gsm48_mm_att_tlvdef, &tvlv_att_def, NULL,
+	};
+	uint8_t buf[FUZZ_MAX_LEN + FUZZ_SLACK];
+	int i, r, ok = 1;
+
+	srand(0x7e57);
+	known[ARRAY_SIZE(known) - 1] = gsm0808_att_tlvdef();
+	for (i = 0; i < NUM_RANDOM_DEFS; i++)
+		random_def(&defs[i]);
+
+	for (r = 0; r < FUZZ_ROUNDS && ok; r++) {
+		const struct tlv_definition *def;
+		int len;
+
+		if (r & 1)
+			def = known[rand() % ARRAY_SIZE(known)];
+		else
+			def = &defs[rand() % NUM_RANDOM_DEFS];
+		len = random_buf(def, buf);
+		if (check_parse("fuzz", def, buf, len, 0, 0) < 0)
+			ok = 0;
+	}
+
+	printf("fuzz: %s\n", ok ? "OK" : "FAIL");
+}
+
+int main(int argc, char **argv)
+{
+	test_corpus();
+	test_lookup();
+	test_lv_tags();
+	test_def_patch();
+	test_fuzz();
+
+	return 0;
+}
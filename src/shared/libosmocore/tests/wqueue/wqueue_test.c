@@ -0,0 +1,226 @@
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/write_queue.h>
+
+#define NUM_MSGS	200
+#define MAX_MSG_LEN	300
+
+static unsigned int write_cb_calls;
+static unsigned int except_cb_calls;
+
+static int write_cb(struct osmo_fd *fd, struct msgb *msg)
+{
+	write_cb_calls++;
+	return write(fd->fd, msg->data, msg->len) == msg->len ? 0 : -1;
+}
+
+static int except_cb(struct osmo_fd *fd)
+{
+	except_cb_calls++;
+	return 0;
+}
+
+/* message i has 1..MAX_MSG_LEN octets counting up from i */
+static struct msgb *test_msg(int i)
+{
+	struct msgb *msg = msgb_alloc(MAX_MSG_LEN, "wqueue test");
+	int len = 1 + (i * 37) % MAX_MSG_LEN, j;
+
+	for (j = 0; j < len; j++)
+		msgb_put_u8(msg, i + j);
+	return msg;
+}
+
+static int test_len(int i)
+{
+	return 1 + (i * 37) % MAX_MSG_LEN;
+}
+
+static void queue_setup(struct osmo_wqueue *q, int fd, enum osmo_wqueue_mode mode)
+{
+	osmo_wqueue_init(q, NUM_MSGS);
+	q->bfd.fd = fd;
+	q->mode = mode;
+	q->write_cb = write_cb;
+}
+
+/* what the select loop would do as long as the fd is writable */
+static void run_writes(struct osmo_wqueue *q)
+{
+	while (q->bfd.when & BSC_FD_WRITE)
+		osmo_wqueue_bfd_cb(&q->bfd, BSC_FD_WRITE);
+}
+
+static void test_msg_mode(void)
+{
+	struct osmo_wqueue q;
+	int sv[2], i;
+
+	socketpair(AF_UNIX, SOCK_DGRAM, 0, sv);
+	queue_setup(&q, sv[0], OSMO_WQUEUE_M_MSG);
+	for (i = 0; i < 10; i++)
+		osmo_wqueue_enqueue(&q, test_msg(i));
+
+	/* one message per write event */
+	osmo_wqueue_bfd_cb(&q.bfd, BSC_FD_WRITE);
+	printf("msg: %u write_cb calls, %u queued\n", write_cb_calls,
+	       q.current_length);
+	run_writes(&q);
+	printf("msg: %u write_cb calls, %u queued\n", write_cb_calls,
+	       q.current_length);
+	printf("msg: %lu msgs, %llu bytes in %lu calls, %lu errors\n",
+	       q.stats.msgs, q.stats.bytes, q.stats.syscalls, q.stats.errors);
+
+	close(sv[0]);
+	close(sv[1]);
+}
+
+static void test_dgram_mode(void)
+{
+	struct osmo_wqueue q;
+	uint8_t buf[MAX_MSG_LEN + 1];
+	int sv[2], i, ok = 1;
+
+	socketpair(AF_UNIX, SOCK_DGRAM, 0, sv);
+	queue_setup(&q, sv[0], OSMO_WQUEUE_M_DGRAM);
+	write_cb_calls = 0;
+	for (i = 0; i < 10; i++)
+		osmo_wqueue_enqueue(&q, test_msg(i));
+
+	osmo_wqueue_bfd_cb(&q.bfd, BSC_FD_WRITE);
+	printf("dgram: %lu msgs in %lu syscalls, %u queued, %u write_cb calls\n",
+	       q.stats.msgs, q.stats.syscalls, q.current_length,
+	       write_cb_calls);
+
+	/* the message boundaries are kept */
+	for (i = 0; i < 10; i++) {
+		struct msgb *msg = test_msg(i);
+
+		if (read(sv[1], buf, sizeof(buf)) != msg->len ||
+		    memcmp(buf, msg->data, msg->len))
+			ok = 0;
+		msgb_free(msg);
+	}
+	printf("dgram: %s\n", ok ? "OK" : "FAIL");
+
+	close(sv[0]);
+	close(sv[1]);
+}
+
+static void test_stream_mode(void)
+{
+	struct osmo_wqueue q;
+	struct msgb *msg;
+	uint8_t *buf, *p;
+	unsigned int ofs, queued;
+	int sv[2], i, sndbuf = 4096, len = 0, rx = 0, rc, ok = 1;
+
+	socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	fcntl(sv[1], F_SETFL, O_NONBLOCK);
+	setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+	queue_setup(&q, sv[0], OSMO_WQUEUE_M_STREAM);
+	for (i = 0; i < NUM_MSGS; i++) {
+		osmo_wqueue_enqueue(&q, test_msg(i));
+		len += test_len(i);
+	}
+
+	/* the socket takes less than all of it at once, so the writes
+	 * end in the middle of messages */
+	buf = malloc(len);
+	while (q.bfd.when & BSC_FD_WRITE) {
+		osmo_wqueue_bfd_cb(&q.bfd, BSC_FD_WRITE);
+		while ((rc = read(sv[1], buf + rx, len - rx)) > 0)
+			rx += rc;
+	}
+	while ((rc = read(sv[1], buf + rx, len - rx)) > 0)
+		rx += rc;
+
+	p = buf;
+	for (i = 0; i < NUM_MSGS && ok; i++) {
+		struct msgb *msg = test_msg(i);
+
+		if (p + msg->len > buf + rx || memcmp(p, msg->data, msg->len))
+			ok = 0;
+		p += msg->len;
+		msgb_free(msg);
+	}
+	printf("stream: %s, %s than one write per msg\n",
+	       ok && rx == len ? "OK" : "FAIL",
+	       q.stats.syscalls < NUM_MSGS / 4 ? "less" : "not less");
+	printf("stream: %lu msgs, %llu bytes, max length %u, %u queued\n",
+	       q.stats.msgs, q.stats.bytes, q.stats.max_length,
+	       q.current_length);
+	free(buf);
+
+	/* a write error in the middle of a message keeps all of them and
+	 * stops the writes */
+	q.except_cb = except_cb;
+	for (i = 0; i < NUM_MSGS; i++)
+		osmo_wqueue_enqueue(&q, test_msg(i));
+	osmo_wqueue_bfd_cb(&q.bfd, BSC_FD_WRITE);
+	ofs = q.head_ofs;
+	queued = q.current_length;
+	close(sv[1]);
+	osmo_wqueue_bfd_cb(&q.bfd, BSC_FD_WRITE);
+	printf("stream: %lu errors, %u except_cb calls, %s, %s\n",
+	       q.stats.errors, except_cb_calls,
+	       ofs && q.head_ofs == ofs && q.current_length == queued ?
+	       "kept" : "dropped",
+	       q.bfd.when & BSC_FD_WRITE ? "writing" : "stopped");
+
+	/* with the fd broken the queue fills up and rejects the rest */
+	for (i = 0; i <= NUM_MSGS; i++) {
+		msg = test_msg(i);
+		rc = osmo_wqueue_enqueue(&q, msg);
+		if (rc) {
+			msgb_free(msg);
+			break;
+		}
+	}
+	printf("stream: full at %u, %s\n", q.current_length,
+	       rc == -ENOSPC ? "rejected" : "accepted");
+	osmo_wqueue_clear(&q);
+
+	close(sv[0]);
+}
+
+int main(int argc, char **argv)
+{
+	signal(SIGPIPE, SIG_IGN);
+
+	test_msg_mode();
+	test_dgram_mode();
+	test_stream_mode();
+
+	return 0;
+}
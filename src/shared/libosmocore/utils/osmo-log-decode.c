@@ -0,0 +1,177 @@
+/* Utility program printing the messages of a binary log file */
+/*
+ * (C) 2013 by the osmocom-bb contributors
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <osmocom/core/logging.h>
+#include <osmocom/core/logging_binary.h>
+#include <osmocom/core/talloc.h>
+
+static int print_timestamp = 1;
+static int print_filename = 0;
+static int print_category = 0;
+
+static void print_msg(const struct log_binary_msg *msg)
+{
+	if (!msg->cont) {
+		if (print_timestamp) {
+			time_t tm = msg->ts_ns / 1000000000ULL;
+			char timestr[32];
+
+			strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S",
+				 localtime(&tm));
+			printf("%s.%06u ", timestr,
+			       (unsigned int)(msg->ts_ns % 1000000000ULL) / 1000);
+		}
+		if (print_category) {
+			if (msg->cat_name)
+				printf("%s ", msg->cat_name);
+			else
+				printf("<%4.4x> ", msg->subsys);
+			printf("%s ", log_level_str(msg->level));
+		}
+		if (print_filename)
+			printf("%s:%d ", msg->file, msg->line);
+	}
+	fputs(msg->text, stdout);
+	if (msg->truncated)
+		printf(" [truncated]\n");
+}
+
+static int decode_file(const char *fname)
+{
+	struct log_binary_reader *r;
+	struct log_binary_msg *msg;
+	struct stat st;
+	uint8_t *buf;
+	int fd, rc;
+
+	fd = open(fname, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "%s: %s\n", fname, strerror(errno));
+		return -errno;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED) {
+		fprintf(stderr, "%s: %s\n", fname, strerror(errno));
+		return -errno;
+	}
+
+	r = log_binary_reader_alloc(NULL, buf, st.st_size);
+	if (!r) {
+		fprintf(stderr, "%s: not a binary log file\n", fname);
+		munmap(buf, st.st_size);
+		return -EINVAL;
+	}
+	msg = talloc_zero(r, struct log_binary_msg);
+
+	while ((rc = log_binary_reader_next(r, msg)) != 0) {
+		if (rc == -EBADMSG) {
+			/* only this message is lost */
+			printf("<undecodable message>\n");
+			continue;
+		}
+		if (rc < 0)
+			break;
+		print_msg(msg);
+	}
+	if (rc < 0)
+		fprintf(stderr, "%s: corrupt record, stopping\n", fname);
+
+	talloc_free(r);
+	munmap(buf, st.st_size);
+
+	return rc;
+}
+
+static void help(const char *name)
+{
+	printf("Usage: %s [-n] [-f] [-c] FILE...\n", name);
+	printf(" -n --no-timestamp\tDon't print the time of each message\n");
+	printf(" -f --filename\t\tPrint the source file and line\n");
+	printf(" -c --category\t\tPrint the category and level\n");
+	printf(" -h --help\t\tThis help message\n");
+}
+
+int main(int argc, char **argv)
+{
+	int i, rc = 0;
+
+	while (1) {
+		int c;
+		static struct option long_options[] = {
+			{ "no-timestamp", 0, 0, 'n' },
+			{ "filename", 0, 0, 'f' },
+			{ "category", 0, 0, 'c' },
+			{ "help", 0, 0, 'h' },
+			{ 0, 0, 0, 0 }
+		};
+
+		c = getopt_long(argc, argv, "nfch", long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'n':
+			print_timestamp = 0;
+			break;
+		case 'f':
+			print_filename = 1;
+			break;
+		case 'c':
+			print_category = 1;
+			break;
+		case 'h':
+			help(argv[0]);
+			exit(0);
+		default:
+			help(argv[0]);
+			exit(2);
+		}
+	}
+
+	if (optind >= argc) {
+		help(argv[0]);
+		exit(2);
+	}
+
+	for (i = optind; i < argc; i++) {
+		if (decode_file(argv[i]) < 0)
+			rc = 1;
+	}
+
+	return rc;
+}